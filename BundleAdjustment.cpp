@@ -0,0 +1,1151 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "BundleAdjustment.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+typedef BundleAdjustment::Observation Observation;
+typedef BundleAdjustment::ObservationJacobian ObservationJacobian;
+
+// Factor the symmetric positive definite n x n matrix A (row major) in place into L L^T.
+// Returns false if A is not positive definite.
+bool CholeskyFactor(double* A, const unsigned int n)
+{
+  for(unsigned int j = 0; j < n; ++j)
+    {
+    double diagonal = A[j * n + j];
+    for(unsigned int k = 0; k < j; ++k)
+      {
+      diagonal -= A[j * n + k] * A[j * n + k];
+      }
+    if(diagonal <= 0)
+      {
+      return false;
+      }
+    A[j * n + j] = sqrt(diagonal);
+    for(unsigned int i = j + 1; i < n; ++i)
+      {
+      double value = A[i * n + j];
+      for(unsigned int k = 0; k < j; ++k)
+        {
+        value -= A[i * n + k] * A[j * n + k];
+        }
+      A[i * n + j] = value / A[j * n + j];
+      }
+    }
+  return true;
+}
+
+// Solve L L^T x = b in place, with L from CholeskyFactor
+void CholeskySubstitute(const double* L, double* b, const unsigned int n)
+{
+  for(unsigned int i = 0; i < n; ++i)
+    {
+    for(unsigned int k = 0; k < i; ++k)
+      {
+      b[i] -= L[i * n + k] * b[k];
+      }
+    b[i] /= L[i * n + i];
+    }
+  for(int i = static_cast<int>(n) - 1; i >= 0; --i)
+    {
+    for(unsigned int k = i + 1; k < n; ++k)
+      {
+      b[i] -= L[k * n + i] * b[k];
+      }
+    b[i] /= L[i * n + i];
+    }
+}
+
+// Inverse of a symmetric positive definite 3x3 matrix. Returns false if it is singular.
+bool Invert3x3(const double A[9], double inverse[9])
+{
+  inverse[0] = A[4] * A[8] - A[5] * A[7];
+  inverse[1] = A[2] * A[7] - A[1] * A[8];
+  inverse[2] = A[1] * A[5] - A[2] * A[4];
+  inverse[3] = A[5] * A[6] - A[3] * A[8];
+  inverse[4] = A[0] * A[8] - A[2] * A[6];
+  inverse[5] = A[2] * A[3] - A[0] * A[5];
+  inverse[6] = A[3] * A[7] - A[4] * A[6];
+  inverse[7] = A[1] * A[6] - A[0] * A[7];
+  inverse[8] = A[0] * A[4] - A[1] * A[3];
+  double determinant = A[0] * inverse[0] + A[1] * inverse[3] + A[2] * inverse[6];
+  if(determinant <= 0)
+    {
+    return false;
+    }
+  for(unsigned int i = 0; i < 9; ++i)
+    {
+    inverse[i] /= determinant;
+    }
+  return true;
+}
+
+// C (rows x columns) = A (rows x inner) * B^T (columns x inner), all row major
+void MultiplyTransposed(const double* A, const double* B, const unsigned int rows, const unsigned int inner,
+                        const unsigned int columns, double* C)
+{
+  for(unsigned int r = 0; r < rows; ++r)
+    {
+    for(unsigned int c = 0; c < columns; ++c)
+      {
+      double sum = 0;
+      for(unsigned int k = 0; k < inner; ++k)
+        {
+        sum += A[r * inner + k] * B[c * inner + k];
+        }
+      C[r * columns + c] = sum;
+      }
+    }
+}
+
+// Symmetric matrix made of dense blocks: the blocks on the diagonal and the nonzero ones above it
+struct BlockSystem
+{
+  std::vector<unsigned int> Sizes;
+  std::vector<unsigned int> Offsets;
+  unsigned int Size;
+  std::vector<std::vector<double> > Diagonal;
+  std::vector<std::map<unsigned int, std::vector<double> > > Upper; // Upper[a][b] with a < b
+
+  void Initialize(const std::vector<unsigned int>& sizes)
+  {
+    this->Sizes = sizes;
+    this->Offsets.resize(sizes.size());
+    this->Size = 0;
+    this->Diagonal.resize(sizes.size());
+    this->Upper.assign(sizes.size(), std::map<unsigned int, std::vector<double> >());
+    for(unsigned int a = 0; a < sizes.size(); ++a)
+      {
+      this->Offsets[a] = this->Size;
+      this->Size += sizes[a];
+      this->Diagonal[a].assign(sizes[a] * sizes[a], 0);
+      }
+  }
+
+  // Add scale * block (Sizes[a] x Sizes[b], row major) at (a, b), and so its transpose at (b, a)
+  void Add(const unsigned int a, const unsigned int b, const double* block, const double scale)
+  {
+    const unsigned int rows = this->Sizes[a];
+    const unsigned int columns = this->Sizes[b];
+    if(rows == 0 || columns == 0)
+      {
+      return;
+      }
+    if(a == b)
+      {
+      for(unsigned int i = 0; i < rows * columns; ++i)
+        {
+        this->Diagonal[a][i] += scale * block[i];
+        }
+      return;
+      }
+
+    unsigned int first = std::min(a, b);
+    std::vector<double>& stored = this->Upper[first][std::max(a, b)];
+    if(stored.empty())
+      {
+      stored.assign(rows * columns, 0);
+      }
+    for(unsigned int r = 0; r < rows; ++r)
+      {
+      for(unsigned int c = 0; c < columns; ++c)
+        {
+        // Stored as (first, second)
+        unsigned int index = a < b ? r * columns + c : c * rows + r;
+        stored[index] += scale * block[r * columns + c];
+        }
+      }
+  }
+
+  void Multiply(const std::vector<double>& x, std::vector<double>& y) const
+  {
+    y.assign(this->Size, 0);
+    for(unsigned int a = 0; a < this->Sizes.size(); ++a)
+      {
+      const unsigned int n = this->Sizes[a];
+      const double* xa = &x[0] + this->Offsets[a];
+      double* ya = &y[0] + this->Offsets[a];
+      for(unsigned int r = 0; r < n; ++r)
+        {
+        for(unsigned int c = 0; c < n; ++c)
+          {
+          ya[r] += this->Diagonal[a][r * n + c] * xa[c];
+          }
+        }
+
+      for(std::map<unsigned int, std::vector<double> >::const_iterator iterator = this->Upper[a].begin();
+          iterator != this->Upper[a].end(); ++iterator)
+        {
+        const unsigned int b = iterator->first;
+        const unsigned int m = this->Sizes[b];
+        const double* block = &iterator->second[0];
+        const double* xb = &x[0] + this->Offsets[b];
+        double* yb = &y[0] + this->Offsets[b];
+        for(unsigned int r = 0; r < n; ++r)
+          {
+          for(unsigned int c = 0; c < m; ++c)
+            {
+            ya[r] += block[r * m + c] * xb[c];
+            yb[c] += block[r * m + c] * xa[r];
+            }
+          }
+        }
+      }
+  }
+};
+
+double Dot(const std::vector<double>& a, const std::vector<double>& b)
+{
+  double sum = 0;
+  for(unsigned int i = 0; i < a.size(); ++i)
+    {
+    sum += a[i] * b[i];
+    }
+  return sum;
+}
+
+// Conjugate gradients preconditioned by the inverses of the diagonal blocks.
+// Returns false if a diagonal block is not positive definite.
+bool SolveConjugateGradients(const BlockSystem& system, const std::vector<double>& b, std::vector<double>& x)
+{
+  std::vector<std::vector<double> > factors = system.Diagonal;
+  for(unsigned int a = 0; a < factors.size(); ++a)
+    {
+    if(system.Sizes[a] > 0 && !CholeskyFactor(&factors[a][0], system.Sizes[a]))
+      {
+      return false;
+      }
+    }
+
+  x.assign(system.Size, 0);
+  std::vector<double> r = b;
+  std::vector<double> z = r;
+  for(unsigned int a = 0; a < factors.size(); ++a)
+    {
+    if(system.Sizes[a] > 0)
+      {
+      CholeskySubstitute(&factors[a][0], &z[0] + system.Offsets[a], system.Sizes[a]);
+      }
+    }
+  std::vector<double> p = z;
+  std::vector<double> Ap;
+  double rz = Dot(r, z);
+  const double tolerance = 1e-12 * Dot(b, b);
+  const unsigned int maximumIterations = std::max(100u, system.Size);
+  for(unsigned int iteration = 0; iteration < maximumIterations && Dot(r, r) > tolerance; ++iteration)
+    {
+    system.Multiply(p, Ap);
+    double pAp = Dot(p, Ap);
+    if(pAp <= 0)
+      {
+      break;
+      }
+    double alpha = rz / pAp;
+    for(unsigned int i = 0; i < system.Size; ++i)
+      {
+      x[i] += alpha * p[i];
+      r[i] -= alpha * Ap[i];
+      }
+
+    z = r;
+    for(unsigned int a = 0; a < factors.size(); ++a)
+      {
+      if(system.Sizes[a] > 0)
+        {
+        CholeskySubstitute(&factors[a][0], &z[0] + system.Offsets[a], system.Sizes[a]);
+        }
+      }
+    double rzNew = Dot(r, z);
+    double beta = rzNew / rz;
+    rz = rzNew;
+    for(unsigned int i = 0; i < system.Size; ++i)
+      {
+      p[i] = z[i] + beta * p[i];
+      }
+    }
+  return true;
+}
+
+// The residual of one observation and its derivatives with respect to the shared intrinsics, the pose
+// (rotation increment applied on the left, R <- exp([w]x) R, then translation) and the point
+bool Linearize(const Camera& camera, const double* R, const Coord3D& point, const double observed[2],
+               const std::vector<unsigned int>& intrinsicParameters, ObservationJacobian& jacobian)
+{
+  double world[3] = {point.x, point.y, point.z};
+  double rotated[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    rotated[d] = R[3 * d] * world[0] + R[3 * d + 1] * world[1] + R[3 * d + 2] * world[2];
+    }
+  double cameraPoint[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    cameraPoint[d] = rotated[d] + camera.Translation[d];
+    }
+
+  // d(u,v)/d(x,y,z)
+  double pixel[2];
+  double dProjection[2][3];
+  if(!camera.ProjectCameraPoint(cameraPoint, pixel, dProjection))
+    {
+    jacobian.Valid = false;
+    return false;
+    }
+  jacobian.Valid = true;
+  jacobian.Residual[0] = pixel[0] - observed[0];
+  jacobian.Residual[1] = pixel[1] - observed[1];
+  // d(x,y,z)/dw = -[rotated]x
+  double dRotation[3][3] = {{0, rotated[2], -rotated[1]},
+                            {-rotated[2], 0, rotated[0]},
+                            {rotated[1], -rotated[0], 0}};
+
+  for(unsigned int row = 0; row < 2; ++row)
+    {
+    for(unsigned int k = 0; k < 3; ++k)
+      {
+      jacobian.Pose[row][k] = dProjection[row][0] * dRotation[0][k] + dProjection[row][1] * dRotation[1][k] +
+                              dProjection[row][2] * dRotation[2][k];
+      jacobian.Pose[row][k + 3] = dProjection[row][k];
+      jacobian.Point[row][k] = dProjection[row][0] * R[k] + dProjection[row][1] * R[3 + k] +
+                               dProjection[row][2] * R[6 + k];
+      }
+    }
+
+  for(unsigned int k = 0; k < intrinsicParameters.size(); ++k)
+    {
+    switch(intrinsicParameters[k])
+      {
+      case 0: // focal length, the distorted normalized coordinates
+        jacobian.Intrinsics[0][k] = (pixel[0] - camera.PrincipalPoint[0]) / camera.FocalLength;
+        jacobian.Intrinsics[1][k] = (pixel[1] - camera.PrincipalPoint[1]) / camera.FocalLength;
+        break;
+      case 1: // principal point x
+        jacobian.Intrinsics[0][k] = 1;
+        jacobian.Intrinsics[1][k] = 0;
+        break;
+      default: // principal point y
+        jacobian.Intrinsics[0][k] = 0;
+        jacobian.Intrinsics[1][k] = 1;
+        break;
+      }
+    }
+  return true;
+}
+
+void GetRotations(const std::vector<Camera>& cameras, std::vector<double>& rotations)
+{
+  rotations.resize(9 * cameras.size());
+  for(unsigned int frame = 0; frame < cameras.size(); ++frame)
+    {
+    double R[3][3];
+    cameras[frame].GetRotationMatrix(R);
+    for(unsigned int i = 0; i < 3; ++i)
+      {
+      for(unsigned int j = 0; j < 3; ++j)
+        {
+        rotations[9 * frame + 3 * i + j] = R[i][j];
+        }
+      }
+    }
+}
+
+struct LinearizeFunctor
+{
+  const std::vector<Observation>* Observations;
+  const std::vector<Camera>* Cameras;
+  const std::vector<double>* Rotations;
+  const std::vector<Coord3D>* Tracks;
+  const std::vector<unsigned int>* IntrinsicParameters;
+  const std::vector<unsigned char>* FixedIntrinsics;
+  std::vector<ObservationJacobian>* Jacobians;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      const Observation& observation = (*this->Observations)[i];
+      ObservationJacobian& jacobian = (*this->Jacobians)[i];
+      Linearize((*this->Cameras)[observation.Frame], &(*this->Rotations)[9 * observation.Frame],
+                (*this->Tracks)[observation.Track], observation.Pixel, *this->IntrinsicParameters, jacobian);
+      // Frames with fixed intrinsics do not move the shared ones
+      if((*this->FixedIntrinsics)[observation.Frame])
+        {
+        for(unsigned int k = 0; k < this->IntrinsicParameters->size(); ++k)
+          {
+          jacobian.Intrinsics[0][k] = jacobian.Intrinsics[1][k] = 0;
+          }
+        }
+      }
+  }
+};
+
+// Squared reprojection errors. Points behind the camera are penalized by the focal length.
+struct CostFunctor
+{
+  const std::vector<Observation>* Observations;
+  const std::vector<Camera>* Cameras;
+  const std::vector<Coord3D>* Tracks;
+  std::vector<double>* Costs; // per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    double cost = 0;
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      const Observation& observation = (*this->Observations)[i];
+      const Camera& camera = (*this->Cameras)[observation.Frame];
+      const Coord3D& track = (*this->Tracks)[observation.Track];
+      double world[3] = {track.x, track.y, track.z};
+      double pixel[2];
+      if(!camera.Project(world, pixel))
+        {
+        cost += 2.0 * camera.FocalLength * camera.FocalLength;
+        continue;
+        }
+      double du = pixel[0] - observation.Pixel[0];
+      double dv = pixel[1] - observation.Pixel[1];
+      cost += du * du + dv * dv;
+      }
+    (*this->Costs)[threadId] += cost;
+  }
+};
+
+// The camera parameter blocks of J^T J and J^T r, frame by frame. The intrinsics parts (shared by all frames)
+// are summed per frame and added up by the caller. Intrinsics blocks use a stride of 3.
+struct FrameFunctor
+{
+  const std::vector<std::vector<unsigned int> >* FrameObservations;
+  const std::vector<ObservationJacobian>* Jacobians;
+  unsigned int NumberOfIntrinsics;
+
+  std::vector<double>* PoseBlocks;         // 6 x 6 per frame
+  std::vector<double>* PoseGradients;      // 6 per frame
+  std::vector<double>* CouplingBlocks;     // intrinsics x pose, 3 x 6 per frame
+  std::vector<double>* IntrinsicBlocks;    // 3 x 3 per frame
+  std::vector<double>* IntrinsicGradients; // 3 per frame
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    const unsigned int ni = this->NumberOfIntrinsics;
+    for(vtkIdType frame = begin; frame < end; ++frame)
+      {
+      double* U = &(*this->PoseBlocks)[36 * frame];
+      double* g = &(*this->PoseGradients)[6 * frame];
+      double* coupling = &(*this->CouplingBlocks)[18 * frame];
+      double* intrinsics = &(*this->IntrinsicBlocks)[9 * frame];
+      double* intrinsicGradient = &(*this->IntrinsicGradients)[3 * frame];
+      std::fill(U, U + 36, 0.0);
+      std::fill(g, g + 6, 0.0);
+      std::fill(coupling, coupling + 18, 0.0);
+      std::fill(intrinsics, intrinsics + 9, 0.0);
+      std::fill(intrinsicGradient, intrinsicGradient + 3, 0.0);
+
+      const std::vector<unsigned int>& observations = (*this->FrameObservations)[frame];
+      for(unsigned int o = 0; o < observations.size(); ++o)
+        {
+        const ObservationJacobian& J = (*this->Jacobians)[observations[o]];
+        if(!J.Valid)
+          {
+          continue;
+          }
+        for(unsigned int row = 0; row < 2; ++row)
+          {
+          for(unsigned int a = 0; a < 6; ++a)
+            {
+            g[a] += J.Pose[row][a] * J.Residual[row];
+            for(unsigned int b = 0; b < 6; ++b)
+              {
+              U[6 * a + b] += J.Pose[row][a] * J.Pose[row][b];
+              }
+            }
+          for(unsigned int a = 0; a < ni; ++a)
+            {
+            intrinsicGradient[a] += J.Intrinsics[row][a] * J.Residual[row];
+            for(unsigned int b = 0; b < ni; ++b)
+              {
+              intrinsics[3 * a + b] += J.Intrinsics[row][a] * J.Intrinsics[row][b];
+              }
+            for(unsigned int b = 0; b < 6; ++b)
+              {
+              coupling[6 * a + b] += J.Intrinsics[row][a] * J.Pose[row][b];
+              }
+            }
+          }
+        }
+      }
+  }
+};
+
+// The point blocks, track by track: the damped 3 x 3 block with the prior, inverted, the gradient, and the
+// couplings of the point with the pose of each observation and with the intrinsics
+struct TrackFunctor
+{
+  const std::vector<std::vector<unsigned int> >* TrackObservations;
+  const std::vector<ObservationJacobian>* Jacobians;
+  const std::vector<Coord3D>* Tracks;
+  const std::vector<Coord3D>* PickedTracks;
+  double PriorWeight;
+  double Lambda;
+  unsigned int NumberOfIntrinsics;
+
+  std::vector<double>* InverseBlocks;        // 3 x 3 per track
+  std::vector<double>* Gradients;            // 3 per track
+  std::vector<double>* ObservationCouplings; // pose x point, 6 x 3 per observation
+  std::vector<double>* IntrinsicCouplings;   // intrinsics x point, 3 x 3 per track
+  std::vector<int>* Failed;                  // per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    const unsigned int ni = this->NumberOfIntrinsics;
+    for(vtkIdType track = begin; track < end; ++track)
+      {
+      double V[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+      double* g = &(*this->Gradients)[3 * track];
+      double* intrinsicCoupling = &(*this->IntrinsicCouplings)[9 * track];
+      std::fill(intrinsicCoupling, intrinsicCoupling + 9, 0.0);
+
+      // Prior (X - picked) / sigma
+      const Coord3D& position = (*this->Tracks)[track];
+      const Coord3D& picked = (*this->PickedTracks)[track];
+      g[0] = this->PriorWeight * (position.x - picked.x);
+      g[1] = this->PriorWeight * (position.y - picked.y);
+      g[2] = this->PriorWeight * (position.z - picked.z);
+      V[0] = V[4] = V[8] = this->PriorWeight;
+
+      const std::vector<unsigned int>& observations = (*this->TrackObservations)[track];
+      for(unsigned int o = 0; o < observations.size(); ++o)
+        {
+        const ObservationJacobian& J = (*this->Jacobians)[observations[o]];
+        double* W = &(*this->ObservationCouplings)[18 * observations[o]];
+        std::fill(W, W + 18, 0.0);
+        if(!J.Valid)
+          {
+          continue;
+          }
+        for(unsigned int row = 0; row < 2; ++row)
+          {
+          for(unsigned int a = 0; a < 3; ++a)
+            {
+            g[a] += J.Point[row][a] * J.Residual[row];
+            for(unsigned int b = 0; b < 3; ++b)
+              {
+              V[3 * a + b] += J.Point[row][a] * J.Point[row][b];
+              }
+            }
+          for(unsigned int a = 0; a < 6; ++a)
+            {
+            for(unsigned int b = 0; b < 3; ++b)
+              {
+              W[3 * a + b] += J.Pose[row][a] * J.Point[row][b];
+              }
+            }
+          for(unsigned int a = 0; a < ni; ++a)
+            {
+            for(unsigned int b = 0; b < 3; ++b)
+              {
+              intrinsicCoupling[3 * a + b] += J.Intrinsics[row][a] * J.Point[row][b];
+              }
+            }
+          }
+        }
+
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        V[4 * d] += this->Lambda * (V[4 * d] + 1e-12);
+        }
+      if(!Invert3x3(V, &(*this->InverseBlocks)[9 * track]))
+        {
+        (*this->Failed)[threadId] = 1;
+        }
+      }
+  }
+};
+
+// Apply an increment (rotation increment on the left, translation) to the pose of a camera
+void UpdatePose(Camera& camera, const double* delta)
+{
+  double increment[3] = {delta[0], delta[1], delta[2]};
+  double incrementRotation[3][3];
+  Camera::RodriguesToMatrix(increment, incrementRotation);
+  double R[3][3];
+  camera.GetRotationMatrix(R);
+  double newR[3][3];
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    for(unsigned int j = 0; j < 3; ++j)
+      {
+      newR[i][j] = incrementRotation[i][0] * R[0][j] + incrementRotation[i][1] * R[1][j] + incrementRotation[i][2] * R[2][j];
+      }
+    }
+  camera.SetRotationMatrix(newR);
+
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    camera.Translation[d] += delta[3 + d];
+    }
+}
+
+} // end anonymous namespace
+
+BundleAdjustment::BundleAdjustment() : RefineFocalLength(true), RefinePrincipalPoint(false), PointSigma(0),
+                                       MaximumNumberOfIterations(50), InitialRMSError(0), FinalRMSError(0),
+                                       NumberOfIterations(0)
+{
+}
+
+unsigned int BundleAdjustment::AddFrame(const std::vector<Coord2D>& imagePoints,
+                                        const std::vector<Coord3D>& worldPoints, const Camera& camera,
+                                        const bool fixedIntrinsics)
+{
+  if(imagePoints.size() != worldPoints.size())
+    {
+    std::cerr << "BundleAdjustment: " << imagePoints.size() << " image points but " << worldPoints.size()
+              << " world points; only the first pairs are used." << std::endl;
+    }
+
+  unsigned int frame = this->Cameras.size();
+  this->Cameras.push_back(camera);
+  this->FixedIntrinsics.push_back(fixedIntrinsics);
+  this->FrameObservations.push_back(std::vector<unsigned int>());
+
+  unsigned int numberOfPairs = std::min(imagePoints.size(), worldPoints.size());
+  for(unsigned int i = 0; i < numberOfPairs; ++i)
+    {
+    TrackKey key(worldPoints[i].x, std::make_pair(worldPoints[i].y, worldPoints[i].z));
+    std::map<TrackKey, unsigned int>::iterator found = this->TrackIndex.find(key);
+    unsigned int track;
+    if(found == this->TrackIndex.end())
+      {
+      track = this->Tracks.size();
+      this->TrackIndex[key] = track;
+      this->Tracks.push_back(worldPoints[i]);
+      this->PickedTracks.push_back(worldPoints[i]);
+      this->TrackObservations.push_back(std::vector<unsigned int>());
+      }
+    else
+      {
+      track = found->second;
+      }
+
+    Observation observation;
+    observation.Frame = frame;
+    observation.Track = track;
+    observation.Pixel[0] = imagePoints[i].x;
+    observation.Pixel[1] = imagePoints[i].y;
+    this->FrameObservations[frame].push_back(this->Observations.size());
+    this->TrackObservations[track].push_back(this->Observations.size());
+    this->Observations.push_back(observation);
+    }
+
+  return frame;
+}
+
+unsigned int BundleAdjustment::GetNumberOfFrames() const
+{
+  return this->Cameras.size();
+}
+
+void BundleAdjustment::SetRefineFocalLength(const bool refine)
+{
+  this->RefineFocalLength = refine;
+}
+
+void BundleAdjustment::SetRefinePrincipalPoint(const bool refine)
+{
+  this->RefinePrincipalPoint = refine;
+}
+
+void BundleAdjustment::SetPointSigma(const double sigma)
+{
+  this->PointSigma = sigma;
+}
+
+void BundleAdjustment::SetMaximumNumberOfIterations(const unsigned int iterations)
+{
+  this->MaximumNumberOfIterations = iterations;
+}
+
+const Camera& BundleAdjustment::GetCamera(const unsigned int frame) const
+{
+  return this->Cameras[frame];
+}
+
+void BundleAdjustment::GetWorldPoints(const unsigned int frame, std::vector<Coord3D>& worldPoints) const
+{
+  worldPoints.clear();
+  for(unsigned int o = 0; o < this->FrameObservations[frame].size(); ++o)
+    {
+    worldPoints.push_back(this->Tracks[this->Observations[this->FrameObservations[frame][o]].Track]);
+    }
+}
+
+double BundleAdjustment::GetInitialRMSError() const
+{
+  return this->InitialRMSError;
+}
+
+double BundleAdjustment::GetFinalRMSError() const
+{
+  return this->FinalRMSError;
+}
+
+double BundleAdjustment::GetRMSError(const unsigned int frame) const
+{
+  const std::vector<unsigned int>& observations = this->FrameObservations[frame];
+  if(observations.empty())
+    {
+    return 0;
+    }
+
+  double sumOfSquares = 0;
+  for(unsigned int o = 0; o < observations.size(); ++o)
+    {
+    const Observation& observation = this->Observations[observations[o]];
+    const Coord3D& track = this->Tracks[observation.Track];
+    double world[3] = {track.x, track.y, track.z};
+    double pixel[2];
+    if(!this->Cameras[frame].Project(world, pixel))
+      {
+      return HUGE_VAL;
+      }
+    double du = pixel[0] - observation.Pixel[0];
+    double dv = pixel[1] - observation.Pixel[1];
+    sumOfSquares += du * du + dv * dv;
+    }
+  return sqrt(sumOfSquares / observations.size());
+}
+
+unsigned int BundleAdjustment::GetNumberOfIterations() const
+{
+  return this->NumberOfIterations;
+}
+
+unsigned int BundleAdjustment::GetNumberOfTracks() const
+{
+  return this->Tracks.size();
+}
+
+double BundleAdjustment::ComputeCost(const std::vector<Camera>& cameras, const std::vector<Coord3D>& tracks,
+                                     const bool includePrior) const
+{
+  std::vector<double> costs(Parallel::GetNumberOfThreads(), 0);
+  CostFunctor functor;
+  functor.Observations = &this->Observations;
+  functor.Cameras = &cameras;
+  functor.Tracks = &tracks;
+  functor.Costs = &costs;
+  Parallel::For(0, this->Observations.size(), functor);
+
+  double cost = 0;
+  for(unsigned int thread = 0; thread < costs.size(); ++thread)
+    {
+    cost += costs[thread];
+    }
+
+  if(includePrior && this->PointSigma > 0)
+    {
+    for(unsigned int track = 0; track < tracks.size(); ++track)
+      {
+      double dx = tracks[track].x - this->PickedTracks[track].x;
+      double dy = tracks[track].y - this->PickedTracks[track].y;
+      double dz = tracks[track].z - this->PickedTracks[track].z;
+      cost += (dx * dx + dy * dy + dz * dz) / (this->PointSigma * this->PointSigma);
+      }
+    }
+  return cost;
+}
+
+void BundleAdjustment::ShiftParameters(const double origin[3])
+{
+  for(unsigned int frame = 0; frame < this->Cameras.size(); ++frame)
+    {
+    this->Cameras[frame] = this->Cameras[frame].Shifted(origin);
+    }
+  for(unsigned int track = 0; track < this->Tracks.size(); ++track)
+    {
+    this->Tracks[track].x -= origin[0];
+    this->Tracks[track].y -= origin[1];
+    this->Tracks[track].z -= origin[2];
+    this->PickedTracks[track].x -= origin[0];
+    this->PickedTracks[track].y -= origin[1];
+    this->PickedTracks[track].z -= origin[2];
+    }
+}
+
+bool BundleAdjustment::Adjust()
+{
+  this->NumberOfIterations = 0;
+  const unsigned int numberOfFrames = this->Cameras.size();
+  const unsigned int numberOfTracks = this->Tracks.size();
+  const unsigned int numberOfObservations = this->Observations.size();
+  for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+    {
+    if(this->FrameObservations[frame].size() < 3)
+      {
+      std::cerr << "BundleAdjustment: frame " << frame << " has " << this->FrameObservations[frame].size()
+                << " correspondences, but at least 3 are required." << std::endl;
+      return false;
+      }
+    }
+  if(numberOfFrames == 0)
+    {
+    std::cerr << "BundleAdjustment: there are no frames to adjust." << std::endl;
+    return false;
+    }
+
+  // Shared intrinsics start from the average of the frames that share them
+  unsigned int numberOfSharingFrames = 0;
+  for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+    {
+    if(!this->FixedIntrinsics[frame])
+      {
+      numberOfSharingFrames++;
+      }
+    }
+  this->IntrinsicParameters.clear();
+  if(this->RefineFocalLength && numberOfSharingFrames > 0)
+    {
+    this->IntrinsicParameters.push_back(0);
+    }
+  if(this->RefinePrincipalPoint && numberOfSharingFrames > 0)
+    {
+    this->IntrinsicParameters.push_back(1);
+    this->IntrinsicParameters.push_back(2);
+    }
+  const unsigned int ni = this->IntrinsicParameters.size();
+  if(ni > 0)
+    {
+    double intrinsics[3] = {0, 0, 0};
+    for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+      {
+      if(this->FixedIntrinsics[frame])
+        {
+        continue;
+        }
+      intrinsics[0] += this->Cameras[frame].FocalLength / numberOfSharingFrames;
+      intrinsics[1] += this->Cameras[frame].PrincipalPoint[0] / numberOfSharingFrames;
+      intrinsics[2] += this->Cameras[frame].PrincipalPoint[1] / numberOfSharingFrames;
+      }
+    for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+      {
+      if(this->FixedIntrinsics[frame])
+        {
+        continue;
+        }
+      this->Cameras[frame].FocalLength = intrinsics[0];
+      this->Cameras[frame].PrincipalPoint[0] = intrinsics[1];
+      this->Cameras[frame].PrincipalPoint[1] = intrinsics[2];
+      }
+    }
+
+  // Work relative to the centroid of the tracks: with georeferenced coordinates a rotation about the world
+  // origin moves the camera by kilometers, which makes the normal equations badly conditioned
+  double origin[3] = {0, 0, 0};
+  for(unsigned int track = 0; track < numberOfTracks; ++track)
+    {
+    origin[0] += this->Tracks[track].x / numberOfTracks;
+    origin[1] += this->Tracks[track].y / numberOfTracks;
+    origin[2] += this->Tracks[track].z / numberOfTracks;
+    }
+  ShiftParameters(origin);
+
+  const bool movePoints = this->PointSigma > 0;
+  const double priorWeight = movePoints ? 1.0 / (this->PointSigma * this->PointSigma) : 0;
+
+  // Camera parameter blocks: the shared intrinsics, then the pose of each frame
+  std::vector<unsigned int> blockSizes(1 + numberOfFrames, 6);
+  blockSizes[0] = ni;
+
+  std::vector<ObservationJacobian> jacobians(numberOfObservations);
+  std::vector<double> rotations;
+  std::vector<double> poseBlocks(36 * numberOfFrames);
+  std::vector<double> poseGradients(6 * numberOfFrames);
+  std::vector<double> couplingBlocks(18 * numberOfFrames);
+  std::vector<double> intrinsicBlocks(9 * numberOfFrames);
+  std::vector<double> intrinsicGradients(3 * numberOfFrames);
+  std::vector<double> inverseBlocks(movePoints ? 9 * numberOfTracks : 0);
+  std::vector<double> trackGradients(movePoints ? 3 * numberOfTracks : 0);
+  std::vector<double> observationCouplings(movePoints ? 18 * numberOfObservations : 0);
+  std::vector<double> intrinsicCouplings(movePoints ? 9 * numberOfTracks : 0);
+
+  double cost = ComputeCost(this->Cameras, this->Tracks, true);
+  this->InitialRMSError = sqrt(ComputeCost(this->Cameras, this->Tracks, false) / numberOfObservations);
+  double lambda = 1e-3;
+  bool moved = false;
+  bool converged = false;
+  for(unsigned int iteration = 0; iteration < this->MaximumNumberOfIterations && !converged; ++iteration)
+    {
+    GetRotations(this->Cameras, rotations);
+    LinearizeFunctor linearize;
+    linearize.Observations = &this->Observations;
+    linearize.Cameras = &this->Cameras;
+    linearize.Rotations = &rotations;
+    linearize.Tracks = &this->Tracks;
+    linearize.IntrinsicParameters = &this->IntrinsicParameters;
+    linearize.FixedIntrinsics = &this->FixedIntrinsics;
+    linearize.Jacobians = &jacobians;
+    Parallel::For(0, numberOfObservations, linearize);
+
+    FrameFunctor frames;
+    frames.FrameObservations = &this->FrameObservations;
+    frames.Jacobians = &jacobians;
+    frames.NumberOfIntrinsics = ni;
+    frames.PoseBlocks = &poseBlocks;
+    frames.PoseGradients = &poseGradients;
+    frames.CouplingBlocks = &couplingBlocks;
+    frames.IntrinsicBlocks = &intrinsicBlocks;
+    frames.IntrinsicGradients = &intrinsicGradients;
+    Parallel::For(0, numberOfFrames, frames);
+
+    // The intrinsics block and gradient, summed over the frames
+    std::vector<double> intrinsicBlock(ni * ni, 0);
+    std::vector<double> intrinsicGradient(ni, 0);
+    for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+      {
+      for(unsigned int a = 0; a < ni; ++a)
+        {
+        intrinsicGradient[a] += intrinsicGradients[3 * frame + a];
+        for(unsigned int b = 0; b < ni; ++b)
+          {
+          intrinsicBlock[ni * a + b] += intrinsicBlocks[9 * frame + 3 * a + b];
+          }
+        }
+      }
+
+    bool improved = false;
+    while(!improved && lambda < 1e10)
+      {
+      // Damped camera blocks and the negative gradient
+      BlockSystem system;
+      system.Initialize(blockSizes);
+      std::vector<double> rhs(system.Size, 0);
+      for(unsigned int a = 0; a < ni; ++a)
+        {
+        rhs[a] = -intrinsicGradient[a];
+        }
+      system.Add(0, 0, ni > 0 ? &intrinsicBlock[0] : NULL, 1);
+      for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+        {
+        system.Add(1 + frame, 1 + frame, &poseBlocks[36 * frame], 1);
+        for(unsigned int a = 0; a < 6; ++a)
+          {
+          rhs[system.Offsets[1 + frame] + a] = -poseGradients[6 * frame + a];
+          }
+        if(ni > 0)
+          {
+          std::vector<double> coupling(ni * 6);
+          for(unsigned int a = 0; a < ni; ++a)
+            {
+            std::copy(&couplingBlocks[18 * frame + 6 * a], &couplingBlocks[18 * frame + 6 * a] + 6, &coupling[6 * a]);
+            }
+          system.Add(0, 1 + frame, &coupling[0], 1);
+          }
+        }
+      for(unsigned int a = 0; a < system.Sizes.size(); ++a)
+        {
+        const unsigned int n = system.Sizes[a];
+        for(unsigned int d = 0; d < n; ++d)
+          {
+          system.Diagonal[a][d * n + d] += lambda * (system.Diagonal[a][d * n + d] + 1e-12);
+          }
+        }
+
+      // Eliminate the points: S = U - W V^-1 W^T, rhs = -g_c + W V^-1 g_p
+      if(movePoints)
+        {
+        std::vector<int> failed(Parallel::GetNumberOfThreads(), 0);
+        TrackFunctor tracks;
+        tracks.TrackObservations = &this->TrackObservations;
+        tracks.Jacobians = &jacobians;
+        tracks.Tracks = &this->Tracks;
+        tracks.PickedTracks = &this->PickedTracks;
+        tracks.PriorWeight = priorWeight;
+        tracks.Lambda = lambda;
+        tracks.NumberOfIntrinsics = ni;
+        tracks.InverseBlocks = &inverseBlocks;
+        tracks.Gradients = &trackGradients;
+        tracks.ObservationCouplings = &observationCouplings;
+        tracks.IntrinsicCouplings = &intrinsicCouplings;
+        tracks.Failed = &failed;
+        Parallel::For(0, numberOfTracks, tracks);
+        if(std::find(failed.begin(), failed.end(), 1) != failed.end())
+          {
+          lambda *= 10;
+          continue;
+          }
+
+        std::vector<double> E; // W_o V^-1 of each observation of the track, 6 x 3
+        std::vector<double> block(36);
+        for(unsigned int track = 0; track < numberOfTracks; ++track)
+          {
+          const std::vector<unsigned int>& observations = this->TrackObservations[track];
+          const double* inverse = &inverseBlocks[9 * track];
+          const double* g = &trackGradients[3 * track];
+
+          E.assign(18 * observations.size(), 0);
+          for(unsigned int o = 0; o < observations.size(); ++o)
+            {
+            // V^-1 is symmetric, so W V^-1 = W (V^-1)^T
+            MultiplyTransposed(&observationCouplings[18 * observations[o]], inverse, 6, 3, 3, &E[18 * o]);
+            const unsigned int frameBlock = 1 + this->Observations[observations[o]].Frame;
+            for(unsigned int a = 0; a < 6; ++a)
+              {
+              rhs[system.Offsets[frameBlock] + a] += E[18 * o + 3 * a] * g[0] + E[18 * o + 3 * a + 1] * g[1] +
+                                                     E[18 * o + 3 * a + 2] * g[2];
+              }
+            }
+
+          for(unsigned int o1 = 0; o1 < observations.size(); ++o1)
+            {
+            const unsigned int frame1 = this->Observations[observations[o1]].Frame;
+            for(unsigned int o2 = 0; o2 < observations.size(); ++o2)
+              {
+              const unsigned int frame2 = this->Observations[observations[o2]].Frame;
+              if(frame1 > frame2)
+                {
+                continue; // the transpose of (o2, o1)
+                }
+              MultiplyTransposed(&E[18 * o1], &observationCouplings[18 * observations[o2]], 6, 3, 6, &block[0]);
+              system.Add(1 + frame1, 1 + frame2, &block[0], -1);
+              }
+            }
+
+          if(ni > 0)
+            {
+            double Ei[9];
+            double Wi[9];
+            for(unsigned int a = 0; a < ni; ++a)
+              {
+              std::copy(&intrinsicCouplings[9 * track + 3 * a], &intrinsicCouplings[9 * track + 3 * a] + 3, &Wi[3 * a]);
+              }
+            MultiplyTransposed(Wi, inverse, ni, 3, 3, Ei);
+            for(unsigned int a = 0; a < ni; ++a)
+              {
+              rhs[a] += Ei[3 * a] * g[0] + Ei[3 * a + 1] * g[1] + Ei[3 * a + 2] * g[2];
+              }
+            MultiplyTransposed(Ei, Wi, ni, 3, ni, &block[0]);
+            system.Add(0, 0, &block[0], -1);
+            for(unsigned int o = 0; o < observations.size(); ++o)
+              {
+              MultiplyTransposed(Ei, &observationCouplings[18 * observations[o]], ni, 3, 6, &block[0]);
+              system.Add(0, 1 + this->Observations[observations[o]].Frame, &block[0], -1);
+              }
+            }
+          }
+        }
+
+      std::vector<double> delta;
+      if(!SolveConjugateGradients(system, rhs, delta))
+        {
+        lambda *= 10;
+        continue;
+        }
+
+      std::vector<Camera> candidateCameras = this->Cameras;
+      for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+        {
+        Camera& camera = candidateCameras[frame];
+        for(unsigned int k = 0; k < ni && !this->FixedIntrinsics[frame]; ++k)
+          {
+          switch(this->IntrinsicParameters[k])
+            {
+            case 0:
+              camera.FocalLength += delta[k];
+              break;
+            case 1:
+              camera.PrincipalPoint[0] += delta[k];
+              break;
+            default:
+              camera.PrincipalPoint[1] += delta[k];
+              break;
+            }
+          }
+        UpdatePose(camera, &delta[system.Offsets[1 + frame]]);
+        }
+
+      // Back substitution: dp = V^-1 (-g_p - W^T dc)
+      std::vector<Coord3D> candidateTracks = this->Tracks;
+      if(movePoints)
+        {
+        for(unsigned int track = 0; track < numberOfTracks; ++track)
+          {
+          double b[3] = {-trackGradients[3 * track], -trackGradients[3 * track + 1], -trackGradients[3 * track + 2]};
+          const std::vector<unsigned int>& observations = this->TrackObservations[track];
+          for(unsigned int o = 0; o < observations.size(); ++o)
+            {
+            const double* W = &observationCouplings[18 * observations[o]];
+            const double* dc = &delta[system.Offsets[1 + this->Observations[observations[o]].Frame]];
+            for(unsigned int a = 0; a < 6; ++a)
+              {
+              for(unsigned int c = 0; c < 3; ++c)
+                {
+                b[c] -= W[3 * a + c] * dc[a];
+                }
+              }
+            }
+          for(unsigned int a = 0; a < ni; ++a)
+            {
+            for(unsigned int c = 0; c < 3; ++c)
+              {
+              b[c] -= intrinsicCouplings[9 * track + 3 * a + c] * delta[a];
+              }
+            }
+          const double* inverse = &inverseBlocks[9 * track];
+          candidateTracks[track].x += inverse[0] * b[0] + inverse[1] * b[1] + inverse[2] * b[2];
+          candidateTracks[track].y += inverse[3] * b[0] + inverse[4] * b[1] + inverse[5] * b[2];
+          candidateTracks[track].z += inverse[6] * b[0] + inverse[7] * b[1] + inverse[8] * b[2];
+          }
+        }
+
+      double candidateCost = ComputeCost(candidateCameras, candidateTracks, true);
+      if(candidateCost < cost)
+        {
+        improved = true;
+        moved = true;
+        converged = cost - candidateCost < 1e-10 * cost;
+        this->Cameras = candidateCameras;
+        this->Tracks = candidateTracks;
+        cost = candidateCost;
+        lambda = std::max(1e-12, lambda * 0.1);
+        this->NumberOfIterations = iteration + 1;
+        continue;
+        }
+      lambda *= 10;
+      }
+    if(!improved)
+      {
+      break;
+      }
+    }
+
+  this->FinalRMSError = sqrt(ComputeCost(this->Cameras, this->Tracks, false) / numberOfObservations);
+  double toWorld[3] = {-origin[0], -origin[1], -origin[2]};
+  ShiftParameters(toWorld);
+  return moved;
+}
@@ -0,0 +1,129 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef BUNDLEADJUSTMENT_H
+#define BUNDLEADJUSTMENT_H
+
+// STL
+#include <map>
+#include <utility>
+#include <vector>
+
+// Custom
+#include "Camera.h"
+#include "Coord.h"
+
+// Joint refinement of the poses of many frames registered against one point cloud, of the intrinsics
+// the frames share and of the picked world points, by Levenberg-Marquardt on the reprojection error.
+//
+// A world point picked in several frames (the same coordinates) is one track. The tracks can move, but
+// are held to where they were picked by a prior of PointSigma (world units) against pixel errors of 1;
+// with PointSigma 0 they are fixed. The points are eliminated from each step by the Schur complement,
+// leaving a block sparse system in the camera parameters (frames are coupled only through the tracks they
+// share) that is solved by conjugate gradients with a block Jacobi preconditioner. The residuals,
+// Jacobians (analytic) and point blocks are computed in parallel.
+class BundleAdjustment
+{
+public:
+  BundleAdjustment();
+
+  // Add a frame and its correspondences; 'camera' is its starting pose. A frame with fixed intrinsics
+  // (e.g. from a calibrated camera) keeps its own and does not share the refined ones. Returns the frame's index.
+  unsigned int AddFrame(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                        const Camera& camera, const bool fixedIntrinsics = false);
+  unsigned int GetNumberOfFrames() const;
+
+  // With either of these the frames without fixed intrinsics share one set (starting from their average);
+  // otherwise each frame keeps its own, fixed. The lens distortion of each frame is always kept fixed
+  // (it is estimated by CameraCalibration).
+  void SetRefineFocalLength(const bool refine);
+  void SetRefinePrincipalPoint(const bool refine);
+
+  // Standard deviation of the picked points in world units, or 0 to keep them fixed (default)
+  void SetPointSigma(const double sigma);
+
+  void SetMaximumNumberOfIterations(const unsigned int iterations);
+
+  // Returns false if there is nothing to adjust or no step could be taken
+  bool Adjust();
+
+  const Camera& GetCamera(const unsigned int frame) const;
+
+  // The (possibly moved) world points of a frame, in the order they were added
+  void GetWorldPoints(const unsigned int frame, std::vector<Coord3D>& worldPoints) const;
+
+  // Over all observations, before and after Adjust
+  double GetInitialRMSError() const;
+  double GetFinalRMSError() const;
+  // Of one frame, after Adjust
+  double GetRMSError(const unsigned int frame) const;
+
+  unsigned int GetNumberOfIterations() const;
+  unsigned int GetNumberOfTracks() const;
+
+  // Internal layout, public so the parallel functors can use it
+  struct Observation
+  {
+    unsigned int Frame;
+    unsigned int Track;
+    double Pixel[2];
+  };
+
+  struct ObservationJacobian
+  {
+    bool Valid; // in front of the camera
+    double Residual[2];
+    double Intrinsics[2][3]; // first NumberOfIntrinsics columns are used
+    double Pose[2][6];       // rotation increment (left), translation
+    double Point[2][3];
+  };
+
+private:
+  std::vector<Camera> Cameras;
+  std::vector<unsigned char> FixedIntrinsics; // per frame
+  std::vector<Coord3D> Tracks;        // current positions
+  std::vector<Coord3D> PickedTracks;  // as picked
+  std::vector<Observation> Observations;
+  std::vector<std::vector<unsigned int> > FrameObservations;
+  std::vector<std::vector<unsigned int> > TrackObservations;
+
+  // Track of each picked position, so a point picked in several frames is one track
+  typedef std::pair<double, std::pair<double, double> > TrackKey;
+  std::map<TrackKey, unsigned int> TrackIndex;
+
+  bool RefineFocalLength;
+  bool RefinePrincipalPoint;
+  double PointSigma;
+  unsigned int MaximumNumberOfIterations;
+
+  double InitialRMSError;
+  double FinalRMSError;
+  unsigned int NumberOfIterations;
+
+  // Which of (focal length, principal point x, principal point y) are parameters
+  std::vector<unsigned int> IntrinsicParameters;
+
+  // Express the cameras and tracks relative to 'origin' (world = local + origin)
+  void ShiftParameters(const double origin[3]);
+
+  // Sum of squared reprojection errors, plus the point prior if requested
+  double ComputeCost(const std::vector<Camera>& cameras, const std::vector<Coord3D>& tracks,
+                     const bool includePrior) const;
+};
+
+#endif
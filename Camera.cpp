@@ -0,0 +1,331 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "Camera.h"
+
+// STL
+#include <cmath>
+
+Camera::Camera()
+{
+  this->FocalLength = 1.0;
+  for(unsigned int i = 0; i < 2; ++i)
+    {
+    this->PrincipalPoint[i] = 0;
+    }
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    this->Rotation[i] = 0;
+    this->Translation[i] = 0;
+    }
+  for(unsigned int i = 0; i < 4; ++i)
+    {
+    this->Distortion[i] = 0;
+    }
+}
+
+void Camera::GetPoseParameters(double parameters[6]) const
+{
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    parameters[i] = this->Rotation[i];
+    parameters[i + 3] = this->Translation[i];
+    }
+}
+
+void Camera::SetPoseParameters(const double parameters[6])
+{
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    this->Rotation[i] = parameters[i];
+    this->Translation[i] = parameters[i + 3];
+    }
+}
+
+void Camera::GetRotationMatrix(double R[3][3]) const
+{
+  RodriguesToMatrix(this->Rotation, R);
+}
+
+void Camera::SetRotationMatrix(const double R[3][3])
+{
+  MatrixToRodrigues(R, this->Rotation);
+}
+
+void Camera::WorldToCamera(const double world[3], double camera[3]) const
+{
+  double R[3][3];
+  this->GetRotationMatrix(R);
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    camera[i] = R[i][0] * world[0] + R[i][1] * world[1] + R[i][2] * world[2] + this->Translation[i];
+    }
+}
+
+bool Camera::Project(const double world[3], double pixel[2]) const
+{
+  double camera[3];
+  this->WorldToCamera(world, camera);
+  return this->ProjectCameraPoint(camera, pixel);
+}
+
+bool Camera::ProjectCameraPoint(const double camera[3], double pixel[2], double jacobian[2][3]) const
+{
+  if(camera[2] <= 0)
+    {
+    return false;
+    }
+  double normalized[2] = {camera[0] / camera[2], camera[1] / camera[2]};
+  double distorted[2];
+  double D[2][2];
+  this->Distort(normalized, distorted, jacobian ? D : 0);
+  pixel[0] = this->FocalLength * distorted[0] + this->PrincipalPoint[0];
+  pixel[1] = this->FocalLength * distorted[1] + this->PrincipalPoint[1];
+
+  if(jacobian)
+    {
+    // d(x,y)/d(Xc,Yc,Zc) = [1/Zc 0 -x/Zc; 0 1/Zc -y/Zc]
+    const double scale = this->FocalLength / camera[2];
+    for(unsigned int row = 0; row < 2; ++row)
+      {
+      jacobian[row][0] = scale * D[row][0];
+      jacobian[row][1] = scale * D[row][1];
+      jacobian[row][2] = -scale * (D[row][0] * normalized[0] + D[row][1] * normalized[1]);
+      }
+    }
+  return true;
+}
+
+bool Camera::HasDistortion() const
+{
+  return this->Distortion[0] != 0 || this->Distortion[1] != 0 || this->Distortion[2] != 0 || this->Distortion[3] != 0;
+}
+
+void Camera::Distort(const double normalized[2], double distorted[2], double jacobian[2][2]) const
+{
+  const double x = normalized[0];
+  const double y = normalized[1];
+  const double k1 = this->Distortion[0];
+  const double k2 = this->Distortion[1];
+  const double p1 = this->Distortion[2];
+  const double p2 = this->Distortion[3];
+
+  const double r2 = x * x + y * y;
+  const double radial = 1.0 + k1 * r2 + k2 * r2 * r2;
+  distorted[0] = x * radial + 2.0 * p1 * x * y + p2 * (r2 + 2.0 * x * x);
+  distorted[1] = y * radial + p1 * (r2 + 2.0 * y * y) + 2.0 * p2 * x * y;
+
+  if(jacobian)
+    {
+    // d(radial)/d(r^2)
+    const double dRadial = k1 + 2.0 * k2 * r2;
+    jacobian[0][0] = radial + 2.0 * x * x * dRadial + 2.0 * p1 * y + 6.0 * p2 * x;
+    jacobian[0][1] = 2.0 * x * y * dRadial + 2.0 * p1 * x + 2.0 * p2 * y;
+    jacobian[1][0] = 2.0 * x * y * dRadial + 2.0 * p1 * x + 2.0 * p2 * y;
+    jacobian[1][1] = radial + 2.0 * y * y * dRadial + 6.0 * p1 * y + 2.0 * p2 * x;
+    }
+}
+
+void Camera::Undistort(const double distorted[2], double normalized[2]) const
+{
+  normalized[0] = distorted[0];
+  normalized[1] = distorted[1];
+  if(!this->HasDistortion())
+    {
+    return;
+    }
+
+  for(unsigned int iteration = 0; iteration < 20; ++iteration)
+    {
+    double current[2];
+    double J[2][2];
+    this->Distort(normalized, current, J);
+    double r[2] = {current[0] - distorted[0], current[1] - distorted[1]};
+    double determinant = J[0][0] * J[1][1] - J[0][1] * J[1][0];
+    if(fabs(determinant) < 1e-12)
+      {
+      return;
+      }
+    double step[2] = {(J[1][1] * r[0] - J[0][1] * r[1]) / determinant,
+                      (J[0][0] * r[1] - J[1][0] * r[0]) / determinant};
+    normalized[0] -= step[0];
+    normalized[1] -= step[1];
+    if(step[0] * step[0] + step[1] * step[1] < 1e-24)
+      {
+      return;
+      }
+    }
+}
+
+void Camera::GetCenter(double center[3]) const
+{
+  // C = -R^T t
+  double R[3][3];
+  this->GetRotationMatrix(R);
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    center[i] = -(R[0][i] * this->Translation[0] + R[1][i] * this->Translation[1] + R[2][i] * this->Translation[2]);
+    }
+}
+
+void Camera::GetRay(const double pixel[2], double origin[3], double direction[3]) const
+{
+  this->GetCenter(origin);
+
+  double distorted[2] = {(pixel[0] - this->PrincipalPoint[0]) / this->FocalLength,
+                         (pixel[1] - this->PrincipalPoint[1]) / this->FocalLength};
+  double cameraDirection[3];
+  this->Undistort(distorted, cameraDirection);
+  cameraDirection[2] = 1.0;
+
+  // Rotate back into the world frame: d = R^T dc
+  double R[3][3];
+  this->GetRotationMatrix(R);
+  double length = 0;
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    direction[i] = R[0][i] * cameraDirection[0] + R[1][i] * cameraDirection[1] + R[2][i] * cameraDirection[2];
+    length += direction[i] * direction[i];
+    }
+  length = sqrt(length);
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    direction[i] /= length;
+    }
+}
+
+Camera Camera::Scaled(const double scale) const
+{
+  // Pixel centers are at integer coordinates, so the scaling is about (-0.5, -0.5)
+  Camera scaled = *this;
+  scaled.FocalLength = this->FocalLength * scale;
+  for(unsigned int i = 0; i < 2; ++i)
+    {
+    scaled.PrincipalPoint[i] = (this->PrincipalPoint[i] + 0.5) * scale - 0.5;
+    }
+  return scaled;
+}
+
+Camera Camera::Shifted(const double origin[3]) const
+{
+  // R (p + origin) + t = R p + (R origin + t)
+  Camera shifted = *this;
+  double R[3][3];
+  this->GetRotationMatrix(R);
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    shifted.Translation[i] += R[i][0] * origin[0] + R[i][1] * origin[1] + R[i][2] * origin[2];
+    }
+  return shifted;
+}
+
+void Camera::RodriguesToMatrix(const double r[3], double R[3][3])
+{
+  double theta = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+  if(theta < 1e-12)
+    {
+    // First order approximation: R = I + [r]x
+    R[0][0] = 1;     R[0][1] = -r[2]; R[0][2] = r[1];
+    R[1][0] = r[2];  R[1][1] = 1;     R[1][2] = -r[0];
+    R[2][0] = -r[1]; R[2][1] = r[0];  R[2][2] = 1;
+    return;
+    }
+
+  double k[3] = {r[0] / theta, r[1] / theta, r[2] / theta};
+  double c = cos(theta);
+  double s = sin(theta);
+  double v = 1.0 - c;
+
+  R[0][0] = c + k[0] * k[0] * v;
+  R[0][1] = k[0] * k[1] * v - k[2] * s;
+  R[0][2] = k[0] * k[2] * v + k[1] * s;
+  R[1][0] = k[1] * k[0] * v + k[2] * s;
+  R[1][1] = c + k[1] * k[1] * v;
+  R[1][2] = k[1] * k[2] * v - k[0] * s;
+  R[2][0] = k[2] * k[0] * v - k[1] * s;
+  R[2][1] = k[2] * k[1] * v + k[0] * s;
+  R[2][2] = c + k[2] * k[2] * v;
+}
+
+void Camera::MatrixToRodrigues(const double R[3][3], double r[3])
+{
+  double cosTheta = 0.5 * (R[0][0] + R[1][1] + R[2][2] - 1.0);
+  if(cosTheta > 1.0)
+    {
+    cosTheta = 1.0;
+    }
+  if(cosTheta < -1.0)
+    {
+    cosTheta = -1.0;
+    }
+  double theta = acos(cosTheta);
+
+  if(theta < 1e-12)
+    {
+    r[0] = r[1] = r[2] = 0;
+    return;
+    }
+
+  const double pi = 3.14159265358979323846;
+  if(pi - theta < 1e-6)
+    {
+    // Near 180 degrees the antisymmetric part vanishes. Then R + I = 2 k k^T, so the
+    // column of R + I with the largest norm is parallel to the axis k.
+    unsigned int bestColumn = 0;
+    double bestNorm = 0;
+    for(unsigned int column = 0; column < 3; ++column)
+      {
+      double norm = 0;
+      for(unsigned int row = 0; row < 3; ++row)
+        {
+        double value = R[row][column] + (row == column ? 1.0 : 0.0);
+        norm += value * value;
+        }
+      if(norm > bestNorm)
+        {
+        bestNorm = norm;
+        bestColumn = column;
+        }
+      }
+    bestNorm = sqrt(bestNorm);
+    for(unsigned int row = 0; row < 3; ++row)
+      {
+      r[row] = theta * (R[row][bestColumn] + (row == bestColumn ? 1.0 : 0.0)) / bestNorm;
+      }
+    return;
+    }
+
+  double factor = theta / (2.0 * sin(theta));
+  r[0] = factor * (R[2][1] - R[1][2]);
+  r[1] = factor * (R[0][2] - R[2][0]);
+  r[2] = factor * (R[1][0] - R[0][1]);
+}
+
+std::ostream& operator<<(std::ostream& output, const Camera& camera)
+{
+  output << "Focal length: " << camera.FocalLength
+         << " Principal point: " << camera.PrincipalPoint[0] << " " << camera.PrincipalPoint[1]
+         << " Rotation: " << camera.Rotation[0] << " " << camera.Rotation[1] << " " << camera.Rotation[2]
+         << " Translation: " << camera.Translation[0] << " " << camera.Translation[1] << " " << camera.Translation[2];
+  if(camera.HasDistortion())
+    {
+    output << " Distortion: " << camera.Distortion[0] << " " << camera.Distortion[1] << " "
+           << camera.Distortion[2] << " " << camera.Distortion[3];
+    }
+  return output;
+}
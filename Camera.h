@@ -0,0 +1,90 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef CAMERA_H
+#define CAMERA_H
+
+// STL
+#include <iostream>
+
+// A pinhole camera with lens distortion relating point cloud coordinates to image pixel coordinates.
+// Pixel coordinates follow the image keypoints: u is the column and v is the row (ITK index),
+// so the camera frame is x right, y down, z forward.
+//   Xc = R * X + Translation,  (x, y) = (Xc/Zc, Yc/Zc) distorted,  u = FocalLength * x + PrincipalPoint[0],
+//   v = FocalLength * y + PrincipalPoint[1]
+// R is stored as an axis-angle (Rodrigues) vector. The distortion is the radial and tangential (Brown) model
+// on the normalized coordinates, so it does not change with the image resolution:
+//   r^2 = x^2 + y^2,  x' = x (1 + k1 r^2 + k2 r^4) + 2 p1 x y + p2 (r^2 + 2 x^2)
+//                     y' = y (1 + k1 r^2 + k2 r^4) + p1 (r^2 + 2 y^2) + 2 p2 x y
+// All coefficients are 0 (no distortion) unless the camera has been calibrated.
+class Camera
+{
+public:
+  Camera();
+
+  double FocalLength;
+  double PrincipalPoint[2];
+  double Rotation[3];
+  double Translation[3];
+  double Distortion[4]; // k1, k2, p1, p2
+
+  // Number of pose parameters (Rotation followed by Translation) used by the optimizers
+  static const unsigned int NumberOfPoseParameters = 6;
+
+  void GetPoseParameters(double parameters[6]) const;
+  void SetPoseParameters(const double parameters[6]);
+
+  void GetRotationMatrix(double R[3][3]) const;
+  void SetRotationMatrix(const double R[3][3]);
+
+  // Transform a point into the camera frame
+  void WorldToCamera(const double world[3], double camera[3]) const;
+
+  // Returns false if the point is not in front of the camera
+  bool Project(const double world[3], double pixel[2]) const;
+
+  // Project a point given in the camera frame. If 'jacobian' is given it receives d(u,v)/d(Xc,Yc,Zc).
+  bool ProjectCameraPoint(const double camera[3], double pixel[2], double jacobian[2][3] = 0) const;
+
+  bool HasDistortion() const;
+
+  // Apply the distortion to normalized coordinates. If 'jacobian' is given it receives d(x',y')/d(x,y).
+  void Distort(const double normalized[2], double distorted[2], double jacobian[2][2] = 0) const;
+  // The inverse of Distort, by Newton iterations
+  void Undistort(const double distorted[2], double normalized[2]) const;
+
+  // The camera center in world coordinates
+  void GetCenter(double center[3]) const;
+
+  // The ray through a pixel: origin is the camera center and direction is unit length
+  void GetRay(const double pixel[2], double origin[3], double direction[3]) const;
+
+  // The same camera looking at an image resampled by 'scale' (e.g. 0.5 for half resolution)
+  Camera Scaled(const double scale) const;
+
+  // The same camera for points expressed relative to 'origin' (world = local + origin).
+  // Shifted(-origin) converts back.
+  Camera Shifted(const double origin[3]) const;
+
+  static void RodriguesToMatrix(const double r[3], double R[3][3]);
+  static void MatrixToRodrigues(const double R[3][3], double r[3]);
+};
+
+std::ostream& operator<<(std::ostream& output, const Camera& camera);
+
+#endif
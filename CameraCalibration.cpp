@@ -0,0 +1,979 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "CameraCalibration.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Custom
+#include "Parallel.h"
+#include "PoseEstimation.h"
+
+namespace
+{
+
+typedef CameraCalibration::FrameData FrameData;
+
+// Focal length, principal point (2) and distortion (4)
+const unsigned int MaximumNumberOfIntrinsics = 7;
+
+// Factor the symmetric positive definite n x n matrix A (row major) in place into L L^T.
+// Returns false if A is not positive definite.
+bool CholeskyFactor(double* A, const unsigned int n)
+{
+  for(unsigned int j = 0; j < n; ++j)
+    {
+    double diagonal = A[j * n + j];
+    for(unsigned int k = 0; k < j; ++k)
+      {
+      diagonal -= A[j * n + k] * A[j * n + k];
+      }
+    if(diagonal <= 0)
+      {
+      return false;
+      }
+    A[j * n + j] = sqrt(diagonal);
+    for(unsigned int i = j + 1; i < n; ++i)
+      {
+      double value = A[i * n + j];
+      for(unsigned int k = 0; k < j; ++k)
+        {
+        value -= A[i * n + k] * A[j * n + k];
+        }
+      A[i * n + j] = value / A[j * n + j];
+      }
+    }
+  return true;
+}
+
+// Solve L L^T x = b in place, with L from CholeskyFactor
+void CholeskySubstitute(const double* L, double* b, const unsigned int n)
+{
+  for(unsigned int i = 0; i < n; ++i)
+    {
+    for(unsigned int k = 0; k < i; ++k)
+      {
+      b[i] -= L[i * n + k] * b[k];
+      }
+    b[i] /= L[i * n + i];
+    }
+  for(int i = static_cast<int>(n) - 1; i >= 0; --i)
+    {
+    for(unsigned int k = i + 1; k < n; ++k)
+      {
+      b[i] -= L[k * n + i] * b[k];
+      }
+    b[i] /= L[i * n + i];
+    }
+}
+
+void GetIntrinsicParameters(const Camera& camera, double parameters[MaximumNumberOfIntrinsics])
+{
+  parameters[0] = camera.FocalLength;
+  parameters[1] = camera.PrincipalPoint[0];
+  parameters[2] = camera.PrincipalPoint[1];
+  for(unsigned int i = 0; i < 4; ++i)
+    {
+    parameters[3 + i] = camera.Distortion[i];
+    }
+}
+
+void SetIntrinsicParameters(const double parameters[MaximumNumberOfIntrinsics], Camera& camera)
+{
+  camera.FocalLength = parameters[0];
+  camera.PrincipalPoint[0] = parameters[1];
+  camera.PrincipalPoint[1] = parameters[2];
+  for(unsigned int i = 0; i < 4; ++i)
+    {
+    camera.Distortion[i] = parameters[3 + i];
+    }
+}
+
+// Huber: quadratic up to the threshold, linear beyond, as a function of the length of the residual
+double RobustCost(const double length, const double threshold)
+{
+  if(length <= threshold)
+    {
+    return length * length;
+    }
+  return 2.0 * threshold * length - threshold * threshold;
+}
+
+// The weight that makes a least squares step on the weighted residual a step on the robust cost
+double RobustWeight(const double length, const double threshold)
+{
+  if(length <= threshold)
+    {
+    return 1.0;
+    }
+  return threshold / length;
+}
+
+// The residual of one observation and its derivatives with respect to the intrinsics (in the order of
+// intrinsicParameters) and the pose (rotation increment applied on the left, R <- exp([w]x) R, then translation)
+bool Linearize(const Camera& camera, const double R[3][3], const Coord3D& world, const Coord2D& observed,
+               const std::vector<unsigned int>& intrinsicParameters, double residual[2],
+               double intrinsics[2][MaximumNumberOfIntrinsics], double pose[2][6])
+{
+  double rotated[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    rotated[d] = R[d][0] * world.x + R[d][1] * world.y + R[d][2] * world.z;
+    }
+  double point[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    point[d] = rotated[d] + camera.Translation[d];
+    }
+
+  double pixel[2];
+  double dProjection[2][3];
+  if(!camera.ProjectCameraPoint(point, pixel, dProjection))
+    {
+    return false;
+    }
+  residual[0] = pixel[0] - observed.x;
+  residual[1] = pixel[1] - observed.y;
+
+  // d(x,y,z)/dw = -[rotated]x
+  double dRotation[3][3] = {{0, rotated[2], -rotated[1]},
+                            {-rotated[2], 0, rotated[0]},
+                            {rotated[1], -rotated[0], 0}};
+  for(unsigned int row = 0; row < 2; ++row)
+    {
+    for(unsigned int k = 0; k < 3; ++k)
+      {
+      pose[row][k] = dProjection[row][0] * dRotation[0][k] + dProjection[row][1] * dRotation[1][k] +
+                     dProjection[row][2] * dRotation[2][k];
+      pose[row][k + 3] = dProjection[row][k];
+      }
+    }
+
+  const double f = camera.FocalLength;
+  const double x = point[0] / point[2];
+  const double y = point[1] / point[2];
+  const double r2 = x * x + y * y;
+  for(unsigned int k = 0; k < intrinsicParameters.size(); ++k)
+    {
+    double* du = &intrinsics[0][k];
+    double* dv = &intrinsics[1][k];
+    switch(intrinsicParameters[k])
+      {
+      case 0: // focal length, the distorted normalized coordinates
+        *du = (pixel[0] - camera.PrincipalPoint[0]) / f;
+        *dv = (pixel[1] - camera.PrincipalPoint[1]) / f;
+        break;
+      case 1: // principal point x
+        *du = 1;
+        *dv = 0;
+        break;
+      case 2: // principal point y
+        *du = 0;
+        *dv = 1;
+        break;
+      case 3: // k1
+        *du = f * x * r2;
+        *dv = f * y * r2;
+        break;
+      case 4: // k2
+        *du = f * x * r2 * r2;
+        *dv = f * y * r2 * r2;
+        break;
+      case 5: // p1
+        *du = f * 2.0 * x * y;
+        *dv = f * (r2 + 2.0 * y * y);
+        break;
+      default: // p2
+        *du = f * (r2 + 2.0 * x * x);
+        *dv = f * 2.0 * x * y;
+        break;
+      }
+    }
+  return true;
+}
+
+// The weighted normal equations frame by frame: the pose block, pose gradient and intrinsics x pose coupling
+// of each frame, and the intrinsics block and gradient summed per thread (reduced by the caller)
+struct FrameFunctor
+{
+  const std::vector<FrameData>* Frames;
+  const std::vector<Camera>* Cameras;
+  const std::vector<unsigned int>* IntrinsicParameters;
+  double RobustThreshold;
+
+  std::vector<double>* PoseBlocks;         // 6 x 6 per frame
+  std::vector<double>* PoseGradients;      // 6 per frame
+  std::vector<double>* CouplingBlocks;     // intrinsics x pose, 7 x 6 per frame
+  std::vector<double>* IntrinsicBlocks;    // 7 x 7 per thread
+  std::vector<double>* IntrinsicGradients; // 7 per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    const unsigned int ni = this->IntrinsicParameters->size();
+    const unsigned int stride = MaximumNumberOfIntrinsics;
+    double* V = &(*this->IntrinsicBlocks)[stride * stride * threadId];
+    double* intrinsicGradient = &(*this->IntrinsicGradients)[stride * threadId];
+
+    for(vtkIdType frame = begin; frame < end; ++frame)
+      {
+      double* U = &(*this->PoseBlocks)[36 * frame];
+      double* g = &(*this->PoseGradients)[6 * frame];
+      double* W = &(*this->CouplingBlocks)[6 * stride * frame];
+      std::fill(U, U + 36, 0.0);
+      std::fill(g, g + 6, 0.0);
+      std::fill(W, W + 6 * stride, 0.0);
+
+      const FrameData& data = (*this->Frames)[frame];
+      const Camera& camera = (*this->Cameras)[frame];
+      double R[3][3];
+      camera.GetRotationMatrix(R);
+      for(unsigned int i = 0; i < data.ImagePoints.size(); ++i)
+        {
+        double residual[2];
+        double Ji[2][MaximumNumberOfIntrinsics];
+        double Jp[2][6];
+        if(!Linearize(camera, R, data.WorldPoints[i], data.ImagePoints[i], *this->IntrinsicParameters,
+                      residual, Ji, Jp))
+          {
+          continue;
+          }
+        double length = sqrt(residual[0] * residual[0] + residual[1] * residual[1]);
+        double weight = RobustWeight(length, this->RobustThreshold);
+
+        for(unsigned int row = 0; row < 2; ++row)
+          {
+          for(unsigned int a = 0; a < 6; ++a)
+            {
+            g[a] += weight * Jp[row][a] * residual[row];
+            for(unsigned int b = 0; b < 6; ++b)
+              {
+              U[6 * a + b] += weight * Jp[row][a] * Jp[row][b];
+              }
+            }
+          for(unsigned int a = 0; a < ni; ++a)
+            {
+            intrinsicGradient[a] += weight * Ji[row][a] * residual[row];
+            for(unsigned int b = 0; b < ni; ++b)
+              {
+              V[stride * a + b] += weight * Ji[row][a] * Ji[row][b];
+              }
+            for(unsigned int b = 0; b < 6; ++b)
+              {
+              W[6 * a + b] += weight * Ji[row][a] * Jp[row][b];
+              }
+            }
+          }
+        }
+      }
+  }
+};
+
+// Eliminate the poses: factor each damped pose block U and sum W U^-1 W^T and W U^-1 g per thread.
+// U^-1 g and U^-1 W^T are kept for the back substitution.
+struct SchurFunctor
+{
+  const std::vector<double>* PoseBlocks;
+  const std::vector<double>* PoseGradients;
+  const std::vector<double>* CouplingBlocks;
+  unsigned int NumberOfIntrinsics;
+  double Lambda;
+
+  std::vector<double>* SolvedGradients;    // U^-1 g, 6 per frame
+  std::vector<double>* SolvedCouplings;    // U^-1 W^T stored as rows of W U^-1, 7 x 6 per frame
+  std::vector<double>* ReducedBlocks;      // 7 x 7 per thread
+  std::vector<double>* ReducedGradients;   // 7 per thread
+  std::vector<char>* Failed;               // per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    const unsigned int ni = this->NumberOfIntrinsics;
+    const unsigned int stride = MaximumNumberOfIntrinsics;
+    double* S = &(*this->ReducedBlocks)[stride * stride * threadId];
+    double* b = &(*this->ReducedGradients)[stride * threadId];
+
+    for(vtkIdType frame = begin; frame < end; ++frame)
+      {
+      double L[36];
+      const double* U = &(*this->PoseBlocks)[36 * frame];
+      for(unsigned int i = 0; i < 36; ++i)
+        {
+        L[i] = U[i];
+        }
+      for(unsigned int a = 0; a < 6; ++a)
+        {
+        L[7 * a] += this->Lambda * (U[7 * a] + 1e-12);
+        }
+      if(!CholeskyFactor(L, 6))
+        {
+        (*this->Failed)[threadId] = 1;
+        return;
+        }
+
+      double* solvedGradient = &(*this->SolvedGradients)[6 * frame];
+      const double* g = &(*this->PoseGradients)[6 * frame];
+      std::copy(g, g + 6, solvedGradient);
+      CholeskySubstitute(L, solvedGradient, 6);
+
+      const double* W = &(*this->CouplingBlocks)[6 * stride * frame];
+      double* solvedCoupling = &(*this->SolvedCouplings)[6 * stride * frame];
+      for(unsigned int a = 0; a < ni; ++a)
+        {
+        std::copy(W + 6 * a, W + 6 * a + 6, solvedCoupling + 6 * a);
+        CholeskySubstitute(L, solvedCoupling + 6 * a, 6);
+        }
+
+      for(unsigned int a = 0; a < ni; ++a)
+        {
+        for(unsigned int k = 0; k < 6; ++k)
+          {
+          b[a] += W[6 * a + k] * solvedGradient[k];
+          }
+        for(unsigned int c = 0; c < ni; ++c)
+          {
+          double sum = 0;
+          for(unsigned int k = 0; k < 6; ++k)
+            {
+            sum += W[6 * a + k] * solvedCoupling[6 * c + k];
+            }
+          S[stride * a + c] += sum;
+          }
+        }
+      }
+  }
+};
+
+// Robust cost, summed per thread
+struct CostFunctor
+{
+  const std::vector<FrameData>* Frames;
+  const std::vector<Camera>* Cameras;
+  double RobustThreshold;
+  std::vector<double>* Costs; // per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    double cost = 0;
+    for(vtkIdType frame = begin; frame < end; ++frame)
+      {
+      const FrameData& data = (*this->Frames)[frame];
+      const Camera& camera = (*this->Cameras)[frame];
+      for(unsigned int i = 0; i < data.ImagePoints.size(); ++i)
+        {
+        double world[3] = {data.WorldPoints[i].x, data.WorldPoints[i].y, data.WorldPoints[i].z};
+        double pixel[2];
+        if(!camera.Project(world, pixel))
+          {
+          // Behind the camera: as if the residual were as long as the focal length
+          cost += RobustCost(camera.FocalLength, this->RobustThreshold);
+          continue;
+          }
+        double du = pixel[0] - data.ImagePoints[i].x;
+        double dv = pixel[1] - data.ImagePoints[i].y;
+        cost += RobustCost(sqrt(du * du + dv * dv), this->RobustThreshold);
+        }
+      }
+    (*this->Costs)[threadId] += cost;
+  }
+};
+
+// Refine the pose of each frame alone, with the intrinsics fixed
+struct PoseFunctor
+{
+  const std::vector<FrameData>* Frames;
+  std::vector<Camera>* Cameras;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType frame = begin; frame < end; ++frame)
+      {
+      const FrameData& data = (*this->Frames)[frame];
+      PoseEstimation::RefineCamera(data.ImagePoints, data.WorldPoints, false, (*this->Cameras)[frame]);
+      }
+  }
+};
+
+// Apply an increment (rotation increment on the left, translation) to the pose of a camera
+void UpdatePose(Camera& camera, const double* delta)
+{
+  double increment[3] = {delta[0], delta[1], delta[2]};
+  double incrementRotation[3][3];
+  Camera::RodriguesToMatrix(increment, incrementRotation);
+  double R[3][3];
+  camera.GetRotationMatrix(R);
+  double newR[3][3];
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    for(unsigned int j = 0; j < 3; ++j)
+      {
+      newR[i][j] = incrementRotation[i][0] * R[0][j] + incrementRotation[i][1] * R[1][j] + incrementRotation[i][2] * R[2][j];
+      }
+    }
+  camera.SetRotationMatrix(newR);
+
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    camera.Translation[d] += delta[3 + d];
+    }
+}
+
+} // end anonymous namespace
+
+CameraIntrinsics::CameraIntrinsics() : FocalLength(1.0), NumberOfFrames(0), NumberOfObservations(0), RMSError(0)
+{
+  this->PrincipalPoint[0] = 0;
+  this->PrincipalPoint[1] = 0;
+  for(unsigned int i = 0; i < 4; ++i)
+    {
+    this->Distortion[i] = 0;
+    }
+}
+
+void CameraIntrinsics::Get(const Camera& camera)
+{
+  this->FocalLength = camera.FocalLength;
+  this->PrincipalPoint[0] = camera.PrincipalPoint[0];
+  this->PrincipalPoint[1] = camera.PrincipalPoint[1];
+  for(unsigned int i = 0; i < 4; ++i)
+    {
+    this->Distortion[i] = camera.Distortion[i];
+    }
+}
+
+void CameraIntrinsics::Apply(Camera& camera) const
+{
+  camera.FocalLength = this->FocalLength;
+  camera.PrincipalPoint[0] = this->PrincipalPoint[0];
+  camera.PrincipalPoint[1] = this->PrincipalPoint[1];
+  for(unsigned int i = 0; i < 4; ++i)
+    {
+    camera.Distortion[i] = this->Distortion[i];
+    }
+}
+
+CameraCalibration::CameraCalibration() : RefinePrincipalPoint(true), RefineRadialDistortion(true),
+                                         RefineTangentialDistortion(true), RobustThreshold(2.0),
+                                         MaximumNumberOfIterations(100), InitialRMSError(0), FinalRMSError(0),
+                                         NumberOfOutliers(0), NumberOfIterations(0)
+{
+}
+
+unsigned int CameraCalibration::AddFrame(const std::vector<Coord2D>& imagePoints,
+                                         const std::vector<Coord3D>& worldPoints, const Camera& camera)
+{
+  if(imagePoints.size() != worldPoints.size())
+    {
+    std::cerr << "CameraCalibration: " << imagePoints.size() << " image points but " << worldPoints.size()
+              << " world points; only the first pairs are used." << std::endl;
+    }
+  const unsigned int numberOfPairs = std::min(imagePoints.size(), worldPoints.size());
+
+  FrameData data;
+  data.ImagePoints.assign(imagePoints.begin(), imagePoints.begin() + numberOfPairs);
+  data.WorldPoints.assign(worldPoints.begin(), worldPoints.begin() + numberOfPairs);
+  this->Frames.push_back(data);
+  this->Cameras.push_back(camera);
+  return this->Frames.size() - 1;
+}
+
+unsigned int CameraCalibration::GetNumberOfFrames() const
+{
+  return this->Frames.size();
+}
+
+void CameraCalibration::SetRefinePrincipalPoint(const bool refine)
+{
+  this->RefinePrincipalPoint = refine;
+}
+
+void CameraCalibration::SetRefineRadialDistortion(const bool refine)
+{
+  this->RefineRadialDistortion = refine;
+}
+
+void CameraCalibration::SetRefineTangentialDistortion(const bool refine)
+{
+  this->RefineTangentialDistortion = refine;
+}
+
+void CameraCalibration::SetRobustThreshold(const double threshold)
+{
+  this->RobustThreshold = threshold;
+}
+
+void CameraCalibration::SetMaximumNumberOfIterations(const unsigned int iterations)
+{
+  this->MaximumNumberOfIterations = iterations;
+}
+
+const CameraIntrinsics& CameraCalibration::GetIntrinsics() const
+{
+  return this->Intrinsics;
+}
+
+const Camera& CameraCalibration::GetCamera(const unsigned int frame) const
+{
+  return this->Cameras[frame];
+}
+
+double CameraCalibration::GetInitialRMSError() const
+{
+  return this->InitialRMSError;
+}
+
+double CameraCalibration::GetFinalRMSError() const
+{
+  return this->FinalRMSError;
+}
+
+unsigned int CameraCalibration::GetNumberOfOutliers() const
+{
+  return this->NumberOfOutliers;
+}
+
+unsigned int CameraCalibration::GetNumberOfIterations() const
+{
+  return this->NumberOfIterations;
+}
+
+double CameraCalibration::ComputeCost(const std::vector<Camera>& cameras) const
+{
+  std::vector<double> costs(Parallel::GetNumberOfThreads(), 0);
+  CostFunctor functor;
+  functor.Frames = &this->Frames;
+  functor.Cameras = &cameras;
+  functor.RobustThreshold = this->RobustThreshold;
+  functor.Costs = &costs;
+  Parallel::For(0, this->Frames.size(), functor);
+
+  double cost = 0;
+  for(unsigned int thread = 0; thread < costs.size(); ++thread)
+    {
+    cost += costs[thread];
+    }
+  return cost;
+}
+
+void CameraCalibration::ComputeStatistics()
+{
+  double sumOfSquares = 0;
+  double inlierSumOfSquares = 0;
+  unsigned int numberOfObservations = 0;
+  this->NumberOfOutliers = 0;
+  for(unsigned int frame = 0; frame < this->Frames.size(); ++frame)
+    {
+    const FrameData& data = this->Frames[frame];
+    for(unsigned int i = 0; i < data.ImagePoints.size(); ++i)
+      {
+      double world[3] = {data.WorldPoints[i].x, data.WorldPoints[i].y, data.WorldPoints[i].z};
+      double pixel[2];
+      double squaredError = HUGE_VAL;
+      if(this->Cameras[frame].Project(world, pixel))
+        {
+        double du = pixel[0] - data.ImagePoints[i].x;
+        double dv = pixel[1] - data.ImagePoints[i].y;
+        squaredError = du * du + dv * dv;
+        }
+      sumOfSquares += squaredError;
+      if(squaredError > 9.0 * this->RobustThreshold * this->RobustThreshold)
+        {
+        this->NumberOfOutliers++;
+        }
+      else
+        {
+        inlierSumOfSquares += squaredError;
+        }
+      numberOfObservations++;
+      }
+    }
+
+  this->FinalRMSError = numberOfObservations > 0 ? sqrt(sumOfSquares / numberOfObservations) : 0;
+  unsigned int numberOfInliers = numberOfObservations - this->NumberOfOutliers;
+  this->Intrinsics.RMSError = numberOfInliers > 0 ? sqrt(inlierSumOfSquares / numberOfInliers) : 0;
+  this->Intrinsics.NumberOfFrames = this->Frames.size();
+  this->Intrinsics.NumberOfObservations = numberOfObservations;
+}
+
+bool CameraCalibration::Calibrate()
+{
+  const unsigned int numberOfFrames = this->Frames.size();
+  if(numberOfFrames == 0)
+    {
+    std::cerr << "CameraCalibration: there are no frames." << std::endl;
+    return false;
+    }
+
+  std::vector<unsigned int> intrinsicParameters(1, 0);
+  if(this->RefinePrincipalPoint)
+    {
+    intrinsicParameters.push_back(1);
+    intrinsicParameters.push_back(2);
+    }
+  std::vector<unsigned int> allParameters = intrinsicParameters;
+  if(this->RefineRadialDistortion)
+    {
+    allParameters.push_back(3);
+    allParameters.push_back(4);
+    }
+  if(this->RefineTangentialDistortion)
+    {
+    allParameters.push_back(5);
+    allParameters.push_back(6);
+    }
+
+  unsigned int numberOfObservations = 0;
+  for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+    {
+    if(this->Frames[frame].ImagePoints.size() < 3)
+      {
+      std::cerr << "CameraCalibration: frame " << frame << " has " << this->Frames[frame].ImagePoints.size()
+                << " correspondences, but at least 3 are required." << std::endl;
+      return false;
+      }
+    numberOfObservations += this->Frames[frame].ImagePoints.size();
+    }
+  if(2 * numberOfObservations <= 6 * numberOfFrames + allParameters.size())
+    {
+    std::cerr << "CameraCalibration: " << numberOfObservations << " correspondences in " << numberOfFrames
+              << " frames do not constrain the intrinsics." << std::endl;
+    return false;
+    }
+
+  // Express each frame relative to the centroid of its points, so rotation increments do not swing georeferenced
+  // cameras by kilometers. The frames are independent apart from the intrinsics, so each can use its own origin.
+  std::vector<Coord3D> origins(numberOfFrames);
+  for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+    {
+    FrameData& data = this->Frames[frame];
+    double origin[3] = {0, 0, 0};
+    for(unsigned int i = 0; i < data.WorldPoints.size(); ++i)
+      {
+      origin[0] += data.WorldPoints[i].x / data.WorldPoints.size();
+      origin[1] += data.WorldPoints[i].y / data.WorldPoints.size();
+      origin[2] += data.WorldPoints[i].z / data.WorldPoints.size();
+      }
+    for(unsigned int i = 0; i < data.WorldPoints.size(); ++i)
+      {
+      data.WorldPoints[i].x -= origin[0];
+      data.WorldPoints[i].y -= origin[1];
+      data.WorldPoints[i].z -= origin[2];
+      }
+    this->Cameras[frame] = this->Cameras[frame].Shifted(origin);
+    origins[frame].x = origin[0];
+    origins[frame].y = origin[1];
+    origins[frame].z = origin[2];
+    }
+
+  ComputeStatistics();
+  this->InitialRMSError = this->FinalRMSError;
+
+  // Start from the median focal length (single frame estimates can be far off) and the average principal point,
+  // without distortion, and fit each pose to them
+  std::vector<double> focalLengths(numberOfFrames);
+  double principalPoint[2] = {0, 0};
+  for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+    {
+    focalLengths[frame] = this->Cameras[frame].FocalLength;
+    principalPoint[0] += this->Cameras[frame].PrincipalPoint[0] / numberOfFrames;
+    principalPoint[1] += this->Cameras[frame].PrincipalPoint[1] / numberOfFrames;
+    }
+  std::nth_element(focalLengths.begin(), focalLengths.begin() + numberOfFrames / 2, focalLengths.end());
+  this->Intrinsics = CameraIntrinsics();
+  this->Intrinsics.FocalLength = focalLengths[numberOfFrames / 2];
+  this->Intrinsics.PrincipalPoint[0] = principalPoint[0];
+  this->Intrinsics.PrincipalPoint[1] = principalPoint[1];
+  for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+    {
+    this->Intrinsics.Apply(this->Cameras[frame]);
+    }
+
+  PoseFunctor poses;
+  poses.Frames = &this->Frames;
+  poses.Cameras = &this->Cameras;
+  Parallel::For(0, numberOfFrames, poses);
+
+  this->NumberOfIterations = 0;
+  bool success = Optimize(intrinsicParameters);
+  if(success && allParameters.size() > intrinsicParameters.size())
+    {
+    success = Optimize(allParameters);
+    }
+
+  this->Intrinsics.Get(this->Cameras[0]);
+  ComputeStatistics();
+
+  for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+    {
+    FrameData& data = this->Frames[frame];
+    const Coord3D& origin = origins[frame];
+    for(unsigned int i = 0; i < data.WorldPoints.size(); ++i)
+      {
+      data.WorldPoints[i].x += origin.x;
+      data.WorldPoints[i].y += origin.y;
+      data.WorldPoints[i].z += origin.z;
+      }
+    double back[3] = {-origin.x, -origin.y, -origin.z};
+    this->Cameras[frame] = this->Cameras[frame].Shifted(back);
+    }
+
+  return success;
+}
+
+bool CameraCalibration::Optimize(const std::vector<unsigned int>& intrinsicParameters)
+{
+  const unsigned int numberOfFrames = this->Frames.size();
+  const unsigned int ni = intrinsicParameters.size();
+  const unsigned int stride = MaximumNumberOfIntrinsics;
+  const unsigned int numberOfThreads = Parallel::GetNumberOfThreads();
+
+  std::vector<double> poseBlocks(36 * numberOfFrames);
+  std::vector<double> poseGradients(6 * numberOfFrames);
+  std::vector<double> couplingBlocks(6 * stride * numberOfFrames);
+  std::vector<double> intrinsicBlocks;
+  std::vector<double> intrinsicGradients;
+  std::vector<double> solvedGradients(6 * numberOfFrames);
+  std::vector<double> solvedCouplings(6 * stride * numberOfFrames);
+  std::vector<double> reducedBlocks;
+  std::vector<double> reducedGradients;
+  std::vector<char> failed;
+
+  double cost = ComputeCost(this->Cameras);
+  double lambda = 1e-3;
+  bool stepTaken = false;
+  bool converged = false;
+  for(unsigned int iteration = 0; iteration < this->MaximumNumberOfIterations && !converged; ++iteration)
+    {
+    intrinsicBlocks.assign(stride * stride * numberOfThreads, 0);
+    intrinsicGradients.assign(stride * numberOfThreads, 0);
+
+    FrameFunctor frames;
+    frames.Frames = &this->Frames;
+    frames.Cameras = &this->Cameras;
+    frames.IntrinsicParameters = &intrinsicParameters;
+    frames.RobustThreshold = this->RobustThreshold;
+    frames.PoseBlocks = &poseBlocks;
+    frames.PoseGradients = &poseGradients;
+    frames.CouplingBlocks = &couplingBlocks;
+    frames.IntrinsicBlocks = &intrinsicBlocks;
+    frames.IntrinsicGradients = &intrinsicGradients;
+    Parallel::For(0, numberOfFrames, frames);
+
+    double V[MaximumNumberOfIntrinsics * MaximumNumberOfIntrinsics] = {0};
+    double intrinsicGradient[MaximumNumberOfIntrinsics] = {0};
+    for(unsigned int thread = 0; thread < numberOfThreads; ++thread)
+      {
+      for(unsigned int a = 0; a < ni; ++a)
+        {
+        intrinsicGradient[a] += intrinsicGradients[stride * thread + a];
+        for(unsigned int b = 0; b < ni; ++b)
+          {
+          V[ni * a + b] += intrinsicBlocks[stride * stride * thread + stride * a + b];
+          }
+        }
+      }
+
+    bool improved = false;
+    while(!improved && lambda < 1e10)
+      {
+      reducedBlocks.assign(stride * stride * numberOfThreads, 0);
+      reducedGradients.assign(stride * numberOfThreads, 0);
+      failed.assign(numberOfThreads, 0);
+
+      SchurFunctor schur;
+      schur.PoseBlocks = &poseBlocks;
+      schur.PoseGradients = &poseGradients;
+      schur.CouplingBlocks = &couplingBlocks;
+      schur.NumberOfIntrinsics = ni;
+      schur.Lambda = lambda;
+      schur.SolvedGradients = &solvedGradients;
+      schur.SolvedCouplings = &solvedCouplings;
+      schur.ReducedBlocks = &reducedBlocks;
+      schur.ReducedGradients = &reducedGradients;
+      schur.Failed = &failed;
+      Parallel::For(0, numberOfFrames, schur);
+
+      // (V - sum W U^-1 W^T) d = -g + sum W U^-1 g_pose
+      double S[MaximumNumberOfIntrinsics * MaximumNumberOfIntrinsics];
+      double intrinsicsDelta[MaximumNumberOfIntrinsics];
+      for(unsigned int a = 0; a < ni; ++a)
+        {
+        intrinsicsDelta[a] = -intrinsicGradient[a];
+        for(unsigned int b = 0; b < ni; ++b)
+          {
+          S[ni * a + b] = V[ni * a + b];
+          }
+        S[ni * a + a] += lambda * (V[ni * a + a] + 1e-12);
+        }
+      bool factored = std::find(failed.begin(), failed.end(), 1) == failed.end();
+      for(unsigned int thread = 0; thread < numberOfThreads && factored; ++thread)
+        {
+        for(unsigned int a = 0; a < ni; ++a)
+          {
+          intrinsicsDelta[a] += reducedGradients[stride * thread + a];
+          for(unsigned int b = 0; b < ni; ++b)
+            {
+            S[ni * a + b] -= reducedBlocks[stride * stride * thread + stride * a + b];
+            }
+          }
+        }
+      if(!factored || !CholeskyFactor(S, ni))
+        {
+        lambda *= 10;
+        continue;
+        }
+      CholeskySubstitute(S, intrinsicsDelta, ni);
+
+      std::vector<Camera> candidates = this->Cameras;
+      double intrinsics[MaximumNumberOfIntrinsics];
+      GetIntrinsicParameters(this->Cameras[0], intrinsics);
+      for(unsigned int k = 0; k < ni; ++k)
+        {
+        intrinsics[intrinsicParameters[k]] += intrinsicsDelta[k];
+        }
+      for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+        {
+        // d_pose = -U^-1 g_pose - U^-1 W^T d
+        const double* solvedGradient = &solvedGradients[6 * frame];
+        const double* solvedCoupling = &solvedCouplings[6 * stride * frame];
+        double poseDelta[6];
+        for(unsigned int k = 0; k < 6; ++k)
+          {
+          poseDelta[k] = -solvedGradient[k];
+          for(unsigned int a = 0; a < ni; ++a)
+            {
+            poseDelta[k] -= solvedCoupling[6 * a + k] * intrinsicsDelta[a];
+            }
+          }
+        UpdatePose(candidates[frame], poseDelta);
+        SetIntrinsicParameters(intrinsics, candidates[frame]);
+        }
+
+      double candidateCost = ComputeCost(candidates);
+      if(candidateCost < cost)
+        {
+        improved = true;
+        stepTaken = true;
+        converged = cost - candidateCost < 1e-10 * cost;
+        this->Cameras = candidates;
+        cost = candidateCost;
+        lambda = std::max(1e-12, lambda * 0.1);
+        }
+      else
+        {
+        lambda *= 10;
+        }
+      }
+    if(!improved)
+      {
+      break;
+      }
+    this->NumberOfIterations++;
+    }
+
+  if(!stepTaken && cost > 0)
+    {
+    std::cerr << "CameraCalibration: no step reduced the error." << std::endl;
+    return false;
+    }
+  return true;
+}
+
+bool CalibrationStore::Read(const std::string& fileName)
+{
+  std::ifstream fin(fileName.c_str());
+  if(!fin)
+    {
+    // Nothing has been calibrated yet
+    this->Calibrations.clear();
+    return true;
+    }
+
+  std::map<std::string, CameraIntrinsics> calibrations;
+  std::string line;
+  unsigned int lineNumber = 0;
+  while(std::getline(fin, line))
+    {
+    lineNumber++;
+    std::istringstream ss(line);
+    std::string cameraId;
+    if(!(ss >> cameraId) || cameraId[0] == '#')
+      {
+      continue;
+      }
+    CameraIntrinsics intrinsics;
+    if(!(ss >> intrinsics.FocalLength >> intrinsics.PrincipalPoint[0] >> intrinsics.PrincipalPoint[1]
+            >> intrinsics.Distortion[0] >> intrinsics.Distortion[1] >> intrinsics.Distortion[2]
+            >> intrinsics.Distortion[3] >> intrinsics.NumberOfFrames >> intrinsics.NumberOfObservations
+            >> intrinsics.RMSError))
+      {
+      std::cerr << fileName << " line " << lineNumber << " is not valid: " << line << std::endl;
+      return false;
+      }
+    calibrations[cameraId] = intrinsics;
+    }
+
+  this->Calibrations = calibrations;
+  return true;
+}
+
+bool CalibrationStore::Write(const std::string& fileName) const
+{
+  std::ofstream fout(fileName.c_str());
+  if(!fout)
+    {
+    std::cerr << "Cannot write " << fileName << std::endl;
+    return false;
+    }
+  fout.precision(15);
+
+  for(std::map<std::string, CameraIntrinsics>::const_iterator iterator = this->Calibrations.begin();
+      iterator != this->Calibrations.end(); ++iterator)
+    {
+    const CameraIntrinsics& intrinsics = iterator->second;
+    fout << iterator->first << " " << intrinsics.FocalLength << " " << intrinsics.PrincipalPoint[0] << " "
+         << intrinsics.PrincipalPoint[1] << " " << intrinsics.Distortion[0] << " " << intrinsics.Distortion[1] << " "
+         << intrinsics.Distortion[2] << " " << intrinsics.Distortion[3] << " " << intrinsics.NumberOfFrames << " "
+         << intrinsics.NumberOfObservations << " " << intrinsics.RMSError << std::endl;
+    }
+  return fout.good();
+}
+
+bool CalibrationStore::Find(const std::string& cameraId, CameraIntrinsics& intrinsics) const
+{
+  std::map<std::string, CameraIntrinsics>::const_iterator iterator = this->Calibrations.find(cameraId);
+  if(iterator == this->Calibrations.end())
+    {
+    return false;
+    }
+  intrinsics = iterator->second;
+  return true;
+}
+
+void CalibrationStore::Set(const std::string& cameraId, const CameraIntrinsics& intrinsics)
+{
+  this->Calibrations[cameraId] = intrinsics;
+}
+
+void CalibrationStore::Remove(const std::string& cameraId)
+{
+  this->Calibrations.erase(cameraId);
+}
@@ -0,0 +1,148 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef CAMERACALIBRATION_H
+#define CAMERACALIBRATION_H
+
+// STL
+#include <map>
+#include <string>
+#include <vector>
+
+// Custom
+#include "Camera.h"
+#include "Coord.h"
+
+// The intrinsics of one physical camera: what does not change from frame to frame
+struct CameraIntrinsics
+{
+  CameraIntrinsics();
+
+  double FocalLength;
+  double PrincipalPoint[2];
+  double Distortion[4]; // k1, k2, p1, p2 (see Camera)
+
+  // How the calibration was obtained
+  unsigned int NumberOfFrames;
+  unsigned int NumberOfObservations;
+  double RMSError; // pixels, over the inliers
+
+  // Copy the intrinsics from / to a camera, leaving its pose alone
+  void Get(const Camera& camera);
+  void Apply(Camera& camera) const;
+};
+
+// Calibration of one camera from the correspondences of many frames taken with it: the focal length,
+// principal point and distortion, shared by all frames, are estimated together with the pose of each
+// frame by Levenberg-Marquardt on the reprojection error. The world points are fixed.
+//
+// Picked correspondences contain mistakes, so the error is robust (Huber): residuals longer than
+// RobustThreshold pixels count linearly, so they cannot pull the solution. Each step eliminates the
+// poses (a 6 x 6 block per frame) from the normal equations by the Schur complement, which leaves a
+// small system in the intrinsics; the frames are linearized and eliminated in parallel.
+// The distortion is estimated only after the focal length and principal point have converged without it.
+class CameraCalibration
+{
+public:
+  CameraCalibration();
+
+  // Add a frame and its correspondences; 'camera' is its starting pose (e.g. from PoseEstimation::EstimateCamera).
+  // Returns the frame's index.
+  unsigned int AddFrame(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                        const Camera& camera);
+  unsigned int GetNumberOfFrames() const;
+
+  // Estimate the principal point (default true); otherwise it is the average of the starting cameras
+  void SetRefinePrincipalPoint(const bool refine);
+  // Estimate k1, k2 (default true) and p1, p2 (default true)
+  void SetRefineRadialDistortion(const bool refine);
+  void SetRefineTangentialDistortion(const bool refine);
+
+  // Residuals longer than this (pixels) are down weighted. Default 2.
+  void SetRobustThreshold(const double threshold);
+
+  void SetMaximumNumberOfIterations(const unsigned int iterations);
+
+  // Returns false if there are not enough correspondences or no step could be taken
+  bool Calibrate();
+
+  const CameraIntrinsics& GetIntrinsics() const;
+  const Camera& GetCamera(const unsigned int frame) const;
+
+  // RMS over all observations before and after Calibrate
+  double GetInitialRMSError() const;
+  double GetFinalRMSError() const;
+
+  // Observations further than 3 robust thresholds from their projection after Calibrate
+  unsigned int GetNumberOfOutliers() const;
+
+  unsigned int GetNumberOfIterations() const;
+
+  // Internal layout, public so the parallel functors can use it
+  struct FrameData
+  {
+    std::vector<Coord2D> ImagePoints;
+    std::vector<Coord3D> WorldPoints;
+  };
+
+private:
+  std::vector<FrameData> Frames;
+  std::vector<Camera> Cameras;
+
+  bool RefinePrincipalPoint;
+  bool RefineRadialDistortion;
+  bool RefineTangentialDistortion;
+  double RobustThreshold;
+  unsigned int MaximumNumberOfIterations;
+
+  CameraIntrinsics Intrinsics;
+  double InitialRMSError;
+  double FinalRMSError;
+  unsigned int NumberOfOutliers;
+  unsigned int NumberOfIterations;
+
+  // Levenberg-Marquardt over the given intrinsics (indices into f, cx, cy, k1, k2, p1, p2) and all poses
+  bool Optimize(const std::vector<unsigned int>& intrinsicParameters);
+
+  // The robust cost over all frames
+  double ComputeCost(const std::vector<Camera>& cameras) const;
+
+  // Update the RMS error, inlier RMS and outlier count
+  void ComputeStatistics();
+};
+
+// Calibrations of the cameras a dataset was taken with, by camera id, kept in a text file so they
+// are estimated once and then reused by every frame from the same camera:
+//   <camera id> <focal length> <principal point (2)> <distortion (4)> <frames> <observations> <rms error>
+// one camera per line. Ids may not contain white space.
+class CalibrationStore
+{
+public:
+  bool Read(const std::string& fileName);
+  bool Write(const std::string& fileName) const;
+
+  // Returns false if the camera has not been calibrated
+  bool Find(const std::string& cameraId, CameraIntrinsics& intrinsics) const;
+  void Set(const std::string& cameraId, const CameraIntrinsics& intrinsics);
+  void Remove(const std::string& cameraId);
+
+private:
+  std::map<std::string, CameraIntrinsics> Calibrations;
+};
+
+#endif
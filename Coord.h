@@ -1,14 +1,17 @@
 #ifndef Coord_H
 #define Coord_H
 
+// Keypoint coordinates are kept in double precision. Point clouds are stored in float relative to a
+// local origin (see Helpers::ShiftToLocalOrigin), but georeferenced coordinates (e.g. UTM, around 1e6)
+// need all of double's digits once the origin is added back.
 struct Coord2D
 {
-  float x,y;
+  double x,y;
 };
 
 struct Coord3D
 {
-  float x,y,z;
+  double x,y,z;
 };
 
 #endif
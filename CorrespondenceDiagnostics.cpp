@@ -0,0 +1,291 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "CorrespondenceDiagnostics.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+// Custom
+#include "CameraCalibration.h"
+#include "Parallel.h"
+#include "PoseEstimation.h"
+#include "Session.h"
+
+namespace
+{
+
+// Reprojection error of one pair, or HUGE_VAL behind the camera
+double ComputeResidual(const Camera& camera, const Coord2D& imagePoint, const Coord3D& worldPoint)
+{
+  double world[3] = {worldPoint.x, worldPoint.y, worldPoint.z};
+  double pixel[2];
+  if(!camera.Project(world, pixel))
+    {
+    return HUGE_VAL;
+    }
+  double du = pixel[0] - imagePoint.x;
+  double dv = pixel[1] - imagePoint.y;
+  return sqrt(du * du + dv * dv);
+}
+
+// Re-solve the pose without each pair of the block
+struct LeaveOneOutFunctor
+{
+  const std::vector<Coord2D>* ImagePoints;
+  const std::vector<Coord3D>* WorldPoints;
+  const Camera* Solution;
+  // The projections of all points under Solution
+  const std::vector<Coord2D>* Projections;
+  bool RefineFocalLength;
+  std::vector<CorrespondenceDiagnostic>* Diagnostics;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    const unsigned int numberOfPairs = this->ImagePoints->size();
+    std::vector<Coord2D> imagePoints(numberOfPairs - 1);
+    std::vector<Coord3D> worldPoints(numberOfPairs - 1);
+    for(vtkIdType left = begin; left < end; ++left)
+      {
+      unsigned int k = 0;
+      for(unsigned int i = 0; i < numberOfPairs; ++i)
+        {
+        if(static_cast<vtkIdType>(i) != left)
+          {
+          imagePoints[k] = (*this->ImagePoints)[i];
+          worldPoints[k] = (*this->WorldPoints)[i];
+          k++;
+          }
+        }
+
+      CorrespondenceDiagnostic& diagnostic = (*this->Diagnostics)[left];
+      // Leaving one pair out moves the solution only a little, so a few iterations from it are enough
+      Camera camera = *this->Solution;
+      if(!PoseEstimation::RefineCamera(imagePoints, worldPoints, this->RefineFocalLength, camera, 5))
+        {
+        continue;
+        }
+      diagnostic.Solved = true;
+
+      const Coord2D& imagePoint = (*this->ImagePoints)[left];
+      const Coord3D& worldPoint = (*this->WorldPoints)[left];
+      diagnostic.PredictionResidual = ComputeResidual(camera, imagePoint, worldPoint);
+
+      // Distance from the point to the ray through its keypoint
+      double pixel[2] = {imagePoint.x, imagePoint.y};
+      double origin[3];
+      double direction[3];
+      camera.GetRay(pixel, origin, direction);
+      double offset[3] = {worldPoint.x - origin[0], worldPoint.y - origin[1], worldPoint.z - origin[2]};
+      double along = offset[0] * direction[0] + offset[1] * direction[1] + offset[2] * direction[2];
+      double squaredDistance = 0;
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        double across = offset[d] - along * direction[d];
+        squaredDistance += across * across;
+        }
+      diagnostic.WorldError = along > 0 ? sqrt(squaredDistance) : HUGE_VAL;
+
+      // How far the other pairs' projections move without this one
+      double sumOfSquares = 0;
+      for(unsigned int i = 0; i < worldPoints.size(); ++i)
+        {
+        double world[3] = {worldPoints[i].x, worldPoints[i].y, worldPoints[i].z};
+        double projection[2];
+        if(!camera.Project(world, projection))
+          {
+          sumOfSquares = HUGE_VAL;
+          break;
+          }
+        const Coord2D& full = (*this->Projections)[static_cast<vtkIdType>(i) < left ? i : i + 1];
+        double du = projection[0] - full.x;
+        double dv = projection[1] - full.y;
+        sumOfSquares += du * du + dv * dv;
+        }
+      diagnostic.Influence = sqrt(sumOfSquares / worldPoints.size());
+      }
+  }
+};
+
+} // end anonymous namespace
+
+CorrespondenceDiagnostic::CorrespondenceDiagnostic() : Solved(false), Residual(0), PredictionResidual(HUGE_VAL),
+                                                       WorldError(HUGE_VAL), Influence(HUGE_VAL), Score(0)
+{
+}
+
+namespace CorrespondenceDiagnostics
+{
+
+bool Compute(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints, const Camera& camera,
+             const bool refineFocalLength, Camera& solution, std::vector<CorrespondenceDiagnostic>& diagnostics)
+{
+  const unsigned int minimumNumberOfPairs = refineFocalLength ? 6 : 5;
+  if(imagePoints.size() != worldPoints.size() || imagePoints.size() < minimumNumberOfPairs)
+    {
+    std::cerr << "CorrespondenceDiagnostics: at least " << minimumNumberOfPairs << " keypoint pairs are required (got "
+              << imagePoints.size() << " image and " << worldPoints.size() << " world points)." << std::endl;
+    return false;
+    }
+  const unsigned int numberOfPairs = imagePoints.size();
+
+  solution = camera;
+  if(!PoseEstimation::RefineCamera(imagePoints, worldPoints, refineFocalLength, solution))
+    {
+    return false;
+    }
+
+  diagnostics.assign(numberOfPairs, CorrespondenceDiagnostic());
+  std::vector<Coord2D> projections(numberOfPairs);
+  for(unsigned int i = 0; i < numberOfPairs; ++i)
+    {
+    diagnostics[i].Residual = ComputeResidual(solution, imagePoints[i], worldPoints[i]);
+    double world[3] = {worldPoints[i].x, worldPoints[i].y, worldPoints[i].z};
+    double pixel[2] = {HUGE_VAL, HUGE_VAL};
+    solution.Project(world, pixel);
+    projections[i].x = pixel[0];
+    projections[i].y = pixel[1];
+    }
+
+  LeaveOneOutFunctor functor;
+  functor.ImagePoints = &imagePoints;
+  functor.WorldPoints = &worldPoints;
+  functor.Solution = &solution;
+  functor.Projections = &projections;
+  functor.RefineFocalLength = refineFocalLength;
+  functor.Diagnostics = &diagnostics;
+  Parallel::For(0, numberOfPairs, functor);
+
+  // The median length of a 2D Gaussian residual is 1.1774 standard deviations. Keypoints are not picked
+  // more precisely than a quarter pixel, so a near perfect fit does not make every pair an outlier.
+  // Pairs whose re-solve failed have no prediction and are left out, so they cannot make the median infinite.
+  std::vector<double> predictionResiduals;
+  for(unsigned int i = 0; i < numberOfPairs; ++i)
+    {
+    if(diagnostics[i].Solved)
+      {
+      predictionResiduals.push_back(diagnostics[i].PredictionResidual);
+      }
+    }
+  if(predictionResiduals.size() < numberOfPairs)
+    {
+    std::cout << "CorrespondenceDiagnostics: the pose could not be solved without " << numberOfPairs -
+                 predictionResiduals.size() << " of the " << numberOfPairs << " pairs; they are not scored."
+              << std::endl;
+    }
+  if(predictionResiduals.empty())
+    {
+    return true;
+    }
+  const unsigned int middle = predictionResiduals.size() / 2;
+  std::nth_element(predictionResiduals.begin(), predictionResiduals.begin() + middle, predictionResiduals.end());
+  double sigma = std::max(0.25, predictionResiduals[middle] / 1.1774);
+  for(unsigned int i = 0; i < numberOfPairs; ++i)
+    {
+    if(diagnostics[i].Solved)
+      {
+      diagnostics[i].Score = diagnostics[i].PredictionResidual / sigma;
+      }
+    }
+  return true;
+}
+
+void WriteHeader(std::ostream& output)
+{
+  output << "# frame pair u v x y z solved residual prediction_residual world_error influence score" << std::endl;
+}
+
+void Write(std::ostream& output, const unsigned int frame, const std::vector<Coord2D>& imagePoints,
+           const std::vector<Coord3D>& worldPoints, const std::vector<CorrespondenceDiagnostic>& diagnostics)
+{
+  std::streamsize precision = output.precision(15); // World coordinates may be georeferenced
+  for(unsigned int i = 0; i < diagnostics.size(); ++i)
+    {
+    const CorrespondenceDiagnostic& diagnostic = diagnostics[i];
+    output << frame << " " << i << " " << imagePoints[i].x << " " << imagePoints[i].y << " "
+           << worldPoints[i].x << " " << worldPoints[i].y << " " << worldPoints[i].z << " "
+           << diagnostic.Solved << " " << diagnostic.Residual << " " << diagnostic.PredictionResidual << " " << diagnostic.WorldError << " "
+           << diagnostic.Influence << " " << diagnostic.Score << std::endl;
+    }
+  output.precision(precision);
+}
+
+bool WriteSession(const Session& session, const CalibrationStore& calibrations, const std::string& fileName)
+{
+  std::ofstream fout(fileName.c_str());
+  if(!fout)
+    {
+    std::cerr << "Cannot write " << fileName << std::endl;
+    return false;
+    }
+  WriteHeader(fout);
+
+  unsigned int numberOfFrames = 0;
+  unsigned int numberOfOutliers = 0;
+  unsigned int numberOfUnsolved = 0;
+  for(unsigned int frameIndex = 0; frameIndex < session.Frames.size(); ++frameIndex)
+    {
+    const SessionFrame& frame = session.Frames[frameIndex];
+    CameraIntrinsics intrinsics;
+    const bool calibrated = !frame.CameraId.empty() && calibrations.Find(frame.CameraId, intrinsics);
+
+    // Frames (1 based, like the frame list) without a pose get one from their keypoints
+    Camera camera = frame.Pose;
+    bool hasPose = frame.HasPose;
+    if(calibrated)
+      {
+      intrinsics.Apply(camera);
+      }
+    if(!hasPose && frame.ImagePoints.size() == frame.WorldPoints.size())
+      {
+      hasPose = calibrated ? PoseEstimation::EstimatePose(frame.ImagePoints, frame.WorldPoints, false, camera) :
+                             PoseEstimation::EstimateCamera(frame.ImagePoints, frame.WorldPoints, camera);
+      }
+
+    Camera solution;
+    std::vector<CorrespondenceDiagnostic> diagnostics;
+    if(!hasPose || !Compute(frame.ImagePoints, frame.WorldPoints, camera, !calibrated, solution, diagnostics))
+      {
+      std::cout << "Frame " << frameIndex + 1 << " (" << frame.ImageFileName << ") is skipped." << std::endl;
+      continue;
+      }
+    Write(fout, frameIndex + 1, frame.ImagePoints, frame.WorldPoints, diagnostics);
+    numberOfFrames++;
+    for(unsigned int i = 0; i < diagnostics.size(); ++i)
+      {
+      if(!diagnostics[i].Solved)
+        {
+        numberOfUnsolved++;
+        }
+      else if(diagnostics[i].Score > OutlierScore)
+        {
+        numberOfOutliers++;
+        }
+      }
+    }
+
+  std::cout << "Wrote the diagnostics of " << numberOfFrames << " frames to " << fileName << "; " << numberOfOutliers
+            << " pairs score above " << OutlierScore << " and " << numberOfUnsolved << " could not be scored."
+            << std::endl;
+  return fout.good();
+}
+
+} // end namespace
@@ -0,0 +1,76 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef CORRESPONDENCEDIAGNOSTICS_H
+#define CORRESPONDENCEDIAGNOSTICS_H
+
+// STL
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Custom
+#include "Camera.h"
+#include "Coord.h"
+
+class CalibrationStore;
+class Session;
+
+// How one keypoint pair fits the pose solved from all the pairs, and from the others alone
+struct CorrespondenceDiagnostic
+{
+  CorrespondenceDiagnostic();
+
+  bool Solved;               // the pose could be solved without this pair; if not, only Residual is set
+  double Residual;           // pixels, reprojection error under the pose from all pairs
+  double PredictionResidual; // pixels, reprojection error under the pose from the other pairs
+  double WorldError;         // world units, distance of the point from the ray through its keypoint (other pairs)
+  double Influence;          // pixels, RMS movement of the other pairs' projections when this pair is left out
+  double Score;              // PredictionResidual in robust standard deviations of the prediction residuals of
+                             // the solved pairs; 0 if not Solved
+};
+
+// Leave-one-out diagnostics of a set of keypoint pairs: a mistaken pair is predicted badly by the pose
+// solved from the others, and pulls that pose (it has influence) if it is the only evidence for it.
+namespace CorrespondenceDiagnostics
+{
+
+// Pairs scoring above this are likely mistakes
+const double OutlierScore = 3.0;
+// and above this worth a look
+const double SuspectScore = 2.0;
+
+// Solve the pose from all the pairs starting from 'camera', then from all but each pair in turn starting from
+// that solution. The focal length is solved for too if refineFocalLength (as for an uncalibrated camera).
+// The pairs are left out in parallel. 'solution' receives the pose from all pairs.
+// At least 5 pairs (6 with the focal length) are required.
+bool Compute(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints, const Camera& camera,
+             const bool refineFocalLength, Camera& solution, std::vector<CorrespondenceDiagnostic>& diagnostics);
+
+// A table row per pair, with a header from WriteHeader. Pairs that were not Solved have solved 0.
+void WriteHeader(std::ostream& output);
+void Write(std::ostream& output, const unsigned int frame, const std::vector<Coord2D>& imagePoints,
+           const std::vector<Coord3D>& worldPoints, const std::vector<CorrespondenceDiagnostic>& diagnostics);
+
+// The diagnostics of every frame of a session that has enough pairs, in one table. Frames of a calibrated
+// camera are solved with its intrinsics, the others with their own focal length.
+bool WriteSession(const Session& session, const CalibrationStore& calibrations, const std::string& fileName);
+
+} // end namespace
+
+#endif
@@ -0,0 +1,555 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "CorrespondenceModel.h"
+
+// STL
+#include <algorithm>
+
+CorrespondenceModel::CorrespondenceModel()
+{
+  Clear();
+}
+
+void CorrespondenceModel::Clear()
+{
+  // The views remove the markers of everything that was here
+  for(Id id = GetFirst(); id != 0; id = GetNext(id))
+    {
+    this->Changed.push_back(id);
+    }
+
+  // Only the heads of the lists are left
+  this->ImageX.assign(1, 0);
+  this->ImageY.assign(1, 0);
+  this->WorldX.assign(1, 0);
+  this->WorldY.assign(1, 0);
+  this->WorldZ.assign(1, 0);
+  this->Flags.assign(1, 0);
+  this->Previous.assign(1, 0);
+  this->Next.assign(1, 0);
+  for(unsigned int kind = 0; kind < 2; ++kind)
+    {
+    this->WaitingPrevious[kind].assign(1, 0);
+    this->WaitingNext[kind].assign(1, 0);
+    }
+
+  this->NumberOfCorrespondences = 0;
+  this->NumberOfPairs = 0;
+  this->UndoStack.clear();
+  this->RedoStack.clear();
+}
+
+void CorrespondenceModel::Set(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints)
+{
+  Clear();
+
+  const unsigned int numberOfCorrespondences = std::max(imagePoints.size(), worldPoints.size());
+  for(unsigned int i = 0; i < numberOfCorrespondences; ++i)
+    {
+    Id id = CreateCorrespondence();
+    if(i < imagePoints.size())
+      {
+      double value[3] = {imagePoints[i].x, imagePoints[i].y, 0};
+      SetKeypoint(id, ImageKind, true, value);
+      }
+    if(i < worldPoints.size())
+      {
+      double value[3] = {worldPoints[i].x, worldPoints[i].y, worldPoints[i].z};
+      SetKeypoint(id, WorldKind, true, value);
+      }
+    }
+}
+
+CorrespondenceModel::Id CorrespondenceModel::AddImagePoint(const Coord2D& imagePoint)
+{
+  Id id = this->WaitingNext[ImageKind][0];
+  if(id == 0)
+    {
+    id = CreateCorrespondence();
+    }
+  SetImagePoint(id, imagePoint);
+  return id;
+}
+
+CorrespondenceModel::Id CorrespondenceModel::AddWorldPoint(const Coord3D& worldPoint)
+{
+  Id id = this->WaitingNext[WorldKind][0];
+  if(id == 0)
+    {
+    id = CreateCorrespondence();
+    }
+  SetWorldPoint(id, worldPoint);
+  return id;
+}
+
+CorrespondenceModel::Id CorrespondenceModel::AddPair(const Coord2D& imagePoint, const Coord3D& worldPoint)
+{
+  Id id = CreateCorrespondence();
+  double image[3] = {imagePoint.x, imagePoint.y, 0};
+  double world[3] = {worldPoint.x, worldPoint.y, worldPoint.z};
+  EditKeypoint(id, ImageKind, true, image, false);
+  EditKeypoint(id, WorldKind, true, world, true);
+  return id;
+}
+
+void CorrespondenceModel::SetImagePoint(const Id id, const Coord2D& imagePoint)
+{
+  double value[3] = {imagePoint.x, imagePoint.y, 0};
+  EditKeypoint(id, ImageKind, true, value, false);
+}
+
+void CorrespondenceModel::SetWorldPoint(const Id id, const Coord3D& worldPoint)
+{
+  double value[3] = {worldPoint.x, worldPoint.y, worldPoint.z};
+  EditKeypoint(id, WorldKind, true, value, false);
+}
+
+void CorrespondenceModel::RemoveImagePoint(const Id id)
+{
+  if(HasImagePoint(id))
+    {
+    EditKeypoint(id, ImageKind, false, 0, false);
+    }
+}
+
+void CorrespondenceModel::RemoveWorldPoint(const Id id)
+{
+  if(HasWorldPoint(id))
+    {
+    EditKeypoint(id, WorldKind, false, 0, false);
+    }
+}
+
+void CorrespondenceModel::Remove(const Id id)
+{
+  bool joined = false;
+  if(HasImagePoint(id))
+    {
+    EditKeypoint(id, ImageKind, false, 0, joined);
+    joined = true;
+    }
+  if(HasWorldPoint(id))
+    {
+    EditKeypoint(id, WorldKind, false, 0, joined);
+    }
+}
+
+void CorrespondenceModel::RemoveAllImagePoints()
+{
+  bool joined = false;
+  Id id = GetFirst();
+  while(id != 0)
+    {
+    // Removing the keypoint may delete the correspondence
+    Id next = GetNext(id);
+    if(HasImagePoint(id))
+      {
+      EditKeypoint(id, ImageKind, false, 0, joined);
+      joined = true;
+      }
+    id = next;
+    }
+}
+
+void CorrespondenceModel::RemoveAllWorldPoints()
+{
+  bool joined = false;
+  Id id = GetFirst();
+  while(id != 0)
+    {
+    Id next = GetNext(id);
+    if(HasWorldPoint(id))
+      {
+      EditKeypoint(id, WorldKind, false, 0, joined);
+      joined = true;
+      }
+    id = next;
+    }
+}
+
+void CorrespondenceModel::Move(const Id id, const Id before)
+{
+  if(!Contains(id) || (before != 0 && !Contains(before)) || before == id || this->Next[id] == before)
+    {
+    return;
+    }
+  EditOrder(id, before, false);
+}
+
+void CorrespondenceModel::SwapWorldPoints(const Id first, const Id second)
+{
+  if(!Contains(first) || !Contains(second) || first == second)
+    {
+    return;
+    }
+  // Nothing to exchange, so no step to undo
+  if(!HasWorldPoint(first) && !HasWorldPoint(second))
+    {
+    return;
+    }
+
+  bool firstPresent = HasWorldPoint(first);
+  bool secondPresent = HasWorldPoint(second);
+  double firstValue[3] = {this->WorldX[first], this->WorldY[first], this->WorldZ[first]};
+  double secondValue[3] = {this->WorldX[second], this->WorldY[second], this->WorldZ[second]};
+  EditKeypoint(first, WorldKind, secondPresent, secondValue, false);
+  EditKeypoint(second, WorldKind, firstPresent, firstValue, true);
+}
+
+bool CorrespondenceModel::Undo()
+{
+  if(this->UndoStack.empty())
+    {
+    return false;
+    }
+
+  bool joined = true;
+  while(joined && !this->UndoStack.empty())
+    {
+    Edit edit = this->UndoStack.back();
+    this->UndoStack.pop_back();
+    Apply(edit, false);
+    this->RedoStack.push_back(edit);
+    joined = edit.Joined;
+    }
+  return true;
+}
+
+bool CorrespondenceModel::Redo()
+{
+  if(this->RedoStack.empty())
+    {
+    return false;
+    }
+
+  do
+    {
+    Edit edit = this->RedoStack.back();
+    this->RedoStack.pop_back();
+    Apply(edit, true);
+    this->UndoStack.push_back(edit);
+    } while(!this->RedoStack.empty() && this->RedoStack.back().Joined);
+  return true;
+}
+
+bool CorrespondenceModel::CanUndo() const
+{
+  return !this->UndoStack.empty();
+}
+
+bool CorrespondenceModel::CanRedo() const
+{
+  return !this->RedoStack.empty();
+}
+
+bool CorrespondenceModel::Has(const Id id, const unsigned char flag) const
+{
+  return id != 0 && id < this->Flags.size() && (this->Flags[id] & flag);
+}
+
+bool CorrespondenceModel::Contains(const Id id) const
+{
+  return Has(id, HasImage | HasWorld);
+}
+
+bool CorrespondenceModel::HasImagePoint(const Id id) const
+{
+  return Has(id, HasImage);
+}
+
+bool CorrespondenceModel::HasWorldPoint(const Id id) const
+{
+  return Has(id, HasWorld);
+}
+
+Coord2D CorrespondenceModel::GetImagePoint(const Id id) const
+{
+  Coord2D imagePoint;
+  imagePoint.x = this->ImageX[id];
+  imagePoint.y = this->ImageY[id];
+  return imagePoint;
+}
+
+Coord3D CorrespondenceModel::GetWorldPoint(const Id id) const
+{
+  Coord3D worldPoint;
+  worldPoint.x = this->WorldX[id];
+  worldPoint.y = this->WorldY[id];
+  worldPoint.z = this->WorldZ[id];
+  return worldPoint;
+}
+
+CorrespondenceModel::Id CorrespondenceModel::GetFirst() const
+{
+  return this->Next.empty() ? 0 : this->Next[0];
+}
+
+CorrespondenceModel::Id CorrespondenceModel::GetLast() const
+{
+  return this->Previous.empty() ? 0 : this->Previous[0];
+}
+
+CorrespondenceModel::Id CorrespondenceModel::GetNext(const Id id) const
+{
+  return this->Next[id];
+}
+
+CorrespondenceModel::Id CorrespondenceModel::GetPrevious(const Id id) const
+{
+  return this->Previous[id];
+}
+
+unsigned int CorrespondenceModel::GetNumberOfCorrespondences() const
+{
+  return this->NumberOfCorrespondences;
+}
+
+unsigned int CorrespondenceModel::GetNumberOfPairs() const
+{
+  return this->NumberOfPairs;
+}
+
+CorrespondenceModel::Id CorrespondenceModel::GetEndId() const
+{
+  return this->Flags.size();
+}
+
+void CorrespondenceModel::GetPairs(std::vector<Coord2D>& imagePoints, std::vector<Coord3D>& worldPoints,
+                                   std::vector<Id>* ids) const
+{
+  imagePoints.clear();
+  worldPoints.clear();
+  if(ids)
+    {
+    ids->clear();
+    }
+  for(Id id = GetFirst(); id != 0; id = GetNext(id))
+    {
+    if(HasImagePoint(id) && HasWorldPoint(id))
+      {
+      imagePoints.push_back(GetImagePoint(id));
+      worldPoints.push_back(GetWorldPoint(id));
+      if(ids)
+        {
+        ids->push_back(id);
+        }
+      }
+    }
+}
+
+void CorrespondenceModel::GetKeypoints(std::vector<Coord2D>& imagePoints, std::vector<Coord3D>& worldPoints) const
+{
+  GetPairs(imagePoints, worldPoints);
+  for(Id id = GetFirst(); id != 0; id = GetNext(id))
+    {
+    if(!HasWorldPoint(id))
+      {
+      imagePoints.push_back(GetImagePoint(id));
+      }
+    else if(!HasImagePoint(id))
+      {
+      worldPoints.push_back(GetWorldPoint(id));
+      }
+    }
+}
+
+void CorrespondenceModel::TakeChanged(std::vector<Id>& changed)
+{
+  changed.clear();
+  changed.swap(this->Changed);
+}
+
+CorrespondenceModel::Id CorrespondenceModel::CreateCorrespondence()
+{
+  Id id = this->Flags.size();
+  this->ImageX.push_back(0);
+  this->ImageY.push_back(0);
+  this->WorldX.push_back(0);
+  this->WorldY.push_back(0);
+  this->WorldZ.push_back(0);
+  this->Flags.push_back(0);
+  // Not linked until it has a keypoint
+  this->Previous.push_back(GetLast());
+  this->Next.push_back(0);
+  for(unsigned int kind = 0; kind < 2; ++kind)
+    {
+    this->WaitingPrevious[kind].push_back(0);
+    this->WaitingNext[kind].push_back(0);
+    }
+  return id;
+}
+
+void CorrespondenceModel::EditKeypoint(const Id id, const unsigned char kind, const bool present,
+                                       const double value[3], const bool joined)
+{
+  Edit edit;
+  edit.Correspondence = id;
+  edit.Kind = kind;
+  edit.Joined = joined;
+  edit.BeforePresent = Has(id, kind == ImageKind ? HasImage : HasWorld);
+  edit.AfterPresent = present;
+  if(kind == ImageKind)
+    {
+    edit.Before[0] = this->ImageX[id];
+    edit.Before[1] = this->ImageY[id];
+    edit.Before[2] = 0;
+    }
+  else
+    {
+    edit.Before[0] = this->WorldX[id];
+    edit.Before[1] = this->WorldY[id];
+    edit.Before[2] = this->WorldZ[id];
+    }
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    edit.After[i] = value ? value[i] : edit.Before[i];
+    }
+  edit.BeforeNext = edit.AfterNext = 0;
+
+  Apply(edit, true);
+  this->UndoStack.push_back(edit);
+  this->RedoStack.clear();
+}
+
+void CorrespondenceModel::EditOrder(const Id id, const Id before, const bool joined)
+{
+  Edit edit;
+  edit.Correspondence = id;
+  edit.Kind = OrderKind;
+  edit.Joined = joined;
+  edit.BeforePresent = edit.AfterPresent = true;
+  std::fill(edit.Before, edit.Before + 3, 0.0);
+  std::fill(edit.After, edit.After + 3, 0.0);
+  edit.BeforeNext = this->Next[id];
+  edit.AfterNext = before;
+
+  Apply(edit, true);
+  this->UndoStack.push_back(edit);
+  this->RedoStack.clear();
+}
+
+void CorrespondenceModel::Apply(const Edit& edit, const bool forward)
+{
+  if(edit.Kind == OrderKind)
+    {
+    Unlink(edit.Correspondence);
+    Link(edit.Correspondence, forward ? edit.AfterNext : edit.BeforeNext);
+    return;
+    }
+  SetKeypoint(edit.Correspondence, edit.Kind, forward ? edit.AfterPresent : edit.BeforePresent,
+              forward ? edit.After : edit.Before);
+}
+
+void CorrespondenceModel::SetKeypoint(const Id id, const unsigned char kind, const bool present, const double value[3])
+{
+  const bool wasLinked = Contains(id);
+  const bool wasPair = HasImagePoint(id) && HasWorldPoint(id);
+
+  const unsigned char flag = kind == ImageKind ? HasImage : HasWorld;
+  if(present)
+    {
+    this->Flags[id] |= flag;
+    }
+  else
+    {
+    this->Flags[id] &= ~flag;
+    }
+  // A removed keypoint keeps its value, for undo
+  if(kind == ImageKind)
+    {
+    this->ImageX[id] = value[0];
+    this->ImageY[id] = value[1];
+    }
+  else
+    {
+    this->WorldX[id] = value[0];
+    this->WorldY[id] = value[1];
+    this->WorldZ[id] = value[2];
+    }
+
+  // A deleted correspondence keeps its links, which are its neighbors again whenever it is restored:
+  // edits are undone and redone in the reverse order they were made in
+  const bool isLinked = Contains(id);
+  if(isLinked && !wasLinked)
+    {
+    Link(id, this->Next[id]);
+    this->NumberOfCorrespondences++;
+    }
+  else if(wasLinked && !isLinked)
+    {
+    Unlink(id);
+    this->NumberOfCorrespondences--;
+    }
+
+  const bool isPair = HasImagePoint(id) && HasWorldPoint(id);
+  if(isPair && !wasPair)
+    {
+    this->NumberOfPairs++;
+    }
+  else if(wasPair && !isPair)
+    {
+    this->NumberOfPairs--;
+    }
+
+  UpdateWaiting(id);
+  this->Changed.push_back(id);
+}
+
+void CorrespondenceModel::Link(const Id id, const Id before)
+{
+  Id previous = this->Previous[before];
+  this->Previous[id] = previous;
+  this->Next[id] = before;
+  this->Next[previous] = id;
+  this->Previous[before] = id;
+}
+
+void CorrespondenceModel::Unlink(const Id id)
+{
+  this->Next[this->Previous[id]] = this->Next[id];
+  this->Previous[this->Next[id]] = this->Previous[id];
+}
+
+void CorrespondenceModel::UpdateWaiting(const Id id)
+{
+  const unsigned char waitingFlags[2] = {WaitingForImage, WaitingForWorld};
+  const unsigned char keypointFlags[2] = {HasImage, HasWorld};
+  for(unsigned int kind = 0; kind < 2; ++kind)
+    {
+    std::vector<Id>& previous = this->WaitingPrevious[kind];
+    std::vector<Id>& next = this->WaitingNext[kind];
+    bool waiting = Has(id, keypointFlags[1 - kind]) && !Has(id, keypointFlags[kind]);
+    bool listed = Has(id, waitingFlags[kind]);
+    if(waiting && !listed)
+      {
+      // Last in line
+      previous[id] = previous[0];
+      next[id] = 0;
+      next[previous[0]] = id;
+      previous[0] = id;
+      this->Flags[id] |= waitingFlags[kind];
+      }
+    else if(listed && !waiting)
+      {
+      next[previous[id]] = next[id];
+      previous[next[id]] = previous[id];
+      this->Flags[id] &= ~waitingFlags[kind];
+      }
+    }
+}
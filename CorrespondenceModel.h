@@ -0,0 +1,175 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef CORRESPONDENCEMODEL_H
+#define CORRESPONDENCEMODEL_H
+
+// STL
+#include <vector>
+
+// Custom
+#include "Coord.h"
+
+// The keypoint pairs of a frame, shared by the image and point cloud views. Each correspondence has an
+// image keypoint, a point cloud keypoint or both, and an id that does not change while it exists; the
+// views label its markers with the id and only update the markers of the correspondences that changed.
+//
+// The correspondences are kept as arrays indexed by id, one per field, and in a linked list through
+// the same arrays for their order. A deleted correspondence is only unlinked and keeps its slot, so
+// deleting, moving, re-pairing and undoing or redoing any of them take constant time.
+class CorrespondenceModel
+{
+public:
+  // Ids are not reused until Clear; 0 is never a correspondence
+  typedef unsigned int Id;
+
+  CorrespondenceModel();
+
+  // Delete every correspondence and forget the history
+  void Clear();
+
+  // Replace the correspondences by keypoints paired by position (as in a session), without history
+  void Set(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints);
+
+  // Add a keypoint to the correspondence that has waited longest for one of its kind, or to a new
+  // correspondence if none is waiting. Returns the correspondence.
+  Id AddImagePoint(const Coord2D& imagePoint);
+  Id AddWorldPoint(const Coord3D& worldPoint);
+  // Add a new complete correspondence
+  Id AddPair(const Coord2D& imagePoint, const Coord3D& worldPoint);
+
+  // Add or move one keypoint of a correspondence
+  void SetImagePoint(const Id id, const Coord2D& imagePoint);
+  void SetWorldPoint(const Id id, const Coord3D& worldPoint);
+
+  // Remove one keypoint of a correspondence, which then waits for another. A correspondence left
+  // without keypoints is deleted.
+  void RemoveImagePoint(const Id id);
+  void RemoveWorldPoint(const Id id);
+  // Delete a correspondence
+  void Remove(const Id id);
+  // Remove all the keypoints of one kind, as one step
+  void RemoveAllImagePoints();
+  void RemoveAllWorldPoints();
+
+  // Move a correspondence in front of another, or to the end if 'before' is 0
+  void Move(const Id id, const Id before);
+
+  // Re-pair two correspondences by exchanging their point cloud keypoints (not a step if neither has one)
+  void SwapWorldPoints(const Id first, const Id second);
+
+  // Every change above is a step that can be undone, and redone until the next change.
+  // Return false if there is nothing to undo or redo.
+  bool Undo();
+  bool Redo();
+  bool CanUndo() const;
+  bool CanRedo() const;
+
+  bool Contains(const Id id) const;
+  bool HasImagePoint(const Id id) const;
+  bool HasWorldPoint(const Id id) const;
+  Coord2D GetImagePoint(const Id id) const;
+  Coord3D GetWorldPoint(const Id id) const;
+
+  // The correspondences in order: for(Id id = GetFirst(); id != 0; id = GetNext(id))
+  Id GetFirst() const;
+  Id GetLast() const;
+  Id GetNext(const Id id) const;
+  Id GetPrevious(const Id id) const;
+
+  unsigned int GetNumberOfCorrespondences() const;
+  // Correspondences with both keypoints
+  unsigned int GetNumberOfPairs() const;
+  // All ids are smaller than this
+  Id GetEndId() const;
+
+  // The complete pairs in order, and their ids if 'ids' is given
+  void GetPairs(std::vector<Coord2D>& imagePoints, std::vector<Coord3D>& worldPoints, std::vector<Id>* ids = 0) const;
+
+  // The complete pairs followed by the keypoints waiting for a partner, so that Set restores them
+  void GetKeypoints(std::vector<Coord2D>& imagePoints, std::vector<Coord3D>& worldPoints) const;
+
+  // The correspondences whose keypoints were added, moved or removed since the last call (possibly
+  // repeated), for the views to update their markers
+  void TakeChanged(std::vector<Id>& changed);
+
+private:
+  enum Kind {ImageKind, WorldKind, OrderKind};
+
+  enum Flag
+  {
+    HasImage = 1,
+    HasWorld = 2,
+    WaitingForImage = 4,
+    WaitingForWorld = 8
+  };
+
+  // Fields of the correspondences, indexed by id. Slot 0 is the head (and tail) of the order and of the
+  // lists of correspondences waiting for a keypoint of each kind.
+  std::vector<double> ImageX;
+  std::vector<double> ImageY;
+  std::vector<double> WorldX;
+  std::vector<double> WorldY;
+  std::vector<double> WorldZ;
+  std::vector<unsigned char> Flags;
+  std::vector<Id> Previous;
+  std::vector<Id> Next;
+  std::vector<Id> WaitingPrevious[2];
+  std::vector<Id> WaitingNext[2];
+
+  unsigned int NumberOfCorrespondences;
+  unsigned int NumberOfPairs;
+
+  std::vector<Id> Changed;
+
+  // A change to one keypoint (present or not, and where) or to the position of a correspondence
+  // (the one it comes before)
+  struct Edit
+  {
+    Id Correspondence;
+    unsigned char Kind;
+    bool Joined; // undone and redone together with the edit before it
+    bool BeforePresent;
+    bool AfterPresent;
+    double Before[3];
+    double After[3];
+    Id BeforeNext;
+    Id AfterNext;
+  };
+  std::vector<Edit> UndoStack;
+  std::vector<Edit> RedoStack;
+
+  // A correspondence without keypoints, at the end of the order once it gets one
+  Id CreateCorrespondence();
+
+  // Make an edit of one keypoint, or of the order, and record it
+  void EditKeypoint(const Id id, const unsigned char kind, const bool present, const double value[3], const bool joined);
+  void EditOrder(const Id id, const Id before, const bool joined);
+  void Apply(const Edit& edit, const bool forward);
+
+  void SetKeypoint(const Id id, const unsigned char kind, const bool present, const double value[3]);
+  // Insert 'id' in front of 'before' in the order
+  void Link(const Id id, const Id before);
+  void Unlink(const Id id);
+  // Keep the waiting lists in step with the keypoints of 'id'
+  void UpdateWaiting(const Id id);
+
+  bool Has(const Id id, const unsigned char flag) const;
+};
+
+#endif
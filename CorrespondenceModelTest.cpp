@@ -0,0 +1,172 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Reordering and re-pairing correspondences, and undoing and redoing them
+
+// STL
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Custom
+#include "CorrespondenceModel.h"
+
+namespace
+{
+
+unsigned int NumberOfFailures = 0;
+
+void Check(const bool condition, const std::string& description)
+{
+  if(!condition)
+    {
+    std::cerr << "Failed: " << description << std::endl;
+    NumberOfFailures++;
+    }
+}
+
+std::vector<CorrespondenceModel::Id> GetOrder(const CorrespondenceModel& model)
+{
+  std::vector<CorrespondenceModel::Id> order;
+  for(CorrespondenceModel::Id id = model.GetFirst(); id != 0; id = model.GetNext(id))
+    {
+    order.push_back(id);
+    }
+  return order;
+}
+
+bool HasOrder(const CorrespondenceModel& model, const CorrespondenceModel::Id a, const CorrespondenceModel::Id b,
+              const CorrespondenceModel::Id c)
+{
+  std::vector<CorrespondenceModel::Id> order = GetOrder(model);
+  return order.size() == 3 && order[0] == a && order[1] == b && order[2] == c &&
+         model.GetFirst() == a && model.GetLast() == c && model.GetPrevious(c) == b && model.GetPrevious(b) == a;
+}
+
+Coord2D MakeImagePoint(const double value)
+{
+  Coord2D point;
+  point.x = value;
+  point.y = -value;
+  return point;
+}
+
+Coord3D MakeWorldPoint(const double value)
+{
+  Coord3D point;
+  point.x = value;
+  point.y = 2 * value;
+  point.z = 3 * value;
+  return point;
+}
+
+bool HasWorldPoint(const CorrespondenceModel& model, const CorrespondenceModel::Id id, const double value)
+{
+  Coord3D point = model.GetWorldPoint(id);
+  return model.HasWorldPoint(id) && point.x == value && point.y == 2 * value && point.z == 3 * value;
+}
+
+void TestMove()
+{
+  CorrespondenceModel model;
+  CorrespondenceModel::Id a = model.AddPair(MakeImagePoint(1), MakeWorldPoint(1));
+  CorrespondenceModel::Id b = model.AddPair(MakeImagePoint(2), MakeWorldPoint(2));
+  CorrespondenceModel::Id c = model.AddPair(MakeImagePoint(3), MakeWorldPoint(3));
+
+  model.Move(c, a);
+  Check(HasOrder(model, c, a, b), "Move in front of the first");
+  model.Move(c, 0);
+  Check(HasOrder(model, a, b, c), "Move to the end");
+  model.Move(a, c);
+  Check(HasOrder(model, b, a, c), "Move in front of the last");
+
+  Check(model.Undo() && HasOrder(model, a, b, c), "Undo a move");
+  Check(model.Undo() && HasOrder(model, c, a, b), "Undo a second move");
+  Check(model.Redo() && HasOrder(model, a, b, c), "Redo a move");
+  Check(model.Redo() && HasOrder(model, b, a, c), "Redo a second move");
+  Check(!model.CanRedo(), "Nothing left to redo");
+
+  // Moving in front of itself, or where it already is, is not a step
+  model.Move(a, a);
+  model.Move(a, c);
+  Check(model.Undo() && HasOrder(model, a, b, c), "Moves that change nothing are not steps");
+
+  // The keypoints stay with their correspondences
+  Check(HasWorldPoint(model, a, 1) && HasWorldPoint(model, b, 2) && HasWorldPoint(model, c, 3),
+        "Moves keep the keypoints");
+  Check(model.GetNumberOfPairs() == 3, "Moves keep the pairs");
+}
+
+void TestSwap()
+{
+  CorrespondenceModel model;
+  CorrespondenceModel::Id a = model.AddPair(MakeImagePoint(1), MakeWorldPoint(1));
+  CorrespondenceModel::Id b = model.AddPair(MakeImagePoint(2), MakeWorldPoint(2));
+
+  model.SwapWorldPoints(a, b);
+  Check(HasWorldPoint(model, a, 2) && HasWorldPoint(model, b, 1), "Swap two pairs");
+  Check(model.GetImagePoint(a).x == 1 && model.GetImagePoint(b).x == 2, "Swap keeps the image keypoints");
+  Check(model.Undo() && HasWorldPoint(model, a, 1) && HasWorldPoint(model, b, 2), "Undo a swap as one step");
+  Check(model.Redo() && HasWorldPoint(model, a, 2) && HasWorldPoint(model, b, 1), "Redo a swap");
+
+  // With a correspondence that waits for its point cloud keypoint, the keypoint moves over to it
+  CorrespondenceModel::Id c = model.AddImagePoint(MakeImagePoint(3));
+  Check(!model.HasWorldPoint(c), "An image keypoint waits for a partner");
+  model.SwapWorldPoints(a, c);
+  Check(!model.HasWorldPoint(a) && HasWorldPoint(model, c, 2), "Swap with a waiting correspondence");
+  Check(model.GetNumberOfPairs() == 2, "The pairs are counted after a swap");
+
+  // The next point cloud keypoint goes to the correspondence that is now waiting
+  CorrespondenceModel::Id next = model.AddWorldPoint(MakeWorldPoint(4));
+  Check(next == a && HasWorldPoint(model, a, 4), "The correspondence left waiting gets the next keypoint");
+  Check(model.Undo() && !model.HasWorldPoint(a), "Undo adding the keypoint");
+
+  Check(model.Undo() && HasWorldPoint(model, a, 2) && !model.HasWorldPoint(c), "Undo a swap with a waiting correspondence");
+  Check(model.GetNumberOfPairs() == 2, "The pairs are counted after undoing a swap");
+}
+
+void TestSwapWithoutWorldPoints()
+{
+  CorrespondenceModel model;
+  CorrespondenceModel::Id a = model.AddImagePoint(MakeImagePoint(1));
+  CorrespondenceModel::Id b = model.AddImagePoint(MakeImagePoint(2));
+
+  // Nothing to exchange, so undo goes back to the step before
+  model.SwapWorldPoints(a, b);
+  Check(model.Undo() && model.Contains(a) && !model.Contains(b), "A swap without point cloud keypoints is not a step");
+  Check(model.Undo() && !model.Contains(a), "Undo the first keypoint");
+  Check(!model.Undo(), "Nothing left to undo");
+}
+
+} // end anonymous namespace
+
+int main(int, char*[])
+{
+  TestMove();
+  TestSwap();
+  TestSwapWithoutWorldPoints();
+
+  if(NumberOfFailures > 0)
+    {
+    std::cerr << NumberOfFailures << " checks failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "All checks passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,399 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "CorrespondenceProposer.h"
+
+// VTK
+#include <vtkDataArray.h>
+#include <vtkPoints.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Custom
+#include "FeatureDetection.h"
+#include "ImagePyramid.h"
+#include "Parallel.h"
+#include "PoseEstimation.h"
+
+namespace
+{
+
+// Work at no more than this many pixels along the longer image side; corners are stable and it keeps proposals fast
+const unsigned int MaximumWorkingSize = 1280;
+const unsigned int NumberOfRansacHypotheses = 256;
+const unsigned int RansacSampleSize = 4;
+const unsigned int MinimumNumberOfInliers = 6;
+
+// Fill pixels the cloud does not cover with the average of their covered 3x3 neighbours.
+// One pass closes one pixel wide gaps; the mask is updated for the next pass.
+struct FillHolesFunctor
+{
+  const float* Input;
+  const unsigned char* InputMask;
+  float* Output;
+  unsigned char* OutputMask;
+  int Width;
+  int Height;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType j = begin; j < end; ++j)
+      {
+      for(int i = 0; i < this->Width; ++i)
+        {
+        vtkIdType index = j * this->Width + i;
+        this->Output[index] = this->Input[index];
+        this->OutputMask[index] = this->InputMask[index];
+        if(this->InputMask[index])
+          {
+          continue;
+          }
+        float sum = 0;
+        unsigned int count = 0;
+        for(int dj = -1; dj <= 1; ++dj)
+          {
+          for(int di = -1; di <= 1; ++di)
+            {
+            int x = i + di;
+            int y = static_cast<int>(j) + dj;
+            if(x < 0 || y < 0 || x >= this->Width || y >= this->Height)
+              {
+              continue;
+              }
+            if(this->InputMask[y * this->Width + x])
+              {
+              sum += this->Input[y * this->Width + x];
+              count++;
+              }
+            }
+          }
+        if(count >= 3)
+          {
+          this->Output[index] = sum / count;
+          this->OutputMask[index] = 1;
+          }
+        }
+      }
+  }
+};
+
+struct Match
+{
+  Coord2D ImagePoint;
+  Coord3D WorldPoint;
+  vtkIdType PointId;
+  unsigned int DescriptorDistance;
+};
+
+// Each thread scores its share of minimal-sample hypotheses and keeps its best
+struct RansacFunctor
+{
+  const std::vector<Coord2D>* ImagePoints;
+  const std::vector<Coord3D>* WorldPoints;
+  Camera InitialCamera;
+  double Threshold;
+  std::vector<Camera>* BestCameras;
+  std::vector<unsigned int>* BestInlierCounts;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    const unsigned int numberOfMatches = this->ImagePoints->size();
+    unsigned int state = 12345u + 7919u * threadId;
+    for(vtkIdType hypothesis = begin; hypothesis < end; ++hypothesis)
+      {
+      std::vector<Coord2D> sampleImagePoints;
+      std::vector<Coord3D> sampleWorldPoints;
+      std::vector<unsigned int> sample;
+      while(sample.size() < RansacSampleSize)
+        {
+        state = 1664525u * state + 1013904223u;
+        unsigned int candidate = (state >> 8) % numberOfMatches;
+        if(std::find(sample.begin(), sample.end(), candidate) == sample.end())
+          {
+          sample.push_back(candidate);
+          sampleImagePoints.push_back((*this->ImagePoints)[candidate]);
+          sampleWorldPoints.push_back((*this->WorldPoints)[candidate]);
+          }
+        }
+
+      // The intrinsics of the starting camera are trusted, so a pose from 4 points is enough,
+      // and unlike the DLT this does not degenerate on planar scenes.
+      Camera camera = this->InitialCamera;
+      PoseEstimation::RefineCamera(sampleImagePoints, sampleWorldPoints, false, camera);
+
+      unsigned int numberOfInliers = 0;
+      for(unsigned int m = 0; m < numberOfMatches; ++m)
+        {
+        double world[3] = {(*this->WorldPoints)[m].x, (*this->WorldPoints)[m].y, (*this->WorldPoints)[m].z};
+        double pixel[2];
+        if(camera.Project(world, pixel))
+          {
+          double du = pixel[0] - (*this->ImagePoints)[m].x;
+          double dv = pixel[1] - (*this->ImagePoints)[m].y;
+          if(du * du + dv * dv < this->Threshold * this->Threshold)
+            {
+            numberOfInliers++;
+            }
+          }
+        }
+      if(numberOfInliers > (*this->BestInlierCounts)[threadId])
+        {
+        (*this->BestInlierCounts)[threadId] = numberOfInliers;
+        (*this->BestCameras)[threadId] = camera;
+        }
+      }
+  }
+};
+
+bool BetterProposal(const CorrespondenceProposal& a, const CorrespondenceProposal& b)
+{
+  // Reprojection error in pixels and descriptor distance in bits, weighted so both matter
+  return a.ReprojectionError + 0.1 * a.DescriptorDistance < b.ReprojectionError + 0.1 * b.DescriptorDistance;
+}
+
+} // end anonymous namespace
+
+CorrespondenceProposer::CorrespondenceProposer()
+{
+  this->Points = NULL;
+  this->Scalars = NULL;
+  this->MaximumNumberOfKeypoints = 2000;
+}
+
+void CorrespondenceProposer::SetImage(const FloatScalarImageType* image)
+{
+  this->Image = image;
+}
+
+void CorrespondenceProposer::SetPointCloud(vtkPoints* points, vtkDataArray* scalars)
+{
+  this->Points = points;
+  this->Scalars = scalars;
+  this->Renderer.SetInput(points, scalars);
+}
+
+void CorrespondenceProposer::SetMaximumNumberOfKeypoints(const unsigned int maximumNumberOfKeypoints)
+{
+  this->MaximumNumberOfKeypoints = maximumNumberOfKeypoints;
+}
+
+bool CorrespondenceProposer::Propose(const Camera& camera, std::vector<CorrespondenceProposal>& proposals)
+{
+  proposals.clear();
+  if(!this->Image || !this->Points || !this->Scalars)
+    {
+    std::cerr << "CorrespondenceProposer: the image and the point cloud must both be set." << std::endl;
+    return false;
+    }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+
+  // Pick the pyramid level to work at
+  FloatScalarImageType::SizeType size = this->Image->GetLargestPossibleRegion().GetSize();
+  unsigned int numberOfLevels = 1;
+  while(std::max(size[0], size[1]) / (1u << (numberOfLevels - 1)) > MaximumWorkingSize)
+    {
+    numberOfLevels++;
+    }
+  ImagePyramid pyramid;
+  pyramid.SetImage(this->Image, numberOfLevels);
+  const unsigned int level = pyramid.GetNumberOfLevels() - 1;
+  const double levelScale = static_cast<double>(1 << level);
+  const unsigned int width = pyramid.GetWidth(level);
+  const unsigned int height = pyramid.GetHeight(level);
+  const vtkIdType numberOfPixels = static_cast<vtkIdType>(width) * height;
+
+  // Render the cloud and close small holes so corners are not found on the gaps between points
+  std::vector<float> rendered;
+  std::vector<float> depths;
+  std::vector<vtkIdType> pointIds;
+  this->Renderer.Render(camera.Scaled(1.0 / levelScale), width, height, rendered, depths, pointIds);
+
+  std::vector<unsigned char> mask(numberOfPixels);
+  for(vtkIdType i = 0; i < numberOfPixels; ++i)
+    {
+    mask[i] = depths[i] < std::numeric_limits<float>::infinity() ? 1 : 0;
+    }
+  std::vector<float> filled(numberOfPixels);
+  std::vector<unsigned char> filledMask(numberOfPixels);
+  for(unsigned int pass = 0; pass < 2; ++pass)
+    {
+    FillHolesFunctor fill;
+    fill.Input = &rendered[0];
+    fill.InputMask = &mask[0];
+    fill.Output = &filled[0];
+    fill.OutputMask = &filledMask[0];
+    fill.Width = width;
+    fill.Height = height;
+    Parallel::For(0, height, fill);
+    rendered.swap(filled);
+    mask.swap(filledMask);
+    }
+
+  // Keypoints and descriptors in both images
+  const float minimumDistance = 8.0f;
+  std::vector<Keypoint> imageKeypoints;
+  FeatureDetection::DetectCorners(pyramid.GetLevel(level), width, height, NULL, this->MaximumNumberOfKeypoints,
+                                  minimumDistance, imageKeypoints);
+  std::vector<BinaryDescriptor> imageDescriptors;
+  FeatureDetection::ComputeDescriptors(pyramid.GetLevel(level), width, height, imageKeypoints, imageDescriptors);
+
+  std::vector<Keypoint> renderedKeypoints;
+  FeatureDetection::DetectCorners(&rendered[0], width, height, &mask[0], this->MaximumNumberOfKeypoints,
+                                  minimumDistance, renderedKeypoints);
+  std::vector<BinaryDescriptor> renderedDescriptors;
+  FeatureDetection::ComputeDescriptors(&rendered[0], width, height, renderedKeypoints, renderedDescriptors);
+
+  // Approximate nearest neighbours with Lowe's ratio test
+  FeatureDetection::BinaryDescriptorIndex index;
+  index.Build(renderedDescriptors);
+  std::vector<int> nearest;
+  std::vector<unsigned int> nearestDistance;
+  std::vector<unsigned int> secondDistance;
+  index.Query(imageDescriptors, nearest, nearestDistance, secondDistance);
+
+  std::vector<Match> matches;
+  for(unsigned int q = 0; q < imageKeypoints.size(); ++q)
+    {
+    if(nearest[q] < 0 || nearestDistance[q] > 64 || nearestDistance[q] >= 0.8 * secondDistance[q])
+      {
+      continue;
+      }
+
+    // The point seen at the rendered keypoint, or at the closest covered neighbour
+    const Keypoint& renderedKeypoint = renderedKeypoints[nearest[q]];
+    int x = static_cast<int>(renderedKeypoint.x);
+    int y = static_cast<int>(renderedKeypoint.y);
+    vtkIdType pointId = pointIds[static_cast<vtkIdType>(y) * width + x];
+    float bestDepth = std::numeric_limits<float>::infinity();
+    for(int dy = -1; dy <= 1 && pointId < 0; ++dy)
+      {
+      for(int dx = -1; dx <= 1; ++dx)
+        {
+        vtkIdType pixel = static_cast<vtkIdType>(y + dy) * width + (x + dx);
+        if(pointIds[pixel] >= 0 && depths[pixel] < bestDepth)
+          {
+          pointId = pointIds[pixel];
+          bestDepth = depths[pixel];
+          }
+        }
+      }
+    if(pointId < 0)
+      {
+      continue;
+      }
+
+    Match match;
+    match.ImagePoint.x = (imageKeypoints[q].x + 0.5) * levelScale - 0.5;
+    match.ImagePoint.y = (imageKeypoints[q].y + 0.5) * levelScale - 0.5;
+    double p[3];
+    this->Points->GetPoint(pointId, p);
+    match.WorldPoint.x = p[0];
+    match.WorldPoint.y = p[1];
+    match.WorldPoint.z = p[2];
+    match.PointId = pointId;
+    match.DescriptorDistance = nearestDistance[q];
+    matches.push_back(match);
+    }
+
+  std::cout << "Proposals: " << imageKeypoints.size() << " image and " << renderedKeypoints.size()
+            << " rendered keypoints, " << matches.size() << " matches." << std::endl;
+  if(matches.size() < MinimumNumberOfInliers)
+    {
+    std::cerr << "Too few matches to verify." << std::endl;
+    return false;
+    }
+
+  // Geometric verification
+  std::vector<Coord2D> imagePoints(matches.size());
+  std::vector<Coord3D> worldPoints(matches.size());
+  for(unsigned int m = 0; m < matches.size(); ++m)
+    {
+    imagePoints[m] = matches[m].ImagePoint;
+    worldPoints[m] = matches[m].WorldPoint;
+    }
+
+  RansacFunctor ransac;
+  ransac.ImagePoints = &imagePoints;
+  ransac.WorldPoints = &worldPoints;
+  ransac.InitialCamera = camera;
+  ransac.Threshold = 3.0 * levelScale;
+  std::vector<Camera> bestCameras(Parallel::GetNumberOfThreads(), camera);
+  std::vector<unsigned int> bestInlierCounts(Parallel::GetNumberOfThreads(), 0);
+  ransac.BestCameras = &bestCameras;
+  ransac.BestInlierCounts = &bestInlierCounts;
+  Parallel::For(0, NumberOfRansacHypotheses, ransac);
+
+  unsigned int bestThread = std::max_element(bestInlierCounts.begin(), bestInlierCounts.end()) - bestInlierCounts.begin();
+  Camera verifiedCamera = bestCameras[bestThread];
+
+  // Refit on all inliers and collect them
+  std::vector<Coord2D> inlierImagePoints;
+  std::vector<Coord3D> inlierWorldPoints;
+  for(unsigned int pass = 0; pass < 2; ++pass)
+    {
+    proposals.clear();
+    inlierImagePoints.clear();
+    inlierWorldPoints.clear();
+    for(unsigned int m = 0; m < matches.size(); ++m)
+      {
+      double world[3] = {worldPoints[m].x, worldPoints[m].y, worldPoints[m].z};
+      double pixel[2];
+      if(!verifiedCamera.Project(world, pixel))
+        {
+        continue;
+        }
+      double error = sqrt((pixel[0] - imagePoints[m].x) * (pixel[0] - imagePoints[m].x) +
+                          (pixel[1] - imagePoints[m].y) * (pixel[1] - imagePoints[m].y));
+      if(error < ransac.Threshold)
+        {
+        CorrespondenceProposal proposal;
+        proposal.ImagePoint = matches[m].ImagePoint;
+        proposal.WorldPoint = matches[m].WorldPoint;
+        proposal.PointId = matches[m].PointId;
+        proposal.DescriptorDistance = matches[m].DescriptorDistance;
+        proposal.ReprojectionError = error;
+        proposals.push_back(proposal);
+        inlierImagePoints.push_back(imagePoints[m]);
+        inlierWorldPoints.push_back(worldPoints[m]);
+        }
+      }
+    if(pass == 0 && inlierImagePoints.size() >= MinimumNumberOfInliers)
+      {
+      PoseEstimation::RefineCamera(inlierImagePoints, inlierWorldPoints, false, verifiedCamera);
+      }
+    }
+
+  std::sort(proposals.begin(), proposals.end(), BetterProposal);
+  timer->StopTimer();
+
+  std::cout << proposals.size() << " verified proposals in " << timer->GetElapsedTime() << " s." << std::endl;
+  if(proposals.size() < MinimumNumberOfInliers)
+    {
+    proposals.clear();
+    return false;
+    }
+  return true;
+}
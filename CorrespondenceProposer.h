@@ -0,0 +1,71 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef CORRESPONDENCEPROPOSER_H
+#define CORRESPONDENCEPROPOSER_H
+
+// VTK
+#include <vtkType.h>
+
+// STL
+#include <vector>
+
+// Custom
+#include "Camera.h"
+#include "Coord.h"
+#include "IntensityRenderer.h"
+#include "Types.h"
+
+class vtkDataArray;
+class vtkPoints;
+
+struct CorrespondenceProposal
+{
+  Coord2D ImagePoint;
+  Coord3D WorldPoint;
+  vtkIdType PointId;
+  unsigned int DescriptorDistance;
+  double ReprojectionError; // Under the verified camera, in pixels
+};
+
+// Automatic correspondence proposals. Corners and descriptors are computed on the image and on the point cloud
+// intensity rendered from an approximate camera; descriptors are matched through a hashing index with a ratio test,
+// and the matches are verified by fitting a camera with RANSAC. Every rendered pixel remembers which point it shows,
+// so each surviving match is a 2D/3D pair.
+class CorrespondenceProposer
+{
+public:
+  CorrespondenceProposer();
+
+  void SetImage(const FloatScalarImageType* image);
+  void SetPointCloud(vtkPoints* points, vtkDataArray* scalars);
+
+  void SetMaximumNumberOfKeypoints(const unsigned int maximumNumberOfKeypoints);
+
+  // Inliers ordered best first. Returns false if too few matches survive verification.
+  bool Propose(const Camera& camera, std::vector<CorrespondenceProposal>& proposals);
+
+private:
+  FloatScalarImageType::ConstPointer Image;
+  vtkPoints* Points;
+  vtkDataArray* Scalars;
+  IntensityRenderer Renderer;
+  unsigned int MaximumNumberOfKeypoints;
+};
+
+#endif
@@ -0,0 +1,723 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "DerivedDataCache.h"
+
+// Qt
+#include <QDateTime>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFileInfo>
+
+// VTK
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STL
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// For marking an entry as recently used
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+// Custom
+#include "Helpers.h"
+#include "Parallel.h"
+#include "PointIndex.h"
+#include "TriangleBVH.h"
+
+namespace
+{
+
+// Bump when the layout of an entry or of a stored structure changes, so old entries are ignored
+const vtkTypeUInt32 FormatVersion = 1;
+const char Magic[8] = {'S', 'C', '2', 'D', '3', 'D', 'D', 'C'};
+const vtkTypeUInt64 Alignment = 64;
+const vtkTypeUInt64 HashPieceSize = 1 << 20;
+// Temporary files older than this were left by a writer that did not finish
+const int AbandonedSeconds = 3600;
+
+struct FileHeader
+{
+  char Magic[8];
+  vtkTypeUInt32 Version;
+  vtkTypeUInt32 NumberOfBlocks;
+  vtkTypeUInt64 Key;
+  // Followed by NumberOfBlocks (offset, size) pairs
+};
+
+vtkTypeUInt64 Align(const vtkTypeUInt64 offset)
+{
+  return (offset + Alignment - 1) / Alignment * Alignment;
+}
+
+// Final mix of MurmurHash3
+vtkTypeUInt64 Mix(vtkTypeUInt64 h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+vtkTypeUInt64 HashPiece(const unsigned char* data, const vtkTypeUInt64 size, const vtkTypeUInt64 seed)
+{
+  const vtkTypeUInt64 multiplier = 0x9e3779b97f4a7c15ULL;
+  vtkTypeUInt64 h = Mix(seed + size);
+  vtkTypeUInt64 numberOfWords = size / 8;
+  for(vtkTypeUInt64 i = 0; i < numberOfWords; ++i)
+    {
+    vtkTypeUInt64 word;
+    memcpy(&word, data + 8 * i, 8);
+    h = (h ^ word) * multiplier;
+    h = (h << 31) | (h >> 33);
+    }
+
+  vtkTypeUInt64 tail = 0;
+  memcpy(&tail, data + 8 * numberOfWords, size - 8 * numberOfWords);
+  return Mix(h ^ tail);
+}
+
+struct HashFunctor
+{
+  const unsigned char* Data;
+  vtkTypeUInt64 Size;
+  std::vector<vtkTypeUInt64>* Hashes; // one per piece
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType piece = begin; piece < end; ++piece)
+      {
+      vtkTypeUInt64 pieceBegin = static_cast<vtkTypeUInt64>(piece) * HashPieceSize;
+      vtkTypeUInt64 pieceSize = std::min(HashPieceSize, this->Size - pieceBegin);
+      (*this->Hashes)[piece] = HashPiece(this->Data + pieceBegin, pieceSize, piece);
+      }
+  }
+};
+
+// The checks of the indices of a loaded structure, in parallel. A corrupt entry whose sizes happen to check out
+// must not send a lookup outside its arrays. Each clears the flag of its thread if it finds a bad value.
+struct PointIndexCheck
+{
+  const unsigned int* Offsets; // one more than the number of cells
+  const unsigned int* Ids;
+  vtkIdType NumberOfPoints;
+  std::vector<unsigned char>* Valid;
+
+  // Over the cells, then over the ids
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      if(this->Offsets ? this->Offsets[i] > this->Offsets[i + 1] : this->Ids[i] >= this->NumberOfPoints)
+        {
+        (*this->Valid)[threadId] = 0;
+        return;
+        }
+      }
+  }
+};
+
+struct TriangleBVHCheck
+{
+  const TriangleBVH::Node* Nodes;
+  vtkTypeUInt64 NumberOfNodes;
+  vtkTypeUInt64 NumberOfTriangles;
+  std::vector<unsigned char>* Valid;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      const TriangleBVH::Node& node = this->Nodes[i];
+      // Children come after their parent, so a traversal cannot loop
+      bool valid = node.Count > 0 ?
+                   static_cast<vtkTypeUInt64>(node.Left) + node.Count <= this->NumberOfTriangles :
+                   node.Left > i && node.Right > i && node.Left < this->NumberOfNodes && node.Right < this->NumberOfNodes;
+      if(!valid)
+        {
+        (*this->Valid)[threadId] = 0;
+        return;
+        }
+      }
+  }
+};
+
+struct CellIdCheck
+{
+  const vtkIdType* CellIds;
+  std::vector<unsigned char>* Valid;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      if(this->CellIds[i] < 0)
+        {
+        (*this->Valid)[threadId] = 0;
+        return;
+        }
+      }
+  }
+};
+
+template <typename TCheck>
+bool Check(const vtkIdType numberOfItems, TCheck& check)
+{
+  std::vector<unsigned char> valid(Parallel::GetNumberOfThreads(), 1);
+  check.Valid = &valid;
+  Parallel::For(0, numberOfItems, check);
+  return std::find(valid.begin(), valid.end(), 0) == valid.end();
+}
+
+vtkTypeUInt64 HashCells(vtkCellArray* cells, const vtkTypeUInt64 seed)
+{
+  if(!cells || cells->GetNumberOfCells() == 0)
+    {
+    return Mix(seed);
+    }
+  vtkIdTypeArray* data = cells->GetData();
+  return DerivedDataCache::Hash(data->GetVoidPointer(0), data->GetNumberOfTuples() * sizeof(vtkIdType), seed);
+}
+
+} // end anonymous namespace
+
+DerivedDataCache::Entry::Entry() : Memory(NULL)
+{
+}
+
+DerivedDataCache::Entry::~Entry()
+{
+  Close();
+}
+
+void DerivedDataCache::Entry::Close()
+{
+  if(this->Memory)
+    {
+    this->File.unmap(this->Memory);
+    this->Memory = NULL;
+    }
+  this->File.close();
+  this->Blocks.clear();
+}
+
+unsigned int DerivedDataCache::Entry::GetNumberOfBlocks() const
+{
+  return static_cast<unsigned int>(this->Blocks.size());
+}
+
+const DerivedDataCache::Block& DerivedDataCache::Entry::GetBlock(const unsigned int block) const
+{
+  return this->Blocks[block];
+}
+
+DerivedDataCache::DerivedDataCache() : MaximumSize(static_cast<vtkTypeUInt64>(2) << 30)
+{
+  this->Directory = QDesktopServices::storageLocation(QDesktopServices::CacheLocation) + "/DerivedData";
+}
+
+void DerivedDataCache::SetDirectory(const QString& directory)
+{
+  this->Directory = directory;
+}
+
+QString DerivedDataCache::GetDirectory() const
+{
+  return this->Directory;
+}
+
+void DerivedDataCache::SetMaximumSize(const vtkTypeUInt64 bytes)
+{
+  this->MaximumSize = bytes;
+}
+
+vtkTypeUInt64 DerivedDataCache::GetMaximumSize() const
+{
+  return this->MaximumSize;
+}
+
+vtkTypeUInt64 DerivedDataCache::Hash(const void* data, const vtkTypeUInt64 size, const vtkTypeUInt64 seed)
+{
+  vtkTypeUInt64 numberOfPieces = (size + HashPieceSize - 1) / HashPieceSize;
+  std::vector<vtkTypeUInt64> hashes(numberOfPieces);
+
+  HashFunctor functor;
+  functor.Data = static_cast<const unsigned char*>(data);
+  functor.Size = size;
+  functor.Hashes = &hashes;
+  Parallel::For(0, static_cast<vtkIdType>(numberOfPieces), functor);
+
+  vtkTypeUInt64 h = Mix(seed ^ size);
+  for(vtkTypeUInt64 piece = 0; piece < numberOfPieces; ++piece)
+    {
+    h = Mix(h + hashes[piece]);
+    }
+  return h;
+}
+
+vtkTypeUInt64 DerivedDataCache::ComputeKey(vtkPolyData* polyData)
+{
+  vtkTypeUInt64 key = polyData->GetNumberOfPoints();
+  vtkPoints* points = polyData->GetPoints();
+  if(points && points->GetNumberOfPoints() > 0)
+    {
+    vtkDataArray* data = points->GetData();
+    key = Hash(data->GetVoidPointer(0), static_cast<vtkTypeUInt64>(data->GetNumberOfTuples()) * 3 * data->GetDataTypeSize(),
+               key + data->GetDataType());
+    }
+  key = HashCells(polyData->GetPolys(), key);
+  key = HashCells(polyData->GetStrips(), key);
+  return key;
+}
+
+QString DerivedDataCache::GetFileName(const vtkTypeUInt64 key, const std::string& name) const
+{
+  return this->Directory + "/" + QString("%1").arg(key, 16, 16, QChar('0')) + "-" +
+         QString::fromStdString(name) + ".cache";
+}
+
+bool DerivedDataCache::Store(const vtkTypeUInt64 key, const std::string& name, const std::vector<Block>& blocks)
+{
+  if(!QDir().mkpath(this->Directory))
+    {
+    std::cerr << "Cannot create the cache directory " << this->Directory.toStdString() << std::endl;
+    return false;
+    }
+
+  FileHeader header;
+  memcpy(header.Magic, Magic, sizeof(Magic));
+  header.Version = FormatVersion;
+  header.NumberOfBlocks = static_cast<vtkTypeUInt32>(blocks.size());
+  header.Key = key;
+
+  std::vector<vtkTypeUInt64> table(2 * blocks.size());
+  vtkTypeUInt64 offset = Align(sizeof(FileHeader) + table.size() * sizeof(vtkTypeUInt64));
+  for(unsigned int i = 0; i < blocks.size(); ++i)
+    {
+    table[2 * i] = offset;
+    table[2 * i + 1] = blocks[i].Size;
+    offset = Align(offset + blocks[i].Size);
+    }
+
+  // Write under a temporary name and rename, so a reader never sees a partial entry
+  QString fileName = GetFileName(key, name);
+  QString temporaryFileName = fileName + ".partial";
+  QFile file(temporaryFileName);
+  if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+    std::cerr << "Cannot write the cache entry " << temporaryFileName.toStdString() << std::endl;
+    return false;
+    }
+
+  bool written = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+  if(!table.empty())
+    {
+    qint64 tableSize = table.size() * sizeof(vtkTypeUInt64);
+    written = written && file.write(reinterpret_cast<const char*>(&table[0]), tableSize) == tableSize;
+    }
+  for(unsigned int i = 0; i < blocks.size() && written; ++i)
+    {
+    written = file.seek(table[2 * i]);
+    if(blocks[i].Size > 0)
+      {
+      written = written && file.write(static_cast<const char*>(blocks[i].Data), blocks[i].Size) ==
+                           static_cast<qint64>(blocks[i].Size);
+      }
+    }
+  written = written && file.resize(offset);
+  file.close();
+
+  if(!written)
+    {
+    std::cerr << "Cannot write the cache entry " << temporaryFileName.toStdString() << std::endl;
+    QFile::remove(temporaryFileName);
+    return false;
+    }
+
+  QFile::remove(fileName);
+  if(!QFile::rename(temporaryFileName, fileName))
+    {
+    std::cerr << "Cannot write the cache entry " << fileName.toStdString() << std::endl;
+    QFile::remove(temporaryFileName);
+    return false;
+    }
+
+  Trim();
+  return true;
+}
+
+bool DerivedDataCache::Load(const vtkTypeUInt64 key, const std::string& name, Entry& entry)
+{
+  entry.Close();
+
+  QString fileName = GetFileName(key, name);
+  entry.File.setFileName(fileName);
+  if(!entry.File.open(QIODevice::ReadOnly))
+    {
+    return false;
+    }
+
+  vtkTypeUInt64 fileSize = entry.File.size();
+  if(fileSize < sizeof(FileHeader))
+    {
+    entry.Close();
+    return false;
+    }
+  entry.Memory = entry.File.map(0, fileSize);
+  if(!entry.Memory)
+    {
+    entry.Close();
+    return false;
+    }
+
+  // Anything that does not check out (an older format, a truncated file) is a miss
+  const FileHeader* header = reinterpret_cast<const FileHeader*>(entry.Memory);
+  bool valid = memcmp(header->Magic, Magic, sizeof(Magic)) == 0 && header->Version == FormatVersion &&
+               header->Key == key &&
+               sizeof(FileHeader) + 2 * sizeof(vtkTypeUInt64) * static_cast<vtkTypeUInt64>(header->NumberOfBlocks) <= fileSize;
+  if(valid)
+    {
+    const vtkTypeUInt64* table = reinterpret_cast<const vtkTypeUInt64*>(entry.Memory + sizeof(FileHeader));
+    entry.Blocks.resize(header->NumberOfBlocks);
+    for(unsigned int i = 0; i < header->NumberOfBlocks && valid; ++i)
+      {
+      vtkTypeUInt64 offset = table[2 * i];
+      vtkTypeUInt64 size = table[2 * i + 1];
+      valid = offset <= fileSize && size <= fileSize - offset;
+      entry.Blocks[i].Data = entry.Memory + offset;
+      entry.Blocks[i].Size = size;
+      }
+    }
+
+  if(!valid)
+    {
+    std::cout << "Ignoring the invalid cache entry " << fileName.toStdString() << std::endl;
+    entry.Close();
+    QFile::remove(fileName);
+    return false;
+    }
+
+  // Mark it as recently used for Trim
+  utime(QFile::encodeName(fileName).constData(), NULL);
+
+  return true;
+}
+
+bool DerivedDataCache::StoreValues(const vtkTypeUInt64 key, const std::string& name, const std::vector<double>& values)
+{
+  std::vector<Block> blocks(1);
+  blocks[0].Data = values.empty() ? NULL : &values[0];
+  blocks[0].Size = values.size() * sizeof(double);
+  return Store(key, name, blocks);
+}
+
+bool DerivedDataCache::LoadValues(const vtkTypeUInt64 key, const std::string& name, std::vector<double>& values)
+{
+  Entry entry;
+  if(!Load(key, name, entry) || entry.GetNumberOfBlocks() != 1 || entry.GetBlock(0).Size % sizeof(double) != 0)
+    {
+    return false;
+    }
+
+  const double* data = static_cast<const double*>(entry.GetBlock(0).Data);
+  values.assign(data, data + entry.GetBlock(0).Size / sizeof(double));
+  return true;
+}
+
+bool DerivedDataCache::StorePointIndex(const vtkTypeUInt64 key, const PointIndex& index)
+{
+  if(!index.GetPoints())
+    {
+    return false;
+    }
+
+  // Origin, cell size and dimensions, then the offsets and the ids
+  double grid[7];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    grid[d] = index.GetOrigin()[d];
+    grid[4 + d] = index.GetDimensions()[d];
+    }
+  grid[3] = index.GetCellSize();
+  const unsigned int* dimensions = index.GetDimensions();
+  vtkTypeUInt64 numberOfCells = static_cast<vtkTypeUInt64>(dimensions[0]) * dimensions[1] * dimensions[2];
+
+  std::vector<Block> blocks(3);
+  blocks[0].Data = grid;
+  blocks[0].Size = sizeof(grid);
+  blocks[1].Data = index.GetOffsets();
+  blocks[1].Size = (numberOfCells + 1) * sizeof(unsigned int);
+  blocks[2].Data = index.GetIds();
+  blocks[2].Size = index.GetPoints()->GetNumberOfPoints() * sizeof(unsigned int);
+  return Store(key, "PointIndex", blocks);
+}
+
+bool DerivedDataCache::LoadPointIndex(const vtkTypeUInt64 key, vtkPoints* points, PointIndex& index)
+{
+  Entry entry;
+  if(!Load(key, "PointIndex", entry) || entry.GetNumberOfBlocks() != 3 || entry.GetBlock(0).Size != 7 * sizeof(double))
+    {
+    return false;
+    }
+
+  const double* grid = static_cast<const double*>(entry.GetBlock(0).Data);
+  unsigned int dimensions[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    dimensions[d] = static_cast<unsigned int>(grid[4 + d]);
+    }
+  vtkTypeUInt64 numberOfCells = static_cast<vtkTypeUInt64>(dimensions[0]) * dimensions[1] * dimensions[2];
+  const vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  if(numberOfCells == 0 || !(grid[3] > 0) || entry.GetBlock(1).Size != (numberOfCells + 1) * sizeof(unsigned int) ||
+     entry.GetBlock(2).Size != numberOfPoints * sizeof(unsigned int))
+    {
+    return false;
+    }
+
+  // The offsets run from 0 to the number of points without decreasing, and the ids are points
+  PointIndexCheck check;
+  check.Offsets = static_cast<const unsigned int*>(entry.GetBlock(1).Data);
+  check.Ids = static_cast<const unsigned int*>(entry.GetBlock(2).Data);
+  check.NumberOfPoints = numberOfPoints;
+  bool valid = check.Offsets[0] == 0 && static_cast<vtkIdType>(check.Offsets[numberOfCells]) == numberOfPoints &&
+               Check(numberOfCells, check);
+  check.Offsets = NULL;
+  if(!valid || !Check(numberOfPoints, check))
+    {
+    std::cout << "Ignoring the invalid cached point index." << std::endl;
+    return false;
+    }
+
+  index.Restore(points, grid, grid[3], dimensions, static_cast<const unsigned int*>(entry.GetBlock(1).Data),
+                static_cast<const unsigned int*>(entry.GetBlock(2).Data));
+  return true;
+}
+
+bool DerivedDataCache::StorePointCloud(const vtkTypeUInt64 key, const std::string& name, vtkPolyData* polyData)
+{
+  vtkPoints* points = polyData->GetPoints();
+  if(!points)
+    {
+    return false;
+    }
+
+  // The layout (number of points, then the type and components of the points and of each array),
+  // the array names separated by '\0', the points and the arrays
+  vtkPointData* pointData = polyData->GetPointData();
+  const vtkTypeUInt64 numberOfPoints = polyData->GetNumberOfPoints();
+  std::vector<vtkDataArray*> arrays(1, points->GetData());
+  for(int i = 0; i < pointData->GetNumberOfArrays(); ++i)
+    {
+    if(pointData->GetArray(i))
+      {
+      arrays.push_back(pointData->GetArray(i));
+      }
+    }
+  std::vector<double> layout(1, static_cast<double>(numberOfPoints));
+  std::string names;
+  std::vector<Block> blocks(2 + arrays.size());
+  for(unsigned int i = 0; i < arrays.size(); ++i)
+    {
+    layout.push_back(arrays[i]->GetDataType());
+    layout.push_back(arrays[i]->GetNumberOfComponents());
+    if(i > 0)
+      {
+      names += std::string(arrays[i]->GetName() ? arrays[i]->GetName() : "") + '\0';
+      }
+    blocks[2 + i].Data = numberOfPoints > 0 ? arrays[i]->GetVoidPointer(0) : NULL;
+    blocks[2 + i].Size = numberOfPoints * arrays[i]->GetNumberOfComponents() * arrays[i]->GetDataTypeSize();
+    }
+  blocks[0].Data = &layout[0];
+  blocks[0].Size = layout.size() * sizeof(double);
+  blocks[1].Data = names.data();
+  blocks[1].Size = names.size();
+  return Store(key, name, blocks);
+}
+
+bool DerivedDataCache::LoadPointCloud(const vtkTypeUInt64 key, const std::string& name, vtkPolyData* polyData)
+{
+  Entry entry;
+  if(!Load(key, name, entry) || entry.GetNumberOfBlocks() < 3 || entry.GetBlock(0).Size % sizeof(double) != 0 ||
+     entry.GetBlock(0).Size / sizeof(double) != 1 + 2 * (entry.GetNumberOfBlocks() - 2))
+    {
+    return false;
+    }
+
+  const double* layout = static_cast<const double*>(entry.GetBlock(0).Data);
+  if(!(layout[0] >= 0))
+    {
+    return false;
+    }
+  const vtkIdType numberOfPoints = static_cast<vtkIdType>(layout[0]);
+  const char* names = static_cast<const char*>(entry.GetBlock(1).Data);
+  const char* namesEnd = names + entry.GetBlock(1).Size;
+  std::vector<vtkSmartPointer<vtkDataArray> > arrays;
+  for(unsigned int i = 0; i + 2 < entry.GetNumberOfBlocks(); ++i)
+    {
+    const int type = static_cast<int>(layout[1 + 2 * i]);
+    const int numberOfComponents = static_cast<int>(layout[2 + 2 * i]);
+    const Block& block = entry.GetBlock(2 + i);
+    if(type == VTK_BIT || numberOfComponents < 1 || (i == 0 && numberOfComponents != 3))
+      {
+      return false;
+      }
+    // An unknown type makes some other array
+    vtkSmartPointer<vtkDataArray> array;
+    array.TakeReference(vtkDataArray::CreateDataArray(type));
+    if(!array || array->GetDataType() != type ||
+       block.Size != static_cast<vtkTypeUInt64>(numberOfPoints) * numberOfComponents * array->GetDataTypeSize())
+      {
+      return false;
+      }
+    array->SetNumberOfComponents(numberOfComponents);
+    array->SetNumberOfTuples(numberOfPoints);
+    if(block.Size > 0)
+      {
+      Helpers::ParallelCopy(array->GetVoidPointer(0), block.Data, block.Size);
+      }
+    if(i > 0)
+      {
+      const char* nameEnd = std::find(names, namesEnd, '\0');
+      if(nameEnd == namesEnd)
+        {
+        return false;
+        }
+      array->SetName(std::string(names, nameEnd).c_str());
+      names = nameEnd + 1;
+      }
+    arrays.push_back(array);
+    }
+
+  polyData->Initialize();
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetData(arrays[0]);
+  polyData->SetPoints(points);
+  for(unsigned int i = 1; i < arrays.size(); ++i)
+    {
+    polyData->GetPointData()->AddArray(arrays[i]);
+    }
+  Helpers::AddVertices(polyData);
+  return true;
+}
+
+bool DerivedDataCache::StoreTriangleBVH(const vtkTypeUInt64 key, const TriangleBVH& bvh)
+{
+  if(bvh.GetNumberOfTriangles() == 0)
+    {
+    return false;
+    }
+
+  std::vector<Block> blocks(3);
+  blocks[0].Data = &bvh.GetNodes()[0];
+  blocks[0].Size = bvh.GetNodes().size() * sizeof(TriangleBVH::Node);
+  blocks[1].Data = &bvh.GetTriangles()[0];
+  blocks[1].Size = bvh.GetTriangles().size() * sizeof(float);
+  blocks[2].Data = &bvh.GetCellIds()[0];
+  blocks[2].Size = bvh.GetCellIds().size() * sizeof(vtkIdType);
+  return Store(key, "TriangleBVH", blocks);
+}
+
+bool DerivedDataCache::LoadTriangleBVH(const vtkTypeUInt64 key, TriangleBVH& bvh)
+{
+  Entry entry;
+  if(!Load(key, "TriangleBVH", entry) || entry.GetNumberOfBlocks() != 3 ||
+     entry.GetBlock(0).Size == 0 || entry.GetBlock(0).Size % sizeof(TriangleBVH::Node) != 0 ||
+     entry.GetBlock(2).Size % sizeof(vtkIdType) != 0)
+    {
+    return false;
+    }
+
+  vtkTypeUInt64 numberOfTriangles = entry.GetBlock(2).Size / sizeof(vtkIdType);
+  vtkTypeUInt64 numberOfNodes = entry.GetBlock(0).Size / sizeof(TriangleBVH::Node);
+  if(entry.GetBlock(1).Size != 9 * numberOfTriangles * sizeof(float) || numberOfTriangles > VTK_UNSIGNED_INT_MAX ||
+     numberOfNodes > VTK_UNSIGNED_INT_MAX)
+    {
+    return false;
+    }
+
+  // The children are nodes, the leaves' triangles are triangles and the cell ids are cells
+  TriangleBVHCheck nodeCheck;
+  nodeCheck.Nodes = static_cast<const TriangleBVH::Node*>(entry.GetBlock(0).Data);
+  nodeCheck.NumberOfNodes = numberOfNodes;
+  nodeCheck.NumberOfTriangles = numberOfTriangles;
+  CellIdCheck cellIdCheck;
+  cellIdCheck.CellIds = static_cast<const vtkIdType*>(entry.GetBlock(2).Data);
+  if(!Check(numberOfNodes, nodeCheck) || !Check(numberOfTriangles, cellIdCheck))
+    {
+    std::cout << "Ignoring the invalid cached picking hierarchy." << std::endl;
+    return false;
+    }
+
+  bvh.Restore(static_cast<const TriangleBVH::Node*>(entry.GetBlock(0).Data),
+              static_cast<unsigned int>(entry.GetBlock(0).Size / sizeof(TriangleBVH::Node)),
+              static_cast<const float*>(entry.GetBlock(1).Data),
+              static_cast<const vtkIdType*>(entry.GetBlock(2).Data), numberOfTriangles);
+  return true;
+}
+
+void DerivedDataCache::Clear()
+{
+  QDir directory(this->Directory);
+  QStringList entries = directory.entryList(QStringList() << "*.cache" << "*.cache.partial", QDir::Files);
+  for(int i = 0; i < entries.size(); ++i)
+    {
+    directory.remove(entries[i]);
+    }
+}
+
+void DerivedDataCache::Trim()
+{
+  QDir directory(this->Directory);
+
+  // Entries whose writer crashed or was killed; another one may still be writing a recent one
+  QFileInfoList abandoned = directory.entryInfoList(QStringList("*.cache.partial"), QDir::Files);
+  QDateTime now = QDateTime::currentDateTime();
+  for(int i = 0; i < abandoned.size(); ++i)
+    {
+    if(abandoned[i].lastModified().secsTo(now) > AbandonedSeconds)
+      {
+      directory.remove(abandoned[i].fileName());
+      }
+    }
+
+  // Most recently used first
+  QFileInfoList entries = directory.entryInfoList(QStringList("*.cache"), QDir::Files, QDir::Time);
+
+  vtkTypeUInt64 totalSize = 0;
+  for(int i = 0; i < entries.size(); ++i)
+    {
+    totalSize += entries[i].size();
+    if(totalSize > this->MaximumSize)
+      {
+      directory.remove(entries[i].fileName());
+      }
+    }
+}
@@ -0,0 +1,126 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef DERIVEDDATACACHE_H
+#define DERIVEDDATACACHE_H
+
+// Qt
+#include <QFile>
+#include <QString>
+
+// VTK
+#include <vtkType.h>
+
+// STL
+#include <string>
+#include <vector>
+
+class vtkPoints;
+class vtkPolyData;
+class PointIndex;
+class TriangleBVH;
+
+// On-disk cache of data that is slow to derive from a dataset (spacing, search structures), so reopening
+// the same dataset skips the work. Entries are keyed by a hash of the content they were derived from
+// plus a name, so a changed dataset simply misses. Each entry is one file of raw blocks aligned to 64 bytes,
+// which is memory mapped when loaded. When the files together exceed the size cap, the least recently
+// used ones are deleted, as are entries left half written.
+class DerivedDataCache
+{
+public:
+  // A contiguous piece of an entry
+  struct Block
+  {
+    const void* Data;
+    vtkTypeUInt64 Size; // bytes
+  };
+
+  // A loaded entry. The blocks point into the mapped file and are valid until the entry is closed or destroyed.
+  class Entry
+  {
+  public:
+    Entry();
+    ~Entry();
+
+    void Close();
+
+    unsigned int GetNumberOfBlocks() const;
+    const Block& GetBlock(const unsigned int block) const;
+
+  private:
+    friend class DerivedDataCache;
+    Entry(const Entry&);
+    void operator=(const Entry&);
+
+    QFile File;
+    uchar* Memory;
+    std::vector<Block> Blocks;
+  };
+
+  // Uses the user's cache location and a 2 GB cap
+  DerivedDataCache();
+
+  void SetDirectory(const QString& directory);
+  QString GetDirectory() const;
+
+  void SetMaximumSize(const vtkTypeUInt64 bytes);
+  vtkTypeUInt64 GetMaximumSize() const;
+
+  // 64 bit hash of a byte range, computed in parallel over fixed 1 MB pieces so it does not depend
+  // on the number of threads. 'seed' chains hashes of several ranges.
+  static vtkTypeUInt64 Hash(const void* data, const vtkTypeUInt64 size, const vtkTypeUInt64 seed = 0);
+
+  // Key for data derived from a point cloud or mesh: a hash of its points and its polygons and strips
+  static vtkTypeUInt64 ComputeKey(vtkPolyData* polyData);
+
+  // Write an entry, replacing an existing one. Returns false, after printing why, if it cannot be written.
+  bool Store(const vtkTypeUInt64 key, const std::string& name, const std::vector<Block>& blocks);
+
+  // Map an entry. Returns false if there is no valid entry for this key and name.
+  bool Load(const vtkTypeUInt64 key, const std::string& name, Entry& entry);
+
+  // A few numbers, such as an average spacing or a value range
+  bool StoreValues(const vtkTypeUInt64 key, const std::string& name, const std::vector<double>& values);
+  bool LoadValues(const vtkTypeUInt64 key, const std::string& name, std::vector<double>& values);
+
+  // A PointIndex built over 'points' (the points of the data 'key' was computed from)
+  bool StorePointIndex(const vtkTypeUInt64 key, const PointIndex& index);
+  bool LoadPointIndex(const vtkTypeUInt64 key, vtkPoints* points, PointIndex& index);
+
+  // The points and point data arrays of a point cloud, such as a reduced copy. Its cells are not kept;
+  // the loaded cloud has one vertex per point.
+  bool StorePointCloud(const vtkTypeUInt64 key, const std::string& name, vtkPolyData* polyData);
+  bool LoadPointCloud(const vtkTypeUInt64 key, const std::string& name, vtkPolyData* polyData);
+
+  bool StoreTriangleBVH(const vtkTypeUInt64 key, const TriangleBVH& bvh);
+  bool LoadTriangleBVH(const vtkTypeUInt64 key, TriangleBVH& bvh);
+
+  // Delete all entries
+  void Clear();
+
+private:
+  QString GetFileName(const vtkTypeUInt64 key, const std::string& name) const;
+
+  // Delete least recently used entries until the total size is under the cap
+  void Trim();
+
+  QString Directory;
+  vtkTypeUInt64 MaximumSize;
+};
+
+#endif
@@ -0,0 +1,551 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "FeatureDetection.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+const int PatchRadius = 15;
+const int BlurRadius = 2;
+const unsigned int NumberOfComparisons = 256;
+
+// Deterministic pseudo random numbers so descriptors computed in different sessions are comparable
+struct LinearCongruentialGenerator
+{
+  unsigned int State;
+
+  explicit LinearCongruentialGenerator(const unsigned int seed) : State(seed) {}
+
+  unsigned int Next()
+  {
+    this->State = 1664525u * this->State + 1013904223u;
+    return this->State;
+  }
+
+  double Uniform()
+  {
+    return (this->Next() >> 8) / 16777216.0;
+  }
+};
+
+// Sum of a (2r+1)x(2r+1) window, normalized. Horizontal then vertical pass, each split over rows.
+struct HorizontalBoxFunctor
+{
+  const float* Input;
+  float* Output;
+  int Width;
+  int Radius;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType j = begin; j < end; ++j)
+      {
+      const float* inputRow = this->Input + j * this->Width;
+      float* outputRow = this->Output + j * this->Width;
+      for(int i = 0; i < this->Width; ++i)
+        {
+        float sum = 0;
+        for(int k = -this->Radius; k <= this->Radius; ++k)
+          {
+          int column = std::min(this->Width - 1, std::max(0, i + k));
+          sum += inputRow[column];
+          }
+        outputRow[i] = sum / (2 * this->Radius + 1);
+        }
+      }
+  }
+};
+
+struct VerticalBoxFunctor
+{
+  const float* Input;
+  float* Output;
+  int Width;
+  int Height;
+  int Radius;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType j = begin; j < end; ++j)
+      {
+      for(int i = 0; i < this->Width; ++i)
+        {
+        float sum = 0;
+        for(int k = -this->Radius; k <= this->Radius; ++k)
+          {
+          int row = std::min(this->Height - 1, std::max(0, static_cast<int>(j) + k));
+          sum += this->Input[row * this->Width + i];
+          }
+        this->Output[j * this->Width + i] = sum / (2 * this->Radius + 1);
+        }
+      }
+  }
+};
+
+void BoxBlur(const float* input, const unsigned int width, const unsigned int height, const int radius, std::vector<float>& output)
+{
+  std::vector<float> temporary(static_cast<size_t>(width) * height);
+  output.resize(static_cast<size_t>(width) * height);
+
+  HorizontalBoxFunctor horizontal;
+  horizontal.Input = input;
+  horizontal.Output = &temporary[0];
+  horizontal.Width = width;
+  horizontal.Radius = radius;
+  Parallel::For(0, height, horizontal);
+
+  VerticalBoxFunctor vertical;
+  vertical.Input = &temporary[0];
+  vertical.Output = &output[0];
+  vertical.Width = width;
+  vertical.Height = height;
+  vertical.Radius = radius;
+  Parallel::For(0, height, vertical);
+}
+
+// Gradient products Ix*Ix, Ix*Iy, Iy*Iy from central differences
+struct GradientProductsFunctor
+{
+  const float* Image;
+  int Width;
+  int Height;
+  float* Ixx;
+  float* Ixy;
+  float* Iyy;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType j = begin; j < end; ++j)
+      {
+      int up = std::max(0, static_cast<int>(j) - 1);
+      int down = std::min(this->Height - 1, static_cast<int>(j) + 1);
+      for(int i = 0; i < this->Width; ++i)
+        {
+        int left = std::max(0, i - 1);
+        int right = std::min(this->Width - 1, i + 1);
+        float ix = 0.5f * (this->Image[j * this->Width + right] - this->Image[j * this->Width + left]);
+        float iy = 0.5f * (this->Image[down * this->Width + i] - this->Image[up * this->Width + i]);
+        size_t index = j * this->Width + i;
+        this->Ixx[index] = ix * ix;
+        this->Ixy[index] = ix * iy;
+        this->Iyy[index] = iy * iy;
+        }
+      }
+  }
+};
+
+struct HarrisResponseFunctor
+{
+  const float* Ixx;
+  const float* Ixy;
+  const float* Iyy;
+  float* Response;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    const float k = 0.04f;
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      float trace = this->Ixx[i] + this->Iyy[i];
+      this->Response[i] = this->Ixx[i] * this->Iyy[i] - this->Ixy[i] * this->Ixy[i] - k * trace * trace;
+      }
+  }
+};
+
+// 3x3 local maxima of the response, collected per thread
+struct LocalMaximaFunctor
+{
+  const float* Response;
+  const unsigned char* Mask;
+  int Width;
+  int Height;
+  std::vector<std::vector<Keypoint> >* Candidates;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    std::vector<Keypoint>& candidates = (*this->Candidates)[threadId];
+    for(vtkIdType j = std::max<vtkIdType>(begin, 1); j < std::min<vtkIdType>(end, this->Height - 1); ++j)
+      {
+      for(int i = 1; i < this->Width - 1; ++i)
+        {
+        vtkIdType index = j * this->Width + i;
+        float value = this->Response[index];
+        if(value <= 0 || (this->Mask && !this->Mask[index]))
+          {
+          continue;
+          }
+        bool isMaximum = true;
+        for(int dj = -1; dj <= 1 && isMaximum; ++dj)
+          {
+          for(int di = -1; di <= 1; ++di)
+            {
+            if((di != 0 || dj != 0) && this->Response[index + dj * this->Width + di] >= value)
+              {
+              isMaximum = false;
+              break;
+              }
+            }
+          }
+        if(isMaximum)
+          {
+          Keypoint keypoint;
+          keypoint.x = i;
+          keypoint.y = j;
+          keypoint.Response = value;
+          candidates.push_back(keypoint);
+          }
+        }
+      }
+  }
+};
+
+bool StrongerResponse(const Keypoint& a, const Keypoint& b)
+{
+  return a.Response > b.Response;
+}
+
+// The comparison pattern: pairs of offsets drawn from an isotropic Gaussian over the patch
+const std::vector<int>& GetPattern()
+{
+  static std::vector<int> pattern;
+  if(pattern.empty())
+    {
+    LinearCongruentialGenerator generator(42);
+    const double sigma = PatchRadius / 2.0;
+    while(pattern.size() < 4 * NumberOfComparisons)
+      {
+      // Box-Muller
+      double u1 = std::max(1e-12, generator.Uniform());
+      double u2 = generator.Uniform();
+      double radius = sigma * sqrt(-2.0 * log(u1));
+      int offsets[2] = {static_cast<int>(floor(radius * cos(2.0 * 3.14159265358979 * u2) + 0.5)),
+                        static_cast<int>(floor(radius * sin(2.0 * 3.14159265358979 * u2) + 0.5))};
+      if(abs(offsets[0]) <= PatchRadius && abs(offsets[1]) <= PatchRadius)
+        {
+        pattern.push_back(offsets[0]);
+        pattern.push_back(offsets[1]);
+        }
+      }
+    }
+  return pattern;
+}
+
+struct DescriptorFunctor
+{
+  const float* Smoothed;
+  int Width;
+  const std::vector<Keypoint>* Keypoints;
+  const int* Pattern;
+  BinaryDescriptor* Descriptors;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType k = begin; k < end; ++k)
+      {
+      const Keypoint& keypoint = (*this->Keypoints)[k];
+      const float* center = this->Smoothed + static_cast<int>(keypoint.y) * this->Width + static_cast<int>(keypoint.x);
+      BinaryDescriptor& descriptor = this->Descriptors[k];
+      for(unsigned int word = 0; word < 8; ++word)
+        {
+        descriptor.Bits[word] = 0;
+        }
+      for(unsigned int bit = 0; bit < NumberOfComparisons; ++bit)
+        {
+        const int* pair = this->Pattern + 4 * bit;
+        if(center[pair[1] * this->Width + pair[0]] < center[pair[3] * this->Width + pair[2]])
+          {
+          descriptor.Bits[bit / 32] |= 1u << (bit % 32);
+          }
+        }
+      }
+  }
+};
+
+unsigned int PopulationCount(unsigned int value)
+{
+  value = value - ((value >> 1) & 0x55555555u);
+  value = (value & 0x33333333u) + ((value >> 2) & 0x33333333u);
+  return (((value + (value >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+}
+
+struct QueryFunctor
+{
+  const FeatureDetection::BinaryDescriptorIndex* Index;
+  const std::vector<BinaryDescriptor>* Queries;
+  std::vector<std::vector<unsigned int> >* Stamps;
+  int* Nearest;
+  unsigned int* NearestDistance;
+  unsigned int* SecondDistance;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    // Per-thread "last seen by query q" stamps avoid comparing a candidate twice
+    std::vector<unsigned int>& stamps = (*this->Stamps)[threadId];
+    const std::vector<BinaryDescriptor>& descriptors = *this->Index->Descriptors;
+    for(vtkIdType q = begin; q < end; ++q)
+      {
+      const BinaryDescriptor& query = (*this->Queries)[q];
+      int best = -1;
+      unsigned int bestDistance = NumberOfComparisons + 1;
+      unsigned int secondDistance = NumberOfComparisons + 1;
+      for(unsigned int table = 0; table < this->Index->NumberOfTables; ++table)
+        {
+        const std::vector<int>& bucket = this->Index->Buckets[table][this->Index->ComputeKey(query, table)];
+        for(unsigned int b = 0; b < bucket.size(); ++b)
+          {
+          int candidate = bucket[b];
+          if(stamps[candidate] == static_cast<unsigned int>(q) + 1)
+            {
+            continue;
+            }
+          stamps[candidate] = static_cast<unsigned int>(q) + 1;
+          unsigned int distance = FeatureDetection::HammingDistance(query, descriptors[candidate]);
+          if(distance < bestDistance)
+            {
+            secondDistance = bestDistance;
+            bestDistance = distance;
+            best = candidate;
+            }
+          else if(distance < secondDistance)
+            {
+            secondDistance = distance;
+            }
+          }
+        }
+      this->Nearest[q] = best;
+      this->NearestDistance[q] = bestDistance;
+      this->SecondDistance[q] = secondDistance;
+      }
+  }
+};
+
+} // end anonymous namespace
+
+namespace FeatureDetection
+{
+
+void DetectCorners(const float* image, const unsigned int width, const unsigned int height, const unsigned char* mask,
+                   const unsigned int maximumNumberOfKeypoints, const float minimumDistance, std::vector<Keypoint>& keypoints)
+{
+  keypoints.clear();
+  const size_t numberOfPixels = static_cast<size_t>(width) * height;
+  if(width < 3 || height < 3)
+    {
+    return;
+    }
+
+  std::vector<float> ixx(numberOfPixels);
+  std::vector<float> ixy(numberOfPixels);
+  std::vector<float> iyy(numberOfPixels);
+  GradientProductsFunctor gradients;
+  gradients.Image = image;
+  gradients.Width = width;
+  gradients.Height = height;
+  gradients.Ixx = &ixx[0];
+  gradients.Ixy = &ixy[0];
+  gradients.Iyy = &iyy[0];
+  Parallel::For(0, height, gradients);
+
+  std::vector<float> smoothedIxx;
+  std::vector<float> smoothedIxy;
+  std::vector<float> smoothedIyy;
+  BoxBlur(&ixx[0], width, height, BlurRadius, smoothedIxx);
+  BoxBlur(&ixy[0], width, height, BlurRadius, smoothedIxy);
+  BoxBlur(&iyy[0], width, height, BlurRadius, smoothedIyy);
+
+  std::vector<float> response(numberOfPixels);
+  HarrisResponseFunctor harris;
+  harris.Ixx = &smoothedIxx[0];
+  harris.Ixy = &smoothedIxy[0];
+  harris.Iyy = &smoothedIyy[0];
+  harris.Response = &response[0];
+  Parallel::For(0, numberOfPixels, harris);
+
+  std::vector<std::vector<Keypoint> > candidatesPerThread(Parallel::GetNumberOfThreads());
+  LocalMaximaFunctor maxima;
+  maxima.Response = &response[0];
+  maxima.Mask = mask;
+  maxima.Width = width;
+  maxima.Height = height;
+  maxima.Candidates = &candidatesPerThread;
+  Parallel::For(0, height, maxima);
+
+  std::vector<Keypoint> candidates;
+  for(unsigned int thread = 0; thread < candidatesPerThread.size(); ++thread)
+    {
+    candidates.insert(candidates.end(), candidatesPerThread[thread].begin(), candidatesPerThread[thread].end());
+    }
+  std::sort(candidates.begin(), candidates.end(), StrongerResponse);
+
+  // Greedy spatial suppression on a grid of minimumDistance sized cells
+  const float cellSize = std::max(1.0f, minimumDistance);
+  const int gridWidth = static_cast<int>(width / cellSize) + 1;
+  const int gridHeight = static_cast<int>(height / cellSize) + 1;
+  std::vector<std::vector<unsigned int> > grid(gridWidth * gridHeight);
+  const float minimumDistanceSquared = minimumDistance * minimumDistance;
+
+  for(unsigned int c = 0; c < candidates.size() && keypoints.size() < maximumNumberOfKeypoints; ++c)
+    {
+    const Keypoint& candidate = candidates[c];
+    int cellX = static_cast<int>(candidate.x / cellSize);
+    int cellY = static_cast<int>(candidate.y / cellSize);
+    bool isFree = true;
+    for(int y = std::max(0, cellY - 1); y <= std::min(gridHeight - 1, cellY + 1) && isFree; ++y)
+      {
+      for(int x = std::max(0, cellX - 1); x <= std::min(gridWidth - 1, cellX + 1) && isFree; ++x)
+        {
+        const std::vector<unsigned int>& cell = grid[y * gridWidth + x];
+        for(unsigned int k = 0; k < cell.size(); ++k)
+          {
+          float dx = keypoints[cell[k]].x - candidate.x;
+          float dy = keypoints[cell[k]].y - candidate.y;
+          if(dx * dx + dy * dy < minimumDistanceSquared)
+            {
+            isFree = false;
+            break;
+            }
+          }
+        }
+      }
+    if(isFree)
+      {
+      grid[cellY * gridWidth + cellX].push_back(keypoints.size());
+      keypoints.push_back(candidate);
+      }
+    }
+}
+
+void ComputeDescriptors(const float* image, const unsigned int width, const unsigned int height,
+                        std::vector<Keypoint>& keypoints, std::vector<BinaryDescriptor>& descriptors)
+{
+  // Keep only keypoints with a full patch around them
+  std::vector<Keypoint> inside;
+  inside.reserve(keypoints.size());
+  for(unsigned int k = 0; k < keypoints.size(); ++k)
+    {
+    if(keypoints[k].x >= PatchRadius && keypoints[k].y >= PatchRadius &&
+       keypoints[k].x < static_cast<float>(width) - PatchRadius && keypoints[k].y < static_cast<float>(height) - PatchRadius)
+      {
+      inside.push_back(keypoints[k]);
+      }
+    }
+  keypoints.swap(inside);
+
+  descriptors.resize(keypoints.size());
+  if(keypoints.empty())
+    {
+    return;
+    }
+
+  std::vector<float> smoothed;
+  BoxBlur(image, width, height, BlurRadius, smoothed);
+
+  DescriptorFunctor describe;
+  describe.Smoothed = &smoothed[0];
+  describe.Width = width;
+  describe.Keypoints = &keypoints;
+  describe.Pattern = &GetPattern()[0];
+  describe.Descriptors = &descriptors[0];
+  Parallel::For(0, keypoints.size(), describe);
+}
+
+unsigned int HammingDistance(const BinaryDescriptor& a, const BinaryDescriptor& b)
+{
+  unsigned int distance = 0;
+  for(unsigned int word = 0; word < 8; ++word)
+    {
+    distance += PopulationCount(a.Bits[word] ^ b.Bits[word]);
+    }
+  return distance;
+}
+
+BinaryDescriptorIndex::BinaryDescriptorIndex(const unsigned int numberOfTables, const unsigned int bitsPerKey)
+{
+  this->Descriptors = NULL;
+  this->NumberOfTables = numberOfTables;
+  this->BitsPerKey = bitsPerKey;
+
+  LinearCongruentialGenerator generator(7);
+  this->KeyBits.resize(numberOfTables);
+  for(unsigned int table = 0; table < numberOfTables; ++table)
+    {
+    for(unsigned int bit = 0; bit < bitsPerKey; ++bit)
+      {
+      this->KeyBits[table].push_back(generator.Next() % NumberOfComparisons);
+      }
+    }
+}
+
+unsigned int BinaryDescriptorIndex::ComputeKey(const BinaryDescriptor& descriptor, const unsigned int table) const
+{
+  unsigned int key = 0;
+  const std::vector<unsigned int>& bits = this->KeyBits[table];
+  for(unsigned int bit = 0; bit < bits.size(); ++bit)
+    {
+    key = (key << 1) | ((descriptor.Bits[bits[bit] / 32] >> (bits[bit] % 32)) & 1u);
+    }
+  return key;
+}
+
+void BinaryDescriptorIndex::Build(const std::vector<BinaryDescriptor>& descriptors)
+{
+  this->Descriptors = &descriptors;
+  this->Buckets.assign(this->NumberOfTables, std::vector<std::vector<int> >(1u << this->BitsPerKey));
+  for(unsigned int table = 0; table < this->NumberOfTables; ++table)
+    {
+    for(unsigned int d = 0; d < descriptors.size(); ++d)
+      {
+      this->Buckets[table][this->ComputeKey(descriptors[d], table)].push_back(d);
+      }
+    }
+}
+
+void BinaryDescriptorIndex::Query(const std::vector<BinaryDescriptor>& queries, std::vector<int>& nearest,
+                                  std::vector<unsigned int>& nearestDistance, std::vector<unsigned int>& secondDistance) const
+{
+  nearest.assign(queries.size(), -1);
+  nearestDistance.assign(queries.size(), NumberOfComparisons + 1);
+  secondDistance.assign(queries.size(), NumberOfComparisons + 1);
+  if(queries.empty() || !this->Descriptors || this->Descriptors->empty())
+    {
+    return;
+    }
+
+  std::vector<std::vector<unsigned int> > stamps(Parallel::GetNumberOfThreads(),
+                                                 std::vector<unsigned int>(this->Descriptors->size(), 0));
+
+  QueryFunctor query;
+  query.Index = this;
+  query.Queries = &queries;
+  query.Stamps = &stamps;
+  query.Nearest = &nearest[0];
+  query.NearestDistance = &nearestDistance[0];
+  query.SecondDistance = &secondDistance[0];
+  Parallel::For(0, queries.size(), query);
+}
+
+} // end namespace
@@ -0,0 +1,78 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef FEATUREDETECTION_H
+#define FEATUREDETECTION_H
+
+// STL
+#include <vector>
+
+struct Keypoint
+{
+  float x, y;
+  float Response;
+};
+
+// 256 binary intensity comparisons (BRIEF)
+struct BinaryDescriptor
+{
+  unsigned int Bits[8];
+};
+
+// Harris corners and BRIEF descriptors on row-major float images. All passes are multithreaded.
+namespace FeatureDetection
+{
+
+// Detect up to maximumNumberOfKeypoints Harris corners, strongest first, at least minimumDistance pixels apart.
+// Pixels where mask is zero are ignored (mask may be NULL).
+void DetectCorners(const float* image, const unsigned int width, const unsigned int height, const unsigned char* mask,
+                   const unsigned int maximumNumberOfKeypoints, const float minimumDistance, std::vector<Keypoint>& keypoints);
+
+// Compute a descriptor for each keypoint. Keypoints too close to the border for a full patch are removed.
+// Descriptors are not rotation invariant, which is fine when both images are seen from similar poses.
+void ComputeDescriptors(const float* image, const unsigned int width, const unsigned int height,
+                        std::vector<Keypoint>& keypoints, std::vector<BinaryDescriptor>& descriptors);
+
+unsigned int HammingDistance(const BinaryDescriptor& a, const BinaryDescriptor& b);
+
+// Approximate nearest neighbour search over binary descriptors by locality sensitive hashing:
+// each table hashes a fixed random subset of the bits, and only descriptors sharing a bucket
+// with the query in at least one table are compared.
+class BinaryDescriptorIndex
+{
+public:
+  BinaryDescriptorIndex(const unsigned int numberOfTables = 8, const unsigned int bitsPerKey = 14);
+
+  void Build(const std::vector<BinaryDescriptor>& descriptors);
+
+  // For each query, the nearest and second nearest indexed descriptor (or -1) and their distances
+  void Query(const std::vector<BinaryDescriptor>& queries, std::vector<int>& nearest, std::vector<unsigned int>& nearestDistance,
+             std::vector<unsigned int>& secondDistance) const;
+
+  unsigned int ComputeKey(const BinaryDescriptor& descriptor, const unsigned int table) const;
+
+  const std::vector<BinaryDescriptor>* Descriptors;
+  unsigned int NumberOfTables;
+  unsigned int BitsPerKey;
+  std::vector<std::vector<unsigned int> > KeyBits; // per table, the sampled bit positions
+  std::vector<std::vector<std::vector<int> > > Buckets; // per table, per key, descriptor indices
+};
+
+} // end namespace
+
+#endif
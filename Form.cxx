@@ -27,22 +27,32 @@
 #include "itkVector.h"
 
 // Qt
+#include <QDesktopServices>
+#include <QDir>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QIcon>
+#include <QRegExp>
+#include <QStatusBar>
 #include <QTextEdit>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 
 // VTK
 #include <vtkActor.h>
 #include <vtkActor2D.h>
+#include <vtkBoxWidget.h>
 #include <vtkCamera.h>
 #include <vtkCommand.h>
+#include <vtkDataArray.h>
 #include <vtkDataSetSurfaceFilter.h>
-#include <vtkFloatArray.h>
+#include <vtkEventQtSlotConnect.h>
 #include <vtkImageActor.h>
 #include <vtkImageData.h>
 #include <vtkInteractorStyleImage.h>
-#include <vtkLookupTable.h>
 #include <vtkMath.h>
+#include <vtkPlane.h>
+#include <vtkPlanes.h>
 #include <vtkPointData.h>
 #include <vtkPointPicker.h>
 #include <vtkProperty2D.h>
@@ -55,13 +65,34 @@
 #include <vtkRenderWindow.h>
 #include <vtkRenderWindowInteractor.h>
 #include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+#include <vtkUnsignedCharArray.h>
 #include <vtkVertexGlyphFilter.h>
-#include <vtkXMLPolyDataReader.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
 
 // Custom
+#include "BundleAdjustment.h"
+#include "CorrespondenceDiagnostics.h"
+#include "CorrespondenceProposer.h"
 #include "Helpers.h"
+#include "MutualInformationRegistration.h"
+#include "PointCloudColoring.h"
+#include "PointCloudReader.h"
+#include "PointCloudReduction.h"
+#include "PoseEstimation.h"
 #include "Types.h"
 
+namespace
+{
+
+// The largest change of a coordinate of compact points: a millimetre for scans in metres
+const double CompactPrecision = 0.001;
+
+} // end anonymous namespace
+
 void Form::on_actionHelp_activated()
 {
   QTextEdit* help=new QTextEdit();
@@ -70,13 +101,64 @@ void Form::on_actionHelp_activated()
   help->append("<h1>Image keypoints</h1>\
   Hold the right mouse button and drag to zoom in and out. <br/>\
   Hold the middle mouse button and drag to pan the image. <br/>\
-  Click the left mouse button to select a keypoint.<br/> <p/>\
+  Click the left mouse button to select a keypoint. With snapping enabled the keypoint moves to the nearest corner or blob center.<br/> <p/>\
   <h1>Point cloud keypoints</h1>\
+  Point clouds can be opened from VTP, LAS, PLY and PCD files. Compressed LAZ files must be decompressed to LAS first.<br/>\
+  Dense scans can be reduced as they are opened, by averaging voxels, by keeping points a minimum distance apart (Poisson disk) \
+  or by keeping a random percentage. Keypoints selected on a reduced cloud are still the exact points of the full scan.<br/>\
+  The reduced copy, spacing and search structures computed for a point cloud are cached on disk, so reopening the same cloud is fast.<br/>\
+  Point clouds can be colored by elevation or by any of their point arrays, such as intensity, color or classification.<br/>\
+  Scans split into many tiles are opened through a tile index: Index Point Cloud Tiles reads the chosen tiles once and saves \
+  an index of their bounds (.tiles), which Open Point Cloud opens. Only the tiles in view and nearest the camera are kept \
+  in memory; the others are read in the background as the view moves.<br/>\
+  Check Compact, before opening a point cloud, to keep the full resolution points behind a reduced cloud in about half \
+  the memory. Resident tiles are kept compact too, but the tiles shown are drawn from one float copy of them, so about \
+  1.6 times as many points fit the tile memory (with normals and intensity; less without). Points too scattered to take \
+  less memory compact are kept as they are. Compact coordinates move by at most 0.001 (a millimetre for scans in metres), \
+  normals by 1 degree and intensities by 1/131070 of their range; they are decoded when shown or picked.<br/>\
+  When only part of a large scan is in the image, crop the cloud to a box (drag its faces and handles, then release) or to the \
+  view of the current pose. Only the points inside are shown, picked and registered, so the views stay fast.<br/>\
+  Several images can be opened at once, or one after the other; each is a frame with its own keypoints and pose, \
+  all against the same point cloud. Switch frames with the frame list or Page Up / Page Down, and save them all as a session.<br/>\
+  For frames from a video, check Sequence: stepping to the next frame when it has no keypoints yet tracks the image keypoints \
+  into it and pairs them with the same point cloud keypoints. Keypoints that cannot be followed leave their point cloud keypoint \
+  waiting for a click in the new frame.<br/>\
+  High bit depth images (16 bit, thermal) keep their full range; adjust the window and level with the contrast sliders or Auto.<br/>\
+  The RGB check box switches the image between color and magnitude at any time; each view is prepared the first time it is shown.<br/>\
   Hold the left mouse button and drag to rotate the scene.<br/>\
   Hold the right mouse button and drag to zoom in and out. Hold the middle mouse button and drag to pan the scene. While holding control (CTRL), click the left mouse button to select a keypoint.<br/>\
+  Meshes are shown as surfaces and keypoints are placed exactly where the surface is clicked; for points the nearest point is selected.<br/>\
   If you need to zoom in farther, hold shift while left clicking a point to change the camera's focal point to that point. You can reset the focal point by pressing 'r'.\
+  <h1>Editing keypoints</h1>\
+  A keypoint is paired with the oldest keypoint of the other view still waiting for a partner, and both are labeled with the \
+  number of the pair. Drag a marker in the image, or control drag it in the point cloud, to move its keypoint; once there is a pose \
+  the status bar shows how far the pair is from fitting it. \
+  Press Delete with the mouse over a marker to delete that keypoint; the other keypoint of the pair then \
+  waits for a new partner. To re-pair two keypoints, press 'x' over one image marker and then over another: their point \
+  cloud keypoints are exchanged. Press 'm' the same way to move a pair in front of another in the saved order (or over \
+  empty space to move it to the end). Ctrl+Z and Ctrl+Y undo and redo the changes made to the keypoints of a frame.\
   <h1>Saving keypoints</h1>\
-  The same number of keypoints must be selected in both the image and the point cloud before the points can be saved."
+  Every keypoint must have a partner before the points can be saved.\
+  <h1>Registration</h1>\
+  Estimate Pose computes the camera from at least 6 keypoint pairs.<br/>\
+  Adjust All Frames refines the poses of all the frames together, with the focal length they share. \
+  A point picked in several frames ties them together.<br/>\
+  Enter the camera each frame was taken with next to the frame list. Calibrate Camera estimates the focal length, principal point \
+  and lens distortion of the current frame's camera from the keypoint pairs of all its frames, ignoring mistaken pairs. \
+  The calibration is remembered across sessions, and from then on Estimate Pose finds only the position and orientation \
+  of that camera's frames, which needs as few as 3 pairs once the frame has a pose.<br/>\
+  Register Automatically aligns the point cloud intensity with the image. It starts from the current pose, from the keypoint pairs if there are at least 3, \
+  or otherwise from the point cloud view, so first rotate the point cloud until it roughly looks like the image.<br/>\
+  Propose Correspondences matches corners between the image and the point cloud intensity seen from the same starting pose. \
+  Each proposed pair is highlighted in yellow; press 'y' to accept it as a keypoint pair or 'n' to reject it.<br/>\
+  After Estimate Pose (or with Diagnose Correspondences) each pair is left out in turn and the pose solved from the others: \
+  markers turn green if that pose predicts the pair well, orange if it is worth a look, magenta if it is likely a mistake \
+  and grey if the pose cannot be solved without it. \
+  Export Diagnostics writes these for every frame of the session; \
+  SelectCorrespondences2D3D --diagnose session output.txt does the same without the window.<br/>\
+  Once there is a pose, selecting an image keypoint highlights the point cloud points along its ray, the most likely one in yellow. \
+  Press 'c' to select that point as the matching point cloud keypoint. \
+  Conversely, selecting a point cloud keypoint zooms the image to where it is expected, with an ellipse showing the uncertainty of the pose."
   );
   help->show();
 }
@@ -105,6 +187,19 @@ Form::Form()
   this->PointCloudActor = vtkSmartPointer<vtkActor>::New();
   this->PointCloudMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
   this->PointCloud = vtkSmartPointer<vtkPolyData>::New();
+  this->AverageSpacing = 0;
+  this->CloudKey = 0;
+  this->CloudOrigin[0] = this->CloudOrigin[1] = this->CloudOrigin[2] = 0;
+
+  this->Connections = vtkSmartPointer<vtkEventQtSlotConnect>::New();
+
+  this->ShownImageDisplay = MagnitudeDisplay;
+  this->CurrentFrame = -1;
+  this->TrackerFrame = -1;
+  this->TilesPaging = false;
+  this->TilesOutdated = false;
+  connect(&this->ImageDisplayWatcher, SIGNAL(finished()), this, SLOT(ImageDisplayBuilt()));
+  connect(&this->TileWatcher, SIGNAL(finished()), this, SLOT(TilesPaged()));
 
   // Setup icons
   QIcon openIcon = QIcon::fromTheme("document-open");
@@ -133,8 +228,28 @@ Form::Form()
   // Initializations
   this->pointSelectionStyle2D = NULL;
   this->pointSelectionStyle3D = NULL;
+  this->HasPose = false;
+  this->CurrentProposal = 0;
+  this->RayKeypoint = 0;
+
+  // Cameras calibrated in earlier sessions
+  this->CalibrationFileName = GetCalibrationFileName();
+  if(!this->Calibrations.Read(this->CalibrationFileName))
+    {
+    // Writing would drop the calibrations that could not be read
+    std::cerr << "Could not read the camera calibrations in " << this->CalibrationFileName
+              << "; new calibrations are kept for this session only." << std::endl;
+    this->CalibrationFileName.clear();
+    }
 };
 
+std::string Form::GetCalibrationFileName()
+{
+  QString dataDirectory = QDesktopServices::storageLocation(QDesktopServices::DataLocation);
+  QDir().mkpath(dataDirectory);
+  return (dataDirectory + "/CameraCalibrations.txt").toStdString();
+}
+
 
 void Form::on_actionLoad2DPoints_activated()
 {
@@ -156,18 +271,26 @@ void Form::on_actionLoad2DPoints_activated()
     std::cout << "Cannot open file." << std::endl;
   }
 
-  pointSelectionStyle2D->RemoveAllPoints();
+  // The loaded keypoints pair up with the point cloud keypoints in order
+  this->Correspondences.RemoveAllImagePoints();
   
   while(getline(fin, line))
     {
     std::stringstream ss;
     ss << line;
-    double p[3];
-    ss >> p[0] >> p[1];
-    p[2] = 0;
+    Coord2D p;
+    ss >> p.x >> p.y;
   
-    pointSelectionStyle2D->AddNumber(p);
+    this->Correspondences.AddImagePoint(p);
     }
+  UpdateMarkers();
+}
+
+Form::~Form()
+{
+  // A view being built in the background writes into this form, and frames being prefetched into FrameImages
+  this->ImageDisplayWatcher.waitForFinished();
+  QThreadPool::globalInstance()->waitForDone();
 }
 
 void Form::on_actionLoad3DPoints_activated()
@@ -190,47 +313,74 @@ void Form::on_actionLoad3DPoints_activated()
     std::cout << "Cannot open file." << std::endl;
   }
 
-  pointSelectionStyle3D->RemoveAllPoints();
+  this->Correspondences.RemoveAllWorldPoints();
 
   while(getline(fin, line))
     {
     std::stringstream ss;
     ss << line;
-    double p[3];
-    ss >> p[0] >> p[1] >> p[2];
-    pointSelectionStyle3D->AddNumber(p);
+    Coord3D world;
+    ss >> world.x >> world.y >> world.z;
+    this->Correspondences.AddWorldPoint(world);
     }
+  UpdateMarkers();
 }
 
 void Form::on_actionOpenImage_activated()
 {
-   // Get a filename to open
-  QString fileName = QFileDialog::getOpenFileName(this, "Open File", ".", "Image Files (*.png *.mhd *.tif)");
+  // Get the images to open
+  QStringList fileNames = QFileDialog::getOpenFileNames(this, "Open Files", ".", "Image Files (*.png *.mhd *.tif)");
 
-  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
-  if(fileName.toStdString().empty())
+  if(fileNames.isEmpty())
     {
-    std::cout << "Filename was empty." << std::endl;
+    std::cout << "No files were selected." << std::endl;
     return;
     }
 
-  typedef itk::ImageFileReader<FloatVectorImageType> ReaderType;
-  ReaderType::Pointer reader = ReaderType::New();
-  reader->SetFileName(fileName.toStdString());
-  reader->Update();
-  
-  this->Image = reader->GetOutput();
+  // Each image is a new frame against the same point cloud, taken with the camera entered for the frame shown;
+  // the first one is shown
+  int firstNewFrame = this->CurrentSession.Frames.size();
+  for(int i = 0; i < fileNames.size(); ++i)
+    {
+    std::cout << "Got filename: " << fileNames[i].toStdString() << std::endl;
+    SessionFrame frame;
+    frame.ImageFileName = fileNames[i].toStdString();
+    frame.CameraId = this->txtCameraId->text().toStdString();
+    this->CurrentSession.Frames.push_back(frame);
+    }
+  UpdateFrameList();
+  ShowFrame(firstNewFrame);
+}
 
-  if(this->chkRGB->isChecked())
+void Form::ShowImage()
+{
+  int previousDimensions[3];
+  this->ImageData->GetDimensions(previousDimensions);
+
+  // Build the view that was asked for now; the other one is built if and when chkRGB is toggled
+  for(unsigned int display = 0; display < 2; ++display)
     {
-    Helpers::ITKImagetoVTKRGBImage(this->Image, this->ImageData);
+    this->ImageDisplays[display].Contrast.Initialize();
+    this->ImageDisplays[display].Data = NULL;
     }
-  else
+  unsigned int display = GetRequestedImageDisplay();
+  BuildImageDisplay(&this->ImageDisplays[display], this->Image, this->MagnitudeImage, display == ColorDisplay);
+  ShowImageDisplay(display);
+
+  // The view is set up with the first image; later frames keep its zoom unless their size differs
+  if(this->pointSelectionStyle2D)
     {
-    Helpers::ITKImagetoVTKMagnitudeImage(this->Image, this->ImageData);
+    this->pointSelectionStyle2D->Refiner.SetImage(this->MagnitudeImage.Get());
+    int dimensions[3];
+    this->ImageData->GetDimensions(dimensions);
+    if(dimensions[0] != previousDimensions[0] || dimensions[1] != previousDimensions[1])
+      {
+      this->LeftRenderer->ResetCamera();
+      }
+    this->qvtkWidgetLeft->GetRenderWindow()->Render();
+    return;
     }
-  
-  this->ImageActor->SetInput(this->ImageData);
+
   this->ImageActor->InterpolateOff();
   
   // Add Actor to renderer
@@ -241,6 +391,22 @@ void Form::on_actionOpenImage_activated()
   this->qvtkWidgetLeft->GetRenderWindow()->GetInteractor()->SetPicker(pointPicker);
   this->pointSelectionStyle2D = vtkSmartPointer<PointSelectionStyle2D>::New();
   this->pointSelectionStyle2D->SetCurrentRenderer(this->LeftRenderer);
+  this->pointSelectionStyle2D->Image = this->ImageData;
+  this->pointSelectionStyle2D->Snap = this->chkSnap->isChecked();
+  this->pointSelectionStyle2D->Correspondences = &this->Correspondences;
+  this->Connections->Connect(this->pointSelectionStyle2D, PointSelectionStyle2D::KeypointClickedEvent,
+                             this, SLOT(ImageKeypointClicked()));
+  this->Connections->Connect(this->pointSelectionStyle2D, PointSelectionStyle2D::KeypointDeletedEvent,
+                             this, SLOT(UpdateMarkers()));
+  this->Connections->Connect(this->pointSelectionStyle2D, PointSelectionStyle2D::KeypointDraggedEvent,
+                             this, SLOT(ImageKeypointDragged()));
+  this->Connections->Connect(this->pointSelectionStyle2D, PointSelectionStyle2D::KeypointMovedEvent,
+                             this, SLOT(ImageKeypointMoved()));
+  this->Connections->Connect(this->pointSelectionStyle2D, PointSelectionStyle2D::KeypointsRearrangedEvent,
+                             this, SLOT(UpdateMarkers()));
+  this->pointSelectionStyle2D->UpdateMarkers();
+
+  this->pointSelectionStyle2D->Refiner.SetImage(this->MagnitudeImage.Get());
   this->qvtkWidgetLeft->GetRenderWindow()->GetInteractor()->SetInteractorStyle(pointSelectionStyle2D);
 
   this->LeftRenderer->ResetCamera();
@@ -275,7 +441,8 @@ void Form::on_actionOpenImage_activated()
 void Form::on_actionOpenPointCloud_activated()
 {
   // Get a filename to open
-  QString fileName = QFileDialog::getOpenFileName(this, "Open File", ".", "Image Files (*.vtp)");
+  QString fileName = QFileDialog::getOpenFileName(this, "Open File", ".",
+                                                  "Point Clouds (*.vtp *.las *.laz *.ply *.pcd *.tiles);;All Files (*)");
 
   std::cout << "Got filename: " << fileName.toStdString() << std::endl;
   if(fileName.toStdString().empty())
@@ -284,25 +451,225 @@ void Form::on_actionOpenPointCloud_activated()
     return;
     }
 
-  vtkSmartPointer<vtkXMLPolyDataReader> reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
-  reader->SetFileName(fileName.toStdString().c_str());
-  reader->Update();
-  reader->GetOutput()->GetPointData()->SetActiveScalars("Intensity");
+  OpenPointCloud(fileName.toStdString());
+}
+
+void Form::on_actionIndexTiles_activated()
+{
+  QStringList fileNames = QFileDialog::getOpenFileNames(this, "Tiles to Index", ".",
+                                                        "Point Clouds (*.vtp *.las *.ply *.pcd);;All Files (*)");
+  if(fileNames.isEmpty())
+    {
+    std::cout << "No files were selected." << std::endl;
+    return;
+    }
+
+  QString indexFileName = QFileDialog::getSaveFileName(this, "Save Tile Index", QFileInfo(fileNames[0]).absolutePath(),
+                                                       "Tile Indexes (*.tiles)");
+  std::cout << "Got filename: " << indexFileName.toStdString() << std::endl;
+  if(indexFileName.isEmpty())
+    {
+    std::cout << "Filename was empty." << std::endl;
+    return;
+    }
+  if(!TiledPointCloud::IsIndexFile(indexFileName.toStdString()))
+    {
+    indexFileName += ".tiles";
+    }
+
+  // Each tile is read once, for its bounds
+  std::vector<std::string> tileFileNames;
+  for(int i = 0; i < fileNames.size(); ++i)
+    {
+    tileFileNames.push_back(fileNames[i].toStdString());
+    }
+  this->statusBar()->showMessage(QString("Indexing %1 tiles...").arg(fileNames.size()));
+  bool written = TiledPointCloud::WriteIndex(tileFileNames, indexFileName.toStdString());
+  this->statusBar()->clearMessage();
+  if(written)
+    {
+    OpenPointCloud(indexFileName.toStdString());
+    }
+}
+
+void Form::OpenPointCloud(const std::string& fileName)
+{
+  // The points are kept compact (float) but precise by storing them relative to a local origin
+  vtkSmartPointer<vtkPolyData> pointCloud = vtkSmartPointer<vtkPolyData>::New();
+  double cloudOrigin[3];
+  vtkSmartPointer<vtkTimerLog> readTimer = vtkSmartPointer<vtkTimerLog>::New();
+  readTimer->StartTimer();
+  const bool tiled = TiledPointCloud::IsIndexFile(fileName);
+  TiledPointCloud tiles;
+  if(tiled)
+    {
+    // Start with the tile nearest the middle of the dataset, to place the camera; the ones in view are paged
+    // in the background once it is shown
+    if(!tiles.ReadIndex(fileName))
+      {
+      return;
+      }
+    double bounds[6];
+    tiles.GetBounds(bounds);
+    double center[3] = {0.5 * (bounds[0] + bounds[1]), 0.5 * (bounds[2] + bounds[3]), 0.5 * (bounds[4] + bounds[5])};
+    tiles.SetCompact(this->chkCompact->isChecked(), CompactPrecision);
+    std::vector<unsigned int> firstTiles;
+    tiles.ChooseTiles(center, PointCloudReduction::CropRegion(), 0, firstTiles);
+    firstTiles.resize(1);
+    tiles.Page(firstTiles);
+    tiles.Assemble(pointCloud);
+    tiles.GetOrigin(cloudOrigin);
+    }
+  else if(!PointCloudReader::Read(fileName, pointCloud, cloudOrigin))
+    {
+    return;
+    }
+  this->CurrentSession.PointCloudFileName = fileName;
+
+  // Tiles of the previous dataset may still be paging in
+  this->TileWatcher.waitForFinished();
+  this->TilesPaging = false;
+  this->TilesOutdated = false;
+  this->Tiles = tiles;
+
+  // The keypoints of the current frame are in world coordinates, so they carry over to the new cloud
+  StoreFrame();
+  readTimer->StopTimer();
+  std::cout << "Read " << pointCloud->GetNumberOfPoints() << " points in " << readTimer->GetElapsedTime()
+            << " seconds." << std::endl;
+
+  // Optionally work on a reduced copy; picks are resolved back to the full resolution points
+  this->FullResolutionPoints = NULL;
+  this->CompactFullResolutionPoints.Clear();
+  if(this->cmbReduction->currentIndex() != ReduceNone && !tiled &&
+     pointCloud->GetNumberOfPolys() == 0 && pointCloud->GetNumberOfStrips() == 0)
+    {
+    vtkSmartPointer<vtkPolyData> reduced = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkTimerLog> reductionTimer = vtkSmartPointer<vtkTimerLog>::New();
+    reductionTimer->StartTimer();
+    // A cloud reopened with the same reduction gets the reduced copy from the cache
+    const vtkTypeUInt64 fullResolutionKey = DerivedDataCache::ComputeKey(pointCloud);
+    const std::string reductionName = QString("Reduction%1-%2").arg(this->cmbReduction->currentIndex())
+                                        .arg(this->spinReduction->value(), 0, 'g', 17).toStdString();
+    if(this->Cache.LoadPointCloud(fullResolutionKey, reductionName, reduced))
+      {
+      std::cout << "Using the cached reduction." << std::endl;
+      }
+    else
+      {
+      switch(this->cmbReduction->currentIndex())
+        {
+        case ReduceVoxelGrid:
+          PointCloudReduction::VoxelGrid(pointCloud, this->spinReduction->value(), reduced);
+          break;
+        case ReducePoissonDisk:
+          PointCloudReduction::PoissonDisk(pointCloud, this->spinReduction->value(), reduced);
+          break;
+        default:
+          PointCloudReduction::Random(pointCloud, this->spinReduction->value() / 100.0, reduced);
+          break;
+        }
+      this->Cache.StorePointCloud(fullResolutionKey, reductionName, reduced);
+      }
+    reductionTimer->StopTimer();
+    std::cout << "Reduction took " << reductionTimer->GetElapsedTime() << " seconds." << std::endl;
+
+    if(reduced->GetNumberOfPoints() > 0 && this->chkCompact->isChecked())
+      {
+      // Only the positions are needed to resolve picks
+      vtkSmartPointer<vtkPolyData> positions = vtkSmartPointer<vtkPolyData>::New();
+      positions->SetPoints(pointCloud->GetPoints());
+      this->CompactFullResolutionPoints.Encode(positions, CompactPrecision);
+      // Each run of points in one octree cell costs 20 bytes, so scattered points can take more compact
+      const size_t floatSize = static_cast<size_t>(pointCloud->GetPoints()->GetActualMemorySize()) * 1024;
+      if(this->CompactFullResolutionPoints.GetSize() < floatSize)
+        {
+        std::cout << "Kept the " << this->CompactFullResolutionPoints.GetNumberOfPoints() << " full resolution points in "
+                  << this->CompactFullResolutionPoints.GetSize() / 1048576 << " MB, to within "
+                  << this->CompactFullResolutionPoints.GetPrecision() << "." << std::endl;
+        }
+      else
+        {
+        std::cout << "The full resolution points take no less memory compact, so they are kept as they are." << std::endl;
+        this->CompactFullResolutionPoints.Clear();
+        this->FullResolutionPoints = pointCloud->GetPoints();
+        }
+      pointCloud = reduced;
+      }
+    else if(reduced->GetNumberOfPoints() > 0)
+      {
+      this->FullResolutionPoints = pointCloud->GetPoints();
+      pointCloud = reduced;
+      }
+    }
+
+  this->PointCloud = pointCloud;
+  this->UncroppedPointCloud = pointCloud;
+  this->CropIndex.Initialize();
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    this->CloudOrigin[i] = cloudOrigin[i];
+    }
+  this->PointCloudMapper->SetInput(this->PointCloud);
+
+  // Statistics of everything the points can be colored by; the colors themselves are made when first shown
+  vtkSmartPointer<vtkTimerLog> statisticsTimer = vtkSmartPointer<vtkTimerLog>::New();
+  statisticsTimer->StartTimer();
+  PointCloudColoring::ComputeAttributes(this->PointCloud, this->CloudOrigin, this->PointAttributes);
+  statisticsTimer->StopTimer();
+  std::cout << "Computed the statistics of " << this->PointAttributes.size() << " point attributes in "
+            << statisticsTimer->GetElapsedTime() << " seconds." << std::endl;
+  this->ColorBuffers.assign(this->PointAttributes.size(), vtkSmartPointer<vtkUnsignedCharArray>());
+
+  // Show the colors the scan came with if it has them, else its intensity, else its elevation
+  int colorBy = this->PointAttributes.empty() ? 0 : 1;
+  bool hasColors = false;
+  this->cmbColorBy->blockSignals(true);
+  this->cmbColorBy->clear();
+  this->cmbColorBy->addItem("Solid color");
+  for(unsigned int i = 0; i < this->PointAttributes.size(); ++i)
+    {
+    this->cmbColorBy->addItem(QString::fromStdString(this->PointAttributes[i].Name));
+    if(!hasColors && this->PointAttributes[i].Type == PointAttribute::Color)
+      {
+      colorBy = i + 1;
+      hasColors = true;
+      }
+    else if(!hasColors && this->PointAttributes[i].ArrayName == "Intensity")
+      {
+      colorBy = i + 1;
+      }
+    }
+  this->cmbColorBy->setCurrentIndex(colorBy);
+  this->cmbColorBy->blockSignals(false);
+  ColorPointCloud(colorBy);
 
-  float range[2];
-  vtkFloatArray::SafeDownCast(reader->GetOutput()->GetPointData()->GetArray("Intensity"))->GetValueRange(range);
-  
-  vtkSmartPointer<vtkLookupTable> lookupTable = vtkSmartPointer<vtkLookupTable>::New();
-  //lookupTable->SetTableRange(0.0, 10.0);
-  lookupTable->SetTableRange(range[0], range[1]);
-  //lookupTable->SetHueRange(0, .5);
-  //lookupTable->SetHueRange(.5, 1);
-  lookupTable->SetHueRange(0, 1);
-  
-  this->PointCloudMapper->SetInputConnection(reader->GetOutputPort());
-  this->PointCloudMapper->SetLookupTable(lookupTable);
   this->PointCloudActor->SetMapper(this->PointCloudMapper);
-  this->PointCloudActor->GetProperty()->SetRepresentationToPoints();
+
+  // Everything derived from the cloud below is looked up in the cache under this key first
+  this->CloudKey = DerivedDataCache::ComputeKey(this->PointCloud);
+
+  // Meshes are shown and picked as surfaces, everything else as points
+  this->SurfaceBVH.Initialize();
+  if(this->PointCloud->GetNumberOfPolys() > 0 || this->PointCloud->GetNumberOfStrips() > 0)
+    {
+    this->PointCloudActor->GetProperty()->SetRepresentationToSurface();
+
+    if(!this->Cache.LoadTriangleBVH(this->CloudKey, this->SurfaceBVH))
+      {
+      vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+      timer->StartTimer();
+      this->SurfaceBVH.Build(this->PointCloud);
+      timer->StopTimer();
+      std::cout << "Built the picking hierarchy for " << this->SurfaceBVH.GetNumberOfTriangles() << " triangles in "
+                << timer->GetElapsedTime() << " seconds." << std::endl;
+      this->Cache.StoreTriangleBVH(this->CloudKey, this->SurfaceBVH);
+      }
+    }
+  else
+    {
+    this->PointCloudActor->GetProperty()->SetRepresentationToPoints();
+    }
   
   // Add Actor to renderer
   this->RightRenderer->AddActor(this->PointCloudActor);
@@ -315,13 +682,415 @@ void Form::on_actionOpenPointCloud_activated()
   this->qvtkWidgetRight->GetRenderWindow()->GetInteractor()->SetPicker(pointPicker);
   this->pointSelectionStyle3D = vtkSmartPointer<PointSelectionStyle3D>::New();
   this->pointSelectionStyle3D->SetCurrentRenderer(this->RightRenderer);
-  this->pointSelectionStyle3D->Data = reader->GetOutput();
+  this->pointSelectionStyle3D->Data = this->PointCloud;
+  this->pointSelectionStyle3D->FullResolutionPoints = this->FullResolutionPoints;
+  this->pointSelectionStyle3D->CompactFullResolutionPoints =
+    this->CompactFullResolutionPoints.GetNumberOfPoints() > 0 ? &this->CompactFullResolutionPoints : NULL;
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    this->pointSelectionStyle3D->Origin[i] = this->CloudOrigin[i];
+    }
+  if(this->SurfaceBVH.GetNumberOfTriangles() > 0)
+    {
+    this->pointSelectionStyle3D->Surface = &this->SurfaceBVH;
+    }
+  this->pointSelectionStyle3D->Correspondences = &this->Correspondences;
+  this->pointSelectionStyle3D->Index = &this->CloudIndex;
+  this->Connections->Connect(this->pointSelectionStyle3D, PointSelectionStyle3D::KeypointClickedEvent,
+                             this, SLOT(PointCloudKeypointClicked()));
+  this->Connections->Connect(this->pointSelectionStyle3D, PointSelectionStyle3D::KeypointDeletedEvent,
+                             this, SLOT(UpdateMarkers()));
+  this->Connections->Connect(this->pointSelectionStyle3D, PointSelectionStyle3D::KeypointGrabbedEvent,
+                             this, SLOT(PrepareCloudIndex()));
+  this->Connections->Connect(this->pointSelectionStyle3D, PointSelectionStyle3D::KeypointDraggedEvent,
+                             this, SLOT(PointCloudKeypointDragged()));
+  this->Connections->Connect(this->pointSelectionStyle3D, PointSelectionStyle3D::KeypointMovedEvent,
+                             this, SLOT(PointCloudKeypointMoved()));
+  if(tiled)
+    {
+    this->Connections->Connect(this->pointSelectionStyle3D, vtkCommand::EndInteractionEvent, this, SLOT(UpdateTiles()));
+    }
+  this->pointSelectionStyle3D->UpdateMarkers();
   this->qvtkWidgetRight->GetRenderWindow()->GetInteractor()->SetInteractorStyle(pointSelectionStyle3D);
+
+  // A new cloud starts uncropped, with the crop box around the middle of it
+  if(!this->CropBox)
+    {
+    this->CropBox = vtkSmartPointer<vtkBoxWidget>::New();
+    this->CropBox->SetInteractor(this->qvtkWidgetRight->GetRenderWindow()->GetInteractor());
+    this->CropBox->SetPlaceFactor(0.5);
+    this->Connections->Connect(this->CropBox, vtkCommand::EndInteractionEvent, this, SLOT(CropBoxMoved()));
+    }
+  this->CropBox->Off();
+  this->CropBox->PlaceWidget(this->PointCloud->GetBounds());
+  this->cmbCrop->blockSignals(true);
+  this->cmbCrop->setCurrentIndex(CropNone);
+  this->cmbCrop->blockSignals(false);
   
   this->RightRenderer->ResetCamera();
 
-  float averageSpacing = Helpers::ComputeAverageSpacing(reader->GetOutput()->GetPoints());
+  float averageSpacing;
+  std::vector<double> cachedSpacing;
+  if(this->Cache.LoadValues(this->CloudKey, "AverageSpacing", cachedSpacing) && cachedSpacing.size() == 1)
+    {
+    averageSpacing = cachedSpacing[0];
+    }
+  else
+    {
+    averageSpacing = Helpers::ComputeAverageSpacing(this->PointCloud->GetPoints());
+    this->Cache.StoreValues(this->CloudKey, "AverageSpacing", std::vector<double>(1, averageSpacing));
+    }
   this->pointSelectionStyle3D->SetMarkerRadius(averageSpacing);
+  this->AverageSpacing = averageSpacing;
+
+  this->CloudIndex.Initialize();
+  ClearRayCandidates();
+  this->RayCandidates.clear();
+
+  ShowFrameKeypoints();
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+  UpdateTiles();
+}
+
+void Form::on_actionOpenSession_activated()
+{
+  QString fileName = QFileDialog::getOpenFileName(this, "Open Session", ".", "Sessions (*.session);;All Files (*)");
+
+  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
+  if(fileName.toStdString().empty())
+    {
+    std::cout << "Filename was empty." << std::endl;
+    return;
+    }
+
+  Session session;
+  if(!session.Read(fileName.toStdString()))
+    {
+    return;
+    }
+
+  this->CurrentSession = session;
+  this->CurrentFrame = -1;
+  this->TrackerPreparation.waitForFinished();
+  this->TrackerFrame = -1;
+  this->FrameImages.Clear();
+  if(!session.PointCloudFileName.empty())
+    {
+    OpenPointCloud(session.PointCloudFileName);
+    }
+  UpdateFrameList();
+  ShowFrame(0);
+}
+
+void Form::on_actionSaveSession_activated()
+{
+  StoreFrame();
+
+  QString fileName = QFileDialog::getSaveFileName(this, "Save Session", ".", "Sessions (*.session)");
+  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
+  if(fileName.toStdString().empty())
+    {
+    std::cout << "Filename was empty." << std::endl;
+    return;
+    }
+
+  this->CurrentSession.Write(fileName.toStdString());
+}
+
+void Form::on_actionNextFrame_activated()
+{
+  ShowFrame(this->CurrentFrame + 1);
+}
+
+void Form::on_actionPreviousFrame_activated()
+{
+  ShowFrame(this->CurrentFrame - 1);
+}
+
+void Form::on_cmbFrame_currentIndexChanged(int index)
+{
+  if(index != this->CurrentFrame)
+    {
+    ShowFrame(index);
+    }
+}
+
+void Form::StoreFrame()
+{
+  if(this->CurrentFrame < 0)
+    {
+    return;
+    }
+
+  SessionFrame& frame = this->CurrentSession.Frames[this->CurrentFrame];
+  this->Correspondences.GetKeypoints(frame.ImagePoints, frame.WorldPoints);
+  frame.Pose = this->Pose;
+  frame.HasPose = this->HasPose;
+}
+
+void Form::ShowFrame(const int index)
+{
+  if(index < 0 || index >= static_cast<int>(this->CurrentSession.Frames.size()))
+    {
+    return;
+    }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+  StoreFrame();
+  const int previousFrame = this->CurrentFrame;
+
+  // Usually the image was read ahead of time, while the previous frame was shown
+  const SessionFrame& frame = this->CurrentSession.Frames[index];
+  if(!this->FrameImages.Contains(frame.ImageFileName))
+    {
+    this->statusBar()->showMessage(QString("Reading ") + QString::fromStdString(frame.ImageFileName) + "...");
+    }
+  ImageHandle<FloatVectorImageType> image;
+  ImageHandle<FloatScalarImageType> magnitudeImage;
+  bool read = this->FrameImages.Get(frame.ImageFileName, image, magnitudeImage);
+  this->statusBar()->clearMessage();
+  if(!read)
+    {
+    // Stay on the frame that is shown
+    UpdateFrameList();
+    return;
+    }
+
+  // A view still being built in the background fills one of the ImageDisplays, which ShowImage resets
+  this->ImageDisplayWatcher.waitForFinished();
+
+  this->CurrentFrame = index;
+  this->Image = image;
+  this->MagnitudeImage = magnitudeImage;
+  ShowImage();
+
+  this->Pose = frame.Pose;
+  this->HasPose = frame.HasPose;
+  UpdateViewCrop();
+  this->txtCameraId->setText(QString::fromStdString(frame.CameraId));
+  this->Proposals.clear();
+  this->CurrentProposal = 0;
+  ClearRayCandidates();
+  this->RayCandidates.clear();
+  if(this->chkSequence->isChecked() && index == previousFrame + 1 && frame.ImagePoints.empty() &&
+     frame.WorldPoints.empty())
+    {
+    PropagateKeypoints(previousFrame);
+    }
+  ShowFrameKeypoints();
+  UpdateFrameList();
+
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+  timer->StopTimer();
+  std::cout << "Showing frame " << index + 1 << " of " << this->CurrentSession.Frames.size() << " ("
+            << frame.ImageFileName << ") after " << 1000.0 * timer->GetElapsedTime() << " ms." << std::endl;
+
+  // Read the neighboring frames while this one is worked on, so stepping through them does not wait for the disk
+  std::vector<std::string> neighbors;
+  if(index + 1 < static_cast<int>(this->CurrentSession.Frames.size()))
+    {
+    neighbors.push_back(this->CurrentSession.Frames[index + 1].ImageFileName);
+    }
+  if(index > 0)
+    {
+    neighbors.push_back(this->CurrentSession.Frames[index - 1].ImageFileName);
+    }
+  if(!neighbors.empty())
+    {
+    this->FramePrefetch = QtConcurrent::run(&this->FrameImages, &FrameImageCache::Prefetch, neighbors);
+    }
+  StartTrackerPreparation();
+}
+
+bool Form::PrepareTracker(KeypointTracker* tracker, FrameImageCache* frameImages, const std::string from,
+                          const std::string to)
+{
+  ImageHandle<FloatVectorImageType> image;
+  ImageHandle<FloatScalarImageType> previousImage;
+  ImageHandle<FloatScalarImageType> nextImage;
+  if(!frameImages->Get(from, image, previousImage) || !frameImages->Get(to, image, nextImage))
+    {
+    return false;
+    }
+  tracker->SetImages(previousImage.Get(), nextImage.Get());
+  return true;
+}
+
+void Form::StartTrackerPreparation()
+{
+  if(!this->chkSequence->isChecked() || this->CurrentFrame < 0 ||
+     this->CurrentFrame + 1 >= static_cast<int>(this->CurrentSession.Frames.size()) ||
+     this->TrackerFrame == this->CurrentFrame)
+    {
+    return;
+    }
+
+  // The tracker is not used while it is prepared
+  this->TrackerPreparation.waitForFinished();
+  this->TrackerFrame = this->CurrentFrame;
+  this->TrackerPreparation = QtConcurrent::run(&Form::PrepareTracker, &this->Tracker, &this->FrameImages,
+                                               this->CurrentSession.Frames[this->CurrentFrame].ImageFileName,
+                                               this->CurrentSession.Frames[this->CurrentFrame + 1].ImageFileName);
+}
+
+void Form::PropagateKeypoints(const int from)
+{
+  const SessionFrame& previous = this->CurrentSession.Frames[from];
+  SessionFrame& next = this->CurrentSession.Frames[from + 1];
+
+  // Only complete pairs are tracked; point cloud keypoints still waiting for a partner wait in the next frame too
+  const unsigned int numberOfPairs = std::min(previous.ImagePoints.size(), previous.WorldPoints.size());
+  if(numberOfPairs == 0)
+    {
+    return;
+    }
+
+  // Usually the pyramids were built while the previous frame was shown
+  this->TrackerPreparation.waitForFinished();
+  if(this->TrackerFrame != from || !this->TrackerPreparation.result())
+    {
+    this->TrackerFrame = -1;
+    if(!PrepareTracker(&this->Tracker, &this->FrameImages, previous.ImageFileName, next.ImageFileName))
+      {
+      std::cerr << "Cannot track the keypoints of frame " << from + 1 << " without its image." << std::endl;
+      return;
+      }
+    this->TrackerFrame = from;
+    }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+  std::vector<Coord2D> points(previous.ImagePoints.begin(), previous.ImagePoints.begin() + numberOfPairs);
+  std::vector<Coord2D> tracked;
+  std::vector<unsigned char> found;
+  this->Tracker.Track(points, tracked, found);
+  timer->StopTimer();
+
+  // Tracked keypoints are paired with the same point cloud keypoints as before; the point cloud keypoints
+  // of lost tracks come after them, waiting for a new image keypoint
+  next.ImagePoints.clear();
+  next.WorldPoints.clear();
+  std::vector<Coord3D> waiting;
+  for(unsigned int i = 0; i < numberOfPairs; ++i)
+    {
+    if(found[i])
+      {
+      next.ImagePoints.push_back(tracked[i]);
+      next.WorldPoints.push_back(previous.WorldPoints[i]);
+      }
+    else
+      {
+      waiting.push_back(previous.WorldPoints[i]);
+      }
+    }
+  next.WorldPoints.insert(next.WorldPoints.end(), waiting.begin(), waiting.end());
+  next.WorldPoints.insert(next.WorldPoints.end(), previous.WorldPoints.begin() + numberOfPairs,
+                          previous.WorldPoints.end());
+
+  double elapsed = timer->GetElapsedTime();
+  std::cout << "Tracked " << next.ImagePoints.size() << " of " << numberOfPairs << " keypoints into frame " << from + 2
+            << " in " << 1000.0 * elapsed << " ms";
+  if(elapsed > 0)
+    {
+    std::cout << " (" << numberOfPairs / elapsed << " points per second)";
+    }
+  std::cout << "." << std::endl;
+}
+
+void Form::ShowFrameKeypoints()
+{
+  if(this->CurrentFrame < 0)
+    {
+    return;
+    }
+
+  const SessionFrame& frame = this->CurrentSession.Frames[this->CurrentFrame];
+  if(this->pointSelectionStyle2D)
+    {
+    this->pointSelectionStyle2D->ClearCandidate();
+    this->pointSelectionStyle2D->ClearPrediction();
+    }
+  if(this->pointSelectionStyle3D)
+    {
+    this->pointSelectionStyle3D->ClearCandidate();
+    }
+
+  // Edits are undone within a frame
+  this->Correspondences.Set(frame.ImagePoints, frame.WorldPoints);
+  UpdateMarkers(false);
+}
+
+void Form::UpdateMarkers(const bool render)
+{
+  std::vector<CorrespondenceModel::Id> changed;
+  this->Correspondences.TakeChanged(changed);
+  for(unsigned int i = 0; i < changed.size(); ++i)
+    {
+    if(this->pointSelectionStyle2D)
+      {
+      this->pointSelectionStyle2D->UpdateMarker(changed[i]);
+      }
+    if(this->pointSelectionStyle3D)
+      {
+      this->pointSelectionStyle3D->UpdateMarker(changed[i]);
+      }
+    }
+
+  if(!render)
+    {
+    return;
+    }
+  if(this->pointSelectionStyle2D)
+    {
+    this->qvtkWidgetLeft->GetRenderWindow()->Render();
+    }
+  if(this->pointSelectionStyle3D)
+    {
+    this->qvtkWidgetRight->GetRenderWindow()->Render();
+    }
+}
+
+void Form::UpdateFrameList()
+{
+  this->cmbFrame->blockSignals(true);
+  this->cmbFrame->clear();
+  for(unsigned int i = 0; i < this->CurrentSession.Frames.size(); ++i)
+    {
+    QString name = QFileInfo(QString::fromStdString(this->CurrentSession.Frames[i].ImageFileName)).fileName();
+    this->cmbFrame->addItem(QString("%1: %2").arg(i + 1).arg(name));
+    }
+  this->cmbFrame->setCurrentIndex(this->CurrentFrame);
+  this->cmbFrame->blockSignals(false);
+}
+
+void Form::on_txtCameraId_editingFinished()
+{
+  // Ids are single words in the calibration file
+  QString cameraId = this->txtCameraId->text().trimmed();
+  cameraId.replace(QRegExp("\\s+"), "_");
+  this->txtCameraId->setText(cameraId);
+  if(this->CurrentFrame < 0)
+    {
+    return;
+    }
+
+  SessionFrame& frame = this->CurrentSession.Frames[this->CurrentFrame];
+  frame.CameraId = cameraId.toStdString();
+  CameraIntrinsics intrinsics;
+  if(GetCalibration(frame, intrinsics))
+    {
+    std::cout << "Camera " << frame.CameraId << " was calibrated from " << intrinsics.NumberOfFrames << " frames: focal length "
+              << intrinsics.FocalLength << ", principal point " << intrinsics.PrincipalPoint[0] << " "
+              << intrinsics.PrincipalPoint[1] << ", distortion " << intrinsics.Distortion[0] << " "
+              << intrinsics.Distortion[1] << " " << intrinsics.Distortion[2] << " " << intrinsics.Distortion[3] << std::endl;
+    }
+}
+
+bool Form::GetCalibration(const SessionFrame& frame, CameraIntrinsics& intrinsics) const
+{
+  return !frame.CameraId.empty() && this->Calibrations.Find(frame.CameraId, intrinsics);
 }
 
 void Form::on_actionSaveImagePoints_activated()
@@ -332,8 +1101,7 @@ void Form::on_actionSaveImagePoints_activated()
     return;
     }
   
-  if(this->pointSelectionStyle2D->Numbers.size() !=
-     this->pointSelectionStyle3D->Numbers.size())
+  if(this->Correspondences.GetNumberOfPairs() != this->Correspondences.GetNumberOfCorrespondences())
   {
     std::cerr << "The number of image correspondences must match the number of point cloud correspondences!" << std::endl;
     return;
@@ -347,15 +1115,16 @@ void Form::on_actionSaveImagePoints_activated()
     return;
     }
 
+  std::vector<Coord2D> imagePoints;
+  std::vector<Coord3D> worldPoints;
+  this->Correspondences.GetPairs(imagePoints, worldPoints);
+
   std::ofstream fout(fileName.toStdString().c_str());
+  fout.precision(15);
  
-  for(unsigned int i = 0; i < this->pointSelectionStyle2D->Coordinates.size(); i++)
+  for(unsigned int i = 0; i < imagePoints.size(); i++)
     {
-    //double p[3];
-    //this->pointSelectionStyle2D->Numbers[i]->GetPosition(p);
-    //fout << p[0] << " " << p[1] << std::endl;
-    fout << this->pointSelectionStyle2D->Coordinates[i].x << " " << this->pointSelectionStyle2D->Coordinates[i].y << std::endl;
- 
+    fout << imagePoints[i].x << " " << imagePoints[i].y << std::endl;
     }
   fout.close();
 }
@@ -368,8 +1137,7 @@ void Form::on_actionSavePointCloudPoints_activated()
     return;
     }
     
-  if(this->pointSelectionStyle2D->Numbers.size() !=
-     this->pointSelectionStyle3D->Numbers.size())
+  if(this->Correspondences.GetNumberOfPairs() != this->Correspondences.GetNumberOfCorrespondences())
   {
     std::cerr << "The number of image correspondences must match the number of point cloud correspondences!" << std::endl;
     return;
@@ -383,51 +1151,1410 @@ void Form::on_actionSavePointCloudPoints_activated()
     return;
     }
     
+  std::vector<Coord2D> imagePoints;
+  std::vector<Coord3D> worldPoints;
+  this->Correspondences.GetPairs(imagePoints, worldPoints);
+
   std::ofstream fout(fileName.toStdString().c_str());
+  fout.precision(15); // World coordinates may be georeferenced
  
-  for(unsigned int i = 0; i < this->pointSelectionStyle3D->Numbers.size(); i++)
+  for(unsigned int i = 0; i < worldPoints.size(); i++)
     {
-    /*
-    double p[3];
-    this->pointSelectionStyle3D->Numbers[i]->GetPosition(p);
-  
-    fout << p[0] << " " << p[1] << " " << p[2] << std::endl;
-    */
-    fout << this->pointSelectionStyle3D->Coordinates[i].x << " "
-         << this->pointSelectionStyle3D->Coordinates[i].y << " "
-         << this->pointSelectionStyle3D->Coordinates[i].z << std::endl;
+    fout << worldPoints[i].x << " " << worldPoints[i].y << " " << worldPoints[i].z << std::endl;
     }
   fout.close();
 }
 
 void Form::on_btnDeleteLastImageKeypoint_clicked()
 {
-  this->LeftRenderer->RemoveViewProp( this->pointSelectionStyle2D->Numbers[this->pointSelectionStyle2D->Numbers.size() - 1]);
-  this->LeftRenderer->RemoveViewProp( this->pointSelectionStyle2D->Points[this->pointSelectionStyle2D->Points.size() - 1]);
-  this->pointSelectionStyle2D->Numbers.erase(this->pointSelectionStyle2D->Numbers.end()-1);
-  this->pointSelectionStyle2D->Points.erase(this->pointSelectionStyle2D->Points.end()-1);
-  this->pointSelectionStyle2D->Coordinates.erase(this->pointSelectionStyle2D->Coordinates.end()-1);
-  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+  // The last correspondence with an image keypoint; only the ones waiting for one come after it
+  CorrespondenceModel::Id id = this->Correspondences.GetLast();
+  while(id != 0 && !this->Correspondences.HasImagePoint(id))
+    {
+    id = this->Correspondences.GetPrevious(id);
+    }
+  this->Correspondences.RemoveImagePoint(id);
+  UpdateMarkers();
 }
 
 void Form::on_btnDeleteAllImageKeypoints_clicked()
 {
-  this->pointSelectionStyle2D->RemoveAllPoints();
-  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+  this->Correspondences.RemoveAllImagePoints();
+  UpdateMarkers();
 }
 
 void Form::on_btnDeleteLastPointcloudKeypoint_clicked()
 {
-  this->RightRenderer->RemoveViewProp( this->pointSelectionStyle3D->Numbers[this->pointSelectionStyle3D->Numbers.size() - 1]);
-  this->RightRenderer->RemoveViewProp( this->pointSelectionStyle3D->Points[this->pointSelectionStyle3D->Points.size() - 1]);
-  this->pointSelectionStyle3D->Numbers.erase(this->pointSelectionStyle3D->Numbers.end()-1);
-  this->pointSelectionStyle3D->Points.erase(this->pointSelectionStyle3D->Points.end()-1);
-  this->pointSelectionStyle3D->Coordinates.erase(this->pointSelectionStyle3D->Coordinates.end()-1);
-  this->qvtkWidgetRight->GetRenderWindow()->Render();
+  CorrespondenceModel::Id id = this->Correspondences.GetLast();
+  while(id != 0 && !this->Correspondences.HasWorldPoint(id))
+    {
+    id = this->Correspondences.GetPrevious(id);
+    }
+  this->Correspondences.RemoveWorldPoint(id);
+  UpdateMarkers();
 }
 
 void Form::on_btnDeleteAllPointcloudKeypoints_clicked()
 {
-  this->pointSelectionStyle3D->RemoveAllPoints();
-  this->qvtkWidgetRight->GetRenderWindow()->Render();
+  this->Correspondences.RemoveAllWorldPoints();
+  UpdateMarkers();
+}
+
+void Form::on_actionUndo_activated()
+{
+  if(!this->Correspondences.Undo())
+    {
+    std::cout << "Nothing to undo." << std::endl;
+    return;
+    }
+  UpdateMarkers();
+}
+
+void Form::on_actionRedo_activated()
+{
+  if(!this->Correspondences.Redo())
+    {
+    std::cout << "Nothing to redo." << std::endl;
+    return;
+    }
+  UpdateMarkers();
+}
+
+void Form::on_cmbReduction_currentIndexChanged(int index)
+{
+  // The parameter is a size for the spatial methods and a percentage for random selection
+  this->spinReduction->setEnabled(index != ReduceNone);
+  if(index == ReduceRandom)
+    {
+    this->spinReduction->setDecimals(1);
+    this->spinReduction->setRange(0.1, 100);
+    this->spinReduction->setSingleStep(5);
+    this->spinReduction->setSuffix(" % kept");
+    this->spinReduction->setValue(25);
+    }
+  else
+    {
+    this->spinReduction->setDecimals(3);
+    this->spinReduction->setRange(0.001, 1000);
+    this->spinReduction->setSingleStep(0.01);
+    this->spinReduction->setSuffix(index == ReduceVoxelGrid ? " voxel size" : " minimum distance");
+    this->spinReduction->setValue(0.05);
+    }
+}
+
+void Form::on_cmbColorBy_currentIndexChanged(int index)
+{
+  if(!this->PointCloud)
+    {
+    return;
+    }
+  ColorPointCloud(index);
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void Form::ColorPointCloud(const int index)
+{
+  if(index <= 0 || index > static_cast<int>(this->PointAttributes.size()))
+    {
+    this->PointCloudMapper->ScalarVisibilityOff();
+    return;
+    }
+
+  // The colors of each attribute are made once; switching only swaps which buffer the mapper draws
+  const PointAttribute& attribute = this->PointAttributes[index - 1];
+  vtkSmartPointer<vtkUnsignedCharArray>& colors = this->ColorBuffers[index - 1];
+  if(!colors)
+    {
+    colors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    PointCloudColoring::ComputeColors(this->PointCloud, this->CloudOrigin, attribute, colors);
+    }
+  this->PointCloud->GetPointData()->AddArray(colors);
+
+  this->PointCloudMapper->SetScalarModeToUsePointFieldData();
+  this->PointCloudMapper->SelectColorArray(PointCloudColoring::ColorArrayName);
+  this->PointCloudMapper->SetColorModeToDefault();
+  this->PointCloudMapper->ScalarVisibilityOn();
+
+  if(attribute.Type == PointAttribute::Continuous)
+    {
+    std::cout << "Coloring by " << attribute.Name << " from " << attribute.RobustRange[0] << " (blue) to "
+              << attribute.RobustRange[1] << " (red); the full range is " << attribute.Range[0] << " to "
+              << attribute.Range[1] << "." << std::endl;
+    }
+}
+
+void Form::BuildImageDisplay(ImageDisplay* display, ImageHandle<FloatVectorImageType> imageHandle,
+                             ImageHandle<FloatScalarImageType> magnitudeImageHandle, const bool color)
+{
+  const FloatVectorImageType* image = imageHandle.Get();
+  const FloatScalarImageType* magnitudeImage = magnitudeImageHandle.Get();
+
+  // The pixels keep their full bit depth; what is shown is a window/level lookup of them
+  const unsigned int width = image->GetLargestPossibleRegion().GetSize()[0];
+  const unsigned int height = image->GetLargestPossibleRegion().GetSize()[1];
+  if(color)
+    {
+    display->Contrast.SetPixels(image->GetBufferPointer(), width, height, image->GetNumberOfComponentsPerPixel(), 3);
+    }
+  else
+    {
+    display->Contrast.SetPixels(magnitudeImage->GetBufferPointer(), width, height, 1, 1);
+    }
+
+  // 8 bit color is shown as it is; anything else is stretched between its 0.5 and 99.5 percentiles
+  const double* range = display->Contrast.GetRange();
+  if(color && range[0] >= 0 && range[1] <= 255)
+    {
+    display->Contrast.SetWindowLevel(255, 127.5);
+    }
+  else
+    {
+    double window;
+    double level;
+    display->Contrast.ComputeAutoContrast(0.5, 99.5, window, level);
+    display->Contrast.SetWindowLevel(window, level);
+    }
+
+  vtkSmartPointer<vtkImageData> data = vtkSmartPointer<vtkImageData>::New();
+  display->Contrast.Allocate(data);
+  display->Contrast.Map(data);
+  display->Data = data;
+}
+
+unsigned int Form::GetRequestedImageDisplay() const
+{
+  if(!this->chkRGB->isChecked())
+    {
+    return MagnitudeDisplay;
+    }
+  if(this->Image.Get()->GetNumberOfComponentsPerPixel() < 3)
+    {
+    std::cerr << "The image has " << this->Image.Get()->GetNumberOfComponentsPerPixel()
+              << " components, but at least 3 are required to show it in color." << std::endl;
+    return MagnitudeDisplay;
+    }
+  return ColorDisplay;
+}
+
+void Form::ShowImageDisplay(const unsigned int display)
+{
+  this->ShownImageDisplay = display;
+  this->ImageData = this->ImageDisplays[display].Data;
+  this->ImageActor->SetInput(this->ImageData);
+  if(this->pointSelectionStyle2D)
+    {
+    this->pointSelectionStyle2D->Image = this->ImageData;
+    }
+  UpdateContrastSliders();
+
+  // Keep the hidden view for an instant toggle back, unless the two together take too much memory
+  const size_t maximumMemory = static_cast<size_t>(1) << 30;
+  ImageDisplay& hidden = this->ImageDisplays[1 - display];
+  if(hidden.Data && this->ImageDisplays[display].Contrast.GetMemorySize() + hidden.Contrast.GetMemorySize() > maximumMemory)
+    {
+    hidden.Contrast.Initialize();
+    hidden.Data = NULL;
+    }
+}
+
+void Form::on_chkRGB_clicked()
+{
+  if(this->Image.IsNull())
+    {
+    return;
+    }
+
+  unsigned int display = GetRequestedImageDisplay();
+  if(display == this->ShownImageDisplay || this->ImageDisplayWatcher.isRunning())
+    {
+    // ImageDisplayBuilt shows whatever is asked for by then
+    return;
+    }
+
+  if(this->ImageDisplays[display].Data)
+    {
+    ShowImageDisplay(display);
+    this->qvtkWidgetLeft->GetRenderWindow()->Render();
+    return;
+    }
+
+  // Keep showing the current view while the other one is prepared
+  this->statusBar()->showMessage(display == ColorDisplay ? "Preparing the color view..." : "Preparing the magnitude view...");
+  // The worker reads snapshots, so it is unaffected by anything done to the images meanwhile
+  this->ImageDisplayWatcher.setFuture(QtConcurrent::run(&Form::BuildImageDisplay, &this->ImageDisplays[display],
+                                                        this->Image, this->MagnitudeImage, display == ColorDisplay));
+}
+
+void Form::ImageDisplayBuilt()
+{
+  this->statusBar()->clearMessage();
+
+  // The check box may have been toggled again while the view was being built
+  unsigned int display = GetRequestedImageDisplay();
+  if(display == this->ShownImageDisplay)
+    {
+    return;
+    }
+  if(!this->ImageDisplays[display].Data)
+    {
+    on_chkRGB_clicked();
+    return;
+    }
+  ShowImageDisplay(display);
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+}
+
+void Form::on_btnAutoContrast_clicked()
+{
+  if(this->Image.IsNull())
+    {
+    return;
+    }
+
+  double window;
+  double level;
+  this->ImageDisplays[this->ShownImageDisplay].Contrast.ComputeAutoContrast(0.5, 99.5, window, level);
+  this->ImageDisplays[this->ShownImageDisplay].Contrast.SetWindowLevel(window, level);
+  UpdateContrastSliders();
+  ApplyContrast(false);
+}
+
+void Form::on_sldWindow_valueChanged(int)
+{
+  ContrastSliderMoved();
+}
+
+void Form::on_sldLevel_valueChanged(int)
+{
+  ContrastSliderMoved();
+}
+
+void Form::on_sldWindow_sliderReleased()
+{
+  ApplyContrast(false);
+}
+
+void Form::on_sldLevel_sliderReleased()
+{
+  ApplyContrast(false);
+}
+
+void Form::ContrastSliderMoved()
+{
+  if(this->Image.IsNull())
+    {
+    return;
+    }
+
+  // The sliders span the value range of the image in 1000 steps
+  const double* range = this->ImageDisplays[this->ShownImageDisplay].Contrast.GetRange();
+  double width = range[1] - range[0];
+  double window = width * this->sldWindow->value() / this->sldWindow->maximum();
+  double level = range[0] + width * this->sldLevel->value() / this->sldLevel->maximum();
+  this->ImageDisplays[this->ShownImageDisplay].Contrast.SetWindowLevel(window, level);
+
+  // While dragging, only the part of the image that is in view is remapped; the rest follows on release
+  ApplyContrast(this->sldWindow->isSliderDown() || this->sldLevel->isSliderDown());
+}
+
+void Form::UpdateContrastSliders()
+{
+  const double* range = this->ImageDisplays[this->ShownImageDisplay].Contrast.GetRange();
+  double width = range[1] - range[0];
+  int window = this->sldWindow->maximum();
+  int level = this->sldLevel->maximum() / 2;
+  if(width > 0)
+    {
+    window = static_cast<int>(this->sldWindow->maximum() * this->ImageDisplays[this->ShownImageDisplay].Contrast.GetWindow() / width + 0.5);
+    level = static_cast<int>(this->sldLevel->maximum() * (this->ImageDisplays[this->ShownImageDisplay].Contrast.GetLevel() - range[0]) / width + 0.5);
+    }
+
+  this->sldWindow->blockSignals(true);
+  this->sldLevel->blockSignals(true);
+  this->sldWindow->setValue(window);
+  this->sldLevel->setValue(level);
+  this->sldWindow->blockSignals(false);
+  this->sldLevel->blockSignals(false);
+}
+
+void Form::ApplyContrast(const bool visibleOnly)
+{
+  if(this->Image.IsNull())
+    {
+    return;
+    }
+
+  if(visibleOnly)
+    {
+    // Pixel (i, j) is at world (i, j, 0), so the view corners give the visible pixels
+    int* size = this->LeftRenderer->GetSize();
+    int extent[4] = {VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN};
+    for(int corner = 0; corner < 4; ++corner)
+      {
+      this->LeftRenderer->SetDisplayPoint((corner & 1) ? size[0] : 0, (corner & 2) ? size[1] : 0, 0);
+      this->LeftRenderer->DisplayToWorld();
+      double world[4];
+      this->LeftRenderer->GetWorldPoint(world);
+      for(int d = 0; d < 2; ++d)
+        {
+        double coordinate = world[d] / world[3];
+        extent[2 * d] = std::min(extent[2 * d], static_cast<int>(floor(coordinate)));
+        extent[2 * d + 1] = std::max(extent[2 * d + 1], static_cast<int>(ceil(coordinate)));
+        }
+      }
+    this->ImageDisplays[this->ShownImageDisplay].Contrast.Map(this->ImageData, extent);
+    }
+  else
+    {
+    this->ImageDisplays[this->ShownImageDisplay].Contrast.Map(this->ImageData);
+    }
+
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+}
+
+void Form::on_chkSnap_clicked()
+{
+  if(this->pointSelectionStyle2D)
+    {
+    this->pointSelectionStyle2D->Snap = this->chkSnap->isChecked();
+    }
+}
+
+void Form::on_chkCompact_clicked()
+{
+  // The points are encoded as they are read
+  if(this->pointSelectionStyle3D)
+    {
+    std::cout << "Compact takes effect when the next point cloud is opened." << std::endl;
+    }
+}
+
+void Form::on_chkSequence_clicked()
+{
+  StartTrackerPreparation();
+}
+
+void Form::on_actionEstimatePose_activated()
+{
+  if(!this->pointSelectionStyle2D || !this->pointSelectionStyle3D)
+    {
+    std::cerr << "You must have loaded and selected points from both the image and the corresponding point cloud!" << std::endl;
+    return;
+    }
+
+  std::vector<Coord2D> imagePoints;
+  std::vector<Coord3D> worldPoints;
+  this->Correspondences.GetPairs(imagePoints, worldPoints);
+
+  // With a calibrated camera only the pose is estimated, and a known pose is enough to start from
+  // when there are too few pairs for the DLT
+  CameraIntrinsics intrinsics;
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+  Camera camera = this->Pose;
+  bool estimated = false;
+  if(this->CurrentFrame >= 0 && GetCalibration(this->CurrentSession.Frames[this->CurrentFrame], intrinsics))
+    {
+    intrinsics.Apply(camera);
+    bool usePose = this->HasPose && imagePoints.size() < 6;
+    estimated = PoseEstimation::EstimatePose(imagePoints, worldPoints, usePose, camera);
+    }
+  else
+    {
+    estimated = PoseEstimation::EstimateCamera(imagePoints, worldPoints, camera);
+    }
+  timer->StopTimer();
+  if(!estimated)
+    {
+    return;
+    }
+  this->Pose = camera;
+  this->HasPose = true;
+  std::cout << "Estimated in " << 1000.0 * timer->GetElapsedTime() << " ms" << std::endl;
+
+  std::cout << "Estimated camera: " << this->Pose << std::endl;
+  std::cout << "RMS reprojection error: "
+            << PoseEstimation::ComputeRMSReprojectionError(imagePoints, worldPoints, this->Pose)
+            << " pixels" << std::endl;
+
+  UpdateViewCrop();
+  ShowDiagnostics();
+}
+
+void Form::on_actionDiagnoseCorrespondences_activated()
+{
+  if(!this->pointSelectionStyle2D || !this->pointSelectionStyle3D)
+    {
+    std::cerr << "You must have loaded and selected points from both the image and the corresponding point cloud!" << std::endl;
+    return;
+    }
+  if(!this->HasPose)
+    {
+    std::cerr << "Estimate the pose first." << std::endl;
+    return;
+    }
+  ShowDiagnostics();
+}
+
+void Form::ShowDiagnostics()
+{
+  std::vector<Coord2D> imagePoints;
+  std::vector<Coord3D> worldPoints;
+  std::vector<CorrespondenceModel::Id> ids;
+  this->Correspondences.GetPairs(imagePoints, worldPoints, &ids);
+
+  // Re-solve as the pose was solved: only the pose for a calibrated camera
+  CameraIntrinsics intrinsics;
+  const bool calibrated = this->CurrentFrame >= 0 &&
+                          GetCalibration(this->CurrentSession.Frames[this->CurrentFrame], intrinsics);
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+  Camera solution;
+  std::vector<CorrespondenceDiagnostic> diagnostics;
+  if(!CorrespondenceDiagnostics::Compute(imagePoints, worldPoints, this->Pose, !calibrated, solution, diagnostics))
+    {
+    return;
+    }
+  timer->StopTimer();
+
+  // Green: fits, orange: worth a look, magenta: likely a mistake, grey: the pose cannot be solved without it
+  const double fitColor[3] = {0, 1, 0};
+  const double suspectColor[3] = {1, 0.5, 0};
+  const double outlierColor[3] = {1, 0, 1};
+  const double unsolvedColor[3] = {0.5, 0.5, 0.5};
+  unsigned int numberOfSuspects = 0;
+  for(unsigned int i = 0; i < diagnostics.size(); ++i)
+    {
+    const CorrespondenceDiagnostic& diagnostic = diagnostics[i];
+    const double* color = fitColor;
+    if(!diagnostic.Solved)
+      {
+      color = unsolvedColor;
+      }
+    else if(diagnostic.Score > CorrespondenceDiagnostics::OutlierScore)
+      {
+      color = outlierColor;
+      }
+    else if(diagnostic.Score > CorrespondenceDiagnostics::SuspectScore)
+      {
+      color = suspectColor;
+      }
+    this->pointSelectionStyle2D->SetPointColor(ids[i], color);
+    this->pointSelectionStyle3D->SetPointColor(ids[i], color);
+
+    if(color == unsolvedColor)
+      {
+      std::cout << "Pair " << ids[i] << ": residual " << diagnostic.Residual
+                << " pixels; the pose could not be solved without it" << std::endl;
+      }
+    else if(color != fitColor)
+      {
+      numberOfSuspects++;
+      std::cout << "Pair " << ids[i] << ": residual " << diagnostic.Residual << " pixels, "
+                << diagnostic.PredictionResidual << " pixels without it (score " << diagnostic.Score << "), "
+                << diagnostic.WorldError << " from its ray, moves the others by " << diagnostic.Influence
+                << " pixels" << std::endl;
+      }
+    }
+  std::cout << "Left each of " << diagnostics.size() << " pairs out in " << 1000.0 * timer->GetElapsedTime()
+            << " ms; " << numberOfSuspects << " look suspect." << std::endl;
+
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void Form::on_actionExportDiagnostics_activated()
+{
+  StoreFrame();
+
+  QString fileName = QFileDialog::getSaveFileName(this, "Export Diagnostics", ".", "Text Files (*.txt)");
+  std::cout << "Got filename: " << fileName.toStdString() << std::endl;
+  if(fileName.toStdString().empty())
+    {
+    std::cout << "Filename was empty." << std::endl;
+    return;
+    }
+
+  CorrespondenceDiagnostics::WriteSession(this->CurrentSession, this->Calibrations, fileName.toStdString());
+}
+
+void Form::on_actionAdjustAllFrames_activated()
+{
+  StoreFrame();
+
+  // Frames without a pose get one from their own keypoints first. Frames from calibrated cameras keep
+  // their calibration; otherwise the frames share one focal length.
+  BundleAdjustment adjustment;
+  // The tracks may move by about the spacing of the points they were picked from
+  adjustment.SetPointSigma(this->AverageSpacing);
+  std::vector<unsigned int> adjustedFrames;
+  // The adjusted frames whose camera has been calibrated keep its intrinsics; the others share theirs
+  std::vector<bool> calibrated;
+  for(unsigned int i = 0; i < this->CurrentSession.Frames.size(); ++i)
+    {
+    const SessionFrame& frame = this->CurrentSession.Frames[i];
+    if(frame.ImagePoints.size() != frame.WorldPoints.size() || frame.ImagePoints.size() < 3)
+      {
+      std::cout << "Frame " << i + 1 << " is skipped: it has " << frame.ImagePoints.size() << " image and "
+                << frame.WorldPoints.size() << " point cloud keypoints." << std::endl;
+      continue;
+      }
+    Camera camera = frame.Pose;
+    CameraIntrinsics intrinsics;
+    bool estimated = frame.HasPose;
+    const bool hasCalibration = GetCalibration(frame, intrinsics);
+    if(hasCalibration)
+      {
+      intrinsics.Apply(camera);
+      estimated = PoseEstimation::EstimatePose(frame.ImagePoints, frame.WorldPoints, frame.HasPose, camera);
+      }
+    else if(!estimated)
+      {
+      estimated = PoseEstimation::EstimateCamera(frame.ImagePoints, frame.WorldPoints, camera);
+      }
+    if(!estimated)
+      {
+      std::cout << "Frame " << i + 1 << " is skipped: it has no pose and one cannot be estimated from its "
+                << frame.ImagePoints.size() << " keypoint pairs." << std::endl;
+      continue;
+      }
+    adjustment.AddFrame(frame.ImagePoints, frame.WorldPoints, camera, hasCalibration);
+    adjustedFrames.push_back(i);
+    calibrated.push_back(hasCalibration);
+    }
+  if(adjustedFrames.empty())
+    {
+    std::cerr << "No frame has enough keypoint pairs to adjust!" << std::endl;
+    return;
+    }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+  bool adjusted = adjustment.Adjust();
+  timer->StopTimer();
+  std::cout << "Adjusted " << adjustedFrames.size() << " frames and " << adjustment.GetNumberOfTracks()
+            << " points in " << adjustment.GetNumberOfIterations() << " iterations and "
+            << timer->GetElapsedTime() << " seconds. RMS reprojection error: " << adjustment.GetInitialRMSError()
+            << " -> " << adjustment.GetFinalRMSError() << " pixels" << std::endl;
+  if(!adjusted)
+    {
+    return;
+    }
+
+  // The keypoints stay where they were picked; only the cameras change
+  for(unsigned int k = 0; k < adjustedFrames.size(); ++k)
+    {
+    SessionFrame& frame = this->CurrentSession.Frames[adjustedFrames[k]];
+    frame.Pose = adjustment.GetCamera(k);
+    frame.HasPose = true;
+    std::cout << "Frame " << adjustedFrames[k] + 1 << ": RMS reprojection error " << adjustment.GetRMSError(k)
+              << " pixels" << std::endl;
+    }
+  if(this->CurrentFrame >= 0)
+    {
+    this->Pose = this->CurrentSession.Frames[this->CurrentFrame].Pose;
+    this->HasPose = this->CurrentSession.Frames[this->CurrentFrame].HasPose;
+    UpdateViewCrop();
+    }
+  for(unsigned int k = 0; k < adjustedFrames.size(); ++k)
+    {
+    if(!calibrated[k])
+      {
+      std::cout << "Shared focal length: " << adjustment.GetCamera(k).FocalLength << std::endl;
+      break;
+      }
+    }
+}
+
+void Form::on_actionCalibrateCamera_activated()
+{
+  StoreFrame();
+  if(this->CurrentFrame < 0 || this->CurrentSession.Frames[this->CurrentFrame].CameraId.empty())
+    {
+    std::cerr << "Enter the camera of the frame first; all the frames from that camera are used." << std::endl;
+    return;
+    }
+  const std::string cameraId = this->CurrentSession.Frames[this->CurrentFrame].CameraId;
+
+  CameraCalibration calibration;
+  calibration.SetRobustThreshold(2.0);
+  std::vector<unsigned int> calibrationFrames;
+  for(unsigned int i = 0; i < this->CurrentSession.Frames.size(); ++i)
+    {
+    const SessionFrame& frame = this->CurrentSession.Frames[i];
+    if(frame.CameraId != cameraId)
+      {
+      continue;
+      }
+    if(frame.ImagePoints.size() != frame.WorldPoints.size() || frame.ImagePoints.size() < 3)
+      {
+      std::cout << "Frame " << i + 1 << " is skipped: it has " << frame.ImagePoints.size() << " image and "
+                << frame.WorldPoints.size() << " point cloud keypoints." << std::endl;
+      continue;
+      }
+    Camera camera = frame.Pose;
+    if(!frame.HasPose && !PoseEstimation::EstimateCamera(frame.ImagePoints, frame.WorldPoints, camera))
+      {
+      std::cout << "Frame " << i + 1 << " is skipped: it has no pose and one cannot be estimated from its "
+                << frame.ImagePoints.size() << " keypoint pairs." << std::endl;
+      continue;
+      }
+    calibration.AddFrame(frame.ImagePoints, frame.WorldPoints, camera);
+    calibrationFrames.push_back(i);
+    }
+  if(calibrationFrames.empty())
+    {
+    std::cerr << "No frame from camera " << cameraId << " has enough keypoint pairs!" << std::endl;
+    return;
+    }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+  bool calibrated = calibration.Calibrate();
+  timer->StopTimer();
+  if(!calibrated)
+    {
+    return;
+    }
+
+  const CameraIntrinsics& intrinsics = calibration.GetIntrinsics();
+  std::cout << "Calibrated camera " << cameraId << " from " << calibrationFrames.size() << " frames and "
+            << intrinsics.NumberOfObservations << " keypoint pairs in " << calibration.GetNumberOfIterations()
+            << " iterations and " << timer->GetElapsedTime() << " seconds." << std::endl
+            << "Focal length " << intrinsics.FocalLength << ", principal point " << intrinsics.PrincipalPoint[0] << " "
+            << intrinsics.PrincipalPoint[1] << ", distortion " << intrinsics.Distortion[0] << " "
+            << intrinsics.Distortion[1] << " " << intrinsics.Distortion[2] << " " << intrinsics.Distortion[3] << std::endl
+            << "RMS reprojection error " << calibration.GetInitialRMSError() << " -> " << calibration.GetFinalRMSError()
+            << " pixels (" << intrinsics.RMSError << " without the " << calibration.GetNumberOfOutliers()
+            << " outlying pairs)" << std::endl;
+
+  this->Calibrations.Set(cameraId, intrinsics);
+  if(this->CalibrationFileName.empty())
+    {
+    std::cout << "The calibration is kept for this session only." << std::endl;
+    }
+  else if(!this->Calibrations.Write(this->CalibrationFileName))
+    {
+    std::cerr << "Could not write the camera calibrations to " << this->CalibrationFileName << std::endl;
+    }
+
+  for(unsigned int k = 0; k < calibrationFrames.size(); ++k)
+    {
+    SessionFrame& frame = this->CurrentSession.Frames[calibrationFrames[k]];
+    frame.Pose = calibration.GetCamera(k);
+    frame.HasPose = true;
+    }
+  this->Pose = this->CurrentSession.Frames[this->CurrentFrame].Pose;
+  this->HasPose = this->CurrentSession.Frames[this->CurrentFrame].HasPose;
+  UpdateViewCrop();
+}
+
+void Form::on_actionRegisterAutomatically_activated()
+{
+  if(this->Image.IsNull() || !this->pointSelectionStyle3D)
+    {
+    std::cerr << "You must load both an image and a point cloud before registering them!" << std::endl;
+    return;
+    }
+
+  vtkDataArray* intensity = this->PointCloud->GetPointData()->GetArray("Intensity");
+  if(!intensity)
+    {
+    std::cerr << "The point cloud does not have an Intensity array to register with!" << std::endl;
+    return;
+    }
+
+  unsigned int imageSize[2] = {this->Image.Get()->GetLargestPossibleRegion().GetSize()[0],
+                               this->Image.Get()->GetLargestPossibleRegion().GetSize()[1]};
+
+  // Starting pose: the current estimate, else the clicked pairs, else whatever the point cloud view shows
+  Camera camera = this->Pose;
+  if(!this->HasPose)
+    {
+    std::vector<Coord2D> imagePoints;
+    std::vector<Coord3D> worldPoints;
+    this->Correspondences.GetPairs(imagePoints, worldPoints);
+    unsigned int numberOfPairs = imagePoints.size();
+
+    if(numberOfPairs >= 6)
+      {
+      if(!PoseEstimation::EstimateCamera(imagePoints, worldPoints, camera))
+        {
+        std::cerr << "A starting pose cannot be estimated from the " << numberOfPairs
+                  << " keypoint pairs; check them or estimate the pose first!" << std::endl;
+        return;
+        }
+      }
+    else
+      {
+      // The point cloud view is in the local frame of the cloud; the keypoints are in world coordinates
+      Helpers::VTKCameraToCamera(this->RightRenderer->GetActiveCamera(), imageSize, camera);
+      double toWorld[3] = {-this->CloudOrigin[0], -this->CloudOrigin[1], -this->CloudOrigin[2]};
+      camera = camera.Shifted(toWorld);
+      Camera viewCamera = camera;
+      if(numberOfPairs >= 3 && !PoseEstimation::RefineCamera(imagePoints, worldPoints, false, camera))
+        {
+        std::cout << "The keypoint pairs do not refine the view; starting from the view as it is." << std::endl;
+        camera = viewCamera;
+        }
+      }
+    }
+
+  MutualInformationRegistration registration;
+  registration.SetImage(this->MagnitudeImage.Get());
+  registration.SetPointCloud(this->PointCloud->GetPoints(), intensity);
+  // The cloud points are relative to CloudOrigin, so the registration works in that frame
+  Camera localCamera = camera.Shifted(this->CloudOrigin);
+  if(!registration.Register(localCamera))
+    {
+    return;
+    }
+
+  double toWorld[3] = {-this->CloudOrigin[0], -this->CloudOrigin[1], -this->CloudOrigin[2]};
+  this->Pose = localCamera.Shifted(toWorld);
+  this->HasPose = true;
+  std::cout << "Registered camera: " << this->Pose << std::endl;
+  UpdateViewCrop();
+
+  // Show the cloud from the registered camera so the result can be compared with the image
+  Helpers::CameraToVTKCamera(localCamera, imageSize, this->RightRenderer->GetActiveCamera());
+  this->RightRenderer->ResetCameraClippingRange();
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void Form::on_actionProposeCorrespondences_activated()
+{
+  if(this->Image.IsNull() || !this->pointSelectionStyle2D || !this->pointSelectionStyle3D)
+    {
+    std::cerr << "You must load both an image and a point cloud before proposing correspondences!" << std::endl;
+    return;
+    }
+
+  vtkDataArray* intensity = this->PointCloud->GetPointData()->GetArray("Intensity");
+  if(!intensity)
+    {
+    std::cerr << "The point cloud does not have an Intensity array to match against!" << std::endl;
+    return;
+    }
+
+  unsigned int imageSize[2] = {this->Image.Get()->GetLargestPossibleRegion().GetSize()[0],
+                               this->Image.Get()->GetLargestPossibleRegion().GetSize()[1]};
+
+  // The cloud is rendered from the current estimate, or else from the point cloud view.
+  // Both the rendering and the proposals are in the local frame of the cloud.
+  Camera camera = this->Pose.Shifted(this->CloudOrigin);
+  if(!this->HasPose)
+    {
+    Helpers::VTKCameraToCamera(this->RightRenderer->GetActiveCamera(), imageSize, camera);
+    }
+
+  CorrespondenceProposer proposer;
+  proposer.SetImage(this->MagnitudeImage.Get());
+  proposer.SetPointCloud(this->PointCloud->GetPoints(), intensity);
+
+  this->Proposals.clear();
+  this->CurrentProposal = 0;
+  if(!proposer.Propose(camera, this->Proposals))
+    {
+    this->Proposals.clear();
+    }
+  std::cout << this->Proposals.size() << " correspondences proposed." << std::endl;
+
+  ShowCurrentProposal();
+}
+
+void Form::on_actionAcceptProposal_activated()
+{
+  if(this->CurrentProposal >= this->Proposals.size())
+    {
+    return;
+    }
+
+  const CorrespondenceProposal& proposal = this->Proposals[this->CurrentProposal];
+  double scene[3];
+  this->pointSelectionStyle3D->GetFullResolutionPoint(proposal.PointId, scene);
+  double world[3];
+  this->pointSelectionStyle3D->SceneToWorld(scene, world);
+  Coord3D worldPoint;
+  worldPoint.x = world[0];
+  worldPoint.y = world[1];
+  worldPoint.z = world[2];
+  // A pair of its own, whatever keypoints are waiting for a partner
+  this->Correspondences.AddPair(proposal.ImagePoint, worldPoint);
+  UpdateMarkers(false);
+
+  this->CurrentProposal++;
+  ShowCurrentProposal();
+}
+
+void Form::on_actionRejectProposal_activated()
+{
+  if(this->CurrentProposal >= this->Proposals.size())
+    {
+    return;
+    }
+
+  this->CurrentProposal++;
+  ShowCurrentProposal();
+}
+
+void Form::ShowCurrentProposal()
+{
+  this->pointSelectionStyle2D->ClearCandidate();
+  this->pointSelectionStyle3D->ClearCandidate();
+
+  if(this->CurrentProposal < this->Proposals.size())
+    {
+    const CorrespondenceProposal& proposal = this->Proposals[this->CurrentProposal];
+    double imagePoint[3] = {proposal.ImagePoint.x, proposal.ImagePoint.y, 0};
+    double worldPoint[3] = {proposal.WorldPoint.x, proposal.WorldPoint.y, proposal.WorldPoint.z};
+    this->pointSelectionStyle2D->ShowCandidate(imagePoint);
+    this->pointSelectionStyle3D->ShowCandidate(worldPoint);
+
+    std::cout << "Proposal " << this->CurrentProposal + 1 << " of " << this->Proposals.size()
+              << ": reprojection error " << proposal.ReprojectionError << " pixels, descriptor distance "
+              << proposal.DescriptorDistance << std::endl;
+    }
+
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void Form::PrepareCloudIndex()
+{
+  // Crops and tiles are indexed as they come; only the whole cloud's index is worth caching
+  const bool cached = this->PointCloud == this->UncroppedPointCloud && this->Tiles.GetNumberOfTiles() == 0;
+  if(this->CloudIndex.GetPoints() == this->PointCloud->GetPoints() ||
+     (cached && this->Cache.LoadPointIndex(this->CloudKey, this->PointCloud->GetPoints(), this->CloudIndex)))
+    {
+    return;
+    }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+  this->CloudIndex.Build(this->PointCloud->GetPoints());
+  timer->StopTimer();
+  std::cout << "Indexed " << this->PointCloud->GetNumberOfPoints() << " points in "
+            << timer->GetElapsedTime() << " seconds." << std::endl;
+  if(cached)
+    {
+    this->Cache.StorePointIndex(this->CloudKey, this->CloudIndex);
+    }
+}
+
+void Form::on_cmbCrop_currentIndexChanged(int)
+{
+  UpdateCrop();
+}
+
+void Form::CropBoxMoved()
+{
+  if(this->cmbCrop->currentIndex() == CropToBox)
+    {
+    UpdateCrop();
+    }
+}
+
+void Form::UpdateViewCrop()
+{
+  if(this->cmbCrop->currentIndex() == CropToView)
+    {
+    UpdateCrop();
+    }
+}
+
+void Form::UpdateCrop()
+{
+  if(!this->UncroppedPointCloud)
+    {
+    return;
+    }
+
+  const int method = this->cmbCrop->currentIndex();
+  this->CropBox->SetEnabled(method == CropToBox);
+  if(method == CropNone)
+    {
+    ShowPointCloud(this->UncroppedPointCloud);
+    return;
+    }
+  if(this->UncroppedPointCloud->GetNumberOfPolys() > 0 || this->UncroppedPointCloud->GetNumberOfStrips() > 0)
+    {
+    std::cerr << "Only point clouds can be cropped, not meshes." << std::endl;
+    return;
+    }
+
+  // The box and the camera are in the cloud's local coordinates, the pose in world coordinates
+  PointCloudReduction::CropRegion region;
+  if(method == CropToBox)
+    {
+    vtkSmartPointer<vtkPlanes> planes = vtkSmartPointer<vtkPlanes>::New();
+    this->CropBox->GetPlanes(planes); // normals point out of the box
+    for(int i = 0; i < planes->GetNumberOfPlanes(); ++i)
+      {
+      vtkPlane* plane = planes->GetPlane(i);
+      region.AddPlane(plane->GetNormal(), plane->GetOrigin());
+      }
+    vtkSmartPointer<vtkPolyData> box = vtkSmartPointer<vtkPolyData>::New();
+    this->CropBox->GetPolyData(box);
+    box->GetBounds(region.Bounds);
+    }
+  else
+    {
+    if(!this->HasPose || this->Image.IsNull())
+      {
+      this->statusBar()->showMessage("Cropping to the camera view needs a pose.", 5000);
+      ShowPointCloud(this->UncroppedPointCloud);
+      return;
+      }
+
+    // The four planes through the camera center and the edges of the image
+    unsigned int imageSize[2] = {this->Image.Get()->GetLargestPossibleRegion().GetSize()[0],
+                                 this->Image.Get()->GetLargestPossibleRegion().GetSize()[1]};
+    double corners[4][2] = {{-0.5, -0.5}, {imageSize[0] - 0.5, -0.5}, {imageSize[0] - 0.5, imageSize[1] - 0.5},
+                            {-0.5, imageSize[1] - 0.5}};
+    double imageCenter[2] = {0.5 * imageSize[0] - 0.5, 0.5 * imageSize[1] - 0.5};
+    double center[3];
+    double forward[3];
+    this->Pose.GetRay(imageCenter, center, forward);
+    double directions[4][3];
+    for(unsigned int i = 0; i < 4; ++i)
+      {
+      this->Pose.GetRay(corners[i], center, directions[i]);
+      }
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      center[d] -= this->CloudOrigin[d];
+      }
+    for(unsigned int i = 0; i < 4; ++i)
+      {
+      double normal[3];
+      vtkMath::Cross(directions[i], directions[(i + 1) % 4], normal);
+      if(vtkMath::Dot(normal, forward) > 0)
+        {
+        for(unsigned int d = 0; d < 3; ++d)
+          {
+          normal[d] = -normal[d];
+          }
+        }
+      region.AddPlane(normal, center);
+      }
+    double backward[3] = {-forward[0], -forward[1], -forward[2]};
+    region.AddPlane(backward, center);
+    }
+
+  // The cells of the whole cloud's grid are what the region is looked up in
+  vtkPoints* points = this->UncroppedPointCloud->GetPoints();
+  const bool cached = this->Tiles.GetNumberOfTiles() == 0;
+  if(this->CropIndex.GetPoints() != points &&
+     !(cached && this->Cache.LoadPointIndex(this->CloudKey, points, this->CropIndex)))
+    {
+    this->CropIndex.Build(points);
+    if(cached)
+      {
+      this->Cache.StorePointIndex(this->CloudKey, this->CropIndex);
+      }
+    }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+  // The colors of the whole cloud are not carried into the crop, which makes its own
+  this->UncroppedPointCloud->GetPointData()->RemoveArray(PointCloudColoring::ColorArrayName);
+  vtkSmartPointer<vtkPolyData> cropped = vtkSmartPointer<vtkPolyData>::New();
+  PointCloudReduction::Crop(this->UncroppedPointCloud, this->CropIndex, region, cropped);
+  timer->StopTimer();
+  std::cout << "Cropped to " << cropped->GetNumberOfPoints() << " of " << points->GetNumberOfPoints() << " points in "
+            << timer->GetElapsedTime() << " seconds." << std::endl;
+  ShowPointCloud(cropped);
+}
+
+void Form::ChooseTiles(std::vector<unsigned int>& tiles) const
+{
+  // The sides of the view from the camera on. Its near and far planes are not used: they follow the tiles
+  // already shown.
+  vtkCamera* camera = this->RightRenderer->GetActiveCamera();
+  double planes[24];
+  camera->GetFrustumPlanes(this->RightRenderer->GetTiledAspectRatio(), planes);
+  PointCloudReduction::CropRegion view;
+  for(unsigned int i = 0; i < 4; ++i)
+    {
+    // VTK's planes a x + b y + c z + d = 0 face into the view
+    const double* plane = &planes[4 * i];
+    double squaredNorm = plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2];
+    double normal[3];
+    double point[3];
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      normal[d] = -plane[d];
+      point[d] = -plane[3] * plane[d] / squaredNorm;
+      }
+    view.AddPlane(normal, point);
+    }
+  double position[3];
+  camera->GetPosition(position);
+  double backward[3];
+  camera->GetDirectionOfProjection(backward);
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    backward[d] = -backward[d];
+    }
+  view.AddPlane(backward, position);
+
+  // The cloud shown now, with its crop and indexes, stays in memory while the tiles are paged
+  size_t shownSize = this->CropIndex.GetSize() + this->CloudIndex.GetSize();
+  if(this->UncroppedPointCloud)
+    {
+    shownSize += static_cast<size_t>(this->UncroppedPointCloud->GetActualMemorySize()) * 1024;
+    }
+  if(this->PointCloud && this->PointCloud != this->UncroppedPointCloud)
+    {
+    shownSize += static_cast<size_t>(this->PointCloud->GetActualMemorySize()) * 1024;
+    }
+
+  this->Tiles.ChooseTiles(position, view, shownSize, tiles);
+}
+
+void Form::UpdateTiles()
+{
+  if(this->Tiles.GetNumberOfTiles() == 0)
+    {
+    return;
+    }
+  // One paging at a time; the view is looked at again once it is done
+  if(this->TilesPaging)
+    {
+    this->TilesOutdated = true;
+    return;
+    }
+  this->TilesOutdated = false;
+
+  std::vector<unsigned int> tiles;
+  ChooseTiles(tiles);
+  if(this->Tiles.IsResident(tiles))
+    {
+    return;
+    }
+  this->statusBar()->showMessage("Paging in point cloud tiles...");
+  this->TilesPaging = true;
+  this->TileWatcher.setFuture(QtConcurrent::run(&this->Tiles, &TiledPointCloud::Page, tiles));
+}
+
+void Form::TilesPaged()
+{
+  // Ignore a paging of a dataset that has since been replaced
+  if(!this->TilesPaging)
+    {
+    return;
+    }
+  this->TilesPaging = false;
+  this->statusBar()->clearMessage();
+
+  // Release the cloud shown, its crop, indexes and colors first, so there is only one assembled copy at a
+  // time (the budget allows for the tiles and one copy)
+  this->PointCloudMapper->SetInput(NULL);
+  this->pointSelectionStyle3D->Data = NULL;
+  this->pointSelectionStyle3D->FullResolutionPoints = NULL;
+  this->PointCloud = NULL;
+  this->UncroppedPointCloud = NULL;
+  this->CropIndex.Initialize();
+  this->CloudIndex.Initialize();
+  this->ColorBuffers.assign(this->PointAttributes.size(), vtkSmartPointer<vtkUnsignedCharArray>());
+
+  vtkSmartPointer<vtkPolyData> assembled = vtkSmartPointer<vtkPolyData>::New();
+  this->Tiles.Assemble(assembled);
+  std::cout << "Showing " << this->Tiles.GetNumberOfResidentTiles() << " of " << this->Tiles.GetNumberOfTiles()
+            << " tiles (" << assembled->GetNumberOfPoints() << " points, " << this->Tiles.GetResidentSize() / 1048576
+            << " MB)." << std::endl;
+
+  // The crop, picking and colors follow the tiles
+  this->UncroppedPointCloud = assembled;
+  UpdateCrop();
+  if(this->TilesOutdated)
+    {
+    UpdateTiles();
+    }
+}
+
+void Form::ShowPointCloud(vtkPolyData* pointCloud)
+{
+  if(pointCloud == this->PointCloud)
+    {
+    return;
+    }
+
+  this->PointCloud = pointCloud;
+  this->PointCloudMapper->SetInput(this->PointCloud);
+  // The colors are made again for the points shown
+  this->ColorBuffers.assign(this->PointAttributes.size(), vtkSmartPointer<vtkUnsignedCharArray>());
+  ColorPointCloud(this->cmbColorBy->currentIndex());
+
+  // A crop records the points of the whole cloud it came from, which may itself be a reduced copy
+  this->pointSelectionStyle3D->Data = this->PointCloud;
+  this->pointSelectionStyle3D->FullResolutionPoints = this->FullResolutionPoints;
+  if(this->PointCloud != this->UncroppedPointCloud && !this->FullResolutionPoints &&
+     this->CompactFullResolutionPoints.GetNumberOfPoints() == 0)
+    {
+    this->pointSelectionStyle3D->FullResolutionPoints = this->UncroppedPointCloud->GetPoints();
+    }
+
+  // Ray candidates and proposals are ids of the points that were shown
+  this->CloudIndex.Initialize();
+  ClearRayCandidates();
+  this->RayCandidates.clear();
+  if(!this->Proposals.empty())
+    {
+    std::cout << "The shown points changed; propose correspondences again." << std::endl;
+    this->Proposals.clear();
+    this->CurrentProposal = 0;
+    if(this->pointSelectionStyle2D)
+      {
+      this->pointSelectionStyle2D->ClearCandidate();
+      this->qvtkWidgetLeft->GetRenderWindow()->Render();
+      }
+    }
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void Form::ImageKeypointClicked()
+{
+  // The clicked keypoint's marker is shown already
+  UpdateMarkers(false);
+
+  // A predicted location has served its purpose once the keypoint is clicked
+  this->pointSelectionStyle2D->ClearPrediction();
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
+
+  // Only search for a partner if the keypoint does not already have one
+  CorrespondenceModel::Id id = this->pointSelectionStyle2D->LastKeypoint;
+  if(!this->HasPose || !this->pointSelectionStyle3D || this->Correspondences.HasWorldPoint(id))
+    {
+    return;
+    }
+
+  PrepareCloudIndex();
+
+  this->RayKeypoint = id;
+  Coord2D keypoint = this->Correspondences.GetImagePoint(id);
+  double pixel[2] = {keypoint.x, keypoint.y};
+  double origin[3];
+  double direction[3];
+  this->Pose.Shifted(this->CloudOrigin).GetRay(pixel, origin, direction);
+
+  // A corridor 3 pixels wide, keeping the points within a few spacings of the first surface
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+  this->CloudIndex.FindPointsNearRay(origin, direction, 3.0 / this->Pose.FocalLength, 0, 3.0 * this->AverageSpacing,
+                                     50, this->RayCandidates);
+  timer->StopTimer();
+  std::cout << this->RayCandidates.size() << " points found along the ray in "
+            << 1000.0 * timer->GetElapsedTime() << " ms." << std::endl;
+
+  ClearRayCandidates();
+  if(this->RayCandidates.empty())
+    {
+    this->qvtkWidgetRight->GetRenderWindow()->Render();
+    return;
+    }
+
+  vtkSmartPointer<vtkPoints> candidatePoints = vtkSmartPointer<vtkPoints>::New();
+  for(unsigned int i = 0; i < this->RayCandidates.size(); ++i)
+    {
+    candidatePoints->InsertNextPoint(this->PointCloud->GetPoint(this->RayCandidates[i]));
+    }
+  vtkSmartPointer<vtkPolyData> candidatePolyData = vtkSmartPointer<vtkPolyData>::New();
+  candidatePolyData->SetPoints(candidatePoints);
+
+  vtkSmartPointer<vtkVertexGlyphFilter> glyphFilter = vtkSmartPointer<vtkVertexGlyphFilter>::New();
+  glyphFilter->SetInputConnection(candidatePolyData->GetProducerPort());
+  vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+  mapper->SetInputConnection(glyphFilter->GetOutputPort());
+
+  this->RayCandidatesActor = vtkSmartPointer<vtkActor>::New();
+  this->RayCandidatesActor->SetMapper(mapper);
+  this->RayCandidatesActor->GetProperty()->SetColor(1, 0.5, 0); // orange
+  this->RayCandidatesActor->GetProperty()->SetPointSize(5);
+  this->RightRenderer->AddViewProp(this->RayCandidatesActor);
+
+  double best[3];
+  this->PointCloud->GetPoint(this->RayCandidates[0], best);
+  this->pointSelectionStyle3D->ShowCandidate(best);
+
+  this->qvtkWidgetRight->GetRenderWindow()->Render();
+}
+
+void Form::on_actionAcceptRayCandidate_activated()
+{
+  if(this->RayCandidates.empty() || !this->pointSelectionStyle3D)
+    {
+    return;
+    }
+
+  double best[3];
+  this->pointSelectionStyle3D->GetFullResolutionPoint(this->RayCandidates[0], best);
+  double world[3];
+  this->pointSelectionStyle3D->SceneToWorld(best, world);
+  Coord3D worldPoint;
+  worldPoint.x = world[0];
+  worldPoint.y = world[1];
+  worldPoint.z = world[2];
+
+  // The partner of the keypoint the ray went through, unless it got one in the meantime
+  if(this->Correspondences.HasImagePoint(this->RayKeypoint) && !this->Correspondences.HasWorldPoint(this->RayKeypoint))
+    {
+    this->Correspondences.SetWorldPoint(this->RayKeypoint, worldPoint);
+    }
+  else
+    {
+    this->Correspondences.AddWorldPoint(worldPoint);
+    }
+
+  ClearRayCandidates();
+  this->RayCandidates.clear();
+  UpdateMarkers();
+}
+
+void Form::ClearRayCandidates()
+{
+  if(this->RayCandidatesActor)
+    {
+    this->RightRenderer->RemoveViewProp(this->RayCandidatesActor);
+    this->RayCandidatesActor = NULL;
+    }
+  if(this->pointSelectionStyle3D)
+    {
+    this->pointSelectionStyle3D->ClearCandidate();
+    }
+}
+
+void Form::ImageKeypointDragged()
+{
+  CorrespondenceModel::Id id = this->pointSelectionStyle2D->DraggedKeypoint;
+  if(this->HasPose && this->Correspondences.HasWorldPoint(id))
+    {
+    Coord2D imagePoint;
+    imagePoint.x = this->pointSelectionStyle2D->DragPixel[0];
+    imagePoint.y = this->pointSelectionStyle2D->DragPixel[1];
+    ShowPairResidual(id, imagePoint, this->Correspondences.GetWorldPoint(id));
+    }
+}
+
+void Form::PointCloudKeypointDragged()
+{
+  CorrespondenceModel::Id id = this->pointSelectionStyle3D->DraggedKeypoint;
+  if(this->HasPose && this->Correspondences.HasImagePoint(id))
+    {
+    Coord3D worldPoint;
+    worldPoint.x = this->pointSelectionStyle3D->DragPoint[0];
+    worldPoint.y = this->pointSelectionStyle3D->DragPoint[1];
+    worldPoint.z = this->pointSelectionStyle3D->DragPoint[2];
+    ShowPairResidual(id, this->Correspondences.GetImagePoint(id), worldPoint);
+    }
+}
+
+void Form::ShowPairResidual(const CorrespondenceModel::Id id, const Coord2D& imagePoint, const Coord3D& worldPoint)
+{
+  double world[3] = {worldPoint.x, worldPoint.y, worldPoint.z};
+  double pixel[2];
+  if(!this->Pose.Project(world, pixel))
+    {
+    this->statusBar()->showMessage(QString("Pair %1: the point is behind the camera").arg(id));
+    return;
+    }
+  double du = pixel[0] - imagePoint.x;
+  double dv = pixel[1] - imagePoint.y;
+  this->statusBar()->showMessage(QString("Pair %1: %2 pixels from its projection").arg(id).arg(sqrt(du * du + dv * dv), 0, 'f', 2));
+}
+
+void Form::ImageKeypointMoved()
+{
+  KeypointMoved(this->pointSelectionStyle2D->LastKeypoint);
+}
+
+void Form::PointCloudKeypointMoved()
+{
+  KeypointMoved(this->pointSelectionStyle3D->LastKeypoint);
+}
+
+void Form::KeypointMoved(const CorrespondenceModel::Id id)
+{
+  this->statusBar()->clearMessage();
+
+  // The pair's diagnosis no longer holds
+  const double red[3] = {1, 0, 0};
+  if(this->pointSelectionStyle2D)
+    {
+    this->pointSelectionStyle2D->SetPointColor(id, red);
+    }
+  if(this->pointSelectionStyle3D)
+    {
+    this->pointSelectionStyle3D->SetPointColor(id, red);
+    }
+  UpdateMarkers();
+
+  if(this->HasPose && this->Correspondences.GetNumberOfPairs() > 0)
+    {
+    std::vector<Coord2D> imagePoints;
+    std::vector<Coord3D> worldPoints;
+    this->Correspondences.GetPairs(imagePoints, worldPoints);
+    std::cout << "RMS reprojection error: "
+              << PoseEstimation::ComputeRMSReprojectionError(imagePoints, worldPoints, this->Pose)
+              << " pixels" << std::endl;
+    }
+}
+
+void Form::PointCloudKeypointClicked()
+{
+  UpdateMarkers(false);
+
+  // Only predict if the keypoint does not already have a partner
+  CorrespondenceModel::Id id = this->pointSelectionStyle3D->LastKeypoint;
+  if(!this->HasPose || !this->pointSelectionStyle2D || this->Correspondences.HasImagePoint(id))
+    {
+    return;
+    }
+
+  Coord3D keypoint = this->Correspondences.GetWorldPoint(id);
+  double world[3] = {keypoint.x, keypoint.y, keypoint.z};
+
+  // The uncertainty comes from the pairs selected so far
+  std::vector<Coord2D> imagePoints;
+  std::vector<Coord3D> worldPoints;
+  this->Correspondences.GetPairs(imagePoints, worldPoints);
+  double poseCovariance[6][6] = {{0}};
+  if(imagePoints.size() < 4 || !PoseEstimation::ComputePoseCovariance(imagePoints, worldPoints, this->Pose, poseCovariance))
+    {
+    std::cout << "At least 4 keypoint pairs are needed to estimate the uncertainty of the prediction." << std::endl;
+    }
+
+  double pixel[2];
+  double pixelCovariance[2][2];
+  if(!PoseEstimation::ProjectWithCovariance(this->Pose, poseCovariance, world, pixel, pixelCovariance))
+    {
+    std::cout << "The point is behind the camera." << std::endl;
+    return;
+    }
+  std::cout << "Predicted image location: " << pixel[0] << " " << pixel[1] << " (standard deviation "
+            << sqrt(pixelCovariance[0][0]) << ", " << sqrt(pixelCovariance[1][1]) << " pixels)" << std::endl;
+
+  this->pointSelectionStyle2D->ShowPrediction(pixel, pixelCovariance);
+
+  // Center the image view on the prediction and zoom so the ellipse fills a good part of it
+  double center[3];
+  this->pointSelectionStyle2D->PixelToWorld(pixel, center);
+  double largestVariance = std::max(pixelCovariance[0][0], pixelCovariance[1][1]);
+  double visiblePixels = std::max(64.0, 6.0 * sqrt(5.991 * largestVariance));
+  double visibleHeight = visiblePixels * this->ImageData->GetSpacing()[1];
+
+  vtkCamera* camera = this->LeftRenderer->GetActiveCamera();
+  double directionOfProjection[3];
+  camera->GetDirectionOfProjection(directionOfProjection);
+  double distance = 0.5 * visibleHeight / tan(0.5 * vtkMath::RadiansFromDegrees(camera->GetViewAngle()));
+  camera->SetFocalPoint(center);
+  camera->SetPosition(center[0] - distance * directionOfProjection[0],
+                      center[1] - distance * directionOfProjection[1],
+                      center[2] - distance * directionOfProjection[2]);
+  camera->SetParallelScale(0.5 * visibleHeight);
+  this->LeftRenderer->ResetCameraClippingRange();
+
+  this->qvtkWidgetLeft->GetRenderWindow()->Render();
 }
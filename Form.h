@@ -23,26 +23,44 @@
 
 // VTK
 #include <vtkSmartPointer.h>
-#include <vtkSeedWidget.h>
-#include <vtkPointHandleRepresentation2D.h>
 
 // ITK
 #include "itkImage.h"
 
 // Qt
+#include <QFuture>
+#include <QFutureWatcher>
 #include <QMainWindow>
 
 // Custom
+#include "Camera.h"
+#include "CameraCalibration.h"
+#include "CorrespondenceModel.h"
+#include "CorrespondenceProposer.h"
+#include "DerivedDataCache.h"
+#include "FrameImageCache.h"
+#include "ImageContrast.h"
+#include "ImageHandle.h"
+#include "KeypointTracker.h"
+#include "PointCloudColoring.h"
+#include "PointIndex.h"
+#include "QuantizedPointCloud.h"
+#include "Session.h"
+#include "TiledPointCloud.h"
+#include "TriangleBVH.h"
 #include "Types.h"
-#include "SeedCallback.h"
 #include "PointSelectionStyle2D.h"
 #include "PointSelectionStyle3D.h"
 
 // Forward declarations
 class vtkActor;
 class vtkBorderWidget;
+class vtkBoxWidget;
+class vtkEventQtSlotConnect;
 class vtkImageData;
 class vtkImageActor;
+class vtkPoints;
+class vtkUnsignedCharArray;
 class vtkPolyData;
 class vtkPolyDataMapper;
 class vtkRenderer;
@@ -54,39 +72,245 @@ public:
 
   // Constructor/Destructor
   Form();
-  ~Form() {};
+  ~Form();
+
+  // Where the camera calibrations are kept
+  static std::string GetCalibrationFileName();
 
 public slots:
   void on_actionOpenImage_activated();
   void on_actionOpenPointCloud_activated();
+  void on_actionIndexTiles_activated();
   void on_actionSaveImagePoints_activated();
   void on_actionSavePointCloudPoints_activated();
   void on_actionLoad2DPoints_activated();
   void on_actionLoad3DPoints_activated();
+  void on_actionOpenSession_activated();
+  void on_actionSaveSession_activated();
+  void on_actionNextFrame_activated();
+  void on_actionPreviousFrame_activated();
+  void on_cmbFrame_currentIndexChanged(int index);
+  void on_actionEstimatePose_activated();
+  void on_actionAdjustAllFrames_activated();
+  void on_actionCalibrateCamera_activated();
+  void on_actionDiagnoseCorrespondences_activated();
+  void on_actionExportDiagnostics_activated();
+  void on_txtCameraId_editingFinished();
+  void on_actionRegisterAutomatically_activated();
+  void on_actionProposeCorrespondences_activated();
+  void on_actionAcceptProposal_activated();
+  void on_actionRejectProposal_activated();
   void on_actionHelp_activated();
   void on_actionQuit_activated();
   void on_btnDeleteLastImageKeypoint_clicked();
   void on_btnDeleteAllImageKeypoints_clicked();
   void on_btnDeleteLastPointcloudKeypoint_clicked();
   void on_btnDeleteAllPointcloudKeypoints_clicked();
+  void on_chkSnap_clicked();
+  void on_chkSequence_clicked();
+  void on_chkCompact_clicked();
+  void on_cmbReduction_currentIndexChanged(int index);
+  void on_cmbColorBy_currentIndexChanged(int index);
+  void on_cmbCrop_currentIndexChanged(int index);
+  void on_btnAutoContrast_clicked();
+  void on_chkRGB_clicked();
+  void ImageDisplayBuilt();
+  void on_sldWindow_valueChanged(int);
+  void on_sldLevel_valueChanged(int);
+  void on_sldWindow_sliderReleased();
+  void on_sldLevel_sliderReleased();
+  void on_actionAcceptRayCandidate_activated();
+  void on_actionUndo_activated();
+  void on_actionRedo_activated();
+
+  // Look for the 3D point under a new image keypoint once a pose is known
+  void ImageKeypointClicked();
+
+  // Predict where a new point cloud keypoint is in the image once a pose is known
+  void PointCloudKeypointClicked();
+
+  // Show how far the pair of a keypoint being dragged is from fitting the pose, in the status bar
+  void ImageKeypointDragged();
+  void PointCloudKeypointDragged();
+
+  // The pair of a dragged keypoint is no longer the one diagnosed
+  void ImageKeypointMoved();
+  void PointCloudKeypointMoved();
+
+  // Bring the markers of the correspondences that changed up to date, and render the views if 'render'
+  void UpdateMarkers(const bool render = true);
+
+  // Index the point cloud (for the ray searches and dragged keypoints) unless it is indexed already
+  void PrepareCloudIndex();
+
+  // Crop to the box once it has been moved or resized
+  void CropBoxMoved();
+
+  // Page in the tiles the point cloud view needs, after the view changed
+  void UpdateTiles();
+  // Show the tiles once they have been paged in
+  void TilesPaged();
   
 protected:
 
   vtkSmartPointer<vtkRenderer> LeftRenderer;
   vtkSmartPointer<vtkRenderer> RightRenderer;
   
-  // Image
-  FloatVectorImageType::Pointer Image;
+  // The frames registered against the point cloud; CurrentFrame (-1 if none) is the one shown.
+  // Its keypoints and pose are edited in Correspondences and Pose, and put back by StoreFrame.
+  Session CurrentSession;
+  int CurrentFrame;
+  FrameImageCache FrameImages;
+  QFuture<void> FramePrefetch;
+
+  void StoreFrame();
+  // Show the image, keypoints and pose of a frame, and read the frames next to it in the background
+  void ShowFrame(const int index);
+  void ShowFrameKeypoints();
+  void UpdateFrameList();
+
+  // In sequence mode the image keypoints of a frame are tracked into the next frame when it is shown
+  // without keypoints, and paired again with the same point cloud keypoints. The tracker's pyramids of
+  // the current and next frames are built in the background along with the prefetch (TrackerFrame is
+  // the frame they start from, or -1).
+  KeypointTracker Tracker;
+  QFuture<bool> TrackerPreparation;
+  int TrackerFrame;
+  // Safe to run in a worker thread while Tracker is not used
+  static bool PrepareTracker(KeypointTracker* tracker, FrameImageCache* frameImages, const std::string from,
+                             const std::string to);
+  void StartTrackerPreparation();
+  // Fill the keypoints of frame 'from + 1' from those of frame 'from'
+  void PropagateKeypoints(const int from);
+
+  // Calibrations of the cameras by id, kept in the user's data location and shared by all sessions
+  CalibrationStore Calibrations;
+  std::string CalibrationFileName;
+  // Returns false if the frame's camera has not been calibrated
+  bool GetCalibration(const SessionFrame& frame, CameraIntrinsics& intrinsics) const;
+
+  // Leave each keypoint pair of the current frame out in turn, color the markers by how badly the others
+  // predict it and list the suspect pairs
+  void ShowDiagnostics();
+
+  // Image of the current frame
+  ImageHandle<FloatVectorImageType> Image;
   vtkSmartPointer<vtkImageActor> ImageActor;
   vtkSmartPointer<vtkImageData> ImageData;
+
+  // The image is shown in color or as its magnitude. Each view is built the first time it is shown
+  // (in the background, when toggled) and kept while memory allows. ImageData is the one shown.
+  struct ImageDisplay
+  {
+    ImageContrast Contrast; // maps the full bit depth pixels to Data
+    vtkSmartPointer<vtkImageData> Data;
+  };
+  enum {ColorDisplay, MagnitudeDisplay};
+  ImageDisplay ImageDisplays[2];
+  unsigned int ShownImageDisplay;
+  QFutureWatcher<void> ImageDisplayWatcher;
+  ImageHandle<FloatScalarImageType> MagnitudeImage;
+
+  // Safe to run in a worker thread while 'display' is not shown; the handles are snapshots of the images
+  static void BuildImageDisplay(ImageDisplay* display, ImageHandle<FloatVectorImageType> image,
+                                ImageHandle<FloatScalarImageType> magnitudeImage, const bool color);
+  unsigned int GetRequestedImageDisplay() const;
+  void ShowImageDisplay(const unsigned int display);
+  // Show Image, after it has changed
+  void ShowImage();
+
+  void ContrastSliderMoved();
+  void UpdateContrastSliders();
+  // Remap ImageData after a window/level change, only the pixels in view if visibleOnly
+  void ApplyContrast(const bool visibleOnly);
   
-  // Point cloud
+  // Point cloud, shared by all the frames
+  void OpenPointCloud(const std::string& fileName);
   vtkSmartPointer<vtkActor> PointCloudActor;
   vtkSmartPointer<vtkPolyDataMapper> PointCloudMapper;
   vtkSmartPointer<vtkPolyData> PointCloud;
+  float AverageSpacing;
+
+  // What the points can be colored by, and the colors of each once they have been shown (else NULL)
+  std::vector<PointAttribute> PointAttributes;
+  std::vector<vtkSmartPointer<vtkUnsignedCharArray> > ColorBuffers;
+
+  // Color the points by PointAttributes[index - 1], or in a solid color if index is 0
+  void ColorPointCloud(const int index);
+
+  // The points as read, when PointCloud is a reduced copy of them (otherwise NULL)
+  vtkSmartPointer<vtkPoints> FullResolutionPoints;
+  // The same, when chkCompact is checked (otherwise empty)
+  QuantizedPointCloud CompactFullResolutionPoints;
+
+  // The cloud as opened (and reduced). PointCloud is the part of it inside the crop region, or the same
+  // cloud when it is not cropped; only PointCloud is rendered, indexed for picking and registered, so
+  // their cost follows the size of the crop rather than of the scan.
+  vtkSmartPointer<vtkPolyData> UncroppedPointCloud;
+  // When a tiled dataset is open, UncroppedPointCloud is assembled from the tiles resident in Tiles. The
+  // tiles are paged in the background while TilesPaging (TilesOutdated if the view changed meanwhile).
+  TiledPointCloud Tiles;
+  QFutureWatcher<void> TileWatcher;
+  bool TilesPaging;
+  bool TilesOutdated;
+  // The tiles overlapping the point cloud view, nearest its camera first
+  void ChooseTiles(std::vector<unsigned int>& tiles) const;
+
+  // Over UncroppedPointCloud, to find the points in a crop region
+  PointIndex CropIndex;
+  vtkSmartPointer<vtkBoxWidget> CropBox;
+
+  // Entries of cmbCrop
+  enum CropMethod {CropNone, CropToBox, CropToView};
+
+  // Crop to the region chosen in cmbCrop
+  void UpdateCrop();
+  // Crop again if the crop follows the pose, after it changed
+  void UpdateViewCrop();
+  // Show, pick and register 'pointCloud', which is UncroppedPointCloud or a crop of it
+  void ShowPointCloud(vtkPolyData* pointCloud);
+
+  // Entries of cmbReduction
+  enum ReductionMethod {ReduceNone, ReduceVoxelGrid, ReducePoissonDisk, ReduceRandom};
+
+  // Built the first time it is needed after a point cloud is opened
+  PointIndex CloudIndex;
+
+  // Spacing and search structures of clouds opened before, keyed by CloudKey (the hash of the current cloud)
+  DerivedDataCache Cache;
+  vtkTypeUInt64 CloudKey;
+
+  // For picking on the surface when the point cloud is a mesh
+  TriangleBVH SurfaceBVH;
+
+  // Points near the ray through the image keypoint of RayKeypoint, best first
+  std::vector<vtkIdType> RayCandidates;
+  CorrespondenceModel::Id RayKeypoint;
+  vtkSmartPointer<vtkActor> RayCandidatesActor;
+  void ClearRayCandidates();
+
+  void ShowPairResidual(const CorrespondenceModel::Id id, const Coord2D& imagePoint, const Coord3D& worldPoint);
+  void KeypointMoved(const CorrespondenceModel::Id id);
+
+  vtkSmartPointer<vtkEventQtSlotConnect> Connections;
   
+  // The keypoints of the current frame, shown by both selection styles
+  CorrespondenceModel Correspondences;
   vtkSmartPointer<PointSelectionStyle2D> pointSelectionStyle2D;
   vtkSmartPointer<PointSelectionStyle3D> pointSelectionStyle3D;
+
+  // The point cloud is stored and rendered relative to this point, so that georeferenced
+  // coordinates keep their precision as floats. Pose and the keypoints are in world coordinates.
+  double CloudOrigin[3];
+
+  // Camera relating the point cloud to the image, once one has been estimated
+  Camera Pose;
+  bool HasPose;
+
+  // Automatically proposed pairs waiting to be accepted or rejected
+  std::vector<CorrespondenceProposal> Proposals;
+  unsigned int CurrentProposal;
+  void ShowCurrentProposal();
 };
 
 #endif // Form_H
@@ -0,0 +1,170 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "FrameImageCache.h"
+
+// ITK
+#include "itkImageFileReader.h"
+
+// Qt
+#include <QMutexLocker>
+
+// Custom
+#include "Helpers.h"
+
+FrameImageCache::FrameImageCache() : MemoryBudget(static_cast<size_t>(2) << 30), Clock(0)
+{
+}
+
+void FrameImageCache::SetMemoryBudget(const size_t bytes)
+{
+  QMutexLocker locker(&this->Mutex);
+  this->MemoryBudget = bytes;
+  Trim(std::string());
+}
+
+bool FrameImageCache::Get(const std::string& fileName, ImageHandle<FloatVectorImageType>& image,
+                          ImageHandle<FloatScalarImageType>& magnitudeImage)
+{
+  QMutexLocker locker(&this->Mutex);
+  if(!Acquire(fileName))
+    {
+    return false;
+    }
+
+  Entry& entry = this->Entries[fileName];
+  entry.LastUse = ++this->Clock;
+  image = entry.Image;
+  magnitudeImage = entry.MagnitudeImage;
+  return true;
+}
+
+void FrameImageCache::Prefetch(const std::vector<std::string>& fileNames)
+{
+  for(unsigned int i = 0; i < fileNames.size(); ++i)
+    {
+    QMutexLocker locker(&this->Mutex);
+    if(this->Failed.count(fileNames[i]))
+      {
+      continue;
+      }
+    if(Acquire(fileNames[i]))
+      {
+      this->Entries[fileNames[i]].LastUse = ++this->Clock;
+      }
+    }
+}
+
+bool FrameImageCache::Contains(const std::string& fileName)
+{
+  QMutexLocker locker(&this->Mutex);
+  return this->Entries.count(fileName) > 0;
+}
+
+void FrameImageCache::Clear()
+{
+  QMutexLocker locker(&this->Mutex);
+  this->Entries.clear();
+  this->Failed.clear();
+}
+
+bool FrameImageCache::Acquire(const std::string& fileName)
+{
+  while(this->Reading.count(fileName))
+    {
+    this->ReadFinished.wait(&this->Mutex);
+    }
+  if(this->Entries.count(fileName))
+    {
+    return true;
+    }
+
+  // Other files can be got from the cache meanwhile
+  this->Reading.insert(fileName);
+  this->Mutex.unlock();
+  Entry entry;
+  bool read = Read(fileName, entry);
+  this->Mutex.lock();
+  this->Reading.erase(fileName);
+  this->ReadFinished.wakeAll();
+
+  if(!read)
+    {
+    this->Failed.insert(fileName);
+    return false;
+    }
+  this->Failed.erase(fileName);
+  this->Entries[fileName] = entry;
+  Trim(fileName);
+  return true;
+}
+
+void FrameImageCache::Trim(const std::string& keep)
+{
+  size_t total = 0;
+  for(std::map<std::string, Entry>::const_iterator iterator = this->Entries.begin();
+      iterator != this->Entries.end(); ++iterator)
+    {
+    total += iterator->second.Size;
+    }
+
+  while(total > this->MemoryBudget)
+    {
+    std::map<std::string, Entry>::iterator oldest = this->Entries.end();
+    for(std::map<std::string, Entry>::iterator iterator = this->Entries.begin();
+        iterator != this->Entries.end(); ++iterator)
+      {
+      if(iterator->first != keep && (oldest == this->Entries.end() || iterator->second.LastUse < oldest->second.LastUse))
+        {
+        oldest = iterator;
+        }
+      }
+    if(oldest == this->Entries.end())
+      {
+      return;
+      }
+    total -= oldest->second.Size;
+    this->Entries.erase(oldest);
+    }
+}
+
+bool FrameImageCache::Read(const std::string& fileName, Entry& entry)
+{
+  typedef itk::ImageFileReader<FloatVectorImageType> ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(fileName);
+  try
+    {
+    reader->Update();
+    }
+  catch(itk::ExceptionObject& error)
+    {
+    std::cerr << "Cannot read " << fileName << ": " << error.GetDescription() << std::endl;
+    return false;
+    }
+
+  FloatVectorImageType::Pointer image = reader->GetOutput();
+  image->DisconnectPipeline();
+  FloatScalarImageType::Pointer magnitudeImage = FloatScalarImageType::New();
+  Helpers::ITKImagetoMagnitudeImage(image, magnitudeImage);
+  entry.Size = (image->GetPixelContainer()->Size() + magnitudeImage->GetPixelContainer()->Size()) * sizeof(float);
+  entry.Image = ImageHandle<FloatVectorImageType>(image);
+  entry.MagnitudeImage = ImageHandle<FloatScalarImageType>(magnitudeImage);
+  entry.LastUse = 0;
+  return true;
+}
@@ -0,0 +1,90 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef FRAMEIMAGECACHE_H
+#define FRAMEIMAGECACHE_H
+
+// Qt
+#include <QMutex>
+#include <QWaitCondition>
+
+// STL
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Custom
+#include "ImageHandle.h"
+#include "Types.h"
+
+// Decoded images of the frames of a session, with their magnitude images, kept within a memory budget.
+// Images are read the first time they are asked for, or ahead of time by Prefetch in a worker thread;
+// when the budget is exceeded the least recently used ones are dropped. Images are handed out as snapshots
+// (copy-on-write handles), so they stay valid after they are dropped and writing to them leaves the cached
+// ones as they are. All functions are safe to call from any thread.
+class FrameImageCache
+{
+public:
+  // 2 GB budget
+  FrameImageCache();
+
+  void SetMemoryBudget(const size_t bytes);
+
+  // The image in fileName and its magnitude, read now unless cached (or being prefetched, which is waited for).
+  // Returns false if the file cannot be read.
+  bool Get(const std::string& fileName, ImageHandle<FloatVectorImageType>& image,
+           ImageHandle<FloatScalarImageType>& magnitudeImage);
+
+  // Read the images not cached yet, in order. Meant to run in a worker thread.
+  void Prefetch(const std::vector<std::string>& fileNames);
+
+  bool Contains(const std::string& fileName);
+
+  // Drop every image
+  void Clear();
+
+private:
+  struct Entry
+  {
+    ImageHandle<FloatVectorImageType> Image;
+    ImageHandle<FloatScalarImageType> MagnitudeImage;
+    size_t Size; // bytes
+    unsigned long LastUse;
+  };
+
+  // Wait until fileName is cached, reading it if no other thread is. Called with the mutex locked.
+  bool Acquire(const std::string& fileName);
+
+  // Drop least recently used entries, but not 'keep', until the budget is met. Called with the mutex locked.
+  void Trim(const std::string& keep);
+
+  static bool Read(const std::string& fileName, Entry& entry);
+
+  std::map<std::string, Entry> Entries;
+  std::set<std::string> Reading; // being read by some thread
+  std::set<std::string> Failed;  // could not be read, so not retried by Prefetch
+
+  size_t MemoryBudget;
+  unsigned long Clock;
+
+  QMutex Mutex;
+  QWaitCondition ReadFinished;
+};
+
+#endif
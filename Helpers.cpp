@@ -24,9 +24,79 @@
 #include "itkRescaleIntensityImageFilter.h"
 
 // VTK
+#include <vtkCamera.h>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
 #include <vtkIdList.h>
+#include <vtkIdTypeArray.h>
 #include <vtkKdTree.h>
 #include <vtkMath.h>
+#include <vtkPolyData.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+struct ShiftFunctor
+{
+  vtkPoints* Input;
+  double Origin[3];
+  float* Output;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      double p[3];
+      this->Input->GetPoint(i, p);
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        this->Output[3 * i + d] = static_cast<float>(p[d] - this->Origin[d]);
+        }
+      }
+  }
+};
+
+// One vertex cell per point
+struct VertexFunctor
+{
+  vtkIdType* Cells;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType pointId = begin; pointId < end; ++pointId)
+      {
+      this->Cells[2 * pointId] = 1;
+      this->Cells[2 * pointId + 1] = pointId;
+      }
+  }
+};
+
+// Pieces [begin, end) of a copy
+struct CopyFunctor
+{
+  char* Destination;
+  const char* Source;
+  size_t NumberOfBytes;
+  size_t PieceSize;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    size_t first = begin * this->PieceSize;
+    size_t last = std::min(this->NumberOfBytes, end * this->PieceSize);
+    memcpy(this->Destination + first, this->Source + first, last - first);
+  }
+};
+
+} // end anonymous namespace
 
 namespace Helpers
 {
@@ -130,6 +200,31 @@ void ITKImagetoVTKMagnitudeImage(FloatVectorImageType::Pointer image, vtkImageDa
     }
 }
 
+// Compute the per-pixel magnitude of a vector image without rescaling it
+void ITKImagetoMagnitudeImage(FloatVectorImageType::Pointer image, FloatScalarImageType::Pointer outputImage)
+{
+  typedef itk::VectorMagnitudeImageFilter<
+                  FloatVectorImageType, FloatScalarImageType >  VectorMagnitudeFilterType;
+
+  VectorMagnitudeFilterType::Pointer magnitudeFilter = VectorMagnitudeFilterType::New();
+  magnitudeFilter->SetInput( image );
+  magnitudeFilter->Update();
+
+  DeepCopyScalarImage<FloatScalarImageType>(magnitudeFilter->GetOutput(), outputImage);
+}
+
+void ParallelCopy(void* destination, const void* source, const size_t numberOfBytes)
+{
+  // Pieces of 1 MB; small copies are not worth the threads
+  const size_t pieceSize = 1 << 20;
+  CopyFunctor copy;
+  copy.Destination = static_cast<char*>(destination);
+  copy.Source = static_cast<const char*>(source);
+  copy.NumberOfBytes = numberOfBytes;
+  copy.PieceSize = pieceSize;
+  Parallel::For(0, static_cast<vtkIdType>((numberOfBytes + pieceSize - 1) / pieceSize), copy);
+}
+
 float ComputeAverageSpacing(vtkPoints* points)
 {
   float sumOfDistances = 0.;
@@ -163,4 +258,156 @@ float ComputeAverageSpacing(vtkPoints* points)
   return averageDistance;
 }
 
+void VTKCameraToCamera(vtkCamera* vtkcamera, const unsigned int imageSize[2], Camera& camera)
+{
+  double position[3];
+  vtkcamera->GetPosition(position);
+  double focalPoint[3];
+  vtkcamera->GetFocalPoint(focalPoint);
+  double viewUp[3];
+  vtkcamera->GetViewUp(viewUp);
+
+  // The camera frame is x right, y down (image rows), z forward
+  double z[3];
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    z[i] = focalPoint[i] - position[i];
+    }
+  vtkMath::Normalize(z);
+
+  double y[3];
+  double upDotZ = vtkMath::Dot(viewUp, z);
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    y[i] = -(viewUp[i] - upDotZ * z[i]);
+    }
+  vtkMath::Normalize(y);
+
+  double x[3];
+  vtkMath::Cross(y, z, x);
+
+  double R[3][3];
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    R[0][i] = x[i];
+    R[1][i] = y[i];
+    R[2][i] = z[i];
+    }
+  camera.SetRotationMatrix(R);
+
+  // t = -R C
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    camera.Translation[i] = -(R[i][0] * position[0] + R[i][1] * position[1] + R[i][2] * position[2]);
+    }
+
+  camera.FocalLength = 0.5 * imageSize[1] / tan(0.5 * vtkMath::RadiansFromDegrees(vtkcamera->GetViewAngle()));
+  camera.PrincipalPoint[0] = 0.5 * (imageSize[0] - 1);
+  camera.PrincipalPoint[1] = 0.5 * (imageSize[1] - 1);
+}
+
+void CameraToVTKCamera(const Camera& camera, const unsigned int imageSize[2], vtkCamera* vtkcamera)
+{
+  double R[3][3];
+  camera.GetRotationMatrix(R);
+
+  double position[3];
+  camera.GetCenter(position);
+
+  // Keep the current distance to the focal point so zooming still behaves
+  double distance = vtkcamera->GetDistance();
+  double focalPoint[3];
+  double viewUp[3];
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    focalPoint[i] = position[i] + distance * R[2][i];
+    viewUp[i] = -R[1][i];
+    }
+
+  vtkcamera->SetPosition(position);
+  vtkcamera->SetFocalPoint(focalPoint);
+  vtkcamera->SetViewUp(viewUp);
+  vtkcamera->SetViewAngle(vtkMath::DegreesFromRadians(2.0 * atan(0.5 * imageSize[1] / camera.FocalLength)));
+}
+
+bool ChooseLocalOrigin(const double bounds[6], double origin[3])
+{
+  origin[0] = origin[1] = origin[2] = 0;
+
+  // Within 1e4 of the origin float still resolves a millimeter
+  double largestCoordinate = 0;
+  for(unsigned int i = 0; i < 6; ++i)
+    {
+    largestCoordinate = std::max(largestCoordinate, fabs(bounds[i]));
+    }
+  if(largestCoordinate < 1e4)
+    {
+    return false;
+    }
+
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    origin[d] = floor(0.5 * (bounds[2 * d] + bounds[2 * d + 1]) + 0.5);
+    }
+  return true;
+}
+
+void ShiftToLocalOrigin(vtkPolyData* polyData, double origin[3])
+{
+  origin[0] = origin[1] = origin[2] = 0;
+
+  vtkPoints* points = polyData->GetPoints();
+  if(!points || points->GetNumberOfPoints() == 0)
+    {
+    return;
+    }
+
+  double bounds[6];
+  points->GetBounds(bounds);
+  if(!ChooseLocalOrigin(bounds, origin))
+    {
+    return;
+    }
+
+  if(points->GetDataType() != VTK_DOUBLE)
+    {
+    std::cout << "Warning: the point coordinates were stored in single precision, so shifting them to a local origin "
+              << "cannot restore the precision they have already lost." << std::endl;
+    }
+
+  vtkSmartPointer<vtkFloatArray> localCoordinates = vtkSmartPointer<vtkFloatArray>::New();
+  localCoordinates->SetNumberOfComponents(3);
+  localCoordinates->SetNumberOfTuples(points->GetNumberOfPoints());
+
+  ShiftFunctor shift;
+  shift.Input = points;
+  shift.Output = localCoordinates->GetPointer(0);
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    shift.Origin[d] = origin[d];
+    }
+  Parallel::For(0, points->GetNumberOfPoints(), shift);
+
+  vtkSmartPointer<vtkPoints> localPoints = vtkSmartPointer<vtkPoints>::New();
+  localPoints->SetData(localCoordinates);
+  polyData->SetPoints(localPoints);
+
+  std::cout << "Point coordinates are stored relative to the local origin " << std::setprecision(12)
+            << origin[0] << " " << origin[1] << " " << origin[2] << std::setprecision(6) << std::endl;
+}
+
+void AddVertices(vtkPolyData* polyData)
+{
+  vtkIdType numberOfPoints = polyData->GetNumberOfPoints();
+  vtkSmartPointer<vtkIdTypeArray> cells = vtkSmartPointer<vtkIdTypeArray>::New();
+  cells->SetNumberOfTuples(2 * numberOfPoints);
+  VertexFunctor vertices;
+  vertices.Cells = cells->GetPointer(0);
+  Parallel::For(0, numberOfPoints, vertices);
+
+  vtkSmartPointer<vtkCellArray> vertexCells = vtkSmartPointer<vtkCellArray>::New();
+  vertexCells->SetCells(numberOfPoints, cells);
+  polyData->SetVerts(vertexCells);
+}
+
 } // end namespace
@@ -31,21 +31,68 @@
 #include <vtkSmartPointer.h>
 
 // Custom
+#include "Camera.h"
 #include "Types.h"
 
+class vtkCamera;
+class vtkPolyData;
+
 namespace Helpers
 {
 
 void ITKImagetoVTKImage(FloatVectorImageType::Pointer image, vtkImageData* outputImage); // This function simply drives ITKImagetoVTKRGBImage or ITKImagetoVTKMagnitudeImage
 void ITKImagetoVTKRGBImage(FloatVectorImageType::Pointer image, vtkImageData* outputImage);
 void ITKImagetoVTKMagnitudeImage(FloatVectorImageType::Pointer image, vtkImageData* outputImage);
+void ITKImagetoMagnitudeImage(FloatVectorImageType::Pointer image, FloatScalarImageType::Pointer outputImage);
 float ComputeAverageSpacing(vtkPoints* points);
 
+// Points far from the origin (e.g. UTM coordinates) cannot be stored in float without losing centimeters.
+// If the points are far from the origin, replace them by float points relative to 'origin' (the rounded center
+// of their bounds, returned); otherwise leave them and return a zero origin. World coordinates are local + origin.
+void ShiftToLocalOrigin(vtkPolyData* polyData, double origin[3]);
+
+// The origin ShiftToLocalOrigin would use for points with these bounds. Returns false (and a zero origin)
+// if no shift is needed. Readers that know the bounds up front use this to write local floats directly.
+bool ChooseLocalOrigin(const double bounds[6], double origin[3]);
+
+// Give every point of polyData its own vertex cell (built in parallel), so a bare point set renders
+void AddVertices(vtkPolyData* polyData);
+
+// Conversions between the VTK camera of the point cloud view and a pinhole Camera for an image of the given size.
+// The principal point is assumed to be the image center and the VTK view angle spans the image height.
+void VTKCameraToCamera(vtkCamera* vtkcamera, const unsigned int imageSize[2], Camera& camera);
+void CameraToVTKCamera(const Camera& camera, const unsigned int imageSize[2], vtkCamera* vtkcamera);
+
+// memcpy split over the threads, for large buffers
+void ParallelCopy(void* destination, const void* source, const size_t numberOfBytes);
+
+// If 'input' holds its whole image in its buffer (the usual case), copy the pixel container to the
+// freshly allocated 'output' in one parallel bulk copy and return true. Otherwise return false.
+template<typename TImage>
+bool CopyPixelContainer(const TImage* input, TImage* output)
+{
+  if(input->GetBufferedRegion() != input->GetLargestPossibleRegion() ||
+     output->GetBufferedRegion() != input->GetLargestPossibleRegion())
+    {
+    return false;
+    }
+
+  // For vector images the container holds the components, so its size is pixels times components
+  ParallelCopy(output->GetBufferPointer(), input->GetBufferPointer(),
+               input->GetPixelContainer()->Size() * sizeof(typename TImage::InternalPixelType));
+  return true;
+}
+
 template<typename TImage>
 void DeepCopyScalarImage(typename TImage::Pointer input, typename TImage::Pointer output)
 {
   output->SetRegions(input->GetLargestPossibleRegion());
   output->Allocate();
+
+  if(CopyPixelContainer<TImage>(input, output))
+    {
+    return;
+    }
  
   itk::ImageRegionConstIterator<TImage> inputIterator(input, input->GetLargestPossibleRegion());
   itk::ImageRegionIterator<TImage> outputIterator(output, output->GetLargestPossibleRegion());
@@ -64,6 +111,11 @@ void DeepCopyVectorImage(typename TImage::Pointer input, typename TImage::Pointe
   output->SetRegions(input->GetLargestPossibleRegion());
   output->SetNumberOfComponentsPerPixel(input->GetNumberOfComponentsPerPixel());
   output->Allocate();
+
+  if(CopyPixelContainer<TImage>(input, output))
+    {
+    return;
+    }
  
   itk::ImageRegionConstIterator<TImage> inputIterator(input, input->GetLargestPossibleRegion());
   itk::ImageRegionIterator<TImage> outputIterator(output, output->GetLargestPossibleRegion());
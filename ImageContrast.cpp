@@ -0,0 +1,341 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "ImageContrast.h"
+
+// VTK
+#include <vtkImageData.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+const unsigned int NumberOfLevels = 65536;
+
+struct RangeFunctor
+{
+  const float* Pixels;
+  unsigned int Width;
+  unsigned int NumberOfComponents;
+  unsigned int NumberOfChannels;
+  std::vector<double>* Range; // 2 per thread
+
+  void operator()(const vtkIdType beginRow, const vtkIdType endRow, const int threadId)
+  {
+    float minimum = std::numeric_limits<float>::max();
+    float maximum = -std::numeric_limits<float>::max();
+    for(vtkIdType j = beginRow; j < endRow; ++j)
+      {
+      const float* pixel = this->Pixels + static_cast<size_t>(j) * this->Width * this->NumberOfComponents;
+      for(unsigned int i = 0; i < this->Width; ++i, pixel += this->NumberOfComponents)
+        {
+        for(unsigned int c = 0; c < this->NumberOfChannels; ++c)
+          {
+          // NaN fails both comparisons
+          minimum = pixel[c] < minimum ? pixel[c] : minimum;
+          maximum = pixel[c] > maximum ? pixel[c] : maximum;
+          }
+        }
+      }
+    (*this->Range)[2 * threadId] = std::min((*this->Range)[2 * threadId], static_cast<double>(minimum));
+    (*this->Range)[2 * threadId + 1] = std::max((*this->Range)[2 * threadId + 1], static_cast<double>(maximum));
+  }
+};
+
+struct QuantizeFunctor
+{
+  const float* Pixels;
+  unsigned int Width;
+  unsigned int NumberOfComponents;
+  unsigned int NumberOfChannels;
+  double Minimum;
+  double Scale; // levels per unit
+  unsigned short* Levels;
+  std::vector<std::vector<vtkIdType> >* Histograms; // per thread
+
+  void operator()(const vtkIdType beginRow, const vtkIdType endRow, const int threadId)
+  {
+    vtkIdType* histogram = &(*this->Histograms)[threadId][0];
+    for(vtkIdType j = beginRow; j < endRow; ++j)
+      {
+      const float* pixel = this->Pixels + static_cast<size_t>(j) * this->Width * this->NumberOfComponents;
+      unsigned short* levels = this->Levels + static_cast<size_t>(j) * this->Width * this->NumberOfChannels;
+      for(unsigned int i = 0; i < this->Width; ++i, pixel += this->NumberOfComponents)
+        {
+        for(unsigned int c = 0; c < this->NumberOfChannels; ++c)
+          {
+          double level = (pixel[c] - this->Minimum) * this->Scale + 0.5;
+          unsigned short quantized = 0;
+          if(level >= NumberOfLevels - 1)
+            {
+            quantized = NumberOfLevels - 1;
+            }
+          else if(level > 0)
+            {
+            quantized = static_cast<unsigned short>(level);
+            }
+          *levels++ = quantized;
+          histogram[quantized]++;
+          }
+        }
+      }
+  }
+};
+
+struct MapFunctor
+{
+  const unsigned short* Levels;
+  const unsigned char* Table;
+  unsigned int Width;
+  unsigned int NumberOfChannels;
+  int FirstColumn;
+  int LastColumn;
+  unsigned char* Output;
+
+  void operator()(const vtkIdType beginRow, const vtkIdType endRow, const int)
+  {
+    size_t rowLength = static_cast<size_t>(this->Width) * this->NumberOfChannels;
+    size_t first = static_cast<size_t>(this->FirstColumn) * this->NumberOfChannels;
+    size_t last = static_cast<size_t>(this->LastColumn + 1) * this->NumberOfChannels;
+    for(vtkIdType j = beginRow; j < endRow; ++j)
+      {
+      const unsigned short* levels = this->Levels + j * rowLength;
+      unsigned char* output = this->Output + j * rowLength;
+      for(size_t k = first; k < last; ++k)
+        {
+        output[k] = this->Table[levels[k]];
+        }
+      }
+  }
+};
+
+} // end anonymous namespace
+
+ImageContrast::ImageContrast() : Width(0), Height(0), NumberOfChannels(1), Window(1), Level(0.5)
+{
+  this->Range[0] = 0;
+  this->Range[1] = 1;
+  this->Table.resize(NumberOfLevels, 0);
+}
+
+void ImageContrast::Initialize()
+{
+  this->Width = 0;
+  this->Height = 0;
+  std::vector<unsigned short>().swap(this->Levels);
+  std::vector<vtkIdType>().swap(this->Histogram);
+}
+
+void ImageContrast::SetPixels(const float* pixels, const unsigned int width, const unsigned int height,
+                              const unsigned int numberOfComponents, const unsigned int numberOfChannels)
+{
+  this->Width = width;
+  this->Height = height;
+  this->NumberOfChannels = numberOfChannels;
+
+  int numberOfThreads = Parallel::GetNumberOfThreads();
+  std::vector<double> ranges(2 * numberOfThreads);
+  for(int thread = 0; thread < numberOfThreads; ++thread)
+    {
+    ranges[2 * thread] = std::numeric_limits<double>::max();
+    ranges[2 * thread + 1] = -std::numeric_limits<double>::max();
+    }
+
+  RangeFunctor rangeFunctor;
+  rangeFunctor.Pixels = pixels;
+  rangeFunctor.Width = width;
+  rangeFunctor.NumberOfComponents = numberOfComponents;
+  rangeFunctor.NumberOfChannels = numberOfChannels;
+  rangeFunctor.Range = &ranges;
+  Parallel::For(0, height, rangeFunctor);
+
+  this->Range[0] = std::numeric_limits<double>::max();
+  this->Range[1] = -std::numeric_limits<double>::max();
+  for(int thread = 0; thread < numberOfThreads; ++thread)
+    {
+    this->Range[0] = std::min(this->Range[0], ranges[2 * thread]);
+    this->Range[1] = std::max(this->Range[1], ranges[2 * thread + 1]);
+    }
+  if(this->Range[0] > this->Range[1])
+    {
+    this->Range[0] = this->Range[1] = 0;
+    }
+
+  // Integer data with at most 65536 values maps one value to one level
+  this->Levels.resize(static_cast<size_t>(width) * height * numberOfChannels);
+  std::vector<std::vector<vtkIdType> > histograms(numberOfThreads, std::vector<vtkIdType>(NumberOfLevels, 0));
+  QuantizeFunctor quantize;
+  quantize.Pixels = pixels;
+  quantize.Width = width;
+  quantize.NumberOfComponents = numberOfComponents;
+  quantize.NumberOfChannels = numberOfChannels;
+  quantize.Minimum = this->Range[0];
+  quantize.Scale = this->Range[1] > this->Range[0] ? (NumberOfLevels - 1) / (this->Range[1] - this->Range[0]) : 0;
+  quantize.Levels = this->Levels.empty() ? NULL : &this->Levels[0];
+  quantize.Histograms = &histograms;
+  Parallel::For(0, height, quantize);
+
+  this->Histogram.assign(NumberOfLevels, 0);
+  for(int thread = 0; thread < numberOfThreads; ++thread)
+    {
+    for(unsigned int level = 0; level < NumberOfLevels; ++level)
+      {
+      this->Histogram[level] += histograms[thread][level];
+      }
+    }
+
+  SetWindowLevel(this->Range[1] - this->Range[0], 0.5 * (this->Range[0] + this->Range[1]));
+}
+
+unsigned int ImageContrast::GetWidth() const
+{
+  return this->Width;
+}
+
+unsigned int ImageContrast::GetHeight() const
+{
+  return this->Height;
+}
+
+unsigned int ImageContrast::GetNumberOfChannels() const
+{
+  return this->NumberOfChannels;
+}
+
+size_t ImageContrast::GetMemorySize() const
+{
+  return this->Levels.size() * (sizeof(unsigned short) + 1) + this->Histogram.size() * sizeof(vtkIdType);
+}
+
+const double* ImageContrast::GetRange() const
+{
+  return this->Range;
+}
+
+void ImageContrast::ComputeAutoContrast(const double lowPercentile, const double highPercentile,
+                                        double& window, double& level) const
+{
+  vtkIdType total = 0;
+  for(unsigned int i = 0; i < this->Histogram.size(); ++i)
+    {
+    total += this->Histogram[i];
+    }
+
+  // The first levels at which the cumulative count reaches each percentile
+  vtkIdType lowCount = static_cast<vtkIdType>(total * lowPercentile / 100.0);
+  vtkIdType highCount = static_cast<vtkIdType>(total * highPercentile / 100.0);
+  unsigned int low = 0;
+  unsigned int high = NumberOfLevels - 1;
+  vtkIdType cumulative = 0;
+  bool foundLow = false;
+  for(unsigned int i = 0; i < this->Histogram.size(); ++i)
+    {
+    cumulative += this->Histogram[i];
+    if(!foundLow && cumulative > lowCount)
+      {
+      low = i;
+      foundLow = true;
+      }
+    if(cumulative >= highCount)
+      {
+      high = i;
+      break;
+      }
+    }
+
+  double valuePerLevel = (this->Range[1] - this->Range[0]) / (NumberOfLevels - 1);
+  double lowValue = this->Range[0] + low * valuePerLevel;
+  double highValue = this->Range[0] + high * valuePerLevel;
+  if(highValue <= lowValue)
+    {
+    lowValue = this->Range[0];
+    highValue = this->Range[1];
+    }
+  window = highValue - lowValue;
+  level = 0.5 * (lowValue + highValue);
+}
+
+void ImageContrast::SetWindowLevel(const double window, const double level)
+{
+  this->Window = window;
+  this->Level = level;
+
+  double valuePerLevel = (this->Range[1] - this->Range[0]) / (NumberOfLevels - 1);
+  double black = level - 0.5 * window;
+  for(unsigned int i = 0; i < NumberOfLevels; ++i)
+    {
+    double value = this->Range[0] + i * valuePerLevel;
+    double display = window > 0 ? 255.0 * (value - black) / window : (value < level ? 0 : 255);
+    this->Table[i] = static_cast<unsigned char>(std::max(0.0, std::min(255.0, display + 0.5)));
+    }
+}
+
+double ImageContrast::GetWindow() const
+{
+  return this->Window;
+}
+
+double ImageContrast::GetLevel() const
+{
+  return this->Level;
+}
+
+void ImageContrast::Allocate(vtkImageData* output) const
+{
+  output->SetNumberOfScalarComponents(this->NumberOfChannels);
+  output->SetScalarTypeToUnsignedChar();
+  output->SetDimensions(this->Width, this->Height, 1);
+  output->AllocateScalars();
+}
+
+void ImageContrast::Map(vtkImageData* output, const int extent[4]) const
+{
+  int firstColumn = std::max(extent[0], 0);
+  int lastColumn = std::min(extent[1], static_cast<int>(this->Width) - 1);
+  int firstRow = std::max(extent[2], 0);
+  int lastRow = std::min(extent[3], static_cast<int>(this->Height) - 1);
+  if(firstColumn > lastColumn || firstRow > lastRow)
+    {
+    return;
+    }
+
+  MapFunctor functor;
+  functor.Levels = &this->Levels[0];
+  functor.Table = &this->Table[0];
+  functor.Width = this->Width;
+  functor.NumberOfChannels = this->NumberOfChannels;
+  functor.FirstColumn = firstColumn;
+  functor.LastColumn = lastColumn;
+  functor.Output = static_cast<unsigned char*>(output->GetScalarPointer(0, 0, 0));
+  Parallel::For(firstRow, lastRow + 1, functor);
+
+  output->Modified();
+}
+
+void ImageContrast::Map(vtkImageData* output) const
+{
+  int extent[4] = {0, static_cast<int>(this->Width) - 1, 0, static_cast<int>(this->Height) - 1};
+  Map(output, extent);
+}
@@ -0,0 +1,87 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef IMAGECONTRAST_H
+#define IMAGECONTRAST_H
+
+// VTK
+#include <vtkType.h>
+
+// STL
+#include <vector>
+
+class vtkImageData;
+
+// Display of a high bit depth image (16 bit or float, e.g. thermal) through a window/level lookup.
+// SetPixels quantizes the displayed channels once to 16 bit levels spanning the value range of the image
+// (lossless for 16 bit data) and histograms them in parallel. Changing the window or level only rebuilds
+// a 65536 entry table; Map then writes display pixels with one table lookup each, for any part of the image.
+class ImageContrast
+{
+public:
+  ImageContrast();
+
+  // Release the pixels
+  void Initialize();
+
+  // 'pixels' is row-major with numberOfComponents values per pixel (as in an itk::VectorImage buffer).
+  // The first numberOfChannels components (1 for gray, 3 for color) are displayed, all with the same window/level.
+  void SetPixels(const float* pixels, const unsigned int width, const unsigned int height,
+                 const unsigned int numberOfComponents, const unsigned int numberOfChannels);
+
+  unsigned int GetWidth() const;
+  unsigned int GetHeight() const;
+  unsigned int GetNumberOfChannels() const;
+
+  // Bytes held for the image, plus those of the display image Allocate makes
+  size_t GetMemorySize() const;
+
+  // Lowest and highest value of the displayed channels
+  const double* GetRange() const;
+
+  // Window and level (in pixel values) that stretch the given percentiles of the histogram to black and white
+  void ComputeAutoContrast(const double lowPercentile, const double highPercentile, double& window, double& level) const;
+
+  // Values up to level - window/2 are black, values from level + window/2 on are white
+  void SetWindowLevel(const double window, const double level);
+  double GetWindow() const;
+  double GetLevel() const;
+
+  // Make 'output' an unsigned char image of the same size with one component per displayed channel
+  void Allocate(vtkImageData* output) const;
+
+  // Map the pixels of columns [extent[0], extent[1]] and rows [extent[2], extent[3]] into 'output' (see Allocate)
+  void Map(vtkImageData* output, const int extent[4]) const;
+
+  // Map the whole image
+  void Map(vtkImageData* output) const;
+
+private:
+  unsigned int Width;
+  unsigned int Height;
+  unsigned int NumberOfChannels;
+  double Range[2];
+  double Window;
+  double Level;
+
+  std::vector<unsigned short> Levels; // quantized values, NumberOfChannels per pixel
+  std::vector<vtkIdType> Histogram;   // of Levels, 65536 bins
+  std::vector<unsigned char> Table;   // display value of each level
+};
+
+#endif
@@ -0,0 +1,72 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef IMAGEHANDLE_H
+#define IMAGEHANDLE_H
+
+// Custom
+#include "Helpers.h"
+
+// Copy-on-write handle to an ITK image (scalar or vector). Copying a handle takes a snapshot in O(1):
+// the copies share the image until one of them is written through, and only then does that one
+// get its own copy of the pixels (a parallel bulk copy, see Helpers::CopyPixelContainer).
+// The image is treated as shared whenever anything else also holds a reference to it.
+template <typename TImage>
+class ImageHandle
+{
+public:
+  ImageHandle() {}
+
+  // Take over 'image'. Modifying it directly afterwards would change the snapshots too.
+  explicit ImageHandle(TImage* image) : Image(image) {}
+
+  // For reading; do not modify the image through this pointer
+  const TImage* Get() const
+  {
+    return this->Image;
+  }
+
+  // For writing: the pixels are copied first if the image is shared
+  TImage* GetForWriting()
+  {
+    if(this->Image && this->Image->GetReferenceCount() > 1)
+      {
+      typename TImage::Pointer copy = TImage::New();
+      copy->CopyInformation(this->Image);
+      // One bulk copy of the pixel container; scalar images take the number of components too
+      Helpers::DeepCopyVectorImage<TImage>(this->Image, copy);
+      this->Image = copy;
+      }
+    return this->Image;
+  }
+
+  bool IsNull() const
+  {
+    return !this->Image;
+  }
+
+  bool IsShared() const
+  {
+    return this->Image && this->Image->GetReferenceCount() > 1;
+  }
+
+private:
+  typename TImage::Pointer Image;
+};
+
+#endif
@@ -0,0 +1,168 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Snapshots of images share the pixels until one of them is written to
+
+// STL
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Custom
+#include "ImageHandle.h"
+#include "Types.h"
+
+namespace
+{
+
+unsigned int NumberOfFailures = 0;
+
+void Check(const bool condition, const std::string& description)
+{
+  if(!condition)
+    {
+    std::cerr << "Failed: " << description << std::endl;
+    NumberOfFailures++;
+    }
+}
+
+const unsigned int Width = 37;
+const unsigned int Height = 23;
+
+float PixelValue(const unsigned int i)
+{
+  return static_cast<float>(i) * 0.5f - 100.0f;
+}
+
+FloatScalarImageType::Pointer CreateScalarImage()
+{
+  FloatScalarImageType::SizeType size;
+  size[0] = Width;
+  size[1] = Height;
+  FloatScalarImageType::Pointer image = FloatScalarImageType::New();
+  image->SetRegions(size);
+  image->Allocate();
+  float* pixels = image->GetBufferPointer();
+  for(unsigned int i = 0; i < Width * Height; ++i)
+    {
+    pixels[i] = PixelValue(i);
+    }
+  return image;
+}
+
+FloatVectorImageType::Pointer CreateVectorImage(const unsigned int numberOfComponents)
+{
+  FloatVectorImageType::SizeType size;
+  size[0] = Width;
+  size[1] = Height;
+  FloatVectorImageType::Pointer image = FloatVectorImageType::New();
+  image->SetRegions(size);
+  image->SetNumberOfComponentsPerPixel(numberOfComponents);
+  image->Allocate();
+  float* pixels = image->GetBufferPointer();
+  for(unsigned int i = 0; i < Width * Height * numberOfComponents; ++i)
+    {
+    pixels[i] = PixelValue(i);
+    }
+  return image;
+}
+
+// Whether the first 'count' values of 'pixels' are the ones the test images are filled with
+bool HasOriginalPixels(const float* pixels, const unsigned int count)
+{
+  for(unsigned int i = 0; i < count; ++i)
+    {
+    if(pixels[i] != PixelValue(i))
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+void TestScalarSnapshot()
+{
+  ImageHandle<FloatScalarImageType> image(CreateScalarImage());
+  Check(!image.IsNull() && !image.IsShared(), "A new handle owns its image");
+
+  ImageHandle<FloatScalarImageType> snapshot = image;
+  Check(image.IsShared() && snapshot.IsShared(), "A snapshot shares the image");
+  Check(snapshot.Get()->GetBufferPointer() == image.Get()->GetBufferPointer(), "A snapshot shares the buffer");
+
+  // The first write copies the pixels, so the snapshot keeps the old ones
+  const float* sharedBuffer = image.Get()->GetBufferPointer();
+  float* pixels = image.GetForWriting()->GetBufferPointer();
+  Check(pixels != sharedBuffer, "Writing to a shared image copies its buffer");
+  Check(snapshot.Get()->GetBufferPointer() == sharedBuffer, "The snapshot keeps the buffer it had");
+  Check(HasOriginalPixels(pixels, Width * Height), "The copy has the pixels of the image");
+  Check(!image.IsShared() && !snapshot.IsShared(), "After the copy neither image is shared");
+
+  pixels[0] = 1000.0f;
+  pixels[Width * Height - 1] = 2000.0f;
+  Check(HasOriginalPixels(snapshot.Get()->GetBufferPointer(), Width * Height), "Writing leaves the snapshot unchanged");
+  Check(image.Get()->GetBufferPointer()[0] == 1000.0f, "The write goes to the written image");
+
+  // An image that is not shared is written in place
+  Check(image.GetForWriting()->GetBufferPointer() == pixels, "A second write does not copy again");
+  const float* snapshotBuffer = snapshot.Get()->GetBufferPointer();
+  Check(snapshot.GetForWriting()->GetBufferPointer() == snapshotBuffer, "An image no longer shared is written in place");
+}
+
+void TestVectorSnapshot()
+{
+  const unsigned int numberOfComponents = 3;
+  ImageHandle<FloatVectorImageType> image(CreateVectorImage(numberOfComponents));
+  ImageHandle<FloatVectorImageType> snapshot = image;
+  Check(snapshot.Get()->GetBufferPointer() == image.Get()->GetBufferPointer(), "A vector image snapshot shares the buffer");
+
+  FloatVectorImageType* written = snapshot.GetForWriting();
+  Check(written->GetBufferPointer() != image.Get()->GetBufferPointer(), "Writing to a shared vector image copies it");
+  Check(written->GetNumberOfComponentsPerPixel() == numberOfComponents, "The copy has the same number of components");
+  Check(written->GetLargestPossibleRegion() == image.Get()->GetLargestPossibleRegion(), "The copy has the same size");
+  Check(HasOriginalPixels(written->GetBufferPointer(), Width * Height * numberOfComponents),
+        "The copy has every component of every pixel");
+
+  written->GetBufferPointer()[1] = -1.0f;
+  Check(HasOriginalPixels(image.Get()->GetBufferPointer(), Width * Height * numberOfComponents),
+        "Writing to the snapshot leaves the image unchanged");
+}
+
+void TestNull()
+{
+  ImageHandle<FloatScalarImageType> image;
+  ImageHandle<FloatScalarImageType> snapshot = image;
+  Check(image.IsNull() && snapshot.IsNull() && !snapshot.IsShared(), "Snapshots of no image are empty");
+  Check(!snapshot.GetForWriting(), "There is nothing to write to without an image");
+}
+
+} // end anonymous namespace
+
+int main(int, char*[])
+{
+  TestScalarSnapshot();
+  TestVectorSnapshot();
+  TestNull();
+
+  if(NumberOfFailures > 0)
+    {
+    std::cerr << NumberOfFailures << " checks failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "All checks passed." << std::endl;
+  return EXIT_SUCCESS;
+}
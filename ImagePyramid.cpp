@@ -0,0 +1,144 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "ImagePyramid.h"
+
+// STL
+#include <cmath>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+struct DownsampleFunctor
+{
+  const float* Input;
+  unsigned int InputWidth;
+  unsigned int InputHeight;
+  float* Output;
+  unsigned int OutputWidth;
+
+  void operator()(const vtkIdType beginRow, const vtkIdType endRow, const int)
+  {
+    for(vtkIdType j = beginRow; j < endRow; ++j)
+      {
+      unsigned int row0 = 2 * j;
+      unsigned int row1 = row0 + 1 < this->InputHeight ? row0 + 1 : row0;
+      for(unsigned int i = 0; i < this->OutputWidth; ++i)
+        {
+        unsigned int column0 = 2 * i;
+        unsigned int column1 = column0 + 1 < this->InputWidth ? column0 + 1 : column0;
+        this->Output[j * this->OutputWidth + i] = 0.25f * (this->Input[row0 * this->InputWidth + column0] +
+                                                           this->Input[row0 * this->InputWidth + column1] +
+                                                           this->Input[row1 * this->InputWidth + column0] +
+                                                           this->Input[row1 * this->InputWidth + column1]);
+        }
+      }
+  }
+};
+
+} // end anonymous namespace
+
+ImagePyramid::ImagePyramid()
+{
+}
+
+void ImagePyramid::SetImage(const FloatScalarImageType* image, const unsigned int numberOfLevels)
+{
+  FloatScalarImageType::SizeType size = image->GetLargestPossibleRegion().GetSize();
+  this->SetImage(image->GetBufferPointer(), size[0], size[1], numberOfLevels);
+}
+
+void ImagePyramid::SetImage(const float* pixels, const unsigned int width, const unsigned int height,
+                            const unsigned int numberOfLevels)
+{
+  this->Levels.clear();
+  this->Widths.clear();
+  this->Heights.clear();
+
+  this->Levels.push_back(std::vector<float>(pixels, pixels + static_cast<size_t>(width) * height));
+  this->Widths.push_back(width);
+  this->Heights.push_back(height);
+
+  for(unsigned int level = 1; level < numberOfLevels; ++level)
+    {
+    unsigned int inputWidth = this->Widths[level - 1];
+    unsigned int inputHeight = this->Heights[level - 1];
+    if(inputWidth < 2 || inputHeight < 2)
+      {
+      break;
+      }
+    unsigned int outputWidth = (inputWidth + 1) / 2;
+    unsigned int outputHeight = (inputHeight + 1) / 2;
+
+    this->Levels.push_back(std::vector<float>(static_cast<size_t>(outputWidth) * outputHeight));
+    this->Widths.push_back(outputWidth);
+    this->Heights.push_back(outputHeight);
+
+    DownsampleFunctor downsample;
+    downsample.Input = &this->Levels[level - 1][0];
+    downsample.InputWidth = inputWidth;
+    downsample.InputHeight = inputHeight;
+    downsample.Output = &this->Levels[level][0];
+    downsample.OutputWidth = outputWidth;
+    Parallel::For(0, outputHeight, downsample);
+    }
+}
+
+unsigned int ImagePyramid::GetNumberOfLevels() const
+{
+  return this->Levels.size();
+}
+
+unsigned int ImagePyramid::GetWidth(const unsigned int level) const
+{
+  return this->Widths[level];
+}
+
+unsigned int ImagePyramid::GetHeight(const unsigned int level) const
+{
+  return this->Heights[level];
+}
+
+const float* ImagePyramid::GetLevel(const unsigned int level) const
+{
+  return &this->Levels[level][0];
+}
+
+float ImagePyramid::Interpolate(const unsigned int level, const double x, const double y) const
+{
+  const int width = this->Widths[level];
+  const int height = this->Heights[level];
+  const float* pixels = &this->Levels[level][0];
+
+  double clampedX = x < 0 ? 0 : (x > width - 1 ? width - 1 : x);
+  double clampedY = y < 0 ? 0 : (y > height - 1 ? height - 1 : y);
+
+  int x0 = static_cast<int>(floor(clampedX));
+  int y0 = static_cast<int>(floor(clampedY));
+  int x1 = x0 + 1 < width ? x0 + 1 : x0;
+  int y1 = y0 + 1 < height ? y0 + 1 : y0;
+  float fx = static_cast<float>(clampedX - x0);
+  float fy = static_cast<float>(clampedY - y0);
+
+  float top = (1.0f - fx) * pixels[y0 * width + x0] + fx * pixels[y0 * width + x1];
+  float bottom = (1.0f - fx) * pixels[y1 * width + x0] + fx * pixels[y1 * width + x1];
+  return (1.0f - fy) * top + fy * bottom;
+}
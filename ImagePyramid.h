@@ -0,0 +1,55 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+// STL
+#include <vector>
+
+// Custom
+#include "Types.h"
+
+// A stack of successively halved copies of a scalar image. Level 0 is the input.
+// Level l+1 pixel (i,j) is the average of the 2x2 block starting at (2i,2j) of level l,
+// so pixel centers map as x_{l+1} = (x_l + 0.5) / 2 - 0.5 (see Camera::Scaled).
+class ImagePyramid
+{
+public:
+  ImagePyramid();
+
+  void SetImage(const FloatScalarImageType* image, const unsigned int numberOfLevels);
+  void SetImage(const float* pixels, const unsigned int width, const unsigned int height, const unsigned int numberOfLevels);
+
+  unsigned int GetNumberOfLevels() const;
+  unsigned int GetWidth(const unsigned int level) const;
+  unsigned int GetHeight(const unsigned int level) const;
+
+  // Row-major pixels of a level
+  const float* GetLevel(const unsigned int level) const;
+
+  // Bilinear interpolation at a continuous pixel position, clamped to the border
+  float Interpolate(const unsigned int level, const double x, const double y) const;
+
+private:
+  std::vector<std::vector<float> > Levels;
+  std::vector<unsigned int> Widths;
+  std::vector<unsigned int> Heights;
+};
+
+#endif
@@ -0,0 +1,207 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IntensityRenderer.h"
+
+// VTK
+#include <vtkDataArray.h>
+#include <vtkPoints.h>
+
+// STL
+#include <cmath>
+#include <limits>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+// First pass: project every point to a linear pixel index (or -1) and a depth
+struct ProjectFunctor
+{
+  const float* Coordinates;
+  double R[3][3];
+  double Translation[3];
+  Camera Intrinsics; // focal length, principal point and distortion
+  int Width;
+  int Height;
+  vtkIdType* PixelIndices;
+  float* Depths;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      const float* p = this->Coordinates + 3 * i;
+      double z = this->R[2][0] * p[0] + this->R[2][1] * p[1] + this->R[2][2] * p[2] + this->Translation[2];
+      this->PixelIndices[i] = -1;
+      if(z <= 0)
+        {
+        continue;
+        }
+      double point[3];
+      point[0] = this->R[0][0] * p[0] + this->R[0][1] * p[1] + this->R[0][2] * p[2] + this->Translation[0];
+      point[1] = this->R[1][0] * p[0] + this->R[1][1] * p[1] + this->R[1][2] * p[2] + this->Translation[1];
+      point[2] = z;
+      double pixel[2];
+      this->Intrinsics.ProjectCameraPoint(point, pixel);
+      int u = static_cast<int>(floor(pixel[0] + 0.5));
+      int v = static_cast<int>(floor(pixel[1] + 0.5));
+      if(u < 0 || v < 0 || u >= this->Width || v >= this->Height)
+        {
+        continue;
+        }
+      this->PixelIndices[i] = static_cast<vtkIdType>(v) * this->Width + u;
+      this->Depths[i] = static_cast<float>(z);
+      }
+  }
+};
+
+// Second pass: each thread owns a band of rows and z-tests only the points that landed in it,
+// so no two threads ever write the same pixel.
+struct ZBufferFunctor
+{
+  vtkIdType NumberOfPoints;
+  int Width;
+  const vtkIdType* PixelIndices;
+  const float* PointDepths;
+  const float* PointValues;
+  const vtkIdType* PointIds;
+  float* Values;
+  float* Depths;
+  vtkIdType* Ids; // May be NULL
+
+  void operator()(const vtkIdType beginRow, const vtkIdType endRow, const int)
+  {
+    const vtkIdType beginPixel = beginRow * this->Width;
+    const vtkIdType endPixel = endRow * this->Width;
+    for(vtkIdType i = 0; i < this->NumberOfPoints; ++i)
+      {
+      vtkIdType pixel = this->PixelIndices[i];
+      if(pixel < beginPixel || pixel >= endPixel)
+        {
+        continue;
+        }
+      if(this->PointDepths[i] < this->Depths[pixel])
+        {
+        this->Depths[pixel] = this->PointDepths[i];
+        this->Values[pixel] = this->PointValues[i];
+        if(this->Ids)
+          {
+          this->Ids[pixel] = this->PointIds[i];
+          }
+        }
+      }
+  }
+};
+
+} // end anonymous namespace
+
+IntensityRenderer::IntensityRenderer()
+{
+}
+
+void IntensityRenderer::SetInput(vtkPoints* points, vtkDataArray* scalars, const vtkIdType maximumNumberOfPoints)
+{
+  vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  double stride = 1.0;
+  if(maximumNumberOfPoints > 0 && numberOfPoints > maximumNumberOfPoints)
+    {
+    stride = static_cast<double>(numberOfPoints) / static_cast<double>(maximumNumberOfPoints);
+    numberOfPoints = maximumNumberOfPoints;
+    }
+
+  this->Coordinates.resize(3 * numberOfPoints);
+  this->Values.resize(numberOfPoints);
+  this->OriginalIds.resize(numberOfPoints);
+
+  for(vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+    vtkIdType pointId = static_cast<vtkIdType>(i * stride);
+    double p[3];
+    points->GetPoint(pointId, p);
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      this->Coordinates[3 * i + d] = static_cast<float>(p[d]);
+      }
+    this->Values[i] = static_cast<float>(scalars->GetTuple1(pointId));
+    this->OriginalIds[i] = pointId;
+    }
+}
+
+vtkIdType IntensityRenderer::GetNumberOfPoints() const
+{
+  return static_cast<vtkIdType>(this->Values.size());
+}
+
+void IntensityRenderer::Render(const Camera& camera, const unsigned int width, const unsigned int height,
+                               std::vector<float>& values, std::vector<float>& depths) const
+{
+  this->RenderBuffers(camera, width, height, values, depths, NULL);
+}
+
+void IntensityRenderer::Render(const Camera& camera, const unsigned int width, const unsigned int height,
+                               std::vector<float>& values, std::vector<float>& depths, std::vector<vtkIdType>& pointIds) const
+{
+  pointIds.assign(static_cast<vtkIdType>(width) * height, -1);
+  this->RenderBuffers(camera, width, height, values, depths, pointIds.empty() ? NULL : &pointIds[0]);
+}
+
+void IntensityRenderer::RenderBuffers(const Camera& camera, const unsigned int width, const unsigned int height,
+                                      std::vector<float>& values, std::vector<float>& depths, vtkIdType* pointIds) const
+{
+  const vtkIdType numberOfPixels = static_cast<vtkIdType>(width) * height;
+  values.assign(numberOfPixels, 0.0f);
+  depths.assign(numberOfPixels, std::numeric_limits<float>::infinity());
+
+  const vtkIdType numberOfPoints = this->GetNumberOfPoints();
+  if(numberOfPoints == 0)
+    {
+    return;
+    }
+
+  std::vector<vtkIdType> pixelIndices(numberOfPoints);
+  std::vector<float> pointDepths(numberOfPoints);
+
+  ProjectFunctor project;
+  project.Coordinates = &this->Coordinates[0];
+  camera.GetRotationMatrix(project.R);
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    project.Translation[d] = camera.Translation[d];
+    }
+  project.Intrinsics = camera;
+  project.Width = width;
+  project.Height = height;
+  project.PixelIndices = &pixelIndices[0];
+  project.Depths = &pointDepths[0];
+  Parallel::For(0, numberOfPoints, project);
+
+  ZBufferFunctor zbuffer;
+  zbuffer.NumberOfPoints = numberOfPoints;
+  zbuffer.Width = width;
+  zbuffer.PixelIndices = &pixelIndices[0];
+  zbuffer.PointDepths = &pointDepths[0];
+  zbuffer.PointValues = &this->Values[0];
+  zbuffer.PointIds = &this->OriginalIds[0];
+  zbuffer.Values = &values[0];
+  zbuffer.Depths = &depths[0];
+  zbuffer.Ids = pointIds;
+  Parallel::For(0, height, zbuffer);
+}
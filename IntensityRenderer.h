@@ -0,0 +1,67 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef INTENSITYRENDERER_H
+#define INTENSITYRENDERER_H
+
+// VTK
+#include <vtkType.h>
+
+// STL
+#include <vector>
+
+// Custom
+#include "Camera.h"
+
+class vtkDataArray;
+class vtkPoints;
+
+// Software renderer that splats one scalar per point (e.g. "Intensity") into an image as seen by a Camera.
+// Each point covers the pixel it projects to and the nearest point wins (z-buffer).
+// Rendering is multithreaded and does not need an OpenGL context.
+class IntensityRenderer
+{
+public:
+  IntensityRenderer();
+
+  // Copy the points and their scalar. If maximumNumberOfPoints is non-zero and smaller than
+  // the number of points, an evenly strided subset is kept.
+  void SetInput(vtkPoints* points, vtkDataArray* scalars, const vtkIdType maximumNumberOfPoints = 0);
+
+  vtkIdType GetNumberOfPoints() const;
+
+  // Render into width x height buffers. Pixels not covered by any point have depth +infinity.
+  // 'values' and 'depths' are resized as needed.
+  void Render(const Camera& camera, const unsigned int width, const unsigned int height,
+              std::vector<float>& values, std::vector<float>& depths) const;
+
+  // As above, additionally reporting the index (into the point set passed to SetInput) of the point
+  // seen at each pixel, or -1.
+  void Render(const Camera& camera, const unsigned int width, const unsigned int height,
+              std::vector<float>& values, std::vector<float>& depths, std::vector<vtkIdType>& pointIds) const;
+
+private:
+  void RenderBuffers(const Camera& camera, const unsigned int width, const unsigned int height,
+                     std::vector<float>& values, std::vector<float>& depths, vtkIdType* pointIds) const;
+
+  std::vector<float> Coordinates; // x,y,z interleaved
+  std::vector<float> Values;
+  std::vector<vtkIdType> OriginalIds;
+};
+
+#endif
@@ -0,0 +1,375 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Headless frame-time and pick-latency benchmark for the two selection styles.
+// Synthetic images and point clouds of several sizes are rendered offscreen,
+// a scripted camera path is replayed against each view and scripted clicks are
+// sent through PointSelectionStyle2D and PointSelectionStyle3D.
+//
+// Usage: InteractionBenchmark [NumberOfFrames] [NumberOfClicks]
+
+// VTK
+#include <vtkActor.h>
+#include <vtkCamera.h>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkImageActor.h>
+#include <vtkImageData.h>
+#include <vtkLookupTable.h>
+#include <vtkMath.h>
+#include <vtkPointData.h>
+#include <vtkPointPicker.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+#include <vtkRenderer.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderWindowInteractor.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+
+// STL
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Custom
+#include "CorrespondenceModel.h"
+#include "PointSelectionStyle2D.h"
+#include "PointSelectionStyle3D.h"
+
+namespace
+{
+
+const int WindowSize = 600;
+
+// Summary of a set of timings, all in milliseconds
+struct TimingSummary
+{
+  double P50;
+  double P99;
+  double Max;
+};
+
+TimingSummary Summarize(std::vector<double> samples)
+{
+  TimingSummary summary;
+  summary.P50 = 0;
+  summary.P99 = 0;
+  summary.Max = 0;
+  if(samples.empty())
+    {
+    return summary;
+    }
+
+  std::sort(samples.begin(), samples.end());
+  // Nearest-rank percentiles
+  unsigned int p50Index = static_cast<unsigned int>(0.50 * (samples.size() - 1) + 0.5);
+  unsigned int p99Index = static_cast<unsigned int>(0.99 * (samples.size() - 1) + 0.5);
+  summary.P50 = samples[p50Index];
+  summary.P99 = samples[p99Index];
+  summary.Max = samples[samples.size() - 1];
+  return summary;
+}
+
+void Report(const std::string& view, const std::string& scenario, const std::string& measure, const TimingSummary& summary)
+{
+  std::cout << std::left << std::setw(6) << view
+            << std::setw(34) << scenario
+            << std::setw(8) << measure
+            << std::right << std::fixed << std::setprecision(3)
+            << " p50 " << std::setw(9) << summary.P50 << " ms"
+            << " p99 " << std::setw(9) << summary.P99 << " ms"
+            << " max " << std::setw(9) << summary.Max << " ms" << std::endl;
+}
+
+// Create a render window, renderer and interactor that never touch the screen
+void CreateOffscreenView(vtkSmartPointer<vtkRenderWindow>& renderWindow, vtkSmartPointer<vtkRenderer>& renderer,
+                         vtkSmartPointer<vtkRenderWindowInteractor>& interactor)
+{
+  renderer = vtkSmartPointer<vtkRenderer>::New();
+  renderWindow = vtkSmartPointer<vtkRenderWindow>::New();
+  renderWindow->OffScreenRenderingOn();
+  renderWindow->SetSize(WindowSize, WindowSize);
+  renderWindow->AddRenderer(renderer);
+
+  interactor = vtkSmartPointer<vtkRenderWindowInteractor>::New();
+  interactor->SetRenderWindow(renderWindow);
+}
+
+// A smooth synthetic intensity pattern so the image is not trivially compressible
+void CreateSyntheticImage(const unsigned int width, const unsigned int height, vtkImageData* image)
+{
+  image->SetNumberOfScalarComponents(1);
+  image->SetScalarTypeToUnsignedChar();
+  image->SetDimensions(width, height, 1);
+  image->AllocateScalars();
+
+  unsigned char* pixels = static_cast<unsigned char*>(image->GetScalarPointer());
+  for(unsigned int j = 0; j < height; ++j)
+    {
+    for(unsigned int i = 0; i < width; ++i)
+      {
+      pixels[j * width + i] = static_cast<unsigned char>((i * 7 + j * 13 + (i * j) / 64) % 256);
+      }
+    }
+}
+
+// Points scattered over a gently curved sheet, each with an "Intensity" value like the real scans
+void CreateSyntheticPointCloud(const vtkIdType numberOfPoints, vtkPolyData* polyData)
+{
+  vtkMath::RandomSeed(0);
+
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetNumberOfPoints(numberOfPoints);
+
+  vtkSmartPointer<vtkFloatArray> intensity = vtkSmartPointer<vtkFloatArray>::New();
+  intensity->SetName("Intensity");
+  intensity->SetNumberOfComponents(1);
+  intensity->SetNumberOfTuples(numberOfPoints);
+
+  vtkSmartPointer<vtkCellArray> vertices = vtkSmartPointer<vtkCellArray>::New();
+  vertices->Allocate(2 * numberOfPoints);
+
+  for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    double x = vtkMath::Random(-1.0, 1.0);
+    double y = vtkMath::Random(-1.0, 1.0);
+    double z = 0.2 * sin(3.0 * x) * cos(3.0 * y);
+    points->SetPoint(pointId, x, y, z);
+    intensity->SetValue(pointId, static_cast<float>(z));
+    vertices->InsertNextCell(1, &pointId);
+    }
+
+  polyData->SetPoints(points);
+  polyData->SetVerts(vertices);
+  polyData->GetPointData()->AddArray(intensity);
+  polyData->GetPointData()->SetActiveScalars("Intensity");
+}
+
+// Render once per camera step and time each frame.
+// The path is an orbit for the 3D view and a pan/zoom sweep for the 2D view.
+std::vector<double> ReplayCameraPath(vtkRenderWindow* renderWindow, vtkRenderer* renderer,
+                                     const unsigned int numberOfFrames, const bool orbit)
+{
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  std::vector<double> frameTimes;
+  frameTimes.reserve(numberOfFrames);
+
+  renderer->ResetCamera();
+  renderWindow->Render(); // Exclude first-frame setup (context creation, uploads)
+
+  vtkCamera* camera = renderer->GetActiveCamera();
+  for(unsigned int frame = 0; frame < numberOfFrames; ++frame)
+    {
+    if(orbit)
+      {
+      camera->Azimuth(360.0 / numberOfFrames);
+      camera->Elevation(10.0 * sin(2.0 * vtkMath::Pi() * frame / numberOfFrames) / numberOfFrames);
+      camera->OrthogonalizeViewUp();
+      }
+    else
+      {
+      double phase = 2.0 * vtkMath::Pi() * frame / numberOfFrames;
+      camera->Zoom(1.0 + 0.02 * sin(phase));
+      double focalPoint[3];
+      camera->GetFocalPoint(focalPoint);
+      double position[3];
+      camera->GetPosition(position);
+      double shift = 0.5 * cos(phase);
+      camera->SetFocalPoint(focalPoint[0] + shift, focalPoint[1], focalPoint[2]);
+      camera->SetPosition(position[0] + shift, position[1], position[2]);
+      }
+
+    timer->StartTimer();
+    renderWindow->Render();
+    timer->StopTimer();
+    frameTimes.push_back(1000.0 * timer->GetElapsedTime());
+    }
+
+  return frameTimes;
+}
+
+// Send clicks at pseudo-random display positions through the style and time each pick.
+std::vector<double> ReplayClicks(vtkRenderWindowInteractor* interactor, vtkInteractorStyle* style,
+                                 const unsigned int numberOfClicks, const bool controlKey)
+{
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  std::vector<double> pickTimes;
+  pickTimes.reserve(numberOfClicks);
+
+  vtkMath::RandomSeed(1);
+  for(unsigned int click = 0; click < numberOfClicks; ++click)
+    {
+    int x = static_cast<int>(vtkMath::Random(0.25, 0.75) * WindowSize);
+    int y = static_cast<int>(vtkMath::Random(0.25, 0.75) * WindowSize);
+    interactor->SetEventInformation(x, y, controlKey ? 1 : 0, 0);
+
+    timer->StartTimer();
+    style->OnLeftButtonDown();
+    timer->StopTimer();
+    pickTimes.push_back(1000.0 * timer->GetElapsedTime());
+
+    style->OnLeftButtonUp();
+    }
+
+  return pickTimes;
+}
+
+void Benchmark2D(const unsigned int imageSize, const unsigned int numberOfMarkers,
+                 const unsigned int numberOfFrames, const unsigned int numberOfClicks)
+{
+  vtkSmartPointer<vtkRenderWindow> renderWindow;
+  vtkSmartPointer<vtkRenderer> renderer;
+  vtkSmartPointer<vtkRenderWindowInteractor> interactor;
+  CreateOffscreenView(renderWindow, renderer, interactor);
+
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  CreateSyntheticImage(imageSize, imageSize, image);
+
+  vtkSmartPointer<vtkImageActor> imageActor = vtkSmartPointer<vtkImageActor>::New();
+  imageActor->SetInput(image);
+  imageActor->InterpolateOff();
+  renderer->AddActor(imageActor);
+
+  // Same setup as Form::on_actionOpenImage_activated
+  vtkSmartPointer<vtkPointPicker> pointPicker = vtkSmartPointer<vtkPointPicker>::New();
+  interactor->SetPicker(pointPicker);
+  CorrespondenceModel correspondences;
+  vtkSmartPointer<PointSelectionStyle2D> style = vtkSmartPointer<PointSelectionStyle2D>::New();
+  interactor->SetInteractorStyle(style);
+  style->SetCurrentRenderer(renderer);
+  style->Image = image;
+  style->Correspondences = &correspondences;
+
+  vtkMath::RandomSeed(2);
+  for(unsigned int marker = 0; marker < numberOfMarkers; ++marker)
+    {
+    double p[3] = {vtkMath::Random(0, imageSize - 1), vtkMath::Random(0, imageSize - 1), 0};
+    style->AddNumber(p);
+    }
+
+  std::stringstream scenario;
+  scenario << imageSize << "x" << imageSize << " image, " << numberOfMarkers << " markers";
+
+  Report("2D", scenario.str(), "frame", Summarize(ReplayCameraPath(renderWindow, renderer, numberOfFrames, false)));
+  renderer->ResetCamera();
+  renderWindow->Render();
+  Report("2D", scenario.str(), "pick", Summarize(ReplayClicks(interactor, style, numberOfClicks, false)));
+}
+
+void Benchmark3D(const vtkIdType numberOfPoints, const unsigned int numberOfMarkers,
+                 const unsigned int numberOfFrames, const unsigned int numberOfClicks)
+{
+  vtkSmartPointer<vtkRenderWindow> renderWindow;
+  vtkSmartPointer<vtkRenderer> renderer;
+  vtkSmartPointer<vtkRenderWindowInteractor> interactor;
+  CreateOffscreenView(renderWindow, renderer, interactor);
+
+  vtkSmartPointer<vtkPolyData> pointCloud = vtkSmartPointer<vtkPolyData>::New();
+  CreateSyntheticPointCloud(numberOfPoints, pointCloud);
+
+  double range[2];
+  pointCloud->GetPointData()->GetArray("Intensity")->GetRange(range);
+  vtkSmartPointer<vtkLookupTable> lookupTable = vtkSmartPointer<vtkLookupTable>::New();
+  lookupTable->SetTableRange(range[0], range[1]);
+  lookupTable->SetHueRange(0, 1);
+
+  // Same setup as Form::on_actionOpenPointCloud_activated
+  vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+  mapper->SetInput(pointCloud);
+  mapper->SetLookupTable(lookupTable);
+  vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
+  actor->SetMapper(mapper);
+  actor->GetProperty()->SetRepresentationToPoints();
+  renderer->AddActor(actor);
+
+  vtkSmartPointer<vtkPointPicker> pointPicker = vtkSmartPointer<vtkPointPicker>::New();
+  pointPicker->PickFromListOn();
+  pointPicker->AddPickList(actor);
+  interactor->SetPicker(pointPicker);
+  CorrespondenceModel correspondences;
+  vtkSmartPointer<PointSelectionStyle3D> style = vtkSmartPointer<PointSelectionStyle3D>::New();
+  interactor->SetInteractorStyle(style);
+  style->SetCurrentRenderer(renderer);
+  style->Data = pointCloud;
+  style->Correspondences = &correspondences;
+  style->SetMarkerRadius(0.01);
+
+  renderer->ResetCamera();
+  for(unsigned int marker = 0; marker < numberOfMarkers; ++marker)
+    {
+    double p[3];
+    pointCloud->GetPoint((marker * 7919) % numberOfPoints, p);
+    style->AddNumber(p);
+    }
+
+  std::stringstream scenario;
+  scenario << numberOfPoints << " points, " << numberOfMarkers << " markers";
+
+  Report("3D", scenario.str(), "frame", Summarize(ReplayCameraPath(renderWindow, renderer, numberOfFrames, true)));
+  renderer->ResetCamera();
+  renderWindow->Render();
+  Report("3D", scenario.str(), "pick", Summarize(ReplayClicks(interactor, style, numberOfClicks, true)));
+}
+
+} // end anonymous namespace
+
+int main(int argc, char* argv[])
+{
+  unsigned int numberOfFrames = 200;
+  unsigned int numberOfClicks = 50;
+  if(argc > 1)
+    {
+    numberOfFrames = atoi(argv[1]);
+    }
+  if(argc > 2)
+    {
+    numberOfClicks = atoi(argv[2]);
+    }
+
+  std::cout << "Replaying " << numberOfFrames << " frames and " << numberOfClicks
+            << " clicks per scenario in a " << WindowSize << "x" << WindowSize << " offscreen window." << std::endl;
+
+  const unsigned int imageSizes[] = {512, 2048, 8192};
+  const vtkIdType cloudSizes[] = {100000, 1000000, 5000000};
+  const unsigned int markerCounts[] = {0, 100, 1000};
+
+  for(unsigned int imageSize = 0; imageSize < sizeof(imageSizes) / sizeof(imageSizes[0]); ++imageSize)
+    {
+    for(unsigned int markerCount = 0; markerCount < sizeof(markerCounts) / sizeof(markerCounts[0]); ++markerCount)
+      {
+      Benchmark2D(imageSizes[imageSize], markerCounts[markerCount], numberOfFrames, numberOfClicks);
+      }
+    }
+
+  for(unsigned int cloudSize = 0; cloudSize < sizeof(cloudSizes) / sizeof(cloudSizes[0]); ++cloudSize)
+    {
+    for(unsigned int markerCount = 0; markerCount < sizeof(markerCounts) / sizeof(markerCounts[0]); ++markerCount)
+      {
+      Benchmark3D(cloudSizes[cloudSize], markerCounts[markerCount], numberOfFrames, numberOfClicks);
+      }
+    }
+
+  return EXIT_SUCCESS;
+}
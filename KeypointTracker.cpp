@@ -0,0 +1,221 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "KeypointTracker.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+// Track the points forward, then back from where they ended up
+struct TrackFunctor
+{
+  const KeypointTracker* Tracker;
+  const std::vector<Coord2D>* Points;
+  double MaximumForwardBackwardError;
+  std::vector<Coord2D>* Tracked;
+  std::vector<unsigned char>* Found;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    std::vector<float> window;
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      const Coord2D& point = (*this->Points)[i];
+      Coord2D& tracked = (*this->Tracked)[i];
+      (*this->Found)[i] = 0;
+      if(!this->Tracker->TrackPoint(this->Tracker->GetPreviousPyramid(), this->Tracker->GetNextPyramid(),
+                                    point, point, tracked, window))
+        {
+        continue;
+        }
+
+      Coord2D back;
+      if(!this->Tracker->TrackPoint(this->Tracker->GetNextPyramid(), this->Tracker->GetPreviousPyramid(),
+                                    tracked, point, back, window))
+        {
+        continue;
+        }
+      double dx = back.x - point.x;
+      double dy = back.y - point.y;
+      (*this->Found)[i] = dx * dx + dy * dy <= this->MaximumForwardBackwardError * this->MaximumForwardBackwardError;
+      }
+  }
+};
+
+} // end anonymous namespace
+
+KeypointTracker::KeypointTracker() : WindowRadius(7), NumberOfLevels(4), MaximumNumberOfIterations(20),
+                                     MaximumForwardBackwardError(1)
+{
+}
+
+void KeypointTracker::SetWindowRadius(const unsigned int radius)
+{
+  this->WindowRadius = radius;
+}
+
+void KeypointTracker::SetNumberOfLevels(const unsigned int levels)
+{
+  this->NumberOfLevels = std::max(1u, levels);
+}
+
+void KeypointTracker::SetMaximumNumberOfIterations(const unsigned int iterations)
+{
+  this->MaximumNumberOfIterations = iterations;
+}
+
+void KeypointTracker::SetMaximumForwardBackwardError(const double error)
+{
+  this->MaximumForwardBackwardError = error;
+}
+
+void KeypointTracker::SetImages(const FloatScalarImageType* previous, const FloatScalarImageType* next)
+{
+  this->Previous.SetImage(previous, this->NumberOfLevels);
+  this->Next.SetImage(next, this->NumberOfLevels);
+}
+
+const ImagePyramid& KeypointTracker::GetPreviousPyramid() const
+{
+  return this->Previous;
+}
+
+const ImagePyramid& KeypointTracker::GetNextPyramid() const
+{
+  return this->Next;
+}
+
+void KeypointTracker::Track(const std::vector<Coord2D>& points, std::vector<Coord2D>& tracked,
+                            std::vector<unsigned char>& found) const
+{
+  tracked.resize(points.size());
+  found.assign(points.size(), 0);
+  if(points.empty() || this->Previous.GetNumberOfLevels() == 0 || this->Next.GetNumberOfLevels() == 0)
+    {
+    return;
+    }
+
+  TrackFunctor functor;
+  functor.Tracker = this;
+  functor.Points = &points;
+  functor.MaximumForwardBackwardError = this->MaximumForwardBackwardError;
+  functor.Tracked = &tracked;
+  functor.Found = &found;
+  Parallel::For(0, points.size(), functor);
+}
+
+bool KeypointTracker::TrackPoint(const ImagePyramid& from, const ImagePyramid& to, const Coord2D& point,
+                                 const Coord2D& guess, Coord2D& tracked, std::vector<float>& window) const
+{
+  const int radius = this->WindowRadius;
+  const unsigned int numberOfPixels = (2 * radius + 1) * (2 * radius + 1);
+  // Intensity and gradient of each window pixel
+  window.resize(3 * numberOfPixels);
+
+  const int numberOfLevels = std::min(from.GetNumberOfLevels(), to.GetNumberOfLevels());
+  // The motion at the level being aligned. Pixel centers map as x_{l+1} = (x_l + 0.5) / 2 - 0.5,
+  // so motions simply halve from one level to the next.
+  double topScale = 1.0 / (1 << (numberOfLevels - 1));
+  double motion[2] = {(guess.x - point.x) * topScale, (guess.y - point.y) * topScale};
+
+  for(int level = numberOfLevels - 1; level >= 0; --level)
+    {
+    double scale = 1.0 / (1 << level);
+    double x = (point.x + 0.5) * scale - 0.5;
+    double y = (point.y + 0.5) * scale - 0.5;
+
+    // The window in 'from' and the normal matrix of its gradients
+    double gxx = 0;
+    double gxy = 0;
+    double gyy = 0;
+    unsigned int k = 0;
+    for(int j = -radius; j <= radius; ++j)
+      {
+      for(int i = -radius; i <= radius; ++i)
+        {
+        float dx = 0.5f * (from.Interpolate(level, x + i + 1, y + j) - from.Interpolate(level, x + i - 1, y + j));
+        float dy = 0.5f * (from.Interpolate(level, x + i, y + j + 1) - from.Interpolate(level, x + i, y + j - 1));
+        window[3 * k] = from.Interpolate(level, x + i, y + j);
+        window[3 * k + 1] = dx;
+        window[3 * k + 2] = dy;
+        gxx += dx * dx;
+        gxy += dx * dy;
+        gyy += dy * dy;
+        k++;
+        }
+      }
+
+    // A window without texture, or along a straight edge, does not fix the motion
+    double trace = gxx + gyy;
+    double determinant = gxx * gyy - gxy * gxy;
+    double smallestEigenvalue = 0.5 * (trace - sqrt((gxx - gyy) * (gxx - gyy) + 4 * gxy * gxy));
+    if(trace <= 0 || smallestEigenvalue < 1e-3 * trace || determinant <= 0)
+      {
+      return false;
+      }
+
+    // Gauss-Newton on the intensity differences
+    double step[2] = {0, 0};
+    for(unsigned int iteration = 0; iteration < this->MaximumNumberOfIterations; ++iteration)
+      {
+      double bx = 0;
+      double by = 0;
+      k = 0;
+      for(int j = -radius; j <= radius; ++j)
+        {
+        for(int i = -radius; i <= radius; ++i)
+          {
+          float difference = window[3 * k] - to.Interpolate(level, x + i + motion[0] + step[0], y + j + motion[1] + step[1]);
+          bx += difference * window[3 * k + 1];
+          by += difference * window[3 * k + 2];
+          k++;
+          }
+        }
+      double ex = (gyy * bx - gxy * by) / determinant;
+      double ey = (gxx * by - gxy * bx) / determinant;
+      step[0] += ex;
+      step[1] += ey;
+      if(ex * ex + ey * ey < 1e-4) // a hundredth of a pixel
+        {
+        break;
+        }
+      }
+
+    motion[0] += step[0];
+    motion[1] += step[1];
+    if(level > 0)
+      {
+      motion[0] *= 2;
+      motion[1] *= 2;
+      }
+    }
+
+  tracked.x = point.x + motion[0];
+  tracked.y = point.y + motion[1];
+
+  // Pixels cover [index - 0.5, index + 0.5]
+  return tracked.x >= -0.5 && tracked.x <= to.GetWidth(0) - 0.5 &&
+         tracked.y >= -0.5 && tracked.y <= to.GetHeight(0) - 0.5;
+}
@@ -0,0 +1,74 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef KEYPOINTTRACKER_H
+#define KEYPOINTTRACKER_H
+
+// STL
+#include <vector>
+
+// Custom
+#include "Coord.h"
+#include "ImagePyramid.h"
+#include "Types.h"
+
+// Pyramidal Lucas-Kanade tracking of image keypoints from one frame to the next, for frames taken from
+// a video. Each keypoint's window is aligned coarse to fine, the motion found at one level starting the
+// next, so motions of several window sizes are followed. A track is lost if the window has no texture,
+// leaves the image, or does not lead back to where it started when tracked from the next frame back.
+class KeypointTracker
+{
+public:
+  KeypointTracker();
+
+  // Windows are 2 * radius + 1 pixels wide. Default 7.
+  void SetWindowRadius(const unsigned int radius);
+  // Default 4
+  void SetNumberOfLevels(const unsigned int levels);
+  // Per level. Default 20.
+  void SetMaximumNumberOfIterations(const unsigned int iterations);
+  // Pixels between a keypoint and where it ends up tracked there and back. Default 1.
+  void SetMaximumForwardBackwardError(const double error);
+
+  // The magnitude images of the frame the keypoints are in and of the one they are tracked into.
+  // This builds the pyramids, which is most of the work, so it can be done ahead of Track (in a worker
+  // thread, but not while Track runs).
+  void SetImages(const FloatScalarImageType* previous, const FloatScalarImageType* next);
+
+  // Track the keypoints, in parallel. found[i] is 0 for a lost track, whose tracked[i] is its last estimate.
+  void Track(const std::vector<Coord2D>& points, std::vector<Coord2D>& tracked, std::vector<unsigned char>& found) const;
+
+  // Internal, public for the parallel functor: track one point from 'from' to 'to'. 'guess' is where
+  // it is expected in 'to'. Returns false if the track is lost.
+  bool TrackPoint(const ImagePyramid& from, const ImagePyramid& to, const Coord2D& point, const Coord2D& guess,
+                  Coord2D& tracked, std::vector<float>& window) const;
+
+  const ImagePyramid& GetPreviousPyramid() const;
+  const ImagePyramid& GetNextPyramid() const;
+
+private:
+  unsigned int WindowRadius;
+  unsigned int NumberOfLevels;
+  unsigned int MaximumNumberOfIterations;
+  double MaximumForwardBackwardError;
+
+  ImagePyramid Previous;
+  ImagePyramid Next;
+};
+
+#endif
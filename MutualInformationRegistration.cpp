@@ -0,0 +1,396 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "MutualInformationRegistration.h"
+
+// ITK (vnl)
+#include "vnl/vnl_cost_function.h"
+#include "vnl/vnl_vector.h"
+#include "vnl/algo/vnl_amoeba.h"
+
+// VTK
+#include <vtkDataArray.h>
+#include <vtkPoints.h>
+#include <vtkTimerLog.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+// The 1st and 99th percentiles of a strided sample of the values
+template <typename TGetValue>
+void ComputeRobustRange(const vtkIdType numberOfValues, TGetValue getValue, double range[2])
+{
+  const vtkIdType maximumSampleSize = 100000;
+  vtkIdType step = numberOfValues / maximumSampleSize + 1;
+  std::vector<double> sample;
+  sample.reserve(numberOfValues / step + 1);
+  for(vtkIdType i = 0; i < numberOfValues; i += step)
+    {
+    sample.push_back(getValue(i));
+    }
+
+  range[0] = 0;
+  range[1] = 1;
+  if(sample.empty())
+    {
+    return;
+    }
+  std::vector<double>::iterator low = sample.begin() + static_cast<size_t>(0.01 * (sample.size() - 1));
+  std::nth_element(sample.begin(), low, sample.end());
+  range[0] = *low;
+  std::vector<double>::iterator high = sample.begin() + static_cast<size_t>(0.99 * (sample.size() - 1));
+  std::nth_element(sample.begin(), high, sample.end());
+  range[1] = *high;
+  if(range[1] <= range[0])
+    {
+    range[1] = range[0] + 1;
+    }
+}
+
+struct PixelValue
+{
+  const float* Pixels;
+  double operator()(const vtkIdType i) const { return this->Pixels[i]; }
+};
+
+struct ScalarValue
+{
+  vtkDataArray* Scalars;
+  double operator()(const vtkIdType i) const { return this->Scalars->GetTuple1(i); }
+};
+
+inline unsigned char Quantize(const double value, const double range[2], const unsigned int numberOfBins)
+{
+  double bin = (value - range[0]) / (range[1] - range[0]) * numberOfBins;
+  if(bin < 0)
+    {
+    return 0;
+    }
+  if(bin >= numberOfBins)
+    {
+    return static_cast<unsigned char>(numberOfBins - 1);
+    }
+  return static_cast<unsigned char>(bin);
+}
+
+struct QuantizeImageFunctor
+{
+  const float* Pixels;
+  unsigned char* Bins;
+  double Range[2];
+  unsigned int NumberOfBins;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      this->Bins[i] = Quantize(this->Pixels[i], this->Range, this->NumberOfBins);
+      }
+  }
+};
+
+// Per-thread joint histograms over the covered pixels
+struct JointHistogramFunctor
+{
+  const unsigned char* ImageBins;
+  const float* RenderedValues;
+  const float* RenderedDepths;
+  double ScalarRange[2];
+  unsigned int NumberOfBins;
+  std::vector<std::vector<unsigned int> >* Histograms;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    std::vector<unsigned int>& histogram = (*this->Histograms)[threadId];
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      if(this->RenderedDepths[i] == std::numeric_limits<float>::infinity())
+        {
+        continue;
+        }
+      unsigned int renderedBin = Quantize(this->RenderedValues[i], this->ScalarRange, this->NumberOfBins);
+      histogram[this->ImageBins[i] * this->NumberOfBins + renderedBin]++;
+      }
+  }
+};
+
+double Entropy(const std::vector<double>& counts, const double total)
+{
+  double entropy = 0;
+  for(unsigned int i = 0; i < counts.size(); ++i)
+    {
+    if(counts[i] > 0)
+      {
+      double p = counts[i] / total;
+      entropy -= p * log(p);
+      }
+    }
+  return entropy;
+}
+
+// Negative NMI as a function of a pose offset in units of 'Steps'
+class PoseCostFunction : public vnl_cost_function
+{
+public:
+  PoseCostFunction(const MutualInformationRegistration* registration, const Camera& initialCamera,
+                   const double steps[6], const unsigned int level) :
+    vnl_cost_function(6), Registration(registration), InitialCamera(initialCamera), Level(level)
+  {
+    initialCamera.GetPoseParameters(this->InitialParameters);
+    for(unsigned int i = 0; i < 6; ++i)
+      {
+      this->Steps[i] = steps[i];
+      }
+  }
+
+  Camera GetCamera(vnl_vector<double> const& x) const
+  {
+    double parameters[6];
+    for(unsigned int i = 0; i < 6; ++i)
+      {
+      parameters[i] = this->InitialParameters[i] + x[i] * this->Steps[i];
+      }
+    Camera camera = this->InitialCamera;
+    camera.SetPoseParameters(parameters);
+    return camera;
+  }
+
+  double f(vnl_vector<double> const& x)
+  {
+    return -this->Registration->ComputeSimilarity(this->GetCamera(x), this->Level);
+  }
+
+private:
+  const MutualInformationRegistration* Registration;
+  Camera InitialCamera;
+  double InitialParameters[6];
+  double Steps[6];
+  unsigned int Level;
+};
+
+} // end anonymous namespace
+
+MutualInformationRegistration::MutualInformationRegistration()
+{
+  this->NumberOfLevels = 4;
+  this->NumberOfBins = 32;
+  this->MaximumNumberOfIterations = 200;
+  this->Points = NULL;
+  this->Scalars = NULL;
+  this->ScalarRange[0] = 0;
+  this->ScalarRange[1] = 1;
+  this->Initialized = false;
+}
+
+void MutualInformationRegistration::SetImage(const FloatScalarImageType* image)
+{
+  this->Image = image;
+  this->Initialized = false;
+}
+
+void MutualInformationRegistration::SetPointCloud(vtkPoints* points, vtkDataArray* scalars)
+{
+  this->Points = points;
+  this->Scalars = scalars;
+  this->Initialized = false;
+}
+
+void MutualInformationRegistration::SetNumberOfLevels(const unsigned int numberOfLevels)
+{
+  this->NumberOfLevels = std::max(1u, numberOfLevels);
+  this->Initialized = false;
+}
+
+void MutualInformationRegistration::SetNumberOfBins(const unsigned int numberOfBins)
+{
+  this->NumberOfBins = std::min(256u, std::max(2u, numberOfBins));
+  this->Initialized = false;
+}
+
+void MutualInformationRegistration::SetMaximumNumberOfIterations(const unsigned int maximumNumberOfIterations)
+{
+  this->MaximumNumberOfIterations = maximumNumberOfIterations;
+}
+
+void MutualInformationRegistration::Initialize()
+{
+  this->Pyramid.SetImage(this->Image, this->NumberOfLevels);
+
+  PixelValue pixelValue;
+  pixelValue.Pixels = this->Pyramid.GetLevel(0);
+  double imageRange[2];
+  ComputeRobustRange(static_cast<vtkIdType>(this->Pyramid.GetWidth(0)) * this->Pyramid.GetHeight(0), pixelValue, imageRange);
+
+  ScalarValue scalarValue;
+  scalarValue.Scalars = this->Scalars;
+  ComputeRobustRange(this->Scalars->GetNumberOfTuples(), scalarValue, this->ScalarRange);
+
+  this->ImageBins.resize(this->Pyramid.GetNumberOfLevels());
+  this->Renderers.resize(this->Pyramid.GetNumberOfLevels());
+  for(unsigned int level = 0; level < this->Pyramid.GetNumberOfLevels(); ++level)
+    {
+    vtkIdType numberOfPixels = static_cast<vtkIdType>(this->Pyramid.GetWidth(level)) * this->Pyramid.GetHeight(level);
+    this->ImageBins[level].resize(numberOfPixels);
+
+    QuantizeImageFunctor quantize;
+    quantize.Pixels = this->Pyramid.GetLevel(level);
+    quantize.Bins = &this->ImageBins[level][0];
+    quantize.Range[0] = imageRange[0];
+    quantize.Range[1] = imageRange[1];
+    quantize.NumberOfBins = this->NumberOfBins;
+    Parallel::For(0, numberOfPixels, quantize);
+
+    // A few points per pixel are plenty to fill a level; more only costs time
+    this->Renderers[level].SetInput(this->Points, this->Scalars, 4 * numberOfPixels);
+    }
+
+  this->Initialized = true;
+}
+
+double MutualInformationRegistration::ComputeSimilarity(const Camera& camera, const unsigned int level) const
+{
+  const unsigned int width = this->Pyramid.GetWidth(level);
+  const unsigned int height = this->Pyramid.GetHeight(level);
+  const vtkIdType numberOfPixels = static_cast<vtkIdType>(width) * height;
+
+  Camera levelCamera = camera.Scaled(1.0 / static_cast<double>(1 << level));
+
+  std::vector<float> values;
+  std::vector<float> depths;
+  this->Renderers[level].Render(levelCamera, width, height, values, depths);
+
+  const unsigned int numberOfBins = this->NumberOfBins;
+  std::vector<std::vector<unsigned int> > histograms(Parallel::GetNumberOfThreads(),
+                                                     std::vector<unsigned int>(numberOfBins * numberOfBins, 0));
+
+  JointHistogramFunctor accumulate;
+  accumulate.ImageBins = &this->ImageBins[level][0];
+  accumulate.RenderedValues = &values[0];
+  accumulate.RenderedDepths = &depths[0];
+  accumulate.ScalarRange[0] = this->ScalarRange[0];
+  accumulate.ScalarRange[1] = this->ScalarRange[1];
+  accumulate.NumberOfBins = numberOfBins;
+  accumulate.Histograms = &histograms;
+  Parallel::For(0, numberOfPixels, accumulate);
+
+  std::vector<double> joint(numberOfBins * numberOfBins, 0);
+  std::vector<double> imageMarginal(numberOfBins, 0);
+  std::vector<double> renderedMarginal(numberOfBins, 0);
+  double total = 0;
+  for(unsigned int thread = 0; thread < histograms.size(); ++thread)
+    {
+    for(unsigned int a = 0; a < numberOfBins; ++a)
+      {
+      for(unsigned int b = 0; b < numberOfBins; ++b)
+        {
+        unsigned int count = histograms[thread][a * numberOfBins + b];
+        joint[a * numberOfBins + b] += count;
+        imageMarginal[a] += count;
+        renderedMarginal[b] += count;
+        total += count;
+        }
+      }
+    }
+
+  // Too little overlap to say anything
+  if(total < 64 || total < 0.01 * numberOfPixels)
+    {
+    return 1.0;
+    }
+
+  double jointEntropy = Entropy(joint, total);
+  if(jointEntropy <= 0)
+    {
+    return 1.0;
+    }
+  return (Entropy(imageMarginal, total) + Entropy(renderedMarginal, total)) / jointEntropy;
+}
+
+bool MutualInformationRegistration::Register(Camera& camera)
+{
+  if(!this->Image || !this->Points || !this->Scalars)
+    {
+    std::cerr << "MutualInformationRegistration: the image and the point cloud must both be set." << std::endl;
+    return false;
+    }
+
+  if(!this->Initialized)
+    {
+    this->Initialize();
+    }
+
+  // Scale the translation steps by the distance to the cloud so the simplex is sensible in any units
+  double center[3];
+  camera.GetCenter(center);
+  double bounds[6];
+  this->Points->GetBounds(bounds);
+  double distance = 0;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    double delta = 0.5 * (bounds[2 * d] + bounds[2 * d + 1]) - center[d];
+    distance += delta * delta;
+    }
+  distance = sqrt(distance);
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  for(int level = static_cast<int>(this->Pyramid.GetNumberOfLevels()) - 1; level >= 0; --level)
+    {
+    timer->StartTimer();
+    double levelScale = static_cast<double>(1 << level);
+    double steps[6];
+    for(unsigned int i = 0; i < 3; ++i)
+      {
+      steps[i] = 0.01 * levelScale;                // radians
+      steps[i + 3] = 0.01 * distance * levelScale; // scene units
+      }
+
+    PoseCostFunction costFunction(this, camera, steps, level);
+    vnl_vector<double> x(6, 0.0);
+    vnl_vector<double> dx(6, 1.0);
+
+    double before = -costFunction.f(x);
+    vnl_amoeba optimizer(costFunction);
+    optimizer.set_max_iterations(this->MaximumNumberOfIterations);
+    optimizer.set_x_tolerance(0.01);
+    optimizer.set_f_tolerance(1e-6);
+    optimizer.minimize(x, dx);
+    double after = -costFunction.f(x);
+
+    // Nelder-Mead may wander off on a flat cost; only accept improvements
+    if(after > before)
+      {
+      camera = costFunction.GetCamera(x);
+      }
+    timer->StopTimer();
+
+    std::cout << "Registration level " << level << " (" << this->Pyramid.GetWidth(level) << "x" << this->Pyramid.GetHeight(level)
+              << ", " << this->Renderers[level].GetNumberOfPoints() << " points): NMI " << before << " -> " << std::max(before, after)
+              << " in " << timer->GetElapsedTime() << " s" << std::endl;
+    }
+
+  return true;
+}
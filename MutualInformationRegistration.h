@@ -0,0 +1,82 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef MUTUALINFORMATIONREGISTRATION_H
+#define MUTUALINFORMATIONREGISTRATION_H
+
+// STL
+#include <vector>
+
+// Custom
+#include "Camera.h"
+#include "ImagePyramid.h"
+#include "IntensityRenderer.h"
+#include "Types.h"
+
+class vtkDataArray;
+class vtkPoints;
+
+// Automatic 2D/3D registration. The point cloud scalar (e.g. "Intensity") is rendered in software
+// from the current pose and compared to the image with normalized mutual information,
+//   NMI = (H(image) + H(rendered)) / H(image, rendered),
+// computed over the pixels covered by the cloud. NMI is used rather than plain MI because it does not
+// reward poses that simply shrink the overlap. The 6 pose parameters are optimized with Nelder-Mead
+// (vnl_amoeba) from the coarsest pyramid level to the finest; the focal length and principal point are
+// held fixed. Rendering and the joint histogram are multithreaded.
+class MutualInformationRegistration
+{
+public:
+  MutualInformationRegistration();
+
+  // The image to register against, typically the magnitude of the loaded image
+  void SetImage(const FloatScalarImageType* image);
+
+  void SetPointCloud(vtkPoints* points, vtkDataArray* scalars);
+
+  void SetNumberOfLevels(const unsigned int numberOfLevels);
+  void SetNumberOfBins(const unsigned int numberOfBins);
+  void SetMaximumNumberOfIterations(const unsigned int maximumNumberOfIterations);
+
+  // Optimize the pose of 'camera', which must be a reasonable starting point
+  // (e.g. from clicked correspondences or the 3D view). Returns false if the inputs are not set.
+  bool Register(Camera& camera);
+
+  // NMI at a pyramid level for a full resolution camera. Returns 1 (no shared information)
+  // if the cloud covers too few pixels.
+  double ComputeSimilarity(const Camera& camera, const unsigned int level) const;
+
+private:
+  void Initialize();
+
+  unsigned int NumberOfLevels;
+  unsigned int NumberOfBins;
+  unsigned int MaximumNumberOfIterations;
+
+  FloatScalarImageType::ConstPointer Image;
+  vtkPoints* Points;
+  vtkDataArray* Scalars;
+
+  // Per level: the image quantized to bins and a renderer holding a point subset matched to the resolution
+  ImagePyramid Pyramid;
+  std::vector<std::vector<unsigned char> > ImageBins;
+  std::vector<IntensityRenderer> Renderers;
+  double ScalarRange[2];
+  bool Initialized;
+};
+
+#endif
@@ -0,0 +1,99 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// VTK
+#include <vtkMultiThreader.h>
+#include <vtkSmartPointer.h>
+#include <vtkType.h>
+
+namespace Parallel
+{
+
+// The number of threads used by For(). This is VTK's global default, which is the number of cores.
+inline int GetNumberOfThreads()
+{
+  return vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+// Split [begin, end) into one contiguous block per thread and call
+//   functor(blockBegin, blockEnd, threadId)
+// on each block concurrently. threadId is in [0, GetNumberOfThreads()) so it can be used to
+// index per-thread accumulators that are reduced by the caller afterwards.
+template <typename TFunctor>
+struct ForData
+{
+  TFunctor* Functor;
+  vtkIdType Begin;
+  vtkIdType End;
+};
+
+template <typename TFunctor>
+VTK_THREAD_RETURN_TYPE ForThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  ForData<TFunctor>* data = static_cast<ForData<TFunctor>*>(info->UserData);
+
+  vtkIdType length = data->End - data->Begin;
+  vtkIdType blockBegin = data->Begin + (length * info->ThreadID) / info->NumberOfThreads;
+  vtkIdType blockEnd = data->Begin + (length * (info->ThreadID + 1)) / info->NumberOfThreads;
+  if(blockBegin < blockEnd)
+    {
+    (*data->Functor)(blockBegin, blockEnd, info->ThreadID);
+    }
+
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+template <typename TFunctor>
+void For(const vtkIdType begin, const vtkIdType end, TFunctor& functor)
+{
+  if(end <= begin)
+    {
+    return;
+    }
+
+  int numberOfThreads = GetNumberOfThreads();
+  if(end - begin < numberOfThreads)
+    {
+    numberOfThreads = static_cast<int>(end - begin);
+    }
+
+  // Don't pay for thread creation when there is nothing to share
+  if(numberOfThreads <= 1)
+    {
+    functor(begin, end, 0);
+    return;
+    }
+
+  ForData<TFunctor> data;
+  data.Functor = &functor;
+  data.Begin = begin;
+  data.End = end;
+
+  vtkSmartPointer<vtkMultiThreader> threader = vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(numberOfThreads);
+  threader->SetSingleMethod(ForThread<TFunctor>, &data);
+  threader->SingleMethodExecute();
+}
+
+} // end namespace
+
+#endif
@@ -0,0 +1,351 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "PointCloudColoring.h"
+
+// VTK
+#include <vtkDataArray.h>
+#include <vtkLookupTable.h>
+#include <vtkMath.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkUnsignedCharArray.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// Custom
+#include "Parallel.h"
+
+namespace PointCloudColoring
+{
+const char* const ColorArrayName = "DisplayColors";
+}
+
+namespace
+{
+
+const vtkIdType NumberOfSamples = 1 << 16;
+
+// Where the value of an attribute comes from
+struct AttributeSource
+{
+  vtkDataArray* Array; // NULL for the elevation
+  int Component;       // -1 for the magnitude
+};
+
+double GetValue(vtkPoints* points, const double originZ, const AttributeSource& source, const vtkIdType pointId)
+{
+  if(!source.Array)
+    {
+    double p[3];
+    points->GetPoint(pointId, p);
+    return p[2] + originZ;
+    }
+  if(source.Component >= 0)
+    {
+    return source.Array->GetComponent(pointId, source.Component);
+    }
+
+  double sum = 0;
+  for(int c = 0; c < source.Array->GetNumberOfComponents(); ++c)
+    {
+    double value = source.Array->GetComponent(pointId, c);
+    sum += value * value;
+    }
+  return sqrt(sum);
+}
+
+AttributeSource GetSource(vtkPolyData* polyData, const PointAttribute& attribute)
+{
+  AttributeSource source;
+  source.Array = attribute.ArrayName.empty() ? NULL : polyData->GetPointData()->GetArray(attribute.ArrayName.c_str());
+  source.Component = attribute.Component;
+  return source;
+}
+
+// Ranges of all the attributes, plus a regular sample of their values for the percentiles
+struct StatisticsFunctor
+{
+  vtkPoints* Points;
+  double OriginZ;
+  std::vector<AttributeSource> Sources;
+  vtkIdType SampleStride;
+
+  // Per thread, one entry per source
+  std::vector<std::vector<double> >* Minimums;
+  std::vector<std::vector<double> >* Maximums;
+  std::vector<std::vector<std::vector<double> > >* Samples;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    for(unsigned int s = 0; s < this->Sources.size(); ++s)
+      {
+      double minimum = (*this->Minimums)[threadId][s];
+      double maximum = (*this->Maximums)[threadId][s];
+      std::vector<double>& samples = (*this->Samples)[threadId][s];
+      for(vtkIdType pointId = begin; pointId < end; ++pointId)
+        {
+        double value = GetValue(this->Points, this->OriginZ, this->Sources[s], pointId);
+        if(value != value)
+          {
+          continue;
+          }
+        minimum = std::min(minimum, value);
+        maximum = std::max(maximum, value);
+        if(pointId % this->SampleStride == 0)
+          {
+          samples.push_back(value);
+          }
+        }
+      (*this->Minimums)[threadId][s] = minimum;
+      (*this->Maximums)[threadId][s] = maximum;
+      }
+  }
+};
+
+struct ColorFunctor
+{
+  vtkPoints* Points;
+  double OriginZ;
+  AttributeSource Source;
+  PointAttribute::Kind Type;
+  double Lowest;
+  double Scale; // table entries per unit
+  const unsigned char* Table;
+  unsigned char* Colors;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType pointId = begin; pointId < end; ++pointId)
+      {
+      unsigned char* color = this->Colors + 3 * pointId;
+      if(this->Type == PointAttribute::Color)
+        {
+        for(int c = 0; c < 3; ++c)
+          {
+          color[c] = static_cast<unsigned char>(this->Source.Array->GetComponent(pointId, c));
+          }
+        continue;
+        }
+
+      double entry = (GetValue(this->Points, this->OriginZ, this->Source, pointId) - this->Lowest) * this->Scale;
+      unsigned int index = 0;
+      if(entry >= 255)
+        {
+        index = 255;
+        }
+      else if(entry > 0)
+        {
+        index = static_cast<unsigned int>(entry);
+        }
+      memcpy(color, this->Table + 3 * index, 3);
+      }
+  }
+};
+
+bool IsIntegerType(const int dataType)
+{
+  return dataType != VTK_FLOAT && dataType != VTK_DOUBLE;
+}
+
+} // end anonymous namespace
+
+namespace PointCloudColoring
+{
+
+void ComputeAttributes(vtkPolyData* polyData, const double origin[3], std::vector<PointAttribute>& attributes)
+{
+  attributes.clear();
+  vtkIdType numberOfPoints = polyData->GetNumberOfPoints();
+  if(numberOfPoints == 0)
+    {
+    return;
+    }
+
+  PointAttribute elevation;
+  elevation.Name = "Elevation";
+  elevation.Component = 0;
+  elevation.Type = PointAttribute::Continuous;
+  attributes.push_back(elevation);
+
+  vtkPointData* pointData = polyData->GetPointData();
+  for(int i = 0; i < pointData->GetNumberOfArrays(); ++i)
+    {
+    vtkDataArray* array = pointData->GetArray(i);
+    if(!array || array->GetDataType() == VTK_ID_TYPE || array->GetNumberOfTuples() != numberOfPoints ||
+       !array->GetName() || std::string(array->GetName()) == ColorArrayName)
+      {
+      continue;
+      }
+
+    PointAttribute attribute;
+    attribute.Name = array->GetName();
+    attribute.ArrayName = array->GetName();
+    attribute.Component = array->GetNumberOfComponents() == 1 ? 0 : -1;
+    attribute.Type = PointAttribute::Continuous;
+    if(array->GetDataType() == VTK_UNSIGNED_CHAR &&
+       (array->GetNumberOfComponents() == 3 || array->GetNumberOfComponents() == 4))
+      {
+      attribute.Type = PointAttribute::Color;
+      attribute.Range[0] = attribute.RobustRange[0] = 0;
+      attribute.Range[1] = attribute.RobustRange[1] = 255;
+      }
+    else if(array->GetNumberOfComponents() > 1)
+      {
+      attribute.Name += " (magnitude)";
+      }
+    attributes.push_back(attribute);
+    }
+
+  // One pass over the points for every attribute that needs statistics
+  std::vector<unsigned int> measured;
+  StatisticsFunctor statistics;
+  statistics.Points = polyData->GetPoints();
+  statistics.OriginZ = origin[2];
+  statistics.SampleStride = std::max(static_cast<vtkIdType>(1), numberOfPoints / NumberOfSamples);
+  for(unsigned int a = 0; a < attributes.size(); ++a)
+    {
+    if(attributes[a].Type != PointAttribute::Color)
+      {
+      measured.push_back(a);
+      statistics.Sources.push_back(GetSource(polyData, attributes[a]));
+      }
+    }
+
+  int numberOfThreads = Parallel::GetNumberOfThreads();
+  std::vector<std::vector<double> > minimums(numberOfThreads,
+                                             std::vector<double>(measured.size(), std::numeric_limits<double>::max()));
+  std::vector<std::vector<double> > maximums(numberOfThreads,
+                                             std::vector<double>(measured.size(), -std::numeric_limits<double>::max()));
+  std::vector<std::vector<std::vector<double> > > samples(numberOfThreads,
+                                                          std::vector<std::vector<double> >(measured.size()));
+  statistics.Minimums = &minimums;
+  statistics.Maximums = &maximums;
+  statistics.Samples = &samples;
+  Parallel::For(0, numberOfPoints, statistics);
+
+  for(unsigned int m = 0; m < measured.size(); ++m)
+    {
+    PointAttribute& attribute = attributes[measured[m]];
+    attribute.Range[0] = std::numeric_limits<double>::max();
+    attribute.Range[1] = -std::numeric_limits<double>::max();
+    std::vector<double> values;
+    for(int thread = 0; thread < numberOfThreads; ++thread)
+      {
+      attribute.Range[0] = std::min(attribute.Range[0], minimums[thread][m]);
+      attribute.Range[1] = std::max(attribute.Range[1], maximums[thread][m]);
+      values.insert(values.end(), samples[thread][m].begin(), samples[thread][m].end());
+      }
+    if(values.empty())
+      {
+      attribute.Range[0] = attribute.Range[1] = 0;
+      }
+
+    vtkDataArray* array = statistics.Sources[m].Array;
+    if(array && attribute.Component == 0 && IsIntegerType(array->GetDataType()) &&
+       attribute.Range[1] - attribute.Range[0] < 256)
+      {
+      attribute.Type = PointAttribute::Categorical;
+      }
+
+    attribute.RobustRange[0] = attribute.Range[0];
+    attribute.RobustRange[1] = attribute.Range[1];
+    if(attribute.Type == PointAttribute::Continuous && !values.empty())
+      {
+      std::vector<double>::iterator low = values.begin() + values.size() / 50;
+      std::nth_element(values.begin(), low, values.end());
+      double robustLow = *low;
+      std::vector<double>::iterator high = values.begin() + (values.size() * 49) / 50;
+      std::nth_element(values.begin(), high, values.end());
+      if(robustLow < *high)
+        {
+        attribute.RobustRange[0] = robustLow;
+        attribute.RobustRange[1] = *high;
+        }
+      }
+    }
+}
+
+void ComputeColors(vtkPolyData* polyData, const double origin[3], const PointAttribute& attribute,
+                   vtkUnsignedCharArray* colors)
+{
+  vtkIdType numberOfPoints = polyData->GetNumberOfPoints();
+  colors->SetName(ColorArrayName);
+  colors->SetNumberOfComponents(3);
+  colors->SetNumberOfTuples(numberOfPoints);
+
+  // Categories get well separated hues (golden ratio steps); continuous values a blue to red scale
+  unsigned char table[3 * 256];
+  if(attribute.Type == PointAttribute::Categorical)
+    {
+    for(unsigned int i = 0; i < 256; ++i)
+      {
+      double hue = fmod(0.6 + i * 0.618033988749895, 1.0);
+      double rgb[3];
+      vtkMath::HSVToRGB(hue, 0.75, 0.95, &rgb[0], &rgb[1], &rgb[2]);
+      for(unsigned int c = 0; c < 3; ++c)
+        {
+        table[3 * i + c] = static_cast<unsigned char>(255 * rgb[c]);
+        }
+      }
+    }
+  else
+    {
+    vtkSmartPointer<vtkLookupTable> lookupTable = vtkSmartPointer<vtkLookupTable>::New();
+    lookupTable->SetNumberOfTableValues(256);
+    lookupTable->SetHueRange(0.667, 0);
+    lookupTable->Build();
+    for(unsigned int i = 0; i < 256; ++i)
+      {
+      double rgba[4];
+      lookupTable->GetTableValue(i, rgba);
+      for(unsigned int c = 0; c < 3; ++c)
+        {
+        table[3 * i + c] = static_cast<unsigned char>(255 * rgba[c]);
+        }
+      }
+    }
+
+  ColorFunctor functor;
+  functor.Points = polyData->GetPoints();
+  functor.OriginZ = origin[2];
+  functor.Source = GetSource(polyData, attribute);
+  functor.Type = attribute.Type;
+  functor.Table = table;
+  functor.Colors = colors->GetPointer(0);
+  if(attribute.Type == PointAttribute::Categorical)
+    {
+    functor.Lowest = attribute.Range[0] - 0.5;
+    functor.Scale = 1;
+    }
+  else
+    {
+    functor.Lowest = attribute.RobustRange[0];
+    double width = attribute.RobustRange[1] - attribute.RobustRange[0];
+    functor.Scale = width > 0 ? 256 / width : 0;
+    }
+  Parallel::For(0, numberOfPoints, functor);
+}
+
+} // end namespace
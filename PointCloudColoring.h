@@ -0,0 +1,65 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef POINTCLOUDCOLORING_H
+#define POINTCLOUDCOLORING_H
+
+// STL
+#include <string>
+#include <vector>
+
+class vtkPolyData;
+class vtkUnsignedCharArray;
+
+// A quantity the points of a cloud can be colored by, with its statistics
+struct PointAttribute
+{
+  enum Kind
+  {
+    Continuous,  // mapped through a color scale over RobustRange
+    Categorical, // integer labels (at most 256 distinct values), each with its own color
+    Color        // 3 or 4 unsigned char components, shown as they are
+  };
+
+  std::string Name;      // as shown to the user
+  std::string ArrayName; // the point data array; empty for the elevation
+  int Component;         // of the array, or -1 for the magnitude of a vector array
+  Kind Type;
+
+  double Range[2];
+  double RobustRange[2]; // 2nd and 98th percentiles, so a few outliers do not wash out the colors
+};
+
+namespace PointCloudColoring
+{
+
+// The name of the point data array the display colors are put in
+extern const char* const ColorArrayName;
+
+// Find the attributes of a cloud: its elevation (world z; world = local + origin) and each of its point data
+// arrays (except ids and the display colors). The ranges and percentiles of all of them come from one parallel
+// pass over the points; the percentiles are those of a regular sample of about 64k points.
+void ComputeAttributes(vtkPolyData* polyData, const double origin[3], std::vector<PointAttribute>& attributes);
+
+// Fill 'colors' with an RGB color per point for 'attribute', in parallel through a 256 entry table
+void ComputeColors(vtkPolyData* polyData, const double origin[3], const PointAttribute& attribute,
+                   vtkUnsignedCharArray* colors);
+
+} // end namespace
+
+#endif
@@ -0,0 +1,1585 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "PointCloudReader.h"
+
+// VTK
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkXMLPolyDataReader.h>
+
+// STL
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+// Custom
+#include "Helpers.h"
+#include "Parallel.h"
+
+namespace
+{
+
+enum ScalarType {Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64};
+
+unsigned int SizeOf(const ScalarType type)
+{
+  switch(type)
+    {
+    case Int8:
+    case UInt8:
+      return 1;
+    case Int16:
+    case UInt16:
+      return 2;
+    case Int32:
+    case UInt32:
+    case Float32:
+      return 4;
+    default:
+      return 8;
+    }
+}
+
+// The attributes the readers know how to map to point data
+enum Attribute {X, Y, Z, Intensity, Red, Green, Blue, Classification, ReturnNumber, NumberOfAttributes};
+
+// Where the value of an attribute is found for record i: at Offset + i * Stride bytes into a block.
+// This covers interleaved records (Stride is the record size) as well as one array per field (compressed PCD).
+// For ASCII data Offset is the column instead.
+struct FieldLayout
+{
+  bool Present;
+  ScalarType Type;
+  vtkIdType Offset;
+  vtkIdType Stride;
+
+  // If Mask is not 0 the value is the unsigned integer (bits >> Shift) & Mask. This extracts bit fields
+  // (the LAS classification) and packed colors (PCD rgb, whose bits are declared as a float).
+  unsigned int Shift;
+  unsigned int Mask;
+};
+
+struct RecordLayout
+{
+  FieldLayout Fields[NumberOfAttributes];
+  bool SwapBytes;
+
+  // Coordinates are value * Scale + Offset (LAS stores scaled integers)
+  double Scale[3];
+  double Offset[3];
+};
+
+void InitializeLayout(RecordLayout& layout)
+{
+  for(unsigned int attribute = 0; attribute < NumberOfAttributes; ++attribute)
+    {
+    FieldLayout& field = layout.Fields[attribute];
+    field.Present = false;
+    field.Type = Float32;
+    field.Offset = 0;
+    field.Stride = 0;
+    field.Shift = 0;
+    field.Mask = 0;
+    }
+  layout.SwapBytes = false;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    layout.Scale[d] = 1;
+    layout.Offset[d] = 0;
+    }
+}
+
+void SetField(RecordLayout& layout, const Attribute attribute, const ScalarType type, const vtkIdType offset,
+              const vtkIdType stride, const unsigned int shift = 0, const unsigned int mask = 0)
+{
+  FieldLayout& field = layout.Fields[attribute];
+  field.Present = true;
+  field.Type = type;
+  field.Offset = offset;
+  field.Stride = stride;
+  field.Shift = shift;
+  field.Mask = mask;
+}
+
+bool IsLittleEndian()
+{
+  unsigned short one = 1;
+  return *reinterpret_cast<unsigned char*>(&one) == 1;
+}
+
+double ReadScalar(const char* data, const ScalarType type, const bool swapBytes, unsigned int* bits = NULL)
+{
+  const unsigned int size = SizeOf(type);
+  char bytes[8];
+  for(unsigned int b = 0; b < size; ++b)
+    {
+    bytes[b] = swapBytes ? data[size - 1 - b] : data[b];
+    }
+
+  if(bits)
+    {
+    // The raw bits, whatever the declared type
+    unsigned char u8;
+    unsigned short u16;
+    switch(size)
+      {
+      case 1:
+        memcpy(&u8, bytes, 1);
+        *bits = u8;
+        break;
+      case 2:
+        memcpy(&u16, bytes, 2);
+        *bits = u16;
+        break;
+      default:
+        memcpy(bits, bytes, 4);
+        break;
+      }
+    return 0;
+    }
+
+  switch(type)
+    {
+    case Int8:
+      {
+      signed char value;
+      memcpy(&value, bytes, 1);
+      return value;
+      }
+    case UInt8:
+      {
+      unsigned char value;
+      memcpy(&value, bytes, 1);
+      return value;
+      }
+    case Int16:
+      {
+      short value;
+      memcpy(&value, bytes, 2);
+      return value;
+      }
+    case UInt16:
+      {
+      unsigned short value;
+      memcpy(&value, bytes, 2);
+      return value;
+      }
+    case Int32:
+      {
+      int value;
+      memcpy(&value, bytes, 4);
+      return value;
+      }
+    case UInt32:
+      {
+      unsigned int value;
+      memcpy(&value, bytes, 4);
+      return value;
+      }
+    case Float32:
+      {
+      float value;
+      memcpy(&value, bytes, 4);
+      return value;
+      }
+    default:
+      {
+      double value;
+      memcpy(&value, bytes, 8);
+      return value;
+      }
+    }
+}
+
+double ReadField(const char* block, const vtkIdType record, const FieldLayout& field, const bool swapBytes)
+{
+  const char* data = block + field.Offset + record * field.Stride;
+  if(field.Mask)
+    {
+    unsigned int bits = 0;
+    ReadScalar(data, field.Type, swapBytes, &bits);
+    return static_cast<double>((bits >> field.Shift) & field.Mask);
+    }
+  return ReadScalar(data, field.Type, swapBytes);
+}
+
+// The same for a value that was parsed from text
+double FieldFromText(const double value, const FieldLayout& field)
+{
+  if(!field.Mask)
+    {
+    return value;
+    }
+
+  unsigned int bits = 0;
+  if(field.Type == Float32)
+    {
+    float packed = static_cast<float>(value);
+    memcpy(&bits, &packed, 4);
+    }
+  else
+    {
+    bits = static_cast<unsigned int>(value);
+    }
+  return static_cast<double>((bits >> field.Shift) & field.Mask);
+}
+
+bool IsFinite(const double value)
+{
+  return value == value && fabs(value) <= std::numeric_limits<float>::max();
+}
+
+// The arrays being filled. Attributes the file does not have stay NULL.
+struct PointCloudArrays
+{
+  vtkSmartPointer<vtkFloatArray> Points;
+  vtkSmartPointer<vtkFloatArray> Intensity;
+  vtkSmartPointer<vtkUnsignedCharArray> RGB;
+  vtkSmartPointer<vtkUnsignedCharArray> Classification;
+  vtkSmartPointer<vtkUnsignedCharArray> ReturnNumber;
+};
+
+void AllocateArrays(const RecordLayout& layout, const vtkIdType numberOfPoints, PointCloudArrays& arrays)
+{
+  arrays.Points = vtkSmartPointer<vtkFloatArray>::New();
+  arrays.Points->SetNumberOfComponents(3);
+  arrays.Points->SetNumberOfTuples(numberOfPoints);
+
+  arrays.Intensity = NULL;
+  if(layout.Fields[Intensity].Present)
+    {
+    arrays.Intensity = vtkSmartPointer<vtkFloatArray>::New();
+    arrays.Intensity->SetName("Intensity");
+    arrays.Intensity->SetNumberOfTuples(numberOfPoints);
+    }
+
+  arrays.RGB = NULL;
+  if(layout.Fields[Red].Present && layout.Fields[Green].Present && layout.Fields[Blue].Present)
+    {
+    arrays.RGB = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    arrays.RGB->SetName("RGB");
+    arrays.RGB->SetNumberOfComponents(3);
+    arrays.RGB->SetNumberOfTuples(numberOfPoints);
+    }
+
+  arrays.Classification = NULL;
+  if(layout.Fields[Classification].Present)
+    {
+    arrays.Classification = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    arrays.Classification->SetName("Classification");
+    arrays.Classification->SetNumberOfTuples(numberOfPoints);
+    }
+
+  arrays.ReturnNumber = NULL;
+  if(layout.Fields[ReturnNumber].Present)
+    {
+    arrays.ReturnNumber = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    arrays.ReturnNumber->SetName("ReturnNumber");
+    arrays.ReturnNumber->SetNumberOfTuples(numberOfPoints);
+    }
+}
+
+unsigned char ClampToByte(const double value)
+{
+  return static_cast<unsigned char>(std::min(255.0, std::max(0.0, value)));
+}
+
+// Store the attribute values of one point. Returns false if its coordinates are not finite.
+bool StorePoint(const double values[NumberOfAttributes], const RecordLayout& layout, const double origin[3],
+                const vtkIdType pointId, PointCloudArrays& arrays)
+{
+  float* point = arrays.Points->GetPointer(3 * pointId);
+  bool finite = true;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    double coordinate = values[d] * layout.Scale[d] + layout.Offset[d];
+    finite = finite && IsFinite(coordinate);
+    point[d] = static_cast<float>(coordinate - origin[d]);
+    }
+
+  if(arrays.Intensity)
+    {
+    arrays.Intensity->SetValue(pointId, static_cast<float>(values[Intensity]));
+    }
+  if(arrays.RGB)
+    {
+    unsigned char* color = arrays.RGB->GetPointer(3 * pointId);
+    color[0] = ClampToByte(values[Red]);
+    color[1] = ClampToByte(values[Green]);
+    color[2] = ClampToByte(values[Blue]);
+    }
+  if(arrays.Classification)
+    {
+    arrays.Classification->SetValue(pointId, ClampToByte(values[Classification]));
+    }
+  if(arrays.ReturnNumber)
+    {
+    arrays.ReturnNumber->SetValue(pointId, ClampToByte(values[ReturnNumber]));
+    }
+  return finite;
+}
+
+// Decode a block of binary records into the arrays, starting at point FirstPoint
+struct DecodeFunctor
+{
+  const char* Block;
+  const RecordLayout* Layout;
+  const double* Origin;
+  vtkIdType FirstPoint;
+  PointCloudArrays* Arrays;
+  std::vector<vtkIdType>* InvalidCounts; // per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    double values[NumberOfAttributes] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+    for(vtkIdType record = begin; record < end; ++record)
+      {
+      for(unsigned int attribute = 0; attribute < NumberOfAttributes; ++attribute)
+        {
+        if(this->Layout->Fields[attribute].Present)
+          {
+          values[attribute] = ReadField(this->Block, record, this->Layout->Fields[attribute], this->Layout->SwapBytes);
+          }
+        }
+      if(!StorePoint(values, *this->Layout, this->Origin, this->FirstPoint + record, *this->Arrays))
+        {
+        (*this->InvalidCounts)[threadId]++;
+        }
+      }
+  }
+};
+
+vtkIdType DecodeBlock(const char* block, const vtkIdType numberOfRecords, const RecordLayout& layout,
+                      const double origin[3], const vtkIdType firstPoint, PointCloudArrays& arrays)
+{
+  std::vector<vtkIdType> invalidCounts(Parallel::GetNumberOfThreads(), 0);
+
+  DecodeFunctor decode;
+  decode.Block = block;
+  decode.Layout = &layout;
+  decode.Origin = origin;
+  decode.FirstPoint = firstPoint;
+  decode.Arrays = &arrays;
+  decode.InvalidCounts = &invalidCounts;
+  Parallel::For(0, numberOfRecords, decode);
+
+  vtkIdType numberOfInvalidPoints = 0;
+  for(unsigned int thread = 0; thread < invalidCounts.size(); ++thread)
+    {
+    numberOfInvalidPoints += invalidCounts[thread];
+    }
+  return numberOfInvalidPoints;
+}
+
+// Stream fixed-size records in blocks of about 64 MB, decoding each block in parallel.
+// Returns false if the file ends early.
+bool ReadRecords(std::istream& file, const vtkIdType numberOfRecords, const vtkIdType recordSize,
+                 const RecordLayout& layout, const double origin[3], PointCloudArrays& arrays,
+                 vtkIdType& numberOfInvalidPoints)
+{
+  numberOfInvalidPoints = 0;
+  const vtkIdType recordsPerBlock = std::max(static_cast<vtkIdType>(1), static_cast<vtkIdType>((64 << 20) / recordSize));
+  std::vector<char> block(std::min(recordsPerBlock, numberOfRecords) * recordSize);
+
+  for(vtkIdType firstRecord = 0; firstRecord < numberOfRecords; firstRecord += recordsPerBlock)
+    {
+    vtkIdType count = std::min(recordsPerBlock, numberOfRecords - firstRecord);
+    file.read(&block[0], count * recordSize);
+    if(file.gcount() != count * recordSize)
+      {
+      std::cerr << "The file ends after " << firstRecord + file.gcount() / recordSize << " of "
+                << numberOfRecords << " points!" << std::endl;
+      return false;
+      }
+    numberOfInvalidPoints += DecodeBlock(&block[0], count, layout, origin, firstRecord, arrays);
+    }
+  return true;
+}
+
+// Pick the local origin from a point, for formats whose header does not give the bounds.
+// Returns false (and leaves the origin at 0) if the point is not finite.
+bool ChooseOriginFromPoint(const double values[NumberOfAttributes], const RecordLayout& layout, double origin[3])
+{
+  double bounds[6];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    bounds[2 * d] = bounds[2 * d + 1] = values[d] * layout.Scale[d] + layout.Offset[d];
+    }
+  if(!IsFinite(bounds[0]) || !IsFinite(bounds[2]) || !IsFinite(bounds[4]))
+    {
+    origin[0] = origin[1] = origin[2] = 0;
+    return false;
+    }
+  Helpers::ChooseLocalOrigin(bounds, origin);
+  return true;
+}
+
+// The same from the first finite point of a block (organized clouds start with invalid points).
+// Returns false if there is none.
+bool ChooseOriginFromRecords(const char* block, const vtkIdType numberOfRecords, const RecordLayout& layout,
+                             double origin[3])
+{
+  double values[NumberOfAttributes] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  for(vtkIdType record = 0; record < numberOfRecords; ++record)
+    {
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      values[d] = ReadField(block, record, layout.Fields[d], layout.SwapBytes);
+      }
+    if(ChooseOriginFromPoint(values, layout, origin))
+      {
+      return true;
+      }
+    }
+  return false;
+}
+
+// The same from the first finite point of fixed-size records in a file, which is left where it was
+void ChooseOriginFromFile(std::istream& file, const vtkIdType numberOfRecords, const vtkIdType recordSize,
+                          const RecordLayout& layout, double origin[3])
+{
+  origin[0] = origin[1] = origin[2] = 0;
+  std::streampos start = file.tellg();
+  const vtkIdType recordsPerBlock = std::max(static_cast<vtkIdType>(1), static_cast<vtkIdType>((1 << 20) / recordSize));
+  std::vector<char> block(std::min(recordsPerBlock, numberOfRecords) * recordSize);
+  for(vtkIdType firstRecord = 0; firstRecord < numberOfRecords; firstRecord += recordsPerBlock)
+    {
+    vtkIdType count = std::min(recordsPerBlock, numberOfRecords - firstRecord);
+    file.read(&block[0], count * recordSize);
+    count = file.gcount() / recordSize;
+    if(count == 0 || ChooseOriginFromRecords(&block[0], count, layout, origin))
+      {
+      break;
+      }
+    }
+  file.clear();
+  file.seekg(start);
+}
+
+void ReportOrigin(const double origin[3], const bool singlePrecision)
+{
+  if(origin[0] == 0 && origin[1] == 0 && origin[2] == 0)
+    {
+    return;
+    }
+  if(singlePrecision)
+    {
+    std::cout << "Warning: the point coordinates were stored in single precision, so shifting them to a local origin "
+              << "cannot restore the precision they have already lost." << std::endl;
+    }
+  std::cout << "Point coordinates are stored relative to the local origin " << std::setprecision(12)
+            << origin[0] << " " << origin[1] << " " << origin[2] << std::setprecision(6) << std::endl;
+}
+
+// Drop the points with non-finite coordinates (the holes of organized PCD clouds)
+void RemoveInvalidPoints(PointCloudArrays& arrays)
+{
+  vtkIdType numberOfPoints = arrays.Points->GetNumberOfTuples();
+  float* points = arrays.Points->GetPointer(0);
+  vtkIdType kept = 0;
+  for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    const float* point = points + 3 * pointId;
+    if(!IsFinite(point[0]) || !IsFinite(point[1]) || !IsFinite(point[2]))
+      {
+      continue;
+      }
+    if(kept != pointId)
+      {
+      memmove(points + 3 * kept, point, 3 * sizeof(float));
+      if(arrays.Intensity)
+        {
+        arrays.Intensity->SetValue(kept, arrays.Intensity->GetValue(pointId));
+        }
+      if(arrays.RGB)
+        {
+        memmove(arrays.RGB->GetPointer(3 * kept), arrays.RGB->GetPointer(3 * pointId), 3);
+        }
+      if(arrays.Classification)
+        {
+        arrays.Classification->SetValue(kept, arrays.Classification->GetValue(pointId));
+        }
+      if(arrays.ReturnNumber)
+        {
+        arrays.ReturnNumber->SetValue(kept, arrays.ReturnNumber->GetValue(pointId));
+        }
+      }
+    kept++;
+    }
+
+  arrays.Points->SetNumberOfTuples(kept);
+  if(arrays.Intensity)
+    {
+    arrays.Intensity->SetNumberOfTuples(kept);
+    }
+  if(arrays.RGB)
+    {
+    arrays.RGB->SetNumberOfTuples(kept);
+    }
+  if(arrays.Classification)
+    {
+    arrays.Classification->SetNumberOfTuples(kept);
+    }
+  if(arrays.ReturnNumber)
+    {
+    arrays.ReturnNumber->SetNumberOfTuples(kept);
+    }
+  std::cout << "Dropped " << numberOfPoints - kept << " points without valid coordinates." << std::endl;
+}
+
+void AssembleOutput(PointCloudArrays& arrays, vtkCellArray* faces, vtkPolyData* output)
+{
+  output->Initialize();
+
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetData(arrays.Points);
+  output->SetPoints(points);
+
+  if(faces && faces->GetNumberOfCells() > 0)
+    {
+    output->SetPolys(faces);
+    }
+  else
+    {
+    Helpers::AddVertices(output);
+    }
+
+  if(arrays.Intensity)
+    {
+    output->GetPointData()->AddArray(arrays.Intensity);
+    }
+  if(arrays.RGB)
+    {
+    output->GetPointData()->AddArray(arrays.RGB);
+    }
+  if(arrays.Classification)
+    {
+    output->GetPointData()->AddArray(arrays.Classification);
+    }
+  if(arrays.ReturnNumber)
+    {
+    output->GetPointData()->AddArray(arrays.ReturnNumber);
+    }
+}
+
+std::string LowerCase(std::string text)
+{
+  std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+  return text;
+}
+
+std::string Extension(const std::string& fileName)
+{
+  std::string::size_type dot = fileName.find_last_of('.');
+  if(dot == std::string::npos)
+    {
+    return "";
+    }
+  return LowerCase(fileName.substr(dot + 1));
+}
+
+// getline without the '\r' of files written on Windows
+bool GetLine(std::istream& stream, std::string& line)
+{
+  if(!std::getline(stream, line))
+    {
+    return false;
+    }
+  if(!line.empty() && line[line.size() - 1] == '\r')
+    {
+    line.erase(line.size() - 1);
+    }
+  return true;
+}
+
+// Parse a line of numbers. Returns false if it has fewer than 'numberOfValues'.
+bool ParseValues(const std::string& line, const unsigned int numberOfValues, std::vector<double>& values)
+{
+  values.resize(numberOfValues);
+  const char* position = line.c_str();
+  for(unsigned int i = 0; i < numberOfValues; ++i)
+    {
+    char* next = NULL;
+    values[i] = strtod(position, &next);
+    if(next == position)
+      {
+      return false;
+      }
+    position = next;
+    }
+  return true;
+}
+
+// Read ASCII records of 'numberOfColumns' values, one point per line
+bool ReadTextRecords(std::istream& file, const vtkIdType numberOfRecords, const unsigned int numberOfColumns,
+                     RecordLayout& layout, double origin[3], PointCloudArrays& arrays, vtkIdType& numberOfInvalidPoints)
+{
+  numberOfInvalidPoints = 0;
+  std::string line;
+  std::vector<double> columns;
+  double values[NumberOfAttributes] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  bool hasOrigin = false;
+  origin[0] = origin[1] = origin[2] = 0;
+  for(vtkIdType record = 0; record < numberOfRecords; ++record)
+    {
+    if(!GetLine(file, line) || !ParseValues(line, numberOfColumns, columns))
+      {
+      std::cerr << "Could not read point " << record << " of " << numberOfRecords << "!" << std::endl;
+      return false;
+      }
+    for(unsigned int attribute = 0; attribute < NumberOfAttributes; ++attribute)
+      {
+      const FieldLayout& field = layout.Fields[attribute];
+      if(field.Present)
+        {
+        values[attribute] = FieldFromText(columns[field.Offset], field);
+        }
+      }
+    // The points before the first finite one are invalid whatever the origin
+    if(!hasOrigin)
+      {
+      hasOrigin = ChooseOriginFromPoint(values, layout, origin);
+      }
+    if(!StorePoint(values, layout, origin, record, arrays))
+      {
+      numberOfInvalidPoints++;
+      }
+    }
+  return true;
+}
+
+// The ASPRS colors are 16 bits, but many writers store 8 bit values in them. Decide from a sample of records.
+bool ColorsUse16Bits(const char* block, const vtkIdType numberOfRecords, const RecordLayout& layout)
+{
+  for(vtkIdType record = 0; record < numberOfRecords; ++record)
+    {
+    for(unsigned int attribute = Red; attribute <= Blue; ++attribute)
+      {
+      if(ReadField(block, record, layout.Fields[attribute], layout.SwapBytes) > 255)
+        {
+        return true;
+        }
+      }
+    }
+  return false;
+}
+
+bool ParseScalarType(const std::string& name, ScalarType& type)
+{
+  if(name == "char" || name == "int8")
+    {
+    type = Int8;
+    }
+  else if(name == "uchar" || name == "uint8")
+    {
+    type = UInt8;
+    }
+  else if(name == "short" || name == "int16")
+    {
+    type = Int16;
+    }
+  else if(name == "ushort" || name == "uint16")
+    {
+    type = UInt16;
+    }
+  else if(name == "int" || name == "int32")
+    {
+    type = Int32;
+    }
+  else if(name == "uint" || name == "uint32")
+    {
+    type = UInt32;
+    }
+  else if(name == "float" || name == "float32")
+    {
+    type = Float32;
+    }
+  else if(name == "double" || name == "float64")
+    {
+    type = Float64;
+    }
+  else
+    {
+    return false;
+    }
+  return true;
+}
+
+// The point data array a PLY or PCD field name maps to, or NumberOfAttributes if none
+unsigned int AttributeFromName(const std::string& name)
+{
+  std::string lower = LowerCase(name);
+  if(lower == "x")
+    {
+    return X;
+    }
+  if(lower == "y")
+    {
+    return Y;
+    }
+  if(lower == "z")
+    {
+    return Z;
+    }
+  if(lower == "intensity" || lower == "scalar_intensity")
+    {
+    return Intensity;
+    }
+  if(lower == "red" || lower == "diffuse_red")
+    {
+    return Red;
+    }
+  if(lower == "green" || lower == "diffuse_green")
+    {
+    return Green;
+    }
+  if(lower == "blue" || lower == "diffuse_blue")
+    {
+    return Blue;
+    }
+  if(lower == "classification" || lower == "scalar_classification" || lower == "label")
+    {
+    return Classification;
+    }
+  if(lower == "return_number" || lower == "returnnumber")
+    {
+    return ReturnNumber;
+    }
+  return NumberOfAttributes;
+}
+
+struct PLYProperty
+{
+  std::string Name;
+  ScalarType Type;
+  bool IsList;
+  ScalarType CountType;
+};
+
+struct PLYElement
+{
+  std::string Name;
+  vtkIdType Count;
+  std::vector<PLYProperty> Properties;
+};
+
+// Read (or, with values == NULL, skip) one binary PLY element instance with list properties
+bool ReadBinaryPLYInstance(std::istream& file, const PLYElement& element, const bool swapBytes,
+                           const unsigned int listProperty, std::vector<double>* values)
+{
+  char bytes[8];
+  for(unsigned int property = 0; property < element.Properties.size(); ++property)
+    {
+    const PLYProperty& p = element.Properties[property];
+    if(!p.IsList)
+      {
+      file.read(bytes, SizeOf(p.Type));
+      continue;
+      }
+
+    file.read(bytes, SizeOf(p.CountType));
+    unsigned int count = static_cast<unsigned int>(ReadScalar(bytes, p.CountType, swapBytes));
+    if(property == listProperty && values)
+      {
+      values->resize(count);
+      for(unsigned int i = 0; i < count; ++i)
+        {
+        file.read(bytes, SizeOf(p.Type));
+        (*values)[i] = ReadScalar(bytes, p.Type, swapBytes);
+        }
+      }
+    else
+      {
+      file.seekg(static_cast<std::streamoff>(count) * SizeOf(p.Type), std::ios::cur);
+      }
+    }
+  return !file.fail();
+}
+
+// Faces are variable length, so they are streamed
+bool ReadPLYFaces(std::istream& file, const PLYElement& element, const bool ascii, const bool swapBytes,
+                  const vtkIdType numberOfPoints, vtkCellArray* faces)
+{
+  unsigned int listProperty = element.Properties.size();
+  unsigned int column = 0; // of the list, for ASCII faces
+  for(unsigned int property = 0; property < element.Properties.size(); ++property)
+    {
+    const std::string& name = element.Properties[property].Name;
+    if(element.Properties[property].IsList && (name == "vertex_indices" || name == "vertex_index"))
+      {
+      listProperty = property;
+      break;
+      }
+    if(element.Properties[property].IsList)
+      {
+      std::cerr << "Faces with a list before the vertex indices are not supported!" << std::endl;
+      return false;
+      }
+    column++;
+    }
+  if(listProperty == element.Properties.size())
+    {
+    std::cerr << "The faces have no vertex_indices!" << std::endl;
+    return false;
+    }
+
+  std::vector<vtkIdType> connectivity;
+  connectivity.reserve(4 * element.Count);
+  std::vector<double> indices;
+  std::string line;
+  for(vtkIdType face = 0; face < element.Count; ++face)
+    {
+    if(ascii)
+      {
+      std::vector<double> values;
+      if(!GetLine(file, line) || !ParseValues(line, column + 1, values))
+        {
+        std::cerr << "Could not read face " << face << "!" << std::endl;
+        return false;
+        }
+      unsigned int count = static_cast<unsigned int>(values[column]);
+      if(!ParseValues(line, column + 1 + count, values))
+        {
+        std::cerr << "Could not read face " << face << "!" << std::endl;
+        return false;
+        }
+      indices.assign(values.begin() + column + 1, values.end());
+      }
+    else if(!ReadBinaryPLYInstance(file, element, swapBytes, listProperty, &indices))
+      {
+      std::cerr << "The file ends after " << face << " of " << element.Count << " faces!" << std::endl;
+      return false;
+      }
+
+    connectivity.push_back(indices.size());
+    for(unsigned int i = 0; i < indices.size(); ++i)
+      {
+      vtkIdType pointId = static_cast<vtkIdType>(indices[i]);
+      if(pointId < 0 || pointId >= numberOfPoints)
+        {
+        std::cerr << "Face " << face << " refers to point " << pointId << ", which does not exist!" << std::endl;
+        return false;
+        }
+      connectivity.push_back(pointId);
+      }
+    }
+
+  vtkSmartPointer<vtkIdTypeArray> cells = vtkSmartPointer<vtkIdTypeArray>::New();
+  cells->SetNumberOfTuples(connectivity.size());
+  if(!connectivity.empty())
+    {
+    memcpy(cells->GetPointer(0), &connectivity[0], connectivity.size() * sizeof(vtkIdType));
+    }
+  faces->SetCells(element.Count, cells);
+  return true;
+}
+
+// Decompress an LZF block (the compression of binary_compressed PCD files)
+bool DecompressLZF(const unsigned char* input, const unsigned int inputSize, unsigned char* output, const unsigned int outputSize)
+{
+  const unsigned char* in = input;
+  const unsigned char* inEnd = input + inputSize;
+  unsigned char* out = output;
+  unsigned char* outEnd = output + outputSize;
+
+  while(in < inEnd)
+    {
+    unsigned int control = *in++;
+    if(control < 32)
+      {
+      // A run of control + 1 literal bytes
+      unsigned int length = control + 1;
+      if(in + length > inEnd || out + length > outEnd)
+        {
+        return false;
+        }
+      memcpy(out, in, length);
+      in += length;
+      out += length;
+      }
+    else
+      {
+      // A back reference; the source may overlap the output, so copy byte by byte
+      unsigned int length = control >> 5;
+      if(length == 7)
+        {
+        if(in >= inEnd)
+          {
+          return false;
+          }
+        length += *in++;
+        }
+      length += 2;
+      if(in >= inEnd)
+        {
+        return false;
+        }
+      unsigned int distance = ((control & 0x1f) << 8) + *in++ + 1;
+      if(static_cast<unsigned int>(out - output) < distance || out + length > outEnd)
+        {
+        return false;
+        }
+      const unsigned char* reference = out - distance;
+      for(unsigned int i = 0; i < length; ++i)
+        {
+        *out++ = *reference++;
+        }
+      }
+    }
+  return out == outEnd;
+}
+
+} // end anonymous namespace
+
+namespace PointCloudReader
+{
+
+bool Read(const std::string& fileName, vtkPolyData* output, double origin[3])
+{
+  std::string extension = Extension(fileName);
+  if(extension == "vtp")
+    {
+    return ReadVTP(fileName, output, origin);
+    }
+  if(extension == "las" || extension == "laz")
+    {
+    return ReadLAS(fileName, output, origin);
+    }
+  if(extension == "ply")
+    {
+    return ReadPLY(fileName, output, origin);
+    }
+  if(extension == "pcd")
+    {
+    return ReadPCD(fileName, output, origin);
+    }
+
+  std::cerr << "Unknown point cloud format: " << fileName << std::endl;
+  return false;
+}
+
+bool ReadVTP(const std::string& fileName, vtkPolyData* output, double origin[3])
+{
+  vtkSmartPointer<vtkXMLPolyDataReader> reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
+  reader->SetFileName(fileName.c_str());
+  reader->Update();
+  if(reader->GetOutput()->GetNumberOfPoints() == 0)
+    {
+    std::cerr << "No points could be read from " << fileName << "!" << std::endl;
+    return false;
+    }
+
+  output->ShallowCopy(reader->GetOutput());
+  Helpers::ShiftToLocalOrigin(output, origin);
+  return true;
+}
+
+bool ReadLAS(const std::string& fileName, vtkPolyData* output, double origin[3])
+{
+  std::ifstream file(fileName.c_str(), std::ios::binary);
+  if(!file)
+    {
+    std::cerr << "Could not open " << fileName << "!" << std::endl;
+    return false;
+    }
+
+  // The public header block. Everything in LAS is little endian.
+  const bool swapBytes = !IsLittleEndian();
+  char header[375];
+  memset(header, 0, sizeof(header));
+  file.read(header, 227);
+  if(file.gcount() != 227 || strncmp(header, "LASF", 4) != 0)
+    {
+    std::cerr << fileName << " is not a LAS file!" << std::endl;
+    return false;
+    }
+
+  const unsigned int versionMinor = static_cast<unsigned char>(header[25]);
+  const unsigned int headerSize = static_cast<unsigned int>(ReadScalar(header + 94, UInt16, swapBytes));
+  if(headerSize > 227)
+    {
+    file.read(header + 227, std::min(headerSize, static_cast<unsigned int>(sizeof(header))) - 227);
+    }
+
+  const unsigned int pointFormatByte = static_cast<unsigned char>(header[104]);
+  if((pointFormatByte & 0xc0) || Extension(fileName) == "laz")
+    {
+    std::cerr << fileName << " is compressed (LAZ), which needs LASzip. Decompress it to LAS first, "
+              << "for example with 'laszip -i " << fileName << " -o out.las'." << std::endl;
+    return false;
+    }
+  const unsigned int pointFormat = pointFormatByte & 0x3f;
+  if(pointFormat > 10)
+    {
+    std::cerr << "Unknown LAS point format " << pointFormat << "!" << std::endl;
+    return false;
+    }
+
+  const vtkIdType pointDataOffset = static_cast<vtkIdType>(ReadScalar(header + 96, UInt32, swapBytes));
+  const vtkIdType recordSize = static_cast<vtkIdType>(ReadScalar(header + 105, UInt16, swapBytes));
+  vtkIdType numberOfPoints = static_cast<vtkIdType>(ReadScalar(header + 107, UInt32, swapBytes));
+  if(versionMinor >= 4 && headerSize >= 375 && numberOfPoints == 0)
+    {
+    // 1.4 keeps the 64 bit count separately; the legacy count is 0 for large files
+    unsigned int low = 0;
+    unsigned int high = 0;
+    ReadScalar(header + 247, UInt32, swapBytes, &low);
+    ReadScalar(header + 251, UInt32, swapBytes, &high);
+    numberOfPoints = static_cast<vtkIdType>((static_cast<unsigned long long>(high) << 32) | low);
+    }
+  if(numberOfPoints == 0)
+    {
+    std::cerr << fileName << " has no points!" << std::endl;
+    return false;
+    }
+
+  RecordLayout layout;
+  InitializeLayout(layout);
+  layout.SwapBytes = swapBytes;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    SetField(layout, static_cast<Attribute>(X + d), Int32, 4 * d, recordSize);
+    layout.Scale[d] = ReadScalar(header + 131 + 8 * d, Float64, swapBytes);
+    layout.Offset[d] = ReadScalar(header + 155 + 8 * d, Float64, swapBytes);
+    }
+  SetField(layout, Intensity, UInt16, 12, recordSize);
+  if(pointFormat < 6)
+    {
+    // The class is the low 5 bits; the others are flags. The return number is the low 3 bits of byte 14.
+    SetField(layout, Classification, UInt8, 15, recordSize, 0, 0x1f);
+    SetField(layout, ReturnNumber, UInt8, 14, recordSize, 0, 0x7);
+    }
+  else
+    {
+    SetField(layout, Classification, UInt8, 16, recordSize);
+    SetField(layout, ReturnNumber, UInt8, 14, recordSize, 0, 0xf);
+    }
+
+  int colorOffset = -1;
+  if(pointFormat == 2)
+    {
+    colorOffset = 20;
+    }
+  else if(pointFormat == 3 || pointFormat == 5)
+    {
+    colorOffset = 28;
+    }
+  else if(pointFormat == 7 || pointFormat == 8 || pointFormat == 10)
+    {
+    colorOffset = 30;
+    }
+  if(colorOffset >= 0)
+    {
+    SetField(layout, Red, UInt16, colorOffset, recordSize);
+    SetField(layout, Green, UInt16, colorOffset + 2, recordSize);
+    SetField(layout, Blue, UInt16, colorOffset + 4, recordSize);
+    }
+
+  // Max and min of each coordinate are in the header, so the origin is known before the points are read
+  double bounds[6];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    bounds[2 * d + 1] = ReadScalar(header + 179 + 16 * d, Float64, swapBytes);
+    bounds[2 * d] = ReadScalar(header + 187 + 16 * d, Float64, swapBytes);
+    }
+  Helpers::ChooseLocalOrigin(bounds, origin);
+  ReportOrigin(origin, false);
+
+  file.seekg(pointDataOffset, std::ios::beg);
+  if(colorOffset >= 0)
+    {
+    std::vector<char> sample(std::min(numberOfPoints, static_cast<vtkIdType>(65536)) * recordSize);
+    file.read(&sample[0], sample.size());
+    if(ColorsUse16Bits(&sample[0], file.gcount() / recordSize, layout))
+      {
+      for(unsigned int attribute = Red; attribute <= Blue; ++attribute)
+        {
+        layout.Fields[attribute].Shift = 8;
+        layout.Fields[attribute].Mask = 0xff;
+        }
+      }
+    file.clear();
+    file.seekg(pointDataOffset, std::ios::beg);
+    }
+
+  PointCloudArrays arrays;
+  AllocateArrays(layout, numberOfPoints, arrays);
+  vtkIdType numberOfInvalidPoints = 0;
+  if(!ReadRecords(file, numberOfPoints, recordSize, layout, origin, arrays, numberOfInvalidPoints))
+    {
+    return false;
+    }
+
+  AssembleOutput(arrays, NULL, output);
+  return true;
+}
+
+bool ReadPLY(const std::string& fileName, vtkPolyData* output, double origin[3])
+{
+  std::ifstream file(fileName.c_str(), std::ios::binary);
+  std::string line;
+  if(!file || !GetLine(file, line) || line != "ply")
+    {
+    std::cerr << fileName << " is not a PLY file!" << std::endl;
+    return false;
+    }
+
+  std::string format;
+  std::vector<PLYElement> elements;
+  while(GetLine(file, line) && line != "end_header")
+    {
+    std::stringstream ss(line);
+    std::string keyword;
+    ss >> keyword;
+    if(keyword == "format")
+      {
+      ss >> format;
+      }
+    else if(keyword == "element")
+      {
+      PLYElement element;
+      ss >> element.Name >> element.Count;
+      elements.push_back(element);
+      }
+    else if(keyword == "property" && !elements.empty())
+      {
+      PLYProperty property;
+      std::string type;
+      ss >> type;
+      property.IsList = (type == "list");
+      property.CountType = UInt8;
+      if(property.IsList)
+        {
+        std::string countType;
+        ss >> countType >> type;
+        if(!ParseScalarType(countType, property.CountType))
+          {
+          std::cerr << "Unknown PLY type " << countType << "!" << std::endl;
+          return false;
+          }
+        }
+      if(!ParseScalarType(type, property.Type))
+        {
+        std::cerr << "Unknown PLY type " << type << "!" << std::endl;
+        return false;
+        }
+      ss >> property.Name;
+      elements[elements.size() - 1].Properties.push_back(property);
+      }
+    }
+
+  const bool ascii = (format == "ascii");
+  if(!ascii && format != "binary_little_endian" && format != "binary_big_endian")
+    {
+    std::cerr << "Unknown PLY format " << format << "!" << std::endl;
+    return false;
+    }
+  const bool swapBytes = !ascii && ((format == "binary_little_endian") != IsLittleEndian());
+
+  PointCloudArrays arrays;
+  vtkSmartPointer<vtkCellArray> faces = vtkSmartPointer<vtkCellArray>::New();
+  bool foundVertices = false;
+  bool singlePrecision = false;
+  vtkIdType numberOfPoints = 0;
+  vtkIdType numberOfInvalidPoints = 0;
+  for(unsigned int e = 0; e < elements.size(); ++e)
+    {
+    const PLYElement& element = elements[e];
+
+    bool hasLists = false;
+    vtkIdType recordSize = 0;
+    for(unsigned int property = 0; property < element.Properties.size(); ++property)
+      {
+      hasLists = hasLists || element.Properties[property].IsList;
+      recordSize += SizeOf(element.Properties[property].Type);
+      }
+
+    if(element.Name == "vertex")
+      {
+      if(hasLists)
+        {
+        std::cerr << "Vertices with list properties are not supported!" << std::endl;
+        return false;
+        }
+
+      RecordLayout layout;
+      InitializeLayout(layout);
+      layout.SwapBytes = swapBytes;
+      vtkIdType offset = 0;
+      for(unsigned int property = 0; property < element.Properties.size(); ++property)
+        {
+        const PLYProperty& p = element.Properties[property];
+        unsigned int attribute = AttributeFromName(p.Name);
+        if(attribute < NumberOfAttributes)
+          {
+          SetField(layout, static_cast<Attribute>(attribute), p.Type, ascii ? property : offset, recordSize);
+          if((attribute == Red || attribute == Green || attribute == Blue) && SizeOf(p.Type) == 2)
+            {
+            layout.Fields[attribute].Shift = 8;
+            layout.Fields[attribute].Mask = 0xff;
+            }
+          }
+        offset += SizeOf(p.Type);
+        }
+      if(!layout.Fields[X].Present || !layout.Fields[Y].Present || !layout.Fields[Z].Present)
+        {
+        std::cerr << "The PLY vertices have no x, y and z!" << std::endl;
+        return false;
+        }
+      singlePrecision = layout.Fields[X].Type != Float64;
+
+      numberOfPoints = element.Count;
+      AllocateArrays(layout, numberOfPoints, arrays);
+      if(ascii)
+        {
+        if(!ReadTextRecords(file, numberOfPoints, element.Properties.size(), layout, origin, arrays, numberOfInvalidPoints))
+          {
+          return false;
+          }
+        }
+      else
+        {
+        // Look at the first finite point to choose the origin, then read them all
+        ChooseOriginFromFile(file, numberOfPoints, recordSize, layout, origin);
+
+        if(!ReadRecords(file, numberOfPoints, recordSize, layout, origin, arrays, numberOfInvalidPoints))
+          {
+          return false;
+          }
+        }
+      foundVertices = true;
+      }
+    else if(element.Name == "face")
+      {
+      if(!foundVertices)
+        {
+        std::cerr << "The PLY faces come before the vertices, which is not supported!" << std::endl;
+        return false;
+        }
+      if(!ReadPLYFaces(file, element, ascii, swapBytes, numberOfPoints, faces))
+        {
+        return false;
+        }
+      }
+    else
+      {
+      // Skip elements we do not use
+      for(vtkIdType instance = 0; instance < element.Count; ++instance)
+        {
+        if(ascii)
+          {
+          GetLine(file, line);
+          }
+        else if(!hasLists)
+          {
+          file.seekg(static_cast<std::streamoff>(element.Count) * recordSize, std::ios::cur);
+          break;
+          }
+        else
+          {
+          ReadBinaryPLYInstance(file, element, swapBytes, element.Properties.size(), NULL);
+          }
+        }
+      }
+    }
+
+  if(!foundVertices)
+    {
+    std::cerr << fileName << " has no vertices!" << std::endl;
+    return false;
+    }
+
+  ReportOrigin(origin, singlePrecision);
+  if(numberOfInvalidPoints > 0 && faces->GetNumberOfCells() == 0)
+    {
+    RemoveInvalidPoints(arrays);
+    }
+  AssembleOutput(arrays, faces, output);
+  return true;
+}
+
+bool ReadPCD(const std::string& fileName, vtkPolyData* output, double origin[3])
+{
+  std::ifstream file(fileName.c_str(), std::ios::binary);
+  if(!file)
+    {
+    std::cerr << "Could not open " << fileName << "!" << std::endl;
+    return false;
+    }
+
+  std::vector<std::string> names;
+  std::vector<unsigned int> sizes;
+  std::vector<char> types;
+  std::vector<unsigned int> counts;
+  vtkIdType numberOfPoints = -1;
+  vtkIdType width = 0;
+  vtkIdType height = 1;
+  std::string data;
+  std::string line;
+  while(data.empty() && GetLine(file, line))
+    {
+    std::stringstream ss(line);
+    std::string keyword;
+    ss >> keyword;
+    if(keyword.empty() || keyword[0] == '#')
+      {
+      continue;
+      }
+
+    if(keyword == "FIELDS" || keyword == "COLUMNS")
+      {
+      std::string name;
+      while(ss >> name)
+        {
+        names.push_back(name);
+        }
+      }
+    else if(keyword == "SIZE")
+      {
+      unsigned int size;
+      while(ss >> size)
+        {
+        sizes.push_back(size);
+        }
+      }
+    else if(keyword == "TYPE")
+      {
+      char type;
+      while(ss >> type)
+        {
+        types.push_back(type);
+        }
+      }
+    else if(keyword == "COUNT")
+      {
+      unsigned int count;
+      while(ss >> count)
+        {
+        counts.push_back(count);
+        }
+      }
+    else if(keyword == "WIDTH")
+      {
+      ss >> width;
+      }
+    else if(keyword == "HEIGHT")
+      {
+      ss >> height;
+      }
+    else if(keyword == "POINTS")
+      {
+      ss >> numberOfPoints;
+      }
+    else if(keyword == "DATA")
+      {
+      ss >> data;
+      }
+    }
+
+  if(counts.empty())
+    {
+    counts.assign(names.size(), 1);
+    }
+  if(numberOfPoints < 0)
+    {
+    numberOfPoints = width * height;
+    }
+  if(data.empty() || names.empty() || sizes.size() != names.size() || types.size() != names.size() ||
+     counts.size() != names.size())
+    {
+    std::cerr << fileName << " does not have a valid PCD header!" << std::endl;
+    return false;
+    }
+
+  // Field f starts at fieldOffsets[f] in an interleaved record (or, compressed, at numberOfPoints * fieldOffsets[f])
+  RecordLayout layout;
+  InitializeLayout(layout);
+  std::vector<vtkIdType> fieldOffsets(names.size());
+  vtkIdType recordSize = 0;
+  unsigned int numberOfColumns = 0;
+  std::vector<unsigned int> columns(names.size());
+  for(unsigned int f = 0; f < names.size(); ++f)
+    {
+    fieldOffsets[f] = recordSize;
+    columns[f] = numberOfColumns;
+    recordSize += sizes[f] * counts[f];
+    numberOfColumns += counts[f];
+    }
+
+  const bool ascii = (data == "ascii");
+  const bool compressed = (data == "binary_compressed");
+  if(!ascii && !compressed && data != "binary")
+    {
+    std::cerr << "Unknown PCD data type " << data << "!" << std::endl;
+    return false;
+    }
+
+  for(unsigned int f = 0; f < names.size(); ++f)
+    {
+    vtkIdType offset = ascii ? columns[f] : (compressed ? numberOfPoints * fieldOffsets[f] : fieldOffsets[f]);
+    vtkIdType stride = compressed ? sizes[f] * counts[f] : recordSize;
+
+    std::string name = LowerCase(names[f]);
+    if(name == "rgb" || name == "rgba")
+      {
+      // Packed 0x00RRGGBB, usually declared as a float
+      ScalarType packedType = (types[f] == 'F') ? Float32 : UInt32;
+      SetField(layout, Red, packedType, offset, stride, 16, 0xff);
+      SetField(layout, Green, packedType, offset, stride, 8, 0xff);
+      SetField(layout, Blue, packedType, offset, stride, 0, 0xff);
+      continue;
+      }
+
+    unsigned int attribute = AttributeFromName(name);
+    if(attribute == NumberOfAttributes)
+      {
+      continue;
+      }
+
+    ScalarType type;
+    if(types[f] == 'F' && sizes[f] == 4)
+      {
+      type = Float32;
+      }
+    else if(types[f] == 'F' && sizes[f] == 8)
+      {
+      type = Float64;
+      }
+    else if(types[f] == 'U' || types[f] == 'I')
+      {
+      const ScalarType unsignedTypes[] = {UInt8, UInt16, UInt32, UInt32};
+      const ScalarType signedTypes[] = {Int8, Int16, Int32, Int32};
+      if(sizes[f] != 1 && sizes[f] != 2 && sizes[f] != 4)
+        {
+        std::cerr << "Unsupported PCD field size " << sizes[f] << " for " << names[f] << "!" << std::endl;
+        return false;
+        }
+      unsigned int index = sizes[f] == 1 ? 0 : (sizes[f] == 2 ? 1 : 2);
+      type = (types[f] == 'U') ? unsignedTypes[index] : signedTypes[index];
+      }
+    else
+      {
+      std::cerr << "Unsupported PCD field type " << types[f] << sizes[f] << " for " << names[f] << "!" << std::endl;
+      return false;
+      }
+    SetField(layout, static_cast<Attribute>(attribute), type, offset, stride);
+    }
+  if(!layout.Fields[X].Present || !layout.Fields[Y].Present || !layout.Fields[Z].Present)
+    {
+    std::cerr << "The PCD fields have no x, y and z!" << std::endl;
+    return false;
+    }
+  if(numberOfPoints == 0)
+    {
+    std::cerr << fileName << " has no points!" << std::endl;
+    return false;
+    }
+
+  PointCloudArrays arrays;
+  AllocateArrays(layout, numberOfPoints, arrays);
+  vtkIdType numberOfInvalidPoints = 0;
+  if(ascii)
+    {
+    if(!ReadTextRecords(file, numberOfPoints, numberOfColumns, layout, origin, arrays, numberOfInvalidPoints))
+      {
+      return false;
+      }
+    }
+  else
+    {
+    // PCL writes the data in the byte order of the machine, which is little endian in practice
+    layout.SwapBytes = !IsLittleEndian();
+
+    std::vector<char> block;
+    if(compressed)
+      {
+      // One LZF block holding each field as a separate array
+      char sizeBytes[8];
+      file.read(sizeBytes, 8);
+      unsigned int compressedSize = 0;
+      unsigned int uncompressedSize = 0;
+      ReadScalar(sizeBytes, UInt32, layout.SwapBytes, &compressedSize);
+      ReadScalar(sizeBytes + 4, UInt32, layout.SwapBytes, &uncompressedSize);
+      if(!file || uncompressedSize != numberOfPoints * recordSize)
+        {
+        std::cerr << "The compressed PCD data has the wrong size!" << std::endl;
+        return false;
+        }
+
+      if(uncompressedSize == 0)
+        {
+        std::cerr << "The PCD file has no points!" << std::endl;
+        return false;
+        }
+      if(compressedSize == 0)
+        {
+        std::cerr << "The compressed PCD data is corrupt!" << std::endl;
+        return false;
+        }
+
+      std::vector<unsigned char> compressedData(compressedSize);
+      file.read(reinterpret_cast<char*>(&compressedData[0]), compressedSize);
+      block.resize(uncompressedSize);
+      if(file.gcount() != static_cast<std::streamsize>(compressedSize) ||
+         !DecompressLZF(&compressedData[0], compressedSize, reinterpret_cast<unsigned char*>(&block[0]), uncompressedSize))
+        {
+        std::cerr << "The compressed PCD data is corrupt!" << std::endl;
+        return false;
+        }
+      ChooseOriginFromRecords(&block[0], numberOfPoints, layout, origin);
+      }
+    else
+      {
+      ChooseOriginFromFile(file, numberOfPoints, recordSize, layout, origin);
+      }
+
+    if(compressed)
+      {
+      numberOfInvalidPoints = DecodeBlock(&block[0], numberOfPoints, layout, origin, 0, arrays);
+      }
+    else if(!ReadRecords(file, numberOfPoints, recordSize, layout, origin, arrays, numberOfInvalidPoints))
+      {
+      return false;
+      }
+    }
+
+  ReportOrigin(origin, layout.Fields[X].Type != Float64);
+  if(numberOfInvalidPoints > 0)
+    {
+    RemoveInvalidPoints(arrays);
+    }
+  AssembleOutput(arrays, NULL, output);
+  return true;
+}
+
+} // end namespace
@@ -0,0 +1,57 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef POINTCLOUDREADER_H
+#define POINTCLOUDREADER_H
+
+// STL
+#include <string>
+
+class vtkPolyData;
+
+// Readers for the point cloud formats scans arrive in. All of them produce the same polydata:
+// float points relative to 'origin' (see Helpers::ShiftToLocalOrigin), one vertex per point
+// (or the faces, for PLY meshes) and, when the file has them, the point data arrays
+//   "Intensity"      float
+//   "RGB"            3 x unsigned char
+//   "Classification" unsigned char
+//   "ReturnNumber"   unsigned char
+// Fixed-size binary records are read in large blocks that are decoded in parallel;
+// ASCII data, PLY faces and compressed PCD blocks are necessarily read sequentially.
+// The readers return false, after printing why, if the file cannot be read.
+namespace PointCloudReader
+{
+
+// Pick the reader from the file extension (.vtp, .las, .ply or .pcd)
+bool Read(const std::string& fileName, vtkPolyData* output, double origin[3]);
+
+// VTK XML polydata, shifted to a local origin after reading
+bool ReadVTP(const std::string& fileName, vtkPolyData* output, double origin[3]);
+
+// ASPRS LAS 1.0 - 1.4, point formats 0 - 10. Compressed (LAZ) files are rejected.
+bool ReadLAS(const std::string& fileName, vtkPolyData* output, double origin[3]);
+
+// Stanford PLY, ASCII or binary of either byte order, with optional faces
+bool ReadPLY(const std::string& fileName, vtkPolyData* output, double origin[3]);
+
+// PCL PCD, ASCII, binary or binary_compressed. Points with NaN coordinates (organized clouds) are dropped.
+bool ReadPCD(const std::string& fileName, vtkPolyData* output, double origin[3]);
+
+} // end namespace
+
+#endif
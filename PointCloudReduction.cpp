@@ -0,0 +1,818 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "PointCloudReduction.h"
+
+// VTK
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+// Custom
+#include "Helpers.h"
+#include "Parallel.h"
+#include "PointIndex.h"
+
+namespace
+{
+
+// How each point data array of the input is carried over
+struct ArrayTransfer
+{
+  vtkDataArray* Input;
+  vtkSmartPointer<vtkDataArray> Output;
+  bool Averaged;
+  unsigned int FirstSum; // of its components in the per-voxel sums of averaged values
+};
+
+// Create the output arrays and work out which are averaged. Returns the number of averaged components.
+unsigned int PrepareArrays(vtkPolyData* input, const vtkIdType numberOfOutputPoints, std::vector<ArrayTransfer>& transfers)
+{
+  transfers.clear();
+  unsigned int numberOfSums = 0;
+  vtkPointData* pointData = input->GetPointData();
+  for(int i = 0; i < pointData->GetNumberOfArrays(); ++i)
+    {
+    vtkDataArray* array = pointData->GetArray(i);
+    if(!array || (array->GetName() && strcmp(array->GetName(), "OriginalPointId") == 0))
+      {
+      continue;
+      }
+
+    ArrayTransfer transfer;
+    transfer.Input = array;
+    transfer.Output.TakeReference(array->NewInstance());
+    transfer.Output->SetName(array->GetName());
+    transfer.Output->SetNumberOfComponents(array->GetNumberOfComponents());
+    transfer.Output->SetNumberOfTuples(numberOfOutputPoints);
+    transfer.Averaged = array->GetDataType() == VTK_FLOAT || array->GetDataType() == VTK_DOUBLE ||
+                        array->GetNumberOfComponents() >= 3;
+    transfer.FirstSum = numberOfSums;
+    if(transfer.Averaged)
+      {
+      numberOfSums += array->GetNumberOfComponents();
+      }
+    transfers.push_back(transfer);
+    }
+  return numberOfSums;
+}
+
+// The id recorded for input point 'pointId': its own, or the one it already stands for if the input was reduced
+vtkIdType OriginalId(vtkIdTypeArray* inputOriginalIds, const vtkIdType pointId)
+{
+  return inputOriginalIds ? inputOriginalIds->GetValue(pointId) : pointId;
+}
+
+void FinishOutput(vtkPolyData* input, vtkFloatArray* coordinates, vtkIdTypeArray* originalIds,
+                  const std::vector<ArrayTransfer>& transfers, vtkPolyData* output)
+{
+  output->Initialize();
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetData(coordinates);
+  output->SetPoints(points);
+  Helpers::AddVertices(output);
+
+  for(unsigned int i = 0; i < transfers.size(); ++i)
+    {
+    output->GetPointData()->AddArray(transfers[i].Output);
+    }
+  originalIds->SetName("OriginalPointId");
+  output->GetPointData()->AddArray(originalIds);
+
+  std::cout << "Reduced " << input->GetNumberOfPoints() << " points to " << output->GetNumberOfPoints() << "." << std::endl;
+}
+
+// Copy the selected points and all their point data
+struct SelectionFunctor
+{
+  vtkPoints* InputPoints;
+  vtkIdTypeArray* InputOriginalIds;
+  const vtkIdType* Selected;
+  float* Coordinates;
+  vtkIdType* OriginalIds;
+  const std::vector<ArrayTransfer>* Transfers;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      vtkIdType pointId = this->Selected[i];
+      double p[3];
+      this->InputPoints->GetPoint(pointId, p);
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        this->Coordinates[3 * i + d] = static_cast<float>(p[d]);
+        }
+      this->OriginalIds[i] = OriginalId(this->InputOriginalIds, pointId);
+      for(unsigned int a = 0; a < this->Transfers->size(); ++a)
+        {
+        const ArrayTransfer& transfer = (*this->Transfers)[a];
+        transfer.Output->SetTuple(i, pointId, transfer.Input);
+        }
+      }
+  }
+};
+
+void AssembleSelection(vtkPolyData* input, const std::vector<vtkIdType>& selected, vtkPolyData* output)
+{
+  const vtkIdType numberOfSelected = selected.size();
+  std::vector<ArrayTransfer> transfers;
+  PrepareArrays(input, numberOfSelected, transfers);
+
+  vtkSmartPointer<vtkFloatArray> coordinates = vtkSmartPointer<vtkFloatArray>::New();
+  coordinates->SetNumberOfComponents(3);
+  coordinates->SetNumberOfTuples(numberOfSelected);
+  vtkSmartPointer<vtkIdTypeArray> originalIds = vtkSmartPointer<vtkIdTypeArray>::New();
+  originalIds->SetNumberOfTuples(numberOfSelected);
+
+  if(numberOfSelected > 0)
+    {
+    SelectionFunctor selection;
+    selection.InputPoints = input->GetPoints();
+    selection.InputOriginalIds = vtkIdTypeArray::SafeDownCast(input->GetPointData()->GetArray("OriginalPointId"));
+    selection.Selected = &selected[0];
+    selection.Coordinates = coordinates->GetPointer(0);
+    selection.OriginalIds = originalIds->GetPointer(0);
+    selection.Transfers = &transfers;
+    Parallel::For(0, numberOfSelected, selection);
+    }
+
+  FinishOutput(input, coordinates, originalIds, transfers, output);
+}
+
+// The summary of the voxels of a range of grid cells
+struct VoxelResults
+{
+  std::vector<vtkIdType> Representatives;
+  std::vector<float> Centroids;
+  std::vector<double> Averages; // numberOfSums per voxel
+};
+
+struct VoxelFunctor
+{
+  const PointIndex* Index;
+  vtkPoints* Points;
+  double VoxelSize;
+  unsigned int VoxelsPerCell;
+  const std::vector<ArrayTransfer>* Transfers;
+  unsigned int NumberOfSums;
+  std::vector<VoxelResults>* Results; // per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    VoxelResults& results = (*this->Results)[threadId];
+    const double* origin = this->Index->GetOrigin();
+    const unsigned int* dimensions = this->Index->GetDimensions();
+    const unsigned int* ids = this->Index->GetIds();
+    const double cellSize = this->VoxelsPerCell * this->VoxelSize;
+    const double limit = this->VoxelsPerCell - 1;
+
+    std::vector<std::pair<unsigned int, unsigned int> > keys; // (voxel in the cell, point id)
+    std::vector<double> sums(this->NumberOfSums);
+    for(vtkIdType cell = begin; cell < end; ++cell)
+      {
+      unsigned int first;
+      unsigned int last;
+      this->Index->GetCellRange(static_cast<unsigned int>(cell), first, last);
+      if(first == last)
+        {
+        continue;
+        }
+
+      unsigned int cellIndex[3];
+      cellIndex[0] = static_cast<unsigned int>(cell % dimensions[0]);
+      cellIndex[1] = static_cast<unsigned int>((cell / dimensions[0]) % dimensions[1]);
+      cellIndex[2] = static_cast<unsigned int>(cell / (static_cast<vtkIdType>(dimensions[0]) * dimensions[1]));
+      double corner[3];
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        corner[d] = origin[d] + cellIndex[d] * cellSize;
+        }
+
+      // Sort the points of the cell by voxel
+      keys.clear();
+      for(unsigned int i = first; i < last; ++i)
+        {
+        double p[3];
+        this->Points->GetPoint(ids[i], p);
+        unsigned int voxel[3];
+        for(unsigned int d = 0; d < 3; ++d)
+          {
+          voxel[d] = static_cast<unsigned int>(std::max(0.0, std::min(limit, floor((p[d] - corner[d]) / this->VoxelSize))));
+          }
+        unsigned int key = (voxel[2] * this->VoxelsPerCell + voxel[1]) * this->VoxelsPerCell + voxel[0];
+        keys.push_back(std::make_pair(key, ids[i]));
+        }
+      std::sort(keys.begin(), keys.end());
+
+      // Summarize each run of equal voxels
+      for(unsigned int runBegin = 0; runBegin < keys.size(); )
+        {
+        unsigned int runEnd = runBegin;
+        double centroid[3] = {0, 0, 0};
+        std::fill(sums.begin(), sums.end(), 0.0);
+        while(runEnd < keys.size() && keys[runEnd].first == keys[runBegin].first)
+          {
+          vtkIdType pointId = keys[runEnd].second;
+          double p[3];
+          this->Points->GetPoint(pointId, p);
+          for(unsigned int d = 0; d < 3; ++d)
+            {
+            centroid[d] += p[d];
+            }
+          for(unsigned int a = 0; a < this->Transfers->size(); ++a)
+            {
+            const ArrayTransfer& transfer = (*this->Transfers)[a];
+            if(transfer.Averaged)
+              {
+              for(int c = 0; c < transfer.Input->GetNumberOfComponents(); ++c)
+                {
+                sums[transfer.FirstSum + c] += transfer.Input->GetComponent(pointId, c);
+                }
+              }
+            }
+          runEnd++;
+          }
+
+        const double count = runEnd - runBegin;
+        for(unsigned int d = 0; d < 3; ++d)
+          {
+          centroid[d] /= count;
+          }
+
+        vtkIdType representative = keys[runBegin].second;
+        double nearest = -1;
+        for(unsigned int i = runBegin; i < runEnd; ++i)
+          {
+          double p[3];
+          this->Points->GetPoint(keys[i].second, p);
+          double distance = 0;
+          for(unsigned int d = 0; d < 3; ++d)
+            {
+            distance += (p[d] - centroid[d]) * (p[d] - centroid[d]);
+            }
+          if(nearest < 0 || distance < nearest)
+            {
+            nearest = distance;
+            representative = keys[i].second;
+            }
+          }
+
+        results.Representatives.push_back(representative);
+        for(unsigned int d = 0; d < 3; ++d)
+          {
+          results.Centroids.push_back(static_cast<float>(centroid[d]));
+          }
+        for(unsigned int s = 0; s < sums.size(); ++s)
+          {
+          results.Averages.push_back(sums[s] / count);
+          }
+        runBegin = runEnd;
+        }
+      }
+  }
+};
+
+// Write the per thread voxel results into the output arrays, each thread at its offset
+struct VoxelOutputFunctor
+{
+  const std::vector<VoxelResults>* Results;
+  const std::vector<vtkIdType>* Offsets;
+  vtkIdTypeArray* InputOriginalIds;
+  const std::vector<ArrayTransfer>* Transfers;
+  unsigned int NumberOfSums;
+  float* Coordinates;
+  vtkIdType* OriginalIds;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType thread = begin; thread < end; ++thread)
+      {
+      const VoxelResults& results = (*this->Results)[thread];
+      const vtkIdType offset = (*this->Offsets)[thread];
+      if(results.Representatives.empty())
+        {
+        continue;
+        }
+      memcpy(this->Coordinates + 3 * offset, &results.Centroids[0], results.Centroids.size() * sizeof(float));
+      for(unsigned int v = 0; v < results.Representatives.size(); ++v)
+        {
+        const vtkIdType pointId = offset + v;
+        const vtkIdType representative = results.Representatives[v];
+        this->OriginalIds[pointId] = OriginalId(this->InputOriginalIds, representative);
+        for(unsigned int a = 0; a < this->Transfers->size(); ++a)
+          {
+          const ArrayTransfer& transfer = (*this->Transfers)[a];
+          if(!transfer.Averaged)
+            {
+            transfer.Output->SetTuple(pointId, representative, transfer.Input);
+            continue;
+            }
+          const bool integral = transfer.Output->GetDataType() != VTK_FLOAT && transfer.Output->GetDataType() != VTK_DOUBLE;
+          for(int c = 0; c < transfer.Output->GetNumberOfComponents(); ++c)
+            {
+            double value = results.Averages[v * this->NumberOfSums + transfer.FirstSum + c];
+            transfer.Output->SetComponent(pointId, c, integral ? floor(value + 0.5) : value);
+            }
+          }
+        }
+      }
+  }
+};
+
+// A well mixed hash of the point id, so neighboring points are kept independently
+unsigned int Hash(unsigned int x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+struct RandomCountFunctor
+{
+  unsigned int Threshold;
+  std::vector<vtkIdType>* Counts; // per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    vtkIdType count = 0;
+    for(vtkIdType pointId = begin; pointId < end; ++pointId)
+      {
+      if(Hash(static_cast<unsigned int>(pointId)) < this->Threshold)
+        {
+        count++;
+        }
+      }
+    (*this->Counts)[threadId] = count;
+  }
+};
+
+struct RandomSelectFunctor
+{
+  unsigned int Threshold;
+  const std::vector<vtkIdType>* Offsets; // per thread
+  vtkIdType* Selected;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    vtkIdType* selected = this->Selected + (*this->Offsets)[threadId];
+    for(vtkIdType pointId = begin; pointId < end; ++pointId)
+      {
+      if(Hash(static_cast<unsigned int>(pointId)) < this->Threshold)
+        {
+        *selected++ = pointId;
+        }
+      }
+  }
+};
+
+// Accept points of the cells of one phase. Accepted points are moved to the front of their cell's range of Order.
+struct PoissonFunctor
+{
+  const PointIndex* Index;
+  vtkPoints* Points;
+  double Radius;
+  unsigned int Phase[3];
+  unsigned int PhaseDimensions[3];
+  unsigned int* Order;
+  unsigned int* AcceptedCounts; // per cell
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    const unsigned int* dimensions = this->Index->GetDimensions();
+    const double radius2 = this->Radius * this->Radius;
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      unsigned int cellIndex[3];
+      cellIndex[0] = this->Phase[0] + 3 * static_cast<unsigned int>(i % this->PhaseDimensions[0]);
+      cellIndex[1] = this->Phase[1] + 3 * static_cast<unsigned int>((i / this->PhaseDimensions[0]) % this->PhaseDimensions[1]);
+      cellIndex[2] = this->Phase[2] + 3 * static_cast<unsigned int>(i / (static_cast<vtkIdType>(this->PhaseDimensions[0]) * this->PhaseDimensions[1]));
+      const unsigned int cell = (cellIndex[2] * dimensions[1] + cellIndex[1]) * dimensions[0] + cellIndex[0];
+
+      unsigned int first;
+      unsigned int last;
+      this->Index->GetCellRange(cell, first, last);
+      for(unsigned int candidate = first; candidate < last; ++candidate)
+        {
+        double p[3];
+        this->Points->GetPoint(this->Order[candidate], p);
+        if(this->Conflicts(cellIndex, p, radius2))
+          {
+          continue;
+          }
+        std::swap(this->Order[candidate], this->Order[first + this->AcceptedCounts[cell]]);
+        this->AcceptedCounts[cell]++;
+        }
+      }
+  }
+
+  // Is there an accepted point within the radius of p, in its cell or a neighbor?
+  bool Conflicts(const unsigned int cellIndex[3], const double p[3], const double radius2) const
+  {
+    const unsigned int* dimensions = this->Index->GetDimensions();
+    for(int dz = -1; dz <= 1; ++dz)
+      {
+      int z = static_cast<int>(cellIndex[2]) + dz;
+      if(z < 0 || z >= static_cast<int>(dimensions[2]))
+        {
+        continue;
+        }
+      for(int dy = -1; dy <= 1; ++dy)
+        {
+        int y = static_cast<int>(cellIndex[1]) + dy;
+        if(y < 0 || y >= static_cast<int>(dimensions[1]))
+          {
+          continue;
+          }
+        for(int dx = -1; dx <= 1; ++dx)
+          {
+          int x = static_cast<int>(cellIndex[0]) + dx;
+          if(x < 0 || x >= static_cast<int>(dimensions[0]))
+            {
+            continue;
+            }
+          const unsigned int neighbor = (z * dimensions[1] + y) * dimensions[0] + x;
+          unsigned int first;
+          unsigned int last;
+          this->Index->GetCellRange(neighbor, first, last);
+          for(unsigned int a = first; a < first + this->AcceptedCounts[neighbor]; ++a)
+            {
+            double q[3];
+            this->Points->GetPoint(this->Order[a], q);
+            double distance = (p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]) + (p[2] - q[2]) * (p[2] - q[2]);
+            if(distance < radius2)
+              {
+              return true;
+              }
+            }
+          }
+        }
+      }
+    return false;
+  }
+};
+
+// Select the points of a block of grid cells that are inside the crop region
+struct CropFunctor
+{
+  const PointIndex* Index;
+  vtkPoints* Points;
+  const PointCloudReduction::CropRegion* Region;
+  unsigned int First[3]; // the block's lowest cell
+  unsigned int BlockDimensions[3];
+  std::vector<std::vector<vtkIdType> >* Selected; // per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    std::vector<vtkIdType>& selected = (*this->Selected)[threadId];
+    const double* origin = this->Index->GetOrigin();
+    const double cellSize = this->Index->GetCellSize();
+    const unsigned int* dimensions = this->Index->GetDimensions();
+    const unsigned int* ids = this->Index->GetIds();
+    for(vtkIdType blockCell = begin; blockCell < end; ++blockCell)
+      {
+      unsigned int c[3];
+      c[0] = this->First[0] + blockCell % this->BlockDimensions[0];
+      c[1] = this->First[1] + (blockCell / this->BlockDimensions[0]) % this->BlockDimensions[1];
+      c[2] = this->First[2] + blockCell / (this->BlockDimensions[0] * this->BlockDimensions[1]);
+      unsigned int first;
+      unsigned int last;
+      this->Index->GetCellRange((c[2] * dimensions[1] + c[1]) * dimensions[0] + c[0], first, last);
+      if(first == last)
+        {
+        continue;
+        }
+
+      double lower[3];
+      double upper[3];
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        lower[d] = origin[d] + c[d] * cellSize;
+        upper[d] = lower[d] + cellSize;
+        }
+      int side = this->Region->Classify(lower, upper);
+      if(side < 0)
+        {
+        continue;
+        }
+      for(unsigned int i = first; i < last; ++i)
+        {
+        double p[3];
+        this->Points->GetPoint(ids[i], p);
+        if(side > 0 || this->Region->Contains(p))
+          {
+          selected.push_back(ids[i]);
+          }
+        }
+      }
+  }
+};
+
+} // end anonymous namespace
+
+namespace PointCloudReduction
+{
+
+void VoxelGrid(vtkPolyData* input, const double voxelSize, vtkPolyData* output)
+{
+  vtkPoints* points = input->GetPoints();
+  if(!points || points->GetNumberOfPoints() == 0 || voxelSize <= 0)
+    {
+    std::cerr << "Nothing to reduce!" << std::endl;
+    return;
+    }
+
+  // The index cells are blocks of whole voxels; their number is capped, so very large clouds get larger blocks
+  double bounds[6];
+  points->GetBounds(bounds);
+  double extent[3] = {bounds[1] - bounds[0], bounds[3] - bounds[2], bounds[5] - bounds[4]};
+  double size = voxelSize;
+  unsigned int voxelsPerCell = 16;
+  while(PointIndex::ComputeNumberOfCells(extent, voxelsPerCell * size) > PointIndex::GetMaximumNumberOfCells())
+    {
+    if(voxelsPerCell < 1024)
+      {
+      voxelsPerCell *= 2;
+      }
+    else
+      {
+      size *= 2;
+      }
+    }
+  if(size != voxelSize)
+    {
+    std::cout << "The voxels were enlarged to " << size << " to fit the extent of the point cloud." << std::endl;
+    }
+
+  PointIndex index;
+  index.Build(points, voxelsPerCell * size);
+  const unsigned int* dimensions = index.GetDimensions();
+  const vtkIdType numberOfCells = static_cast<vtkIdType>(dimensions[0]) * dimensions[1] * dimensions[2];
+
+  std::vector<ArrayTransfer> transfers;
+  const unsigned int numberOfSums = PrepareArrays(input, 0, transfers);
+
+  std::vector<VoxelResults> results(Parallel::GetNumberOfThreads());
+  VoxelFunctor voxels;
+  voxels.Index = &index;
+  voxels.Points = points;
+  voxels.VoxelSize = size;
+  voxels.VoxelsPerCell = voxelsPerCell;
+  voxels.Transfers = &transfers;
+  voxels.NumberOfSums = numberOfSums;
+  voxels.Results = &results;
+  Parallel::For(0, numberOfCells, voxels);
+
+  // Each thread handled a contiguous range of cells, so concatenating in thread order keeps the cell order
+  std::vector<vtkIdType> offsets(results.size() + 1, 0);
+  for(unsigned int thread = 0; thread < results.size(); ++thread)
+    {
+    offsets[thread + 1] = offsets[thread] + results[thread].Representatives.size();
+    }
+  const vtkIdType numberOfVoxels = offsets[results.size()];
+  for(unsigned int a = 0; a < transfers.size(); ++a)
+    {
+    transfers[a].Output->SetNumberOfTuples(numberOfVoxels);
+    }
+
+  vtkSmartPointer<vtkFloatArray> coordinates = vtkSmartPointer<vtkFloatArray>::New();
+  coordinates->SetNumberOfComponents(3);
+  coordinates->SetNumberOfTuples(numberOfVoxels);
+  vtkSmartPointer<vtkIdTypeArray> originalIds = vtkSmartPointer<vtkIdTypeArray>::New();
+  originalIds->SetNumberOfTuples(numberOfVoxels);
+
+  if(numberOfVoxels > 0)
+    {
+    VoxelOutputFunctor write;
+    write.Results = &results;
+    write.Offsets = &offsets;
+    write.InputOriginalIds = vtkIdTypeArray::SafeDownCast(input->GetPointData()->GetArray("OriginalPointId"));
+    write.Transfers = &transfers;
+    write.NumberOfSums = numberOfSums;
+    write.Coordinates = coordinates->GetPointer(0);
+    write.OriginalIds = originalIds->GetPointer(0);
+    Parallel::For(0, static_cast<vtkIdType>(results.size()), write);
+    }
+
+  FinishOutput(input, coordinates, originalIds, transfers, output);
+}
+
+void PoissonDisk(vtkPolyData* input, const double radius, vtkPolyData* output)
+{
+  vtkPoints* points = input->GetPoints();
+  if(!points || points->GetNumberOfPoints() == 0 || radius <= 0)
+    {
+    std::cerr << "Nothing to reduce!" << std::endl;
+    return;
+    }
+
+  // Cells at least 'radius' wide, so conflicts can only be in neighboring cells
+  PointIndex index;
+  index.Build(points, radius);
+  const unsigned int* dimensions = index.GetDimensions();
+  const unsigned int numberOfCells = dimensions[0] * dimensions[1] * dimensions[2];
+
+  std::vector<unsigned int> order(index.GetIds(), index.GetIds() + points->GetNumberOfPoints());
+  std::vector<unsigned int> acceptedCounts(numberOfCells, 0);
+
+  PoissonFunctor poisson;
+  poisson.Index = &index;
+  poisson.Points = points;
+  poisson.Radius = radius;
+  poisson.Order = &order[0];
+  poisson.AcceptedCounts = &acceptedCounts[0];
+  for(unsigned int phase = 0; phase < 27; ++phase)
+    {
+    poisson.Phase[0] = phase % 3;
+    poisson.Phase[1] = (phase / 3) % 3;
+    poisson.Phase[2] = phase / 9;
+    vtkIdType numberOfPhaseCells = 1;
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      poisson.PhaseDimensions[d] = dimensions[d] > poisson.Phase[d] ? (dimensions[d] - poisson.Phase[d] + 2) / 3 : 0;
+      numberOfPhaseCells *= poisson.PhaseDimensions[d];
+      }
+    Parallel::For(0, numberOfPhaseCells, poisson);
+    }
+
+  std::vector<vtkIdType> selected;
+  for(unsigned int cell = 0; cell < numberOfCells; ++cell)
+    {
+    unsigned int first;
+    unsigned int last;
+    index.GetCellRange(cell, first, last);
+    for(unsigned int i = first; i < first + acceptedCounts[cell]; ++i)
+      {
+      selected.push_back(order[i]);
+      }
+    }
+  std::sort(selected.begin(), selected.end());
+
+  AssembleSelection(input, selected, output);
+}
+
+void Random(vtkPolyData* input, const double fraction, vtkPolyData* output)
+{
+  vtkPoints* points = input->GetPoints();
+  if(!points || points->GetNumberOfPoints() == 0 || fraction <= 0)
+    {
+    std::cerr << "Nothing to reduce!" << std::endl;
+    return;
+    }
+
+  const vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  const unsigned int threshold = static_cast<unsigned int>(std::min(1.0, fraction) * 4294967295.0);
+
+  // Count per thread, then let each thread write its points at its offset. Both passes split the range the same way.
+  std::vector<vtkIdType> counts(Parallel::GetNumberOfThreads(), 0);
+  RandomCountFunctor count;
+  count.Threshold = threshold;
+  count.Counts = &counts;
+  Parallel::For(0, numberOfPoints, count);
+
+  std::vector<vtkIdType> offsets(counts.size() + 1, 0);
+  for(unsigned int thread = 0; thread < counts.size(); ++thread)
+    {
+    offsets[thread + 1] = offsets[thread] + counts[thread];
+    }
+
+  std::vector<vtkIdType> selected(offsets[counts.size()]);
+  if(!selected.empty())
+    {
+    RandomSelectFunctor select;
+    select.Threshold = threshold;
+    select.Offsets = &offsets;
+    select.Selected = &selected[0];
+    Parallel::For(0, numberOfPoints, select);
+    }
+
+  AssembleSelection(input, selected, output);
+}
+
+CropRegion::CropRegion()
+{
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    this->Bounds[2 * d] = -HUGE_VAL;
+    this->Bounds[2 * d + 1] = HUGE_VAL;
+    }
+}
+
+void CropRegion::AddPlane(const double normal[3], const double point[3])
+{
+  this->Planes.push_back(normal[0]);
+  this->Planes.push_back(normal[1]);
+  this->Planes.push_back(normal[2]);
+  this->Planes.push_back(-(normal[0] * point[0] + normal[1] * point[1] + normal[2] * point[2]));
+}
+
+bool CropRegion::Contains(const double point[3]) const
+{
+  for(unsigned int i = 0; i < this->Planes.size(); i += 4)
+    {
+    const double* plane = &this->Planes[i];
+    if(plane[0] * point[0] + plane[1] * point[1] + plane[2] * point[2] + plane[3] > 0)
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+int CropRegion::Classify(const double lower[3], const double upper[3]) const
+{
+  int side = 1;
+  for(unsigned int i = 0; i < this->Planes.size(); i += 4)
+    {
+    // The corners of the box nearest to and farthest out of the plane
+    const double* plane = &this->Planes[i];
+    double nearest = plane[3];
+    double farthest = plane[3];
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      nearest += plane[d] * (plane[d] > 0 ? lower[d] : upper[d]);
+      farthest += plane[d] * (plane[d] > 0 ? upper[d] : lower[d]);
+      }
+    if(nearest > 0)
+      {
+      return -1;
+      }
+    if(farthest > 0)
+      {
+      side = 0;
+      }
+    }
+  return side;
+}
+
+void Crop(vtkPolyData* input, const PointIndex& index, const CropRegion& region, vtkPolyData* output)
+{
+  vtkPoints* points = input->GetPoints();
+  if(!points || points->GetNumberOfPoints() == 0 || index.GetPoints() != points)
+    {
+    std::cerr << "Nothing to crop!" << std::endl;
+    return;
+    }
+
+  // The block of cells overlapping the region's bounds
+  CropFunctor crop;
+  vtkIdType numberOfBlockCells = 1;
+  const double* origin = index.GetOrigin();
+  const unsigned int* dimensions = index.GetDimensions();
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    double first = std::max(0.0, floor((region.Bounds[2 * d] - origin[d]) / index.GetCellSize()));
+    double last = std::min(dimensions[d] - 1.0, floor((region.Bounds[2 * d + 1] - origin[d]) / index.GetCellSize()));
+    crop.First[d] = static_cast<unsigned int>(first);
+    crop.BlockDimensions[d] = last >= first ? static_cast<unsigned int>(last - first) + 1 : 0;
+    numberOfBlockCells *= crop.BlockDimensions[d];
+    }
+
+  std::vector<std::vector<vtkIdType> > threadSelected(Parallel::GetNumberOfThreads());
+  crop.Index = &index;
+  crop.Points = points;
+  crop.Region = &region;
+  crop.Selected = &threadSelected;
+  Parallel::For(0, numberOfBlockCells, crop);
+
+  std::vector<vtkIdType> selected;
+  for(unsigned int thread = 0; thread < threadSelected.size(); ++thread)
+    {
+    selected.insert(selected.end(), threadSelected[thread].begin(), threadSelected[thread].end());
+    }
+  std::sort(selected.begin(), selected.end());
+
+  AssembleSelection(input, selected, output);
+}
+
+} // end namespace
@@ -0,0 +1,74 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef POINTCLOUDREDUCTION_H
+#define POINTCLOUDREDUCTION_H
+
+// STL
+#include <vector>
+
+class vtkPolyData;
+class PointIndex;
+
+// Load-time reduction of dense scans. Each method fills 'output' with a subset or summary of the points of
+// 'input' (its cells are ignored), one vertex per output point and the point data carried over.
+// Every output point records the input point it stands for in the vtkIdType array "OriginalPointId",
+// so a point picked on the reduced cloud can be resolved to an exact full resolution point.
+// The work is done in parallel over a PointIndex grid; besides the output, the memory used is
+// about 12 bytes per input point.
+namespace PointCloudReduction
+{
+
+// Average the points in each cube of side voxelSize. The original point nearest to the average is
+// the one recorded. Floating point arrays and colors (3 or more components) are averaged;
+// other arrays, such as labels, are taken from the recorded point.
+void VoxelGrid(vtkPolyData* input, const double voxelSize, vtkPolyData* output);
+
+// Keep points so that no two kept points are closer than 'radius' (Poisson disk sampling).
+// The grid cells are processed in 27 interleaved phases, so cells processed at the same time never share a neighbor.
+void PoissonDisk(vtkPolyData* input, const double radius, vtkPolyData* output);
+
+// Keep each point with probability 'fraction'. The choice is a hash of the point id, so it is repeatable.
+void Random(vtkPolyData* input, const double fraction, vtkPolyData* output);
+
+// A convex region to crop a cloud to, such as a box or the view of a camera: the points on the inner
+// side of every plane. Bounds is a box known to contain the region (infinite by default), which limits
+// the search.
+struct CropRegion
+{
+  CropRegion();
+
+  // A plane through 'point' whose 'normal' points out of the region
+  void AddPlane(const double normal[3], const double point[3]);
+
+  bool Contains(const double point[3]) const;
+  // -1 if the box is entirely outside the region, 1 if entirely inside and 0 if it may be either
+  int Classify(const double lower[3], const double upper[3]) const;
+
+  std::vector<double> Planes; // a x + b y + c z + d <= 0 inside, four coefficients per plane
+  double Bounds[6];
+};
+
+// Keep the points inside 'region'. 'index' must have been built over the points of 'input'; only its cells
+// that overlap the region's bounds are visited, and only the points of cells crossing the region's
+// boundary are tested one by one, so the time depends on the size of the region more than of the cloud.
+void Crop(vtkPolyData* input, const PointIndex& index, const CropRegion& region, vtkPolyData* output);
+
+} // end namespace
+
+#endif
@@ -0,0 +1,512 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "PointIndex.h"
+
+// VTK
+#include <vtkPoints.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+// Cap on the number of cells so the offsets stay small for huge or very flat bounding boxes
+const double MaximumNumberOfCells = 1 << 26;
+
+struct BoundsFunctor
+{
+  vtkPoints* Points;
+  std::vector<double>* Bounds; // 6 per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    double* bounds = &(*this->Bounds)[6 * threadId];
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      double p[3];
+      this->Points->GetPoint(i, p);
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        bounds[2 * d] = std::min(bounds[2 * d], p[d]);
+        bounds[2 * d + 1] = std::max(bounds[2 * d + 1], p[d]);
+        }
+      }
+  }
+};
+
+struct CellFunctor
+{
+  vtkPoints* Points;
+  double Origin[3];
+  double CellSize;
+  unsigned int Dimensions[3];
+  unsigned int* Cells;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      double p[3];
+      this->Points->GetPoint(i, p);
+      unsigned int index[3];
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        double cell = floor((p[d] - this->Origin[d]) / this->CellSize);
+        index[d] = static_cast<unsigned int>(std::max(0.0, std::min(cell, this->Dimensions[d] - 1.0)));
+        }
+      this->Cells[i] = (index[2] * this->Dimensions[1] + index[1]) * this->Dimensions[0] + index[0];
+      }
+  }
+};
+
+// The counting sort is split by cell range rather than by point range: every thread reads all the cell
+// numbers but only counts and writes the cells of its range, so no two threads touch the same counter
+// and no per-thread histograms (one int per cell each) are needed. Reading is cheap next to scattering.
+struct CountFunctor
+{
+  const unsigned int* Cells;
+  vtkIdType NumberOfPoints;
+  unsigned int NumberOfCells;
+  int NumberOfPartitions;
+  unsigned int* Counts;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType partition = begin; partition < end; ++partition)
+      {
+      unsigned int firstCell = static_cast<unsigned int>((static_cast<double>(this->NumberOfCells) * partition) / this->NumberOfPartitions);
+      unsigned int lastCell = static_cast<unsigned int>((static_cast<double>(this->NumberOfCells) * (partition + 1)) / this->NumberOfPartitions);
+      for(vtkIdType i = 0; i < this->NumberOfPoints; ++i)
+        {
+        unsigned int cell = this->Cells[i];
+        if(cell >= firstCell && cell < lastCell)
+          {
+          this->Counts[cell]++;
+          }
+        }
+      }
+  }
+};
+
+struct ScatterFunctor
+{
+  const unsigned int* Cells;
+  vtkIdType NumberOfPoints;
+  unsigned int NumberOfCells;
+  int NumberOfPartitions;
+  unsigned int* Cursors; // starts as a copy of the offsets
+  unsigned int* Ids;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType partition = begin; partition < end; ++partition)
+      {
+      unsigned int firstCell = static_cast<unsigned int>((static_cast<double>(this->NumberOfCells) * partition) / this->NumberOfPartitions);
+      unsigned int lastCell = static_cast<unsigned int>((static_cast<double>(this->NumberOfCells) * (partition + 1)) / this->NumberOfPartitions);
+      for(vtkIdType i = 0; i < this->NumberOfPoints; ++i)
+        {
+        unsigned int cell = this->Cells[i];
+        if(cell >= firstCell && cell < lastCell)
+          {
+          this->Ids[this->Cursors[cell]++] = static_cast<unsigned int>(i);
+          }
+        }
+      }
+  }
+};
+
+} // end anonymous namespace
+
+PointIndex::PointIndex()
+{
+  this->Initialize();
+}
+
+void PointIndex::Initialize()
+{
+  this->Points = NULL;
+  this->CellSize = 1;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    this->Origin[d] = 0;
+    this->Dimensions[d] = 0;
+    }
+  // Swapped out rather than cleared, so the memory is freed
+  std::vector<unsigned int>().swap(this->Offsets);
+  std::vector<unsigned int>().swap(this->Ids);
+}
+
+vtkPoints* PointIndex::GetPoints() const
+{
+  return this->Points;
+}
+
+double PointIndex::GetCellSize() const
+{
+  return this->CellSize;
+}
+
+size_t PointIndex::GetSize() const
+{
+  return (this->Offsets.size() + this->Ids.size()) * sizeof(unsigned int);
+}
+
+const double* PointIndex::GetOrigin() const
+{
+  return this->Origin;
+}
+
+const unsigned int* PointIndex::GetDimensions() const
+{
+  return this->Dimensions;
+}
+
+void PointIndex::GetCellRange(const unsigned int cell, unsigned int& begin, unsigned int& end) const
+{
+  begin = this->Offsets[cell];
+  end = this->Offsets[cell + 1];
+}
+
+const unsigned int* PointIndex::GetIds() const
+{
+  return this->Ids.empty() ? NULL : &this->Ids[0];
+}
+
+const unsigned int* PointIndex::GetOffsets() const
+{
+  return this->Offsets.empty() ? NULL : &this->Offsets[0];
+}
+
+void PointIndex::Restore(vtkPoints* points, const double origin[3], const double cellSize, const unsigned int dimensions[3],
+                         const unsigned int* offsets, const unsigned int* ids)
+{
+  this->Points = points;
+  this->CellSize = cellSize;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    this->Origin[d] = origin[d];
+    this->Dimensions[d] = dimensions[d];
+    }
+
+  size_t numberOfCells = static_cast<size_t>(dimensions[0]) * dimensions[1] * dimensions[2];
+  this->Offsets.assign(offsets, offsets + numberOfCells + 1);
+  this->Ids.assign(ids, ids + points->GetNumberOfPoints());
+}
+
+double PointIndex::ComputeNumberOfCells(const double extent[3], const double cellSize)
+{
+  double numberOfCells = 1;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    numberOfCells *= floor(extent[d] / cellSize) + 1;
+    }
+  return numberOfCells;
+}
+
+double PointIndex::GetMaximumNumberOfCells()
+{
+  return MaximumNumberOfCells;
+}
+
+void PointIndex::Build(vtkPoints* points, const double cellSize)
+{
+  this->Initialize();
+
+  const vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  if(numberOfPoints == 0)
+    {
+    return;
+    }
+  this->Points = points;
+
+  // Bounds
+  const int numberOfThreads = Parallel::GetNumberOfThreads();
+  std::vector<double> threadBounds(6 * numberOfThreads);
+  for(int thread = 0; thread < numberOfThreads; ++thread)
+    {
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      threadBounds[6 * thread + 2 * d] = std::numeric_limits<double>::max();
+      threadBounds[6 * thread + 2 * d + 1] = -std::numeric_limits<double>::max();
+      }
+    }
+  BoundsFunctor boundsFunctor;
+  boundsFunctor.Points = points;
+  boundsFunctor.Bounds = &threadBounds;
+  Parallel::For(0, numberOfPoints, boundsFunctor);
+
+  double bounds[6];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    bounds[2 * d] = threadBounds[2 * d];
+    bounds[2 * d + 1] = threadBounds[2 * d + 1];
+    for(int thread = 1; thread < numberOfThreads; ++thread)
+      {
+      bounds[2 * d] = std::min(bounds[2 * d], threadBounds[6 * thread + 2 * d]);
+      bounds[2 * d + 1] = std::max(bounds[2 * d + 1], threadBounds[6 * thread + 2 * d + 1]);
+      }
+    }
+
+  // Cell size
+  double extent[3];
+  double largestExtent = 0;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    extent[d] = bounds[2 * d + 1] - bounds[2 * d];
+    largestExtent = std::max(largestExtent, extent[d]);
+    }
+  if(largestExtent <= 0)
+    {
+    largestExtent = 1;
+    }
+
+  this->CellSize = cellSize;
+  if(this->CellSize <= 0)
+    {
+    // Volume of the box with flat dimensions thickened, so planar clouds still get a sensible size
+    double volume = 1;
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      volume *= std::max(extent[d], 1e-3 * largestExtent);
+      }
+    this->CellSize = pow(volume / std::max(1.0, 0.5 * numberOfPoints), 1.0 / 3.0);
+    }
+  while(ComputeNumberOfCells(extent, this->CellSize) > MaximumNumberOfCells)
+    {
+    this->CellSize *= 1.25;
+    }
+
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    this->Origin[d] = bounds[2 * d];
+    this->Dimensions[d] = static_cast<unsigned int>(floor(extent[d] / this->CellSize)) + 1;
+    }
+  const unsigned int numberOfCells = this->Dimensions[0] * this->Dimensions[1] * this->Dimensions[2];
+
+  // Cell of every point
+  std::vector<unsigned int> cells(numberOfPoints);
+  CellFunctor cellFunctor;
+  cellFunctor.Points = points;
+  cellFunctor.CellSize = this->CellSize;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    cellFunctor.Origin[d] = this->Origin[d];
+    cellFunctor.Dimensions[d] = this->Dimensions[d];
+    }
+  cellFunctor.Cells = &cells[0];
+  Parallel::For(0, numberOfPoints, cellFunctor);
+
+  // Count, prefix sum, scatter
+  this->Offsets.assign(numberOfCells + 1, 0);
+  CountFunctor countFunctor;
+  countFunctor.Cells = &cells[0];
+  countFunctor.NumberOfPoints = numberOfPoints;
+  countFunctor.NumberOfCells = numberOfCells;
+  countFunctor.NumberOfPartitions = numberOfThreads;
+  countFunctor.Counts = &this->Offsets[1];
+  Parallel::For(0, numberOfThreads, countFunctor);
+
+  for(unsigned int cell = 0; cell < numberOfCells; ++cell)
+    {
+    this->Offsets[cell + 1] += this->Offsets[cell];
+    }
+
+  std::vector<unsigned int> cursors(this->Offsets.begin(), this->Offsets.end() - 1);
+  this->Ids.resize(numberOfPoints);
+  ScatterFunctor scatterFunctor;
+  scatterFunctor.Cells = &cells[0];
+  scatterFunctor.NumberOfPoints = numberOfPoints;
+  scatterFunctor.NumberOfCells = numberOfCells;
+  scatterFunctor.NumberOfPartitions = numberOfThreads;
+  scatterFunctor.Cursors = &cursors[0];
+  scatterFunctor.Ids = &this->Ids[0];
+  Parallel::For(0, numberOfThreads, scatterFunctor);
+}
+
+void PointIndex::VisitCell(const unsigned int cell, const double origin[3], const double direction[3],
+                           const double radiusPerUnitDistance, const double minimumRadius,
+                           std::vector<double>& depths, std::vector<double>& distances, std::vector<vtkIdType>& ids) const
+{
+  for(unsigned int i = this->Offsets[cell]; i < this->Offsets[cell + 1]; ++i)
+    {
+    double p[3];
+    this->Points->GetPoint(this->Ids[i], p);
+    double v[3] = {p[0] - origin[0], p[1] - origin[1], p[2] - origin[2]};
+    double t = v[0] * direction[0] + v[1] * direction[1] + v[2] * direction[2];
+    if(t <= 0)
+      {
+      continue;
+      }
+    double distanceSquared = v[0] * v[0] + v[1] * v[1] + v[2] * v[2] - t * t;
+    double radius = std::max(minimumRadius, t * radiusPerUnitDistance);
+    if(distanceSquared <= radius * radius)
+      {
+      depths.push_back(t);
+      distances.push_back(distanceSquared);
+      ids.push_back(this->Ids[i]);
+      }
+    }
+}
+
+void PointIndex::FindPointsNearRay(const double origin[3], const double direction[3], const double radiusPerUnitDistance,
+                                   const double minimumRadius, const double depthTolerance,
+                                   const unsigned int maximumNumberOfPoints, std::vector<vtkIdType>& ids) const
+{
+  ids.clear();
+  if(!this->Points || this->Ids.empty())
+    {
+    return;
+    }
+
+  // Clip the ray to the grid
+  double tEnter = 0;
+  double tExit = std::numeric_limits<double>::max();
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    double low = this->Origin[d];
+    double high = this->Origin[d] + this->Dimensions[d] * this->CellSize;
+    if(fabs(direction[d]) < 1e-12)
+      {
+      if(origin[d] < low || origin[d] > high)
+        {
+        return;
+        }
+      continue;
+      }
+    double t0 = (low - origin[d]) / direction[d];
+    double t1 = (high - origin[d]) / direction[d];
+    tEnter = std::max(tEnter, std::min(t0, t1));
+    tExit = std::min(tExit, std::max(t0, t1));
+    }
+  if(tEnter > tExit)
+    {
+    return;
+    }
+
+  // Amanatides & Woo traversal from the entry point
+  int cell[3];
+  int step[3];
+  double tMax[3];
+  double tDelta[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    double position = origin[d] + tEnter * direction[d];
+    cell[d] = static_cast<int>(floor((position - this->Origin[d]) / this->CellSize));
+    cell[d] = std::max(0, std::min(cell[d], static_cast<int>(this->Dimensions[d]) - 1));
+    if(direction[d] > 0)
+      {
+      step[d] = 1;
+      tMax[d] = (this->Origin[d] + (cell[d] + 1) * this->CellSize - origin[d]) / direction[d];
+      tDelta[d] = this->CellSize / direction[d];
+      }
+    else if(direction[d] < 0)
+      {
+      step[d] = -1;
+      tMax[d] = (this->Origin[d] + cell[d] * this->CellSize - origin[d]) / direction[d];
+      tDelta[d] = -this->CellSize / direction[d];
+      }
+    else
+      {
+      step[d] = 0;
+      tMax[d] = std::numeric_limits<double>::max();
+      tDelta[d] = std::numeric_limits<double>::max();
+      }
+    }
+
+  std::set<unsigned int> visited;
+  std::vector<double> depths;
+  std::vector<double> distances;
+  std::vector<vtkIdType> candidates;
+  double firstDepth = std::numeric_limits<double>::max();
+  double tCell = tEnter;
+  while(tCell <= tExit)
+    {
+    // Everything not visited yet is behind tCell (a point within the radius of the ray at t lies within
+    // 'reach' cells of the cell containing the ray at t), so the walk can stop once that is past the first surface.
+    if(tCell > firstDepth + depthTolerance)
+      {
+      break;
+      }
+
+    double tNext = std::min(tMax[0], std::min(tMax[1], tMax[2]));
+    double radius = std::max(minimumRadius, std::min(tNext, tExit) * radiusPerUnitDistance);
+    int reach = static_cast<int>(floor(radius / this->CellSize)) + 1;
+
+    for(int k = std::max(0, cell[2] - reach); k <= std::min(static_cast<int>(this->Dimensions[2]) - 1, cell[2] + reach); ++k)
+      {
+      for(int j = std::max(0, cell[1] - reach); j <= std::min(static_cast<int>(this->Dimensions[1]) - 1, cell[1] + reach); ++j)
+        {
+        for(int i = std::max(0, cell[0] - reach); i <= std::min(static_cast<int>(this->Dimensions[0]) - 1, cell[0] + reach); ++i)
+          {
+          unsigned int index = (k * this->Dimensions[1] + j) * this->Dimensions[0] + i;
+          if(this->Offsets[index] == this->Offsets[index + 1] || !visited.insert(index).second)
+            {
+            continue;
+            }
+          size_t numberOfCandidates = candidates.size();
+          this->VisitCell(index, origin, direction, radiusPerUnitDistance, minimumRadius, depths, distances, candidates);
+          for(size_t c = numberOfCandidates; c < candidates.size(); ++c)
+            {
+            firstDepth = std::min(firstDepth, depths[c]);
+            }
+          }
+        }
+      }
+
+    // Next cell along the ray
+    unsigned int axis = 0;
+    if(tMax[1] < tMax[axis])
+      {
+      axis = 1;
+      }
+    if(tMax[2] < tMax[axis])
+      {
+      axis = 2;
+      }
+    tCell = tMax[axis];
+    tMax[axis] += tDelta[axis];
+    cell[axis] += step[axis];
+    if(cell[axis] < 0 || cell[axis] >= static_cast<int>(this->Dimensions[axis]))
+      {
+      break;
+      }
+    }
+
+  // Keep the first surface, nearest to the ray first
+  std::vector<std::pair<double, vtkIdType> > surface;
+  for(size_t c = 0; c < candidates.size(); ++c)
+    {
+    if(depths[c] <= firstDepth + depthTolerance)
+      {
+      surface.push_back(std::make_pair(distances[c], candidates[c]));
+      }
+    }
+  std::sort(surface.begin(), surface.end());
+  for(size_t c = 0; c < surface.size() && c < maximumNumberOfPoints; ++c)
+    {
+    ids.push_back(surface[c].second);
+    }
+}
@@ -0,0 +1,94 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef POINTINDEX_H
+#define POINTINDEX_H
+
+// VTK
+#include <vtkType.h>
+
+// STL
+#include <cstddef>
+#include <vector>
+
+class vtkPoints;
+
+// Uniform grid over a point set. The point ids are bucket sorted by cell (a parallel counting sort),
+// so each cell is a contiguous range of Ids. Point ids are stored as 32 bits to keep the index small.
+class PointIndex
+{
+public:
+  PointIndex();
+
+  // Forget the indexed points
+  void Initialize();
+
+  // Index 'points', which must stay alive and unchanged while the index is used.
+  // If cellSize is 0 it is chosen so that there are about half as many cells as points.
+  void Build(vtkPoints* points, const double cellSize = 0);
+
+  vtkPoints* GetPoints() const;
+  double GetCellSize() const;
+  // Bytes
+  size_t GetSize() const;
+
+  // The grid, for algorithms that work cell by cell. Cell (i, j, k) is number (k * Dimensions[1] + j) * Dimensions[0] + i
+  // and its lowest corner is Origin + (i, j, k) * CellSize. Its points are Ids[begin] ... Ids[end - 1].
+  const double* GetOrigin() const;
+  const unsigned int* GetDimensions() const;
+  void GetCellRange(const unsigned int cell, unsigned int& begin, unsigned int& end) const;
+  const unsigned int* GetIds() const;
+  const unsigned int* GetOffsets() const; // one per cell, plus one
+
+  // Use a grid that was built earlier for these same points (see DerivedDataCache) instead of calling Build.
+  // The arrays are copied; offsets has one entry per cell plus one and ids one entry per point.
+  void Restore(vtkPoints* points, const double origin[3], const double cellSize, const unsigned int dimensions[3],
+               const unsigned int* offsets, const unsigned int* ids);
+
+  // The number of cells Build would make for this extent and cell size; Build enlarges the cell size
+  // until this is at most GetMaximumNumberOfCells().
+  static double ComputeNumberOfCells(const double extent[3], const double cellSize);
+  static double GetMaximumNumberOfCells();
+
+  // Points near a ray, on the first surface the ray meets. The ray is a cone around
+  // origin + t * direction (direction unit length, t > 0) whose radius at distance t is
+  // max(minimumRadius, t * radiusPerUnitDistance) - for a camera ray this is a few pixels divided by the focal length.
+  // The cells are walked front to back (3D DDA) and the walk stops once the first point found is more than
+  // depthTolerance in front of everything that is left, so the cost depends on the ray, not on the cloud size.
+  // The ids found within depthTolerance of the first point are returned, nearest to the ray first.
+  void FindPointsNearRay(const double origin[3], const double direction[3], const double radiusPerUnitDistance,
+                         const double minimumRadius, const double depthTolerance, const unsigned int maximumNumberOfPoints,
+                         std::vector<vtkIdType>& ids) const;
+
+private:
+  void VisitCell(const unsigned int cell, const double origin[3], const double direction[3],
+                 const double radiusPerUnitDistance, const double minimumRadius,
+                 std::vector<double>& depths, std::vector<double>& distances, std::vector<vtkIdType>& ids) const;
+
+  vtkPoints* Points;
+
+  double Origin[3];
+  double CellSize;
+  unsigned int Dimensions[3];
+
+  // Ids[Offsets[c]] ... Ids[Offsets[c+1] - 1] are the points in cell c
+  std::vector<unsigned int> Offsets;
+  std::vector<unsigned int> Ids;
+};
+
+#endif
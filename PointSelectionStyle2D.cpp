@@ -21,13 +21,19 @@
 #include <vtkAbstractPicker.h>
 #include <vtkActor2D.h>
 #include <vtkCaptionActor2D.h>
+#include <vtkCellArray.h>
 #include <vtkCoordinate.h>
 #include <vtkFollower.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
 #include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
 #include <vtkPolyDataMapper.h>
 #include <vtkPolyDataMapper2D.h>
 #include <vtkProperty.h>
 #include <vtkProperty2D.h>
+#include <vtkRenderer.h>
 #include <vtkRendererCollection.h>
 #include <vtkRenderWindow.h>
 #include <vtkRenderWindowInteractor.h>
@@ -38,87 +44,459 @@
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkVectorText.h>
 
+#include <algorithm>
+#include <cmath>
 #include <sstream>
+#include <string>
 
 vtkStandardNewMacro(PointSelectionStyle2D);
  
+PointSelectionStyle2D::PointSelectionStyle2D()
+{
+  this->Image = NULL;
+  this->Snap = false;
+  this->Correspondences = NULL;
+  this->LastKeypoint = 0;
+  this->DraggedKeypoint = 0;
+  this->DragPixel[0] = this->DragPixel[1] = 0;
+  this->PendingKeypoint = 0;
+}
+
+bool PointSelectionStyle2D::DisplayToPixel(const int displayPosition[2], double pixel[2])
+{
+  if(!this->Image || !this->CurrentRenderer)
+    {
+    return false;
+    }
+
+  // The ray through the display position, from the near to the far clipping plane
+  double nearPoint[4];
+  double farPoint[4];
+  this->CurrentRenderer->SetDisplayPoint(displayPosition[0], displayPosition[1], 0);
+  this->CurrentRenderer->DisplayToWorld();
+  this->CurrentRenderer->GetWorldPoint(nearPoint);
+  this->CurrentRenderer->SetDisplayPoint(displayPosition[0], displayPosition[1], 1);
+  this->CurrentRenderer->DisplayToWorld();
+  this->CurrentRenderer->GetWorldPoint(farPoint);
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    nearPoint[i] /= nearPoint[3];
+    farPoint[i] /= farPoint[3];
+    }
+
+  // The image actor shows the image in the plane z = origin[2]
+  double origin[3];
+  double spacing[3];
+  int extent[6];
+  this->Image->GetOrigin(origin);
+  this->Image->GetSpacing(spacing);
+  this->Image->GetExtent(extent);
+
+  double direction = farPoint[2] - nearPoint[2];
+  if(direction == 0)
+    {
+    return false;
+    }
+  double t = (origin[2] - nearPoint[2]) / direction;
+  for(unsigned int i = 0; i < 2; ++i)
+    {
+    pixel[i] = (nearPoint[i] + t * (farPoint[i] - nearPoint[i]) - origin[i]) / spacing[i];
+    }
+
+  // Pixels cover [index - 0.5, index + 0.5]
+  return pixel[0] >= extent[0] - 0.5 && pixel[0] <= extent[1] + 0.5 &&
+         pixel[1] >= extent[2] - 0.5 && pixel[1] <= extent[3] + 0.5;
+}
+
+void PointSelectionStyle2D::PixelToWorld(const double pixel[2], double world[3])
+{
+  world[0] = pixel[0];
+  world[1] = pixel[1];
+  world[2] = 0;
+  if(this->Image)
+    {
+    double origin[3];
+    double spacing[3];
+    this->Image->GetOrigin(origin);
+    this->Image->GetSpacing(spacing);
+    for(unsigned int i = 0; i < 2; ++i)
+      {
+      world[i] = origin[i] + pixel[i] * spacing[i];
+      }
+    world[2] = origin[2];
+    }
+}
+
 void PointSelectionStyle2D::OnLeftButtonDown() 
 {
-  //std::cout << "Picking pixel: " << this->Interactor->GetEventPosition()[0] << " " << this->Interactor->GetEventPosition()[1] << std::endl;
-  this->Interactor->GetPicker()->Pick(this->Interactor->GetEventPosition()[0], 
-		      this->Interactor->GetEventPosition()[1], 
-		      0,  // always zero.
-                      this->CurrentRenderer);
+  // Grab the marker under the mouse
+  if(this->Correspondences && this->CurrentRenderer)
+    {
+    CorrespondenceModel::Id id = FindMarker(this->Interactor->GetEventPosition(), 5);
+    if(id != 0)
+      {
+      Coord2D coord = this->Correspondences->GetImagePoint(id);
+      this->DraggedKeypoint = id;
+      this->DragPixel[0] = coord.x;
+      this->DragPixel[1] = coord.y;
+      this->InvokeEvent(KeypointGrabbedEvent, NULL);
+      return;
+      }
+    }
 
-  double picked[3];
-  this->Interactor->GetPicker()->GetPickPosition(picked);
-  //std::cout << "Picked point with coordinate: " << picked[0] << " " << picked[1] << " " << picked[2] << std::endl;
+  double pixel[2];
+  if(this->DisplayToPixel(this->Interactor->GetEventPosition(), pixel))
+    {
+    if(this->Snap)
+      {
+      double click[2] = {pixel[0], pixel[1]};
+      if(this->Refiner.Refine(click, pixel))
+        {
+        std::cout << "Snapped " << click[0] << " " << click[1] << " to " << pixel[0] << " " << pixel[1] << std::endl;
+        }
+      }
+    double p[3] = {pixel[0], pixel[1], 0};
+    AddNumber(p);
+    this->InvokeEvent(KeypointClickedEvent, NULL);
+    }
 
-  AddNumber(picked);
- 
   // Forward events
   vtkInteractorStyleImage::OnLeftButtonDown();
 }
 
-void PointSelectionStyle2D::RemoveAllPoints()
+void PointSelectionStyle2D::OnMouseMove()
+{
+  if(this->DraggedKeypoint == 0)
+    {
+    vtkInteractorStyleImage::OnMouseMove();
+    return;
+    }
+
+  // Only the dragged marker moves; the others and Correspondences are left alone until it is released
+  double pixel[2];
+  if(!this->DisplayToPixel(this->Interactor->GetEventPosition(), pixel))
+    {
+    return;
+    }
+  this->DragPixel[0] = pixel[0];
+  this->DragPixel[1] = pixel[1];
+  MoveMarker(this->DraggedKeypoint, pixel);
+  this->InvokeEvent(KeypointDraggedEvent, NULL);
+  this->Interactor->Render();
+}
+
+void PointSelectionStyle2D::OnLeftButtonUp()
 {
-  for(unsigned int i = 0; i < Coordinates.size(); ++i)
+  if(this->DraggedKeypoint == 0)
     {
-    this->CurrentRenderer->RemoveViewProp( Numbers[i]);
-    this->CurrentRenderer->RemoveViewProp( Points[i]);
+    vtkInteractorStyleImage::OnLeftButtonUp();
+    return;
     }
-  Numbers.clear();
-  Points.clear();
-  Coordinates.clear();
+
+  CorrespondenceModel::Id id = this->DraggedKeypoint;
+  this->DraggedKeypoint = 0;
+  this->LastKeypoint = id;
+  double pixel[2] = {this->DragPixel[0], this->DragPixel[1]};
+  if(this->Snap)
+    {
+    this->Refiner.Refine(this->DragPixel, pixel);
+    }
+
+  Coord2D coord;
+  coord.x = pixel[0];
+  coord.y = pixel[1];
+  Coord2D previous = this->Correspondences->GetImagePoint(id);
+  if(coord.x != previous.x || coord.y != previous.y)
+    {
+    this->Correspondences->SetImagePoint(id, coord);
+    std::cout << "Moved keypoint " << id << " to " << coord.x << " " << coord.y << std::endl;
+    }
+  UpdateMarker(id);
+  this->InvokeEvent(KeypointMovedEvent, NULL);
+  this->Interactor->Render();
 }
 
+void PointSelectionStyle2D::OnKeyPress()
+{
+  std::string key = this->Interactor->GetKeySym();
+  if(key == "Delete" && this->Correspondences)
+    {
+    CorrespondenceModel::Id id = FindMarker(this->Interactor->GetEventPosition(), 10);
+    if(id != 0)
+      {
+      this->Correspondences->RemoveImagePoint(id);
+      UpdateMarker(id);
+      this->InvokeEvent(KeypointDeletedEvent, NULL);
+      }
+    }
+  else if((key == "m" || key == "x") && this->Correspondences)
+    {
+    CorrespondenceModel::Id id = FindMarker(this->Interactor->GetEventPosition(), 10);
+    if(this->PendingKeypoint == 0 || this->PendingKey != key || !this->Correspondences->Contains(this->PendingKeypoint))
+      {
+      this->PendingKeypoint = id;
+      this->PendingKey = key;
+      if(id != 0)
+        {
+        std::cout << "Press '" << key << "' over another keypoint to " << (key == "m" ? "move " : "re-pair ")
+                  << id << " with it." << std::endl;
+        }
+      }
+    else if(id == this->PendingKeypoint)
+      {
+      this->PendingKeypoint = 0;
+      }
+    else
+      {
+      if(key == "m")
+        {
+        this->Correspondences->Move(this->PendingKeypoint, id);
+        std::cout << "Moved correspondence " << this->PendingKeypoint;
+        if(id != 0)
+          {
+          std::cout << " in front of " << id << std::endl;
+          }
+        else
+          {
+          std::cout << " to the end" << std::endl;
+          }
+        }
+      else if(id != 0)
+        {
+        this->Correspondences->SwapWorldPoints(this->PendingKeypoint, id);
+        std::cout << "Exchanged the point cloud keypoints of " << this->PendingKeypoint << " and " << id << std::endl;
+        }
+      this->PendingKeypoint = 0;
+      this->InvokeEvent(KeypointsRearrangedEvent, NULL);
+      }
+    }
+
+  // Forward events
+  vtkInteractorStyleImage::OnKeyPress();
+}
 
 void PointSelectionStyle2D::AddNumber(double p[3])
 {
-  // Convert the current number to a string
-  std::stringstream ss;
-  ss << Coordinates.size();
-  
+  if(!this->Correspondences)
+    {
+    return;
+    }
+
   Coord2D coord;
   coord.x = p[0];
   coord.y = p[1];
-  Coordinates.push_back(coord);
-  
-  p[0] = static_cast<int>( p[0] + 0.5 );
-  p[1] = static_cast<int>( p[1] + 0.5 );
-  p[2] = 0;
-  std::cout << "Adding marker at " << p[0] << " " << p[1] << " " << p[2] << std::endl;
+  this->LastKeypoint = this->Correspondences->AddImagePoint(coord);
+  std::cout << "Adding marker at " << p[0] << " " << p[1] << std::endl;
+  UpdateMarker(this->LastKeypoint);
+}
+
+void PointSelectionStyle2D::UpdateMarker(const CorrespondenceModel::Id id)
+{
+  bool shown = id < this->Points.size() && this->Points[id];
+  if(!this->Correspondences || !this->Correspondences->HasImagePoint(id))
+    {
+    if(shown)
+      {
+      this->CurrentRenderer->RemoveViewProp( this->Numbers[id]);
+      this->CurrentRenderer->RemoveViewProp( this->Points[id]);
+      this->Numbers[id] = NULL;
+      this->Points[id] = NULL;
+      }
+    return;
+    }
+
+  // The marker goes exactly where the coordinate is
+  Coord2D coord = this->Correspondences->GetImagePoint(id);
+  double pixel[2] = {coord.x, coord.y};
+  double position[3];
+  PixelToWorld(pixel, position);
+
+  if(shown)
+    {
+    MoveMarker(id, pixel);
+    return;
+    }
+
+  if(id >= this->Points.size())
+    {
+    this->Numbers.resize(id + 1, NULL);
+    this->Points.resize(id + 1, NULL);
+    }
+
+  // The correspondence is labeled by its id in both views
+  std::stringstream ss;
+  ss << id;
 
   // Create the number
   // Create the text
   vtkSmartPointer<vtkCaptionActor2D> captionActor = vtkSmartPointer<vtkCaptionActor2D>::New();
   captionActor->SetCaption( ss.str().c_str() );
-  captionActor->SetAttachmentPoint(p);
+  captionActor->SetAttachmentPoint(position);
   captionActor->BorderOff();
   captionActor->GetCaptionTextProperty()->BoldOff();
   captionActor->GetCaptionTextProperty()->ItalicOff();
   captionActor->GetCaptionTextProperty()->ShadowOff();
   captionActor->ThreeDimensionalLeaderOff();
-  this->Numbers.push_back(captionActor);
+  this->Numbers[id] = captionActor;
   this->CurrentRenderer->AddViewProp( captionActor );
 
   // Create the dot
   // Create a sphere
   vtkSmartPointer<vtkSphereSource> sphereSource = vtkSmartPointer<vtkSphereSource>::New();
   sphereSource->SetRadius(.5);
-  sphereSource->SetCenter(p);
   sphereSource->Update();
 
   // Create a mapper
   vtkSmartPointer<vtkPolyDataMapper> sphereMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
   sphereMapper->SetInputConnection( sphereSource->GetOutputPort() );
 
-  // Create a subclass of vtkActor: a vtkFollower that remains facing the camera
+  // The sphere is moved by its actor, so the marker can follow its keypoint
   vtkSmartPointer<vtkActor> sphereActor = vtkSmartPointer<vtkActor>::New();
   sphereActor->SetMapper( sphereMapper );
+  sphereActor->SetPosition(position);
   sphereActor->GetProperty()->SetColor( 1, 0, 0 ); // red
 
-  this->Points.push_back(sphereActor);
-  //this->Interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer()->AddActor( sphereActor );
+  this->Points[id] = sphereActor;
   this->CurrentRenderer->AddViewProp( sphereActor );
 }
+
+void PointSelectionStyle2D::MoveMarker(const CorrespondenceModel::Id id, const double pixel[2])
+{
+  double position[3];
+  PixelToWorld(pixel, position);
+  this->Numbers[id]->SetAttachmentPoint(position);
+  this->Points[id]->SetPosition(position);
+}
+
+void PointSelectionStyle2D::UpdateMarkers()
+{
+  CorrespondenceModel::Id end = this->Points.size();
+  if(this->Correspondences)
+    {
+    end = std::max(end, this->Correspondences->GetEndId());
+    }
+  for(CorrespondenceModel::Id id = 1; id < end; ++id)
+    {
+    UpdateMarker(id);
+    }
+}
+
+CorrespondenceModel::Id PointSelectionStyle2D::FindMarker(const int displayPosition[2], const double tolerance)
+{
+  CorrespondenceModel::Id nearest = 0;
+  double nearestDistance = tolerance * tolerance;
+  for(CorrespondenceModel::Id id = 1; id < this->Points.size(); ++id)
+    {
+    if(!this->Points[id])
+      {
+      continue;
+      }
+    double* position = this->Points[id]->GetPosition();
+    this->CurrentRenderer->SetWorldPoint(position[0], position[1], position[2], 1);
+    this->CurrentRenderer->WorldToDisplay();
+    double* display = this->CurrentRenderer->GetDisplayPoint();
+    double dx = display[0] - displayPosition[0];
+    double dy = display[1] - displayPosition[1];
+    if(dx * dx + dy * dy <= nearestDistance)
+      {
+      nearestDistance = dx * dx + dy * dy;
+      nearest = id;
+      }
+    }
+  return nearest;
+}
+
+void PointSelectionStyle2D::SetPointColor(const CorrespondenceModel::Id id, const double color[3])
+{
+  if(id < this->Points.size() && this->Points[id])
+    {
+    this->Points[id]->GetProperty()->SetColor(color[0], color[1], color[2]);
+    }
+}
+
+void PointSelectionStyle2D::ShowCandidate(double p[3])
+{
+  ClearCandidate();
+
+  vtkSmartPointer<vtkSphereSource> sphereSource = vtkSmartPointer<vtkSphereSource>::New();
+  sphereSource->SetRadius(1);
+  double position[3];
+  PixelToWorld(p, position);
+  sphereSource->SetCenter(position);
+  sphereSource->Update();
+
+  vtkSmartPointer<vtkPolyDataMapper> sphereMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+  sphereMapper->SetInputConnection( sphereSource->GetOutputPort() );
+
+  this->Candidate = vtkSmartPointer<vtkActor>::New();
+  this->Candidate->SetMapper( sphereMapper );
+  this->Candidate->GetProperty()->SetColor( 1, 1, 0 ); // yellow
+  this->CurrentRenderer->AddViewProp( this->Candidate );
+}
+
+void PointSelectionStyle2D::ClearCandidate()
+{
+  if(this->Candidate)
+    {
+    this->CurrentRenderer->RemoveViewProp( this->Candidate );
+    this->Candidate = NULL;
+    }
+}
+
+void PointSelectionStyle2D::ShowPrediction(const double pixel[2], const double covariance[2][2])
+{
+  ClearPrediction();
+
+  // Axes of the ellipse from the eigen decomposition of the covariance
+  double a = covariance[0][0];
+  double b = covariance[0][1];
+  double c = covariance[1][1];
+  double mean = 0.5 * (a + c);
+  double difference = sqrt(0.25 * (a - c) * (a - c) + b * b);
+  double majorVariance = mean + difference;
+  double minorVariance = std::max(0.0, mean - difference);
+  double angle = 0.5 * atan2(2.0 * b, a - c);
+
+  // 95% of a 2D Gaussian is within sqrt(5.991) standard deviations. Keep it visible even when the pose is very good.
+  const double scale = sqrt(5.991);
+  double majorRadius = std::max(1.0, scale * sqrt(majorVariance));
+  double minorRadius = std::max(1.0, scale * sqrt(minorVariance));
+
+  const unsigned int numberOfSegments = 64;
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
+  lines->InsertNextCell(numberOfSegments + 1);
+  for(unsigned int i = 0; i <= numberOfSegments; ++i)
+    {
+    double theta = 2.0 * vtkMath::Pi() * i / numberOfSegments;
+    double x = majorRadius * cos(theta);
+    double y = minorRadius * sin(theta);
+    double ellipsePixel[2] = {pixel[0] + x * cos(angle) - y * sin(angle),
+                              pixel[1] + x * sin(angle) + y * cos(angle)};
+    double world[3];
+    PixelToWorld(ellipsePixel, world);
+    lines->InsertCellPoint(points->InsertNextPoint(world));
+    }
+
+  vtkSmartPointer<vtkPolyData> ellipse = vtkSmartPointer<vtkPolyData>::New();
+  ellipse->SetPoints(points);
+  ellipse->SetLines(lines);
+
+  vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+  mapper->SetInput(ellipse);
+
+  this->Prediction = vtkSmartPointer<vtkActor>::New();
+  this->Prediction->SetMapper(mapper);
+  this->Prediction->GetProperty()->SetColor( 0, 1, 1 ); // cyan
+  this->Prediction->GetProperty()->SetLineWidth(2);
+  this->CurrentRenderer->AddViewProp( this->Prediction );
+}
+
+void PointSelectionStyle2D::ClearPrediction()
+{
+  if(this->Prediction)
+    {
+    this->CurrentRenderer->RemoveViewProp( this->Prediction );
+    this->Prediction = NULL;
+    }
+}
@@ -20,13 +20,22 @@
 #define PointSelectionStyle2D_H
 
 // VTK
+#include <vtkActor.h>
+#include <vtkCommand.h>
 #include <vtkInteractorStyleImage.h>
+#include <vtkSmartPointer.h>
 
 // STL
+#include <string>
 #include <vector>
 
 // Custom
 #include "Coord.h"
+#include "CorrespondenceModel.h"
+#include "SubPixelRefiner.h"
+
+class vtkCaptionActor2D;
+class vtkImageData;
 
 // Define interaction style
 class PointSelectionStyle2D : public vtkInteractorStyleImage
@@ -35,15 +44,87 @@ class PointSelectionStyle2D : public vtkInteractorStyleImage
     static PointSelectionStyle2D* New();
     vtkTypeMacro(PointSelectionStyle2D, vtkInteractorStyleTrackballCamera);
  
+    PointSelectionStyle2D();
+
+    // Invoked after a keypoint has been clicked (not when points are added programmatically)
+    enum { KeypointClickedEvent = vtkCommand::UserEvent + 1 };
+    // Invoked after the Delete key removed the keypoint under the mouse
+    enum { KeypointDeletedEvent = vtkCommand::UserEvent + 2 };
+    // Invoked when a keypoint is grabbed, as it is dragged (at DragPixel) and once it has been moved there
+    enum { KeypointGrabbedEvent = vtkCommand::UserEvent + 3 };
+    enum { KeypointDraggedEvent = vtkCommand::UserEvent + 4 };
+    enum { KeypointMovedEvent = vtkCommand::UserEvent + 5 };
+    // Invoked after correspondences were reordered or re-paired from the keyboard
+    enum { KeypointsRearrangedEvent = vtkCommand::UserEvent + 6 };
+
+    // Clicking on a marker grabs it instead of adding a keypoint
     void OnLeftButtonDown();
+    void OnLeftButtonUp();
+    void OnMouseMove();
+    void OnKeyPress();
+
+    // The displayed image. Clicks are converted to its continuous pixel coordinates.
+    vtkImageData* Image;
+
+    // Snap clicks to the nearest corner or blob center
+    bool Snap;
+    SubPixelRefiner Refiner;
+
+    // Continuous pixel coordinates of a display position. Returns false if it is outside the image.
+    bool DisplayToPixel(const int displayPosition[2], double pixel[2]);
+
+    // World position of continuous pixel coordinates
+    void PixelToWorld(const double pixel[2], double world[3]);
  
-    std::vector<vtkActor2D*> Numbers;
+    // The keypoints, shared with the point cloud view. The image keypoints are shown here.
+    CorrespondenceModel* Correspondences;
+
+    // Markers of the image keypoints by correspondence id, NULL where there is none
+    std::vector<vtkCaptionActor2D*> Numbers;
     std::vector<vtkActor*> Points;
-    std::vector<Coord2D> Coordinates;
 
+    // The correspondence of the keypoint clicked or moved last
+    CorrespondenceModel::Id LastKeypoint;
+
+    // The correspondence whose keypoint is being dragged (0 if none) and where it is. Correspondences
+    // is only changed when the keypoint is released, so the drag is a single step to undo.
+    CorrespondenceModel::Id DraggedKeypoint;
+    double DragPixel[2];
+
+    // Pressing 'm' over a marker and then over another moves the first correspondence in front of the
+    // second (or to the end, if the second press is not over a marker); 'x' the same way exchanges their
+    // point cloud keypoints. The marker of the first press and its key, until the second (else 0).
+    CorrespondenceModel::Id PendingKeypoint;
+    std::string PendingKey;
+
+    // Add a keypoint to Correspondences and show it; p is in pixel coordinates
     void AddNumber(double p[3]);
 
-    void RemoveAllPoints();
+    // Add, move or remove the marker of one correspondence to match Correspondences, leaving the others alone
+    void UpdateMarker(const CorrespondenceModel::Id id);
+    // All of them, e.g. for a new view of existing correspondences
+    void UpdateMarkers();
+
+    // The correspondence whose marker is nearest a display position, if within 'tolerance' pixels (else 0)
+    CorrespondenceModel::Id FindMarker(const int displayPosition[2], const double tolerance);
+
+    // Color the dot of a keypoint (they are red when added)
+    void SetPointColor(const CorrespondenceModel::Id id, const double color[3]);
+
+    // Highlight a proposed keypoint (yellow) without adding it
+    void ShowCandidate(double p[3]);
+    void ClearCandidate();
+
+    // Show where a keypoint is expected: an ellipse covering 95% of a Gaussian with the given pixel covariance
+    void ShowPrediction(const double pixel[2], const double covariance[2][2]);
+    void ClearPrediction();
+
+  private:
+    // Move the marker of a correspondence, without changing Correspondences
+    void MoveMarker(const CorrespondenceModel::Id id, const double pixel[2]);
+
+    vtkSmartPointer<vtkActor> Candidate;
+    vtkSmartPointer<vtkActor> Prediction;
 };
 
 #endif
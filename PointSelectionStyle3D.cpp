@@ -21,8 +21,13 @@
 #include <vtkAbstractPicker.h>
 #include <vtkCamera.h>
 #include <vtkFollower.h>
+#include <vtkIdTypeArray.h>
+#include <vtkMath.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
 #include <vtkPointPicker.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
 #include <vtkPolyDataMapper.h>
 #include <vtkProperty.h>
 #include <vtkRendererCollection.h>
@@ -30,9 +35,18 @@
 #include <vtkRenderWindowInteractor.h>
 #include <vtkSmartPointer.h>
 #include <vtkSphereSource.h>
+#include <vtkTimerLog.h>
 #include <vtkVectorText.h>
 
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
 #include <sstream>
+#include <string>
+
+#include "PointIndex.h"
+#include "QuantizedPointCloud.h"
+#include "TriangleBVH.h"
 
 vtkStandardNewMacro(PointSelectionStyle3D);
 
@@ -40,6 +54,16 @@ PointSelectionStyle3D::PointSelectionStyle3D()
 {
   
   this->MarkerRadius = .05;
+  this->Data = NULL;
+  this->Surface = NULL;
+  this->FullResolutionPoints = NULL;
+  this->CompactFullResolutionPoints = NULL;
+  this->Origin[0] = this->Origin[1] = this->Origin[2] = 0;
+  this->Correspondences = NULL;
+  this->LastKeypoint = 0;
+  this->DraggedKeypoint = 0;
+  this->DragPoint[0] = this->DragPoint[1] = this->DragPoint[2] = 0;
+  this->Index = NULL;
   
   // Create a sphere to use as the dot
   this->DotSource = vtkSmartPointer<vtkSphereSource>::New();
@@ -55,34 +79,80 @@ void PointSelectionStyle3D::SetMarkerRadius(float radius)
   this->DotSource->Update();
 }
 
+void PointSelectionStyle3D::SceneToWorld(const double scene[3], double world[3]) const
+{
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    world[i] = scene[i] + this->Origin[i];
+    }
+}
+
+void PointSelectionStyle3D::WorldToScene(const double world[3], double scene[3]) const
+{
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    scene[i] = world[i] - this->Origin[i];
+    }
+}
+
 void PointSelectionStyle3D::OnLeftButtonDown() 
 {
-  //std::cout << "Picking pixel: " << this->Interactor->GetEventPosition()[0] << " " << this->Interactor->GetEventPosition()[1] << std::endl;
-  //int success = vtkPointPicker::SafeDownCast(this->Interactor->GetPicker())->Pick(this->Interactor->GetEventPosition()[0],
-  vtkPointPicker::SafeDownCast(this->Interactor->GetPicker())->Pick(this->Interactor->GetEventPosition()[0],
-	  this->Interactor->GetEventPosition()[1],
-	  0,  // always zero.
-	  this->CurrentRenderer);
-  //std::cout << "Success? " << success << std::endl;
+  // A plain click starts a rotation, so there is nothing to pick
+  if(!this->Interactor->GetShiftKey() && !this->Interactor->GetControlKey())
+    {
+    vtkInteractorStyleTrackballCamera::OnLeftButtonDown();
+    return;
+    }
 
-  if(vtkPointPicker::SafeDownCast(this->Interactor->GetPicker())->GetDataSet() != this->Data)
+  // Grab the marker under the mouse
+  if(this->Interactor->GetControlKey() && this->Correspondences)
     {
-    std::cerr << "Did not pick from the correct data set!" << std::endl;
+    CorrespondenceModel::Id id = FindMarker(this->Interactor->GetEventPosition(), 5);
+    if(id != 0)
+      {
+      Coord3D coord = this->Correspondences->GetWorldPoint(id);
+      this->DraggedKeypoint = id;
+      this->DragPoint[0] = coord.x;
+      this->DragPoint[1] = coord.y;
+      this->DragPoint[2] = coord.z;
+      this->InvokeEvent(KeypointGrabbedEvent, NULL);
+      return;
+      }
     }
-  /*
-  vtkIdType pointId = vtkPointPicker::SafeDownCast(this->Interactor->GetPicker())->GetPointId();
-  double p[3];
-  this->Data->GetPoint(pointId, p);
-  
-  //std::cout << "Picked point: " << pointId << std::endl;
-  //std::cout << "Point: " << pointId << " should have coordinate: " << p[0] << " " << p[1] << " " << p[2] << std::endl;
-  */
+
   double picked[3] = {0,0,0};
-  
-  vtkPointPicker::SafeDownCast(this->Interactor->GetPicker())->GetPickPosition(picked);
+
+  if(this->Surface)
+    {
+    if(!PickSurface(picked))
+      {
+      vtkInteractorStyleTrackballCamera::OnLeftButtonDown();
+      return;
+      }
+    }
+  else
+    {
+    vtkPointPicker::SafeDownCast(this->Interactor->GetPicker())->Pick(this->Interactor->GetEventPosition()[0],
+	    this->Interactor->GetEventPosition()[1],
+	    0,  // always zero.
+	    this->CurrentRenderer);
+
+    if(vtkPointPicker::SafeDownCast(this->Interactor->GetPicker())->GetDataSet() != this->Data)
+      {
+      std::cerr << "Did not pick from the correct data set!" << std::endl;
+      }
+
+    // The picked vertex, or the full resolution point it stands for
+    vtkIdType pointId = vtkPointPicker::SafeDownCast(this->Interactor->GetPicker())->GetPointId();
+    if(pointId < 0)
+      {
+      vtkInteractorStyleTrackballCamera::OnLeftButtonDown();
+      return;
+      }
+    GetFullResolutionPoint(pointId, picked);
+    }
   //std::cout << "Picked point with coordinate: " << picked[0] << " " << picked[1] << " " << picked[2] << std::endl;
 
-  
   if(this->Interactor->GetShiftKey())
     {
     this->CurrentRenderer->GetActiveCamera()->SetFocalPoint(picked);
@@ -92,6 +162,7 @@ void PointSelectionStyle3D::OnLeftButtonDown()
   if(this->Interactor->GetControlKey())
     {
     AddNumber(picked);
+    this->InvokeEvent(KeypointClickedEvent, NULL);
     }
 
   // Forward events
@@ -99,31 +170,228 @@ void PointSelectionStyle3D::OnLeftButtonDown()
 
 }
 
-void PointSelectionStyle3D::RemoveAllPoints()
+void PointSelectionStyle3D::GetFullResolutionPoint(const vtkIdType pointId, double p[3]) const
+{
+  vtkIdTypeArray* originalIds = vtkIdTypeArray::SafeDownCast(this->Data->GetPointData()->GetArray("OriginalPointId"));
+  if(this->FullResolutionPoints && originalIds)
+    {
+    this->FullResolutionPoints->GetPoint(originalIds->GetValue(pointId), p);
+    }
+  else if(this->CompactFullResolutionPoints && originalIds)
+    {
+    this->CompactFullResolutionPoints->GetPoint(originalIds->GetValue(pointId), p);
+    }
+  else
+    {
+    this->Data->GetPoint(pointId, p);
+    }
+}
+
+void PointSelectionStyle3D::OnMouseMove()
+{
+  if(this->DraggedKeypoint == 0)
+    {
+    vtkInteractorStyleTrackballCamera::OnMouseMove();
+    return;
+    }
+
+  // Only the dragged marker moves; the others and Correspondences are left alone until it is released
+  double p[3];
+  if(!PickDragged(p))
+    {
+    return;
+    }
+  SceneToWorld(p, this->DragPoint);
+  MoveMarker(this->DraggedKeypoint, p);
+  this->InvokeEvent(KeypointDraggedEvent, NULL);
+  this->Interactor->Render();
+}
+
+void PointSelectionStyle3D::OnLeftButtonUp()
 {
-  for(unsigned int i = 0; i < Coordinates.size(); ++i)
+  if(this->DraggedKeypoint == 0)
+    {
+    vtkInteractorStyleTrackballCamera::OnLeftButtonUp();
+    return;
+    }
+
+  CorrespondenceModel::Id id = this->DraggedKeypoint;
+  this->DraggedKeypoint = 0;
+  this->LastKeypoint = id;
+  Coord3D coord;
+  coord.x = this->DragPoint[0];
+  coord.y = this->DragPoint[1];
+  coord.z = this->DragPoint[2];
+  Coord3D previous = this->Correspondences->GetWorldPoint(id);
+  if(coord.x != previous.x || coord.y != previous.y || coord.z != previous.z)
     {
-    this->CurrentRenderer->RemoveViewProp( Numbers[i]);
-    this->CurrentRenderer->RemoveViewProp( Points[i]);
+    this->Correspondences->SetWorldPoint(id, coord);
+    std::cout << "Moved 3D keypoint " << id << " to " << std::setprecision(12) << coord.x << " " << coord.y << " "
+              << coord.z << std::setprecision(6) << std::endl;
     }
-  Numbers.clear();
-  Points.clear();
-  Coordinates.clear();
+  UpdateMarker(id);
+  this->InvokeEvent(KeypointMovedEvent, NULL);
+  this->Interactor->Render();
+}
+
+bool PointSelectionStyle3D::PickDragged(double picked[3])
+{
+  double origin[3];
+  double direction[3];
+  GetEventRay(origin, direction);
+
+  if(this->Surface)
+    {
+    vtkIdType cellId;
+    return this->Surface->IntersectRay(origin, direction, picked, cellId);
+    }
+
+  if(this->Index && this->Index->GetPoints() == this->Data->GetPoints())
+    {
+    // The first point within 3 pixels of the ray
+    int* size = this->CurrentRenderer->GetSize();
+    double viewAngle = this->CurrentRenderer->GetActiveCamera()->GetViewAngle() * vtkMath::Pi() / 180.0;
+    double pixelAngle = 2.0 * tan(0.5 * viewAngle) / std::max(1, size[1]);
+    std::vector<vtkIdType> ids;
+    this->Index->FindPointsNearRay(origin, direction, 3.0 * pixelAngle, 0, 0, 1, ids);
+    if(ids.empty())
+      {
+      return false;
+      }
+    GetFullResolutionPoint(ids[0], picked);
+    return true;
+    }
+
+  vtkPointPicker* picker = vtkPointPicker::SafeDownCast(this->Interactor->GetPicker());
+  int* position = this->Interactor->GetEventPosition();
+  picker->Pick(position[0], position[1], 0, this->CurrentRenderer);
+  if(picker->GetDataSet() != this->Data || picker->GetPointId() < 0)
+    {
+    return false;
+    }
+  GetFullResolutionPoint(picker->GetPointId(), picked);
+  return true;
+}
+
+void PointSelectionStyle3D::GetEventRay(double origin[3], double direction[3])
+{
+  // The ray through the pixel, from the near to the far clipping plane
+  double nearPoint[4];
+  double farPoint[4];
+  int* position = this->Interactor->GetEventPosition();
+  this->CurrentRenderer->SetDisplayPoint(position[0], position[1], 0);
+  this->CurrentRenderer->DisplayToWorld();
+  this->CurrentRenderer->GetWorldPoint(nearPoint);
+  this->CurrentRenderer->SetDisplayPoint(position[0], position[1], 1);
+  this->CurrentRenderer->DisplayToWorld();
+  this->CurrentRenderer->GetWorldPoint(farPoint);
+
+  double length = 0;
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    nearPoint[i] /= nearPoint[3];
+    farPoint[i] /= farPoint[3];
+    origin[i] = nearPoint[i];
+    direction[i] = farPoint[i] - nearPoint[i];
+    length += direction[i] * direction[i];
+    }
+  length = sqrt(length);
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    direction[i] /= length;
+    }
+}
+
+bool PointSelectionStyle3D::PickSurface(double picked[3])
+{
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  timer->StartTimer();
+
+  double origin[3];
+  double direction[3];
+  GetEventRay(origin, direction);
+
+  vtkIdType cellId;
+  bool hit = this->Surface->IntersectRay(origin, direction, picked, cellId);
+
+  timer->StopTimer();
+  std::cout << "Surface pick took " << 1000.0 * timer->GetElapsedTime() << " ms" << std::endl;
+  return hit;
+}
+
+void PointSelectionStyle3D::OnKeyPress()
+{
+  std::string key = this->Interactor->GetKeySym();
+  if(key == "Delete" && this->Correspondences)
+    {
+    CorrespondenceModel::Id id = FindMarker(this->Interactor->GetEventPosition(), 10);
+    if(id != 0)
+      {
+      this->Correspondences->RemoveWorldPoint(id);
+      UpdateMarker(id);
+      this->InvokeEvent(KeypointDeletedEvent, NULL);
+      }
+    }
+
+  // Forward events
+  vtkInteractorStyleTrackballCamera::OnKeyPress();
 }
 
 void PointSelectionStyle3D::AddNumber(double p[3])
 {
-  // Create the text
-  std::stringstream ss;
-  ss << Coordinates.size();
-  
-  std::cout << "Added 3D keypoint: " << p[0] << " " << p[1] << " " << p[2] << std::endl;
+  if(!this->Correspondences)
+    {
+    return;
+    }
+
+  double world[3];
+  SceneToWorld(p, world);
+  std::cout << "Added 3D keypoint: " << std::setprecision(12) << world[0] << " " << world[1] << " " << world[2]
+            << std::setprecision(6) << std::endl;
   Coord3D coord;
-  coord.x = p[0];
-  coord.y = p[1];
-  coord.z = p[2];
-  Coordinates.push_back(coord);
-  
+  coord.x = world[0];
+  coord.y = world[1];
+  coord.z = world[2];
+  this->LastKeypoint = this->Correspondences->AddWorldPoint(coord);
+  UpdateMarker(this->LastKeypoint);
+}
+
+void PointSelectionStyle3D::UpdateMarker(const CorrespondenceModel::Id id)
+{
+  bool shown = id < this->Points.size() && this->Points[id];
+  if(!this->Correspondences || !this->Correspondences->HasWorldPoint(id))
+    {
+    if(shown)
+      {
+      this->CurrentRenderer->RemoveViewProp( this->Numbers[id]);
+      this->CurrentRenderer->RemoveViewProp( this->Points[id]);
+      this->Numbers[id] = NULL;
+      this->Points[id] = NULL;
+      }
+    return;
+    }
+
+  Coord3D coord = this->Correspondences->GetWorldPoint(id);
+  double world[3] = {coord.x, coord.y, coord.z};
+  double p[3];
+  WorldToScene(world, p);
+
+  if(shown)
+    {
+    MoveMarker(id, p);
+    return;
+    }
+
+  if(id >= this->Points.size())
+    {
+    this->Numbers.resize(id + 1, NULL);
+    this->Points.resize(id + 1, NULL);
+    }
+
+  // Create the text: the correspondence is labeled by its id in both views
+  std::stringstream ss;
+  ss << id;
+
   vtkSmartPointer<vtkVectorText> textSource = vtkSmartPointer<vtkVectorText>::New();
   textSource->SetText( ss.str().c_str() );
 
@@ -139,29 +407,96 @@ void PointSelectionStyle3D::AddNumber(double p[3])
   follower->GetProperty()->SetColor( 1, 0, 0 ); // red
   follower->SetScale( .1, .1, .1 );
 
-  this->Numbers.push_back(follower);
-  this->CurrentRenderer->AddViewProp( follower );
-  
-  /*
-  // Create a blank follower just for testing
-  vtkSmartPointer<vtkFollower> follower = vtkSmartPointer<vtkFollower>::New();
-  this->Numbers.push_back(follower);
+  this->Numbers[id] = follower;
   this->CurrentRenderer->AddViewProp( follower );
-  */
-  
+
   // Create the dot
 
   // Create a mapper
   vtkSmartPointer<vtkPolyDataMapper> sphereMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
   sphereMapper->SetInputConnection( this->DotSource->GetOutputPort() );
 
-  // Create a subclass of vtkActor: a vtkFollower that remains facing the camera
   vtkSmartPointer<vtkActor> sphereActor = vtkSmartPointer<vtkActor>::New();
   sphereActor->SetMapper( sphereMapper );
   sphereActor->SetPosition(p);
   sphereActor->GetProperty()->SetColor( 1, 0, 0 ); // red
 
-  this->Points.push_back(sphereActor);
+  this->Points[id] = sphereActor;
   this->CurrentRenderer->AddViewProp( sphereActor );
 }
 
+void PointSelectionStyle3D::MoveMarker(const CorrespondenceModel::Id id, const double p[3])
+{
+  this->Numbers[id]->SetPosition(p[0], p[1], p[2]);
+  this->Points[id]->SetPosition(p[0], p[1], p[2]);
+}
+
+void PointSelectionStyle3D::UpdateMarkers()
+{
+  CorrespondenceModel::Id end = this->Points.size();
+  if(this->Correspondences)
+    {
+    end = std::max(end, this->Correspondences->GetEndId());
+    }
+  for(CorrespondenceModel::Id id = 1; id < end; ++id)
+    {
+    UpdateMarker(id);
+    }
+}
+
+CorrespondenceModel::Id PointSelectionStyle3D::FindMarker(const int displayPosition[2], const double tolerance)
+{
+  CorrespondenceModel::Id nearest = 0;
+  double nearestDistance = tolerance * tolerance;
+  for(CorrespondenceModel::Id id = 1; id < this->Points.size(); ++id)
+    {
+    if(!this->Points[id])
+      {
+      continue;
+      }
+    double* position = this->Points[id]->GetPosition();
+    this->CurrentRenderer->SetWorldPoint(position[0], position[1], position[2], 1);
+    this->CurrentRenderer->WorldToDisplay();
+    double* display = this->CurrentRenderer->GetDisplayPoint();
+    double dx = display[0] - displayPosition[0];
+    double dy = display[1] - displayPosition[1];
+    if(dx * dx + dy * dy <= nearestDistance)
+      {
+      nearestDistance = dx * dx + dy * dy;
+      nearest = id;
+      }
+    }
+  return nearest;
+}
+
+void PointSelectionStyle3D::SetPointColor(const CorrespondenceModel::Id id, const double color[3])
+{
+  if(id < this->Points.size() && this->Points[id])
+    {
+    this->Points[id]->GetProperty()->SetColor(color[0], color[1], color[2]);
+    }
+}
+
+void PointSelectionStyle3D::ShowCandidate(double p[3])
+{
+  ClearCandidate();
+
+  vtkSmartPointer<vtkPolyDataMapper> sphereMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+  sphereMapper->SetInputConnection( this->DotSource->GetOutputPort() );
+
+  this->Candidate = vtkSmartPointer<vtkActor>::New();
+  this->Candidate->SetMapper( sphereMapper );
+  this->Candidate->SetPosition(p);
+  this->Candidate->SetScale(2);
+  this->Candidate->GetProperty()->SetColor( 1, 1, 0 ); // yellow
+  this->CurrentRenderer->AddViewProp( this->Candidate );
+}
+
+void PointSelectionStyle3D::ClearCandidate()
+{
+  if(this->Candidate)
+    {
+    this->CurrentRenderer->RemoveViewProp( this->Candidate );
+    this->Candidate = NULL;
+    }
+}
@@ -20,6 +20,8 @@
 #define PointSelectionStyle3D_H
 
 // VTK
+#include <vtkActor.h>
+#include <vtkCommand.h>
 #include <vtkInteractorStyleTrackballCamera.h>
 #include <vtkSmartPointer.h>
 #include <vtkSphereSource.h>
@@ -29,6 +31,13 @@
 
 // Custom
 #include "Coord.h"
+#include "CorrespondenceModel.h"
+
+class PointIndex;
+class QuantizedPointCloud;
+class TriangleBVH;
+class vtkPoints;
+class vtkPolyData;
 
 // Define interaction style
 class PointSelectionStyle3D : public vtkInteractorStyleTrackballCamera
@@ -37,25 +46,98 @@ class PointSelectionStyle3D : public vtkInteractorStyleTrackballCamera
     static PointSelectionStyle3D* New();
     PointSelectionStyle3D();
     vtkTypeMacro(PointSelectionStyle3D, vtkInteractorStyleTrackballCamera);
+
+    // Invoked after a keypoint has been clicked (not when points are added programmatically)
+    enum { KeypointClickedEvent = vtkCommand::UserEvent + 1 };
+    // Invoked after the Delete key removed the keypoint under the mouse
+    enum { KeypointDeletedEvent = vtkCommand::UserEvent + 2 };
+    // Invoked when a keypoint is grabbed, as it is dragged (at DragPoint) and once it has been moved there
+    enum { KeypointGrabbedEvent = vtkCommand::UserEvent + 3 };
+    enum { KeypointDraggedEvent = vtkCommand::UserEvent + 4 };
+    enum { KeypointMovedEvent = vtkCommand::UserEvent + 5 };
  
+    // Control clicking on a marker grabs it instead of adding a keypoint
     void OnLeftButtonDown() ;
- 
+    void OnLeftButtonUp();
+    void OnMouseMove();
+    void OnKeyPress();
+
+    // The keypoints, shared with the image view. The point cloud keypoints are shown here.
+    CorrespondenceModel* Correspondences;
+
+    // Markers of the point cloud keypoints by correspondence id, NULL where there is none
     std::vector<vtkActor*> Numbers;
     std::vector<vtkActor*> Points;
-    std::vector<Coord3D> Coordinates;
+
+    // The correspondence of the keypoint clicked or moved last
+    CorrespondenceModel::Id LastKeypoint;
+
+    // The correspondence whose keypoint is being dragged (0 if none) and where it is, in world coordinates.
+    // Correspondences is only changed when the keypoint is released, so the drag is a single step to undo.
+    CorrespondenceModel::Id DraggedKeypoint;
+    double DragPoint[3];
+
+    // The scene shows the points relative to this origin (see Helpers::ShiftToLocalOrigin).
+    // Picks and markers are in scene coordinates, Correspondences are in world coordinates.
+    double Origin[3];
+    void SceneToWorld(const double scene[3], double world[3]) const;
+    void WorldToScene(const double world[3], double scene[3]) const;
 
     vtkSmartPointer<vtkSphereSource> DotSource;
     
+    // Add a keypoint to Correspondences and show it; p is in scene coordinates
     void AddNumber(double p[3]);
 
-    void RemoveAllPoints();
+    // Add, move or remove the marker of one correspondence to match Correspondences, leaving the others alone
+    void UpdateMarker(const CorrespondenceModel::Id id);
+    // All of them, e.g. for a new view of existing correspondences
+    void UpdateMarkers();
+
+    // The correspondence whose marker is nearest a display position, if within 'tolerance' pixels (else 0)
+    CorrespondenceModel::Id FindMarker(const int displayPosition[2], const double tolerance);
+
+    // Color the dot of a keypoint (they are red when added)
+    void SetPointColor(const CorrespondenceModel::Id id, const double color[3]);
 
     vtkPolyData* Data;
+
+    // If Data is a reduced copy of the loaded point cloud (see PointCloudReduction), the full resolution
+    // points. Picked points are then replaced by the full resolution point they stand for.
+    vtkPoints* FullResolutionPoints;
+    // The same, kept compact instead (used when FullResolutionPoints is NULL)
+    const QuantizedPointCloud* CompactFullResolutionPoints;
+
+    // Scene coordinates of the full resolution point behind point pointId of Data
+    void GetFullResolutionPoint(const vtkIdType pointId, double p[3]) const;
+
+    // If set, clicks are intersected with this surface instead of picking the nearest vertex
+    TriangleBVH* Surface;
+
+    // If set and built over the points of Data, a dragged keypoint follows the point under the mouse found
+    // through it rather than by the picker, which tests every point
+    PointIndex* Index;
     
     void SetMarkerRadius(float radius);
-    
+
+    // Highlight a proposed keypoint (yellow) without adding it
+    void ShowCandidate(double p[3]);
+    void ClearCandidate();
+
   private:
+    // The ray through the pixel of the last event, in scene coordinates (direction unit length)
+    void GetEventRay(double origin[3], double direction[3]);
+
+    // Intersect the ray through the clicked pixel with Surface. Returns false if it misses.
+    bool PickSurface(double picked[3]);
+
+    // The point under the mouse while dragging, in scene coordinates. Returns false if there is none.
+    bool PickDragged(double picked[3]);
+
+    // Move the marker of a correspondence, without changing Correspondences; p is in scene coordinates
+    void MoveMarker(const CorrespondenceModel::Id id, const double p[3]);
+
     float MarkerRadius;
+    vtkSmartPointer<vtkActor> Candidate;
   
 };
 
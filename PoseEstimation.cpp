@@ -0,0 +1,629 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "PoseEstimation.h"
+
+// ITK (vnl)
+#include "vnl/vnl_matrix.h"
+#include "vnl/vnl_vector.h"
+#include "vnl/algo/vnl_svd.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+
+// Solve the symmetric positive definite system A x = b (n x n, row major) in place by Cholesky.
+// Returns false if A is not positive definite.
+bool CholeskySolve(std::vector<double>& A, std::vector<double>& b, const unsigned int n)
+{
+  for(unsigned int j = 0; j < n; ++j)
+    {
+    double diagonal = A[j * n + j];
+    for(unsigned int k = 0; k < j; ++k)
+      {
+      diagonal -= A[j * n + k] * A[j * n + k];
+      }
+    if(diagonal <= 0)
+      {
+      return false;
+      }
+    A[j * n + j] = sqrt(diagonal);
+    for(unsigned int i = j + 1; i < n; ++i)
+      {
+      double value = A[i * n + j];
+      for(unsigned int k = 0; k < j; ++k)
+        {
+        value -= A[i * n + k] * A[j * n + k];
+        }
+      A[i * n + j] = value / A[j * n + j];
+      }
+    }
+
+  // L y = b, then L^T x = y
+  for(unsigned int i = 0; i < n; ++i)
+    {
+    for(unsigned int k = 0; k < i; ++k)
+      {
+      b[i] -= A[i * n + k] * b[k];
+      }
+    b[i] /= A[i * n + i];
+    }
+  for(int i = static_cast<int>(n) - 1; i >= 0; --i)
+    {
+    for(unsigned int k = i + 1; k < n; ++k)
+      {
+      b[i] -= A[k * n + i] * b[k];
+      }
+    b[i] /= A[i * n + i];
+    }
+  return true;
+}
+
+// Sum of squared reprojection errors. Points behind the camera are penalized by the focal length.
+double ComputeCost(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints, const Camera& camera)
+{
+  double cost = 0;
+  for(unsigned int i = 0; i < imagePoints.size(); ++i)
+    {
+    double world[3] = {worldPoints[i].x, worldPoints[i].y, worldPoints[i].z};
+    double pixel[2];
+    if(!camera.Project(world, pixel))
+      {
+      cost += 2.0 * camera.FocalLength * camera.FocalLength;
+      continue;
+      }
+    double du = pixel[0] - imagePoints[i].x;
+    double dv = pixel[1] - imagePoints[i].y;
+    cost += du * du + dv * dv;
+    }
+  return cost;
+}
+
+// Projection of a world point and its derivatives with respect to (rotation increment, translation, focal length).
+// The rotation is updated on the left, R <- exp([w]x) R, so the derivative of the camera point is -[R X]x.
+// Returns false if the point is not in front of the camera.
+bool ComputeProjectionJacobian(const Camera& camera, const double R[3][3], const double world[3],
+                               double pixel[2], double J[2][7])
+{
+  double rotated[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    rotated[d] = R[d][0] * world[0] + R[d][1] * world[1] + R[d][2] * world[2];
+    }
+  double point[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    point[d] = rotated[d] + camera.Translation[d];
+    }
+
+  // d(u,v)/d(x,y,z)
+  double dProjection[2][3];
+  if(!camera.ProjectCameraPoint(point, pixel, dProjection))
+    {
+    return false;
+    }
+  // d(x,y,z)/dw = -[rotated]x
+  double dRotation[3][3] = {{0, rotated[2], -rotated[1]},
+                            {-rotated[2], 0, rotated[0]},
+                            {rotated[1], -rotated[0], 0}};
+
+  for(unsigned int row = 0; row < 2; ++row)
+    {
+    for(unsigned int k = 0; k < 3; ++k)
+      {
+      J[row][k] = dProjection[row][0] * dRotation[0][k] + dProjection[row][1] * dRotation[1][k] +
+                  dProjection[row][2] * dRotation[2][k];
+      J[row][k + 3] = dProjection[row][k];
+      }
+    }
+  // The distorted normalized coordinates
+  J[0][6] = (pixel[0] - camera.PrincipalPoint[0]) / camera.FocalLength;
+  J[1][6] = (pixel[1] - camera.PrincipalPoint[1]) / camera.FocalLength;
+  return true;
+}
+
+// Accumulate J^T J and J^T r for the parameters (rotation increment, translation[, focal length])
+void AccumulateNormalEquations(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                               const Camera& camera, const unsigned int numberOfParameters,
+                               std::vector<double>& JtJ, std::vector<double>& Jtr)
+{
+  JtJ.assign(numberOfParameters * numberOfParameters, 0);
+  Jtr.assign(numberOfParameters, 0);
+
+  double R[3][3];
+  camera.GetRotationMatrix(R);
+
+  for(unsigned int i = 0; i < imagePoints.size(); ++i)
+    {
+    double world[3] = {worldPoints[i].x, worldPoints[i].y, worldPoints[i].z};
+    double pixel[2];
+    double J[2][7];
+    if(!ComputeProjectionJacobian(camera, R, world, pixel, J))
+      {
+      continue;
+      }
+    double residual[2] = {pixel[0] - imagePoints[i].x, pixel[1] - imagePoints[i].y};
+
+    for(unsigned int row = 0; row < 2; ++row)
+      {
+      for(unsigned int a = 0; a < numberOfParameters; ++a)
+        {
+        Jtr[a] += J[row][a] * residual[row];
+        for(unsigned int b = 0; b < numberOfParameters; ++b)
+          {
+          JtJ[a * numberOfParameters + b] += J[row][a] * J[row][b];
+          }
+        }
+      }
+    }
+}
+
+// Apply a parameter increment (rotation increment, translation[, focal length])
+Camera UpdateCamera(const Camera& camera, const std::vector<double>& delta, const unsigned int numberOfParameters)
+{
+  Camera updated = camera;
+
+  double increment[3] = {delta[0], delta[1], delta[2]};
+  double incrementRotation[3][3];
+  Camera::RodriguesToMatrix(increment, incrementRotation);
+  double R[3][3];
+  camera.GetRotationMatrix(R);
+  double newR[3][3];
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    for(unsigned int j = 0; j < 3; ++j)
+      {
+      newR[i][j] = incrementRotation[i][0] * R[0][j] + incrementRotation[i][1] * R[1][j] + incrementRotation[i][2] * R[2][j];
+      }
+    }
+  updated.SetRotationMatrix(newR);
+
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    updated.Translation[d] += delta[3 + d];
+    }
+  if(numberOfParameters > 6)
+    {
+    updated.FocalLength += delta[6];
+    }
+  return updated;
+}
+
+// Decompose the left 3x3 block of a projection matrix M = K R with K upper triangular
+// and positive diagonal, using three Givens rotations (Hartley & Zisserman A4.1.1).
+void RQDecomposition(const double M[3][3], double K[3][3], double R[3][3])
+{
+  vnl_matrix<double> A(3, 3);
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    for(unsigned int j = 0; j < 3; ++j)
+      {
+      A(i, j) = M[i][j];
+      }
+    }
+
+  vnl_matrix<double> Qx(3, 3);
+  Qx.set_identity();
+  double r = sqrt(A(2, 2) * A(2, 2) + A(2, 1) * A(2, 1));
+  if(r > 0)
+    {
+    double c = -A(2, 2) / r;
+    double s = A(2, 1) / r;
+    Qx(1, 1) = c; Qx(1, 2) = -s;
+    Qx(2, 1) = s; Qx(2, 2) = c;
+    A = A * Qx;
+    }
+
+  vnl_matrix<double> Qy(3, 3);
+  Qy.set_identity();
+  r = sqrt(A(2, 2) * A(2, 2) + A(2, 0) * A(2, 0));
+  if(r > 0)
+    {
+    double c = A(2, 2) / r;
+    double s = A(2, 0) / r;
+    Qy(0, 0) = c;  Qy(0, 2) = s;
+    Qy(2, 0) = -s; Qy(2, 2) = c;
+    A = A * Qy;
+    }
+
+  vnl_matrix<double> Qz(3, 3);
+  Qz.set_identity();
+  r = sqrt(A(1, 1) * A(1, 1) + A(1, 0) * A(1, 0));
+  if(r > 0)
+    {
+    double c = -A(1, 1) / r;
+    double s = A(1, 0) / r;
+    Qz(0, 0) = c; Qz(0, 1) = -s;
+    Qz(1, 0) = s; Qz(1, 1) = c;
+    A = A * Qz;
+    }
+
+  vnl_matrix<double> rotation = (Qx * Qy * Qz).transpose();
+
+  // Make the diagonal of K positive: K D and D R with D = diag(+-1)
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    if(A(i, i) < 0)
+      {
+      for(unsigned int j = 0; j < 3; ++j)
+        {
+        A(j, i) = -A(j, i);
+        rotation(i, j) = -rotation(i, j);
+        }
+      }
+    }
+
+  for(unsigned int i = 0; i < 3; ++i)
+    {
+    for(unsigned int j = 0; j < 3; ++j)
+      {
+      K[i][j] = A(i, j);
+      R[i][j] = rotation(i, j);
+      }
+    }
+}
+
+} // end anonymous namespace
+
+namespace PoseEstimation
+{
+
+bool EstimateCameraDLT(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints, Camera& camera)
+{
+  if(imagePoints.size() != worldPoints.size() || imagePoints.size() < 6)
+    {
+    std::cerr << "EstimateCameraDLT requires at least 6 correspondences (got " << imagePoints.size()
+              << " image and " << worldPoints.size() << " world points)." << std::endl;
+    return false;
+    }
+
+  const unsigned int numberOfPoints = imagePoints.size();
+
+  // Normalize both point sets (Hartley): zero centroid, average distance sqrt(2) resp. sqrt(3)
+  double imageCentroid[2] = {0, 0};
+  double worldCentroid[3] = {0, 0, 0};
+  for(unsigned int i = 0; i < numberOfPoints; ++i)
+    {
+    imageCentroid[0] += imagePoints[i].x;
+    imageCentroid[1] += imagePoints[i].y;
+    worldCentroid[0] += worldPoints[i].x;
+    worldCentroid[1] += worldPoints[i].y;
+    worldCentroid[2] += worldPoints[i].z;
+    }
+  for(unsigned int d = 0; d < 2; ++d)
+    {
+    imageCentroid[d] /= numberOfPoints;
+    }
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    worldCentroid[d] /= numberOfPoints;
+    }
+
+  double imageScale = 0;
+  double worldScale = 0;
+  for(unsigned int i = 0; i < numberOfPoints; ++i)
+    {
+    double du = imagePoints[i].x - imageCentroid[0];
+    double dv = imagePoints[i].y - imageCentroid[1];
+    imageScale += sqrt(du * du + dv * dv);
+    double dx = worldPoints[i].x - worldCentroid[0];
+    double dy = worldPoints[i].y - worldCentroid[1];
+    double dz = worldPoints[i].z - worldCentroid[2];
+    worldScale += sqrt(dx * dx + dy * dy + dz * dz);
+    }
+  if(imageScale <= 0 || worldScale <= 0)
+    {
+    std::cerr << "EstimateCameraDLT: degenerate correspondences." << std::endl;
+    return false;
+    }
+  imageScale = sqrt(2.0) * numberOfPoints / imageScale;
+  worldScale = sqrt(3.0) * numberOfPoints / worldScale;
+
+  // Each correspondence contributes the two rows of x cross (P X) = 0
+  vnl_matrix<double> A(2 * numberOfPoints, 12, 0.0);
+  for(unsigned int i = 0; i < numberOfPoints; ++i)
+    {
+    double u = (imagePoints[i].x - imageCentroid[0]) * imageScale;
+    double v = (imagePoints[i].y - imageCentroid[1]) * imageScale;
+    double X[4] = {(worldPoints[i].x - worldCentroid[0]) * worldScale,
+                   (worldPoints[i].y - worldCentroid[1]) * worldScale,
+                   (worldPoints[i].z - worldCentroid[2]) * worldScale,
+                   1.0};
+    for(unsigned int j = 0; j < 4; ++j)
+      {
+      A(2 * i, 4 + j) = -X[j];
+      A(2 * i, 8 + j) = v * X[j];
+      A(2 * i + 1, j) = X[j];
+      A(2 * i + 1, 8 + j) = -u * X[j];
+      }
+    }
+
+  vnl_svd<double> svd(A);
+  vnl_vector<double> p = svd.nullvector();
+
+  vnl_matrix<double> normalizedP(3, 4);
+  for(unsigned int row = 0; row < 3; ++row)
+    {
+    for(unsigned int column = 0; column < 4; ++column)
+      {
+      normalizedP(row, column) = p[4 * row + column];
+      }
+    }
+
+  // Undo the normalization: P = T2^-1 * normalizedP * T3
+  vnl_matrix<double> inverseImageTransform(3, 3, 0.0);
+  inverseImageTransform(0, 0) = 1.0 / imageScale;
+  inverseImageTransform(1, 1) = 1.0 / imageScale;
+  inverseImageTransform(0, 2) = imageCentroid[0];
+  inverseImageTransform(1, 2) = imageCentroid[1];
+  inverseImageTransform(2, 2) = 1.0;
+
+  vnl_matrix<double> worldTransform(4, 4, 0.0);
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    worldTransform(d, d) = worldScale;
+    worldTransform(d, 3) = -worldScale * worldCentroid[d];
+    }
+  worldTransform(3, 3) = 1.0;
+
+  vnl_matrix<double> P = inverseImageTransform * normalizedP * worldTransform;
+
+  double M[3][3];
+  for(unsigned int row = 0; row < 3; ++row)
+    {
+    for(unsigned int column = 0; column < 3; ++column)
+      {
+      M[row][column] = P(row, column);
+      }
+    }
+
+  // The null vector has an arbitrary sign. With det(M) > 0, points in front of the camera have positive depth.
+  double determinant = M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1])
+                     - M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0])
+                     + M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
+  if(determinant < 0)
+    {
+    P *= -1.0;
+    for(unsigned int row = 0; row < 3; ++row)
+      {
+      for(unsigned int column = 0; column < 3; ++column)
+        {
+        M[row][column] = -M[row][column];
+        }
+      }
+    }
+
+  double K[3][3];
+  double R[3][3];
+  RQDecomposition(M, K, R);
+
+  // t = K^-1 p4 by back substitution
+  double t[3];
+  t[2] = P(2, 3) / K[2][2];
+  t[1] = (P(1, 3) - K[1][2] * t[2]) / K[1][1];
+  t[0] = (P(0, 3) - K[0][1] * t[1] - K[0][2] * t[2]) / K[0][0];
+
+  camera.SetRotationMatrix(R);
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    camera.Translation[d] = t[d];
+    }
+  camera.FocalLength = 0.5 * (K[0][0] + K[1][1]) / K[2][2];
+  camera.PrincipalPoint[0] = K[0][2] / K[2][2];
+  camera.PrincipalPoint[1] = K[1][2] / K[2][2];
+
+  return true;
+}
+
+bool RefineCamera(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                  const bool refineFocalLength, Camera& camera, const unsigned int maximumNumberOfIterations)
+{
+  const unsigned int numberOfParameters = refineFocalLength ? 7 : 6;
+  if(imagePoints.size() != worldPoints.size() || 2 * imagePoints.size() < numberOfParameters)
+    {
+    std::cerr << "RefineCamera: not enough correspondences." << std::endl;
+    return false;
+    }
+
+  // Levenberg-Marquardt with analytic derivatives
+  double cost = ComputeCost(imagePoints, worldPoints, camera);
+  double lambda = 1e-3;
+  std::vector<double> JtJ;
+  std::vector<double> Jtr;
+  for(unsigned int iteration = 0; iteration < maximumNumberOfIterations; ++iteration)
+    {
+    AccumulateNormalEquations(imagePoints, worldPoints, camera, numberOfParameters, JtJ, Jtr);
+
+    bool improved = false;
+    while(!improved && lambda < 1e10)
+      {
+      std::vector<double> A = JtJ;
+      std::vector<double> delta(numberOfParameters);
+      for(unsigned int a = 0; a < numberOfParameters; ++a)
+        {
+        A[a * numberOfParameters + a] += lambda * (JtJ[a * numberOfParameters + a] + 1e-12);
+        delta[a] = -Jtr[a];
+        }
+      if(CholeskySolve(A, delta, numberOfParameters))
+        {
+        Camera candidate = UpdateCamera(camera, delta, numberOfParameters);
+        double candidateCost = ComputeCost(imagePoints, worldPoints, candidate);
+        if(candidateCost < cost)
+          {
+          improved = true;
+          bool converged = cost - candidateCost < 1e-12 * cost;
+          camera = candidate;
+          cost = candidateCost;
+          lambda = std::max(1e-12, lambda * 0.1);
+          if(converged)
+            {
+            return true;
+            }
+          continue;
+          }
+        }
+      lambda *= 10;
+      }
+    if(!improved)
+      {
+      break;
+      }
+    }
+
+  return true;
+}
+
+bool EstimateCamera(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints, Camera& camera)
+{
+  if(!EstimateCameraDLT(imagePoints, worldPoints, camera))
+    {
+    return false;
+    }
+  return RefineCamera(imagePoints, worldPoints, true, camera);
+}
+
+bool EstimatePose(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                  const bool usePose, Camera& camera)
+{
+  if(!usePose)
+    {
+    // The DLT models a pinhole, so remove the distortion from the keypoints first
+    std::vector<Coord2D> undistortedPoints(imagePoints.size());
+    for(unsigned int i = 0; i < imagePoints.size(); ++i)
+      {
+      double distorted[2] = {(imagePoints[i].x - camera.PrincipalPoint[0]) / camera.FocalLength,
+                             (imagePoints[i].y - camera.PrincipalPoint[1]) / camera.FocalLength};
+      double normalized[2];
+      camera.Undistort(distorted, normalized);
+      undistortedPoints[i].x = camera.FocalLength * normalized[0] + camera.PrincipalPoint[0];
+      undistortedPoints[i].y = camera.FocalLength * normalized[1] + camera.PrincipalPoint[1];
+      }
+    Camera initial;
+    if(!EstimateCameraDLT(undistortedPoints, worldPoints, initial))
+      {
+      return false;
+      }
+
+    // Keep the DLT's rotation and center, which depend less on its focal length than the translation does
+    double R[3][3];
+    initial.GetRotationMatrix(R);
+    double center[3];
+    initial.GetCenter(center);
+    camera.SetRotationMatrix(R);
+    for(unsigned int i = 0; i < 3; ++i)
+      {
+      camera.Translation[i] = -(R[i][0] * center[0] + R[i][1] * center[1] + R[i][2] * center[2]);
+      }
+    }
+  return RefineCamera(imagePoints, worldPoints, false, camera);
+}
+
+double ComputeRMSReprojectionError(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                                   const Camera& camera)
+{
+  if(imagePoints.empty())
+    {
+    return 0;
+    }
+
+  double sumOfSquares = 0;
+  for(unsigned int i = 0; i < imagePoints.size(); ++i)
+    {
+    double world[3] = {worldPoints[i].x, worldPoints[i].y, worldPoints[i].z};
+    double pixel[2];
+    if(!camera.Project(world, pixel))
+      {
+      return HUGE_VAL;
+      }
+    double du = pixel[0] - imagePoints[i].x;
+    double dv = pixel[1] - imagePoints[i].y;
+    sumOfSquares += du * du + dv * dv;
+    }
+  return sqrt(sumOfSquares / imagePoints.size());
+}
+
+bool ComputePoseCovariance(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                           const Camera& camera, double covariance[6][6])
+{
+  const unsigned int numberOfParameters = Camera::NumberOfPoseParameters;
+  if(imagePoints.size() != worldPoints.size() || 2 * imagePoints.size() <= numberOfParameters)
+    {
+    std::cerr << "ComputePoseCovariance: more than 3 correspondences are required." << std::endl;
+    return false;
+    }
+
+  std::vector<double> JtJ;
+  std::vector<double> Jtr;
+  AccumulateNormalEquations(imagePoints, worldPoints, camera, numberOfParameters, JtJ, Jtr);
+
+  // Residual variance with the degrees of freedom taken by the fit
+  double variance = ComputeCost(imagePoints, worldPoints, camera) / (2.0 * imagePoints.size() - numberOfParameters);
+
+  for(unsigned int column = 0; column < numberOfParameters; ++column)
+    {
+    std::vector<double> A = JtJ;
+    std::vector<double> unit(numberOfParameters, 0);
+    unit[column] = 1;
+    if(!CholeskySolve(A, unit, numberOfParameters))
+      {
+      std::cerr << "ComputePoseCovariance: the pose is not constrained by the correspondences." << std::endl;
+      return false;
+      }
+    for(unsigned int row = 0; row < numberOfParameters; ++row)
+      {
+      covariance[row][column] = variance * unit[row];
+      }
+    }
+  return true;
+}
+
+bool ProjectWithCovariance(const Camera& camera, const double poseCovariance[6][6], const double world[3],
+                           double pixel[2], double pixelCovariance[2][2])
+{
+  double R[3][3];
+  camera.GetRotationMatrix(R);
+  double J[2][7];
+  if(!ComputeProjectionJacobian(camera, R, world, pixel, J))
+    {
+    return false;
+    }
+
+  // J * C * J^T over the pose parameters
+  for(unsigned int a = 0; a < 2; ++a)
+    {
+    for(unsigned int b = 0; b < 2; ++b)
+      {
+      double sum = 0;
+      for(unsigned int i = 0; i < 6; ++i)
+        {
+        for(unsigned int j = 0; j < 6; ++j)
+          {
+          sum += J[a][i] * poseCovariance[i][j] * J[b][j];
+          }
+        }
+      pixelCovariance[a][b] = sum;
+      }
+    }
+  return true;
+}
+
+} // end namespace
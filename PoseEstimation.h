@@ -0,0 +1,69 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef POSEESTIMATION_H
+#define POSEESTIMATION_H
+
+// STL
+#include <vector>
+
+// Custom
+#include "Camera.h"
+#include "Coord.h"
+
+// Camera estimation from 2D/3D correspondences (the point pairs selected in the two views).
+namespace PoseEstimation
+{
+
+// Direct linear transform. At least 6 correspondences are required.
+// The resulting projection matrix is decomposed into a Camera (skew and aspect ratio are discarded).
+bool EstimateCameraDLT(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints, Camera& camera);
+
+// Minimize the reprojection error with Levenberg-Marquardt starting from 'camera'.
+// The pose is always refined, the focal length only if requested. A start close to the solution
+// (e.g. the solution for nearly the same pairs) needs only a few iterations.
+// This does not use vnl (whose netlib backends keep static state), so it may be called from several threads.
+bool RefineCamera(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                  const bool refineFocalLength, Camera& camera, const unsigned int maximumNumberOfIterations = 100);
+
+// DLT followed by refinement of the pose and focal length
+bool EstimateCamera(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints, Camera& camera);
+
+// The pose alone (6 DoF) of a camera whose intrinsics and distortion are known (see CameraCalibration).
+// If 'usePose' the refinement starts from the pose in 'camera', which needs only 3 correspondences;
+// otherwise the start is the DLT pose of the undistorted keypoints, which needs 6.
+bool EstimatePose(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                  const bool usePose, Camera& camera);
+
+double ComputeRMSReprojectionError(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                                   const Camera& camera);
+
+// Covariance of the pose at a least squares solution, sigma^2 (J^T J)^-1, with sigma^2 estimated from the residuals.
+// The parameters are a rotation increment applied on the left of the rotation (R <- exp([w]x) R) followed by
+// the translation. At least 4 correspondences are required.
+bool ComputePoseCovariance(const std::vector<Coord2D>& imagePoints, const std::vector<Coord3D>& worldPoints,
+                           const Camera& camera, double covariance[6][6]);
+
+// Project a world point and propagate the pose covariance to the pixel (first order).
+// Returns false if the point is not in front of the camera.
+bool ProjectWithCovariance(const Camera& camera, const double poseCovariance[6][6], const double world[3],
+                           double pixel[2], double pixelCovariance[2][2]);
+
+} // end namespace
+
+#endif
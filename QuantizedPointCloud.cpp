@@ -0,0 +1,450 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "QuantizedPointCloud.h"
+
+// VTK
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+// Custom
+#include "Helpers.h"
+#include "Parallel.h"
+
+namespace
+{
+
+// The largest offset within a cell and the largest octahedral coordinate
+const double MaximumOffset = 65535;
+const float MaximumOctahedral = 255;
+
+unsigned short Quantize(const double value, const double maximum)
+{
+  return static_cast<unsigned short>(std::min(maximum, std::max(0.0, floor(value + 0.5))));
+}
+
+// The unit vector is projected onto the octahedron |x| + |y| + |z| = 1, whose lower half is folded over
+// the upper one, so (x, y) covers the square [-1, 1]^2
+void EncodeNormal(const double normal[3], unsigned char encoded[2])
+{
+  double length = fabs(normal[0]) + fabs(normal[1]) + fabs(normal[2]);
+  double x = length > 0 ? normal[0] / length : 0;
+  double y = length > 0 ? normal[1] / length : 0;
+  if(length > 0 && normal[2] < 0)
+    {
+    double folded = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+    y = (1 - fabs(x)) * (y >= 0 ? 1 : -1);
+    x = folded;
+    }
+  encoded[0] = static_cast<unsigned char>(Quantize((x + 1) * 0.5 * MaximumOctahedral, MaximumOctahedral));
+  encoded[1] = static_cast<unsigned char>(Quantize((y + 1) * 0.5 * MaximumOctahedral, MaximumOctahedral));
+}
+
+void DecodeNormal(const unsigned char encoded[2], float normal[3])
+{
+  float x = encoded[0] * (2 / MaximumOctahedral) - 1;
+  float y = encoded[1] * (2 / MaximumOctahedral) - 1;
+  float z = 1 - fabs(x) - fabs(y);
+  if(z < 0)
+    {
+    float folded = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+    y = (1 - fabs(x)) * (y >= 0 ? 1 : -1);
+    x = folded;
+    }
+  float length = sqrt(x * x + y * y + z * z);
+  normal[0] = x / length;
+  normal[1] = y / length;
+  normal[2] = z / length;
+}
+
+// Quantize a block of points, recording the runs of its points that share a cell
+struct EncodeFunctor
+{
+  vtkPoints* Points;
+  double Origin[3];
+  double CellSize;
+  double Step;
+  unsigned int MaximumCell;
+  unsigned short* Offsets;
+  vtkDataArray* Normals;
+  unsigned char* EncodedNormals;
+  vtkDataArray* Intensity;
+  double IntensityMinimum;
+  double IntensityStep;
+  unsigned short* EncodedIntensity;
+  std::vector<std::vector<vtkIdType> >* RunStarts; // per thread
+  std::vector<std::vector<unsigned int> >* RunCells; // per thread
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int threadId)
+  {
+    std::vector<vtkIdType>& runStarts = (*this->RunStarts)[threadId];
+    std::vector<unsigned int>& runCells = (*this->RunCells)[threadId];
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      double p[3];
+      this->Points->GetPoint(i, p);
+      unsigned int cell[3];
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        double position = p[d] - this->Origin[d];
+        cell[d] = static_cast<unsigned int>(std::min<double>(this->MaximumCell,
+                                                             std::max(0.0, floor(position / this->CellSize))));
+        this->Offsets[3 * i + d] = Quantize((position - cell[d] * this->CellSize) / this->Step, MaximumOffset);
+        }
+      if(i == begin || cell[0] != runCells[runCells.size() - 3] || cell[1] != runCells[runCells.size() - 2] ||
+         cell[2] != runCells[runCells.size() - 1])
+        {
+        runStarts.push_back(i);
+        runCells.insert(runCells.end(), cell, cell + 3);
+        }
+
+      if(this->Normals)
+        {
+        double normal[3];
+        this->Normals->GetTuple(i, normal);
+        EncodeNormal(normal, this->EncodedNormals + 2 * i);
+        }
+      if(this->Intensity)
+        {
+        this->EncodedIntensity[i] = Quantize((this->Intensity->GetComponent(i, 0) - this->IntensityMinimum) /
+                                             this->IntensityStep, MaximumOffset);
+        }
+      }
+  }
+};
+
+// Decode a block of points. Within a run, the corner of its cell is added to the offsets in one plain
+// loop the compiler can vectorize.
+struct DecodeFunctor
+{
+  const vtkIdType* RunStarts;
+  size_t NumberOfRuns;
+  const unsigned int* RunCells;
+  const unsigned short* Offsets;
+  double Origin[3];
+  double CellSize;
+  float Step;
+  float* Coordinates;
+  const unsigned char* Normals;
+  float* DecodedNormals;
+  const unsigned short* Intensity;
+  float IntensityMinimum;
+  float IntensityStep;
+  float* DecodedIntensity;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    size_t run = std::upper_bound(this->RunStarts, this->RunStarts + this->NumberOfRuns, begin) - this->RunStarts - 1;
+    for(vtkIdType first = begin; first < end; ++run)
+      {
+      vtkIdType last = run + 1 < this->NumberOfRuns ? std::min(end, this->RunStarts[run + 1]) : end;
+      float corner[3];
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        corner[d] = static_cast<float>(this->Origin[d] + this->RunCells[3 * run + d] * this->CellSize);
+        }
+      const unsigned short* offsets = this->Offsets + 3 * first;
+      float* coordinates = this->Coordinates + 3 * first;
+      const vtkIdType numberOfValues = 3 * (last - first);
+      for(vtkIdType j = 0; j < numberOfValues; j += 3)
+        {
+        coordinates[j] = corner[0] + this->Step * offsets[j];
+        coordinates[j + 1] = corner[1] + this->Step * offsets[j + 1];
+        coordinates[j + 2] = corner[2] + this->Step * offsets[j + 2];
+        }
+      first = last;
+      }
+
+    if(this->Normals)
+      {
+      for(vtkIdType i = begin; i < end; ++i)
+        {
+        DecodeNormal(this->Normals + 2 * i, this->DecodedNormals + 3 * i);
+        }
+      }
+    if(this->Intensity)
+      {
+      for(vtkIdType i = begin; i < end; ++i)
+        {
+        this->DecodedIntensity[i] = this->IntensityMinimum + this->IntensityStep * this->Intensity[i];
+        }
+      }
+  }
+};
+
+} // end anonymous namespace
+
+// The largest angle between a unit normal and its decoding, found by sampling the sphere, rounded up
+const double QuantizedPointCloud::MaximumNormalError = 1;
+
+QuantizedPointCloud::QuantizedPointCloud()
+{
+  Clear();
+}
+
+void QuantizedPointCloud::Clear()
+{
+  this->NumberOfPoints = 0;
+  this->Origin[0] = this->Origin[1] = this->Origin[2] = 0;
+  this->CellSize = 1;
+  this->Step = this->CellSize / MaximumOffset;
+  // Swapped out rather than cleared, so the memory is freed
+  std::vector<vtkIdType>().swap(this->RunStarts);
+  std::vector<unsigned int>().swap(this->RunCells);
+  std::vector<unsigned short>().swap(this->Offsets);
+  this->NormalsName.clear();
+  std::vector<unsigned char>().swap(this->Normals);
+  std::vector<unsigned short>().swap(this->Intensity);
+  this->IntensityMinimum = 0;
+  this->IntensityStep = 1;
+  this->OtherArrays.clear();
+}
+
+void QuantizedPointCloud::Encode(vtkPolyData* input, const double precision)
+{
+  Clear();
+  vtkPoints* points = input->GetPoints();
+  if(!points || input->GetNumberOfPoints() == 0)
+    {
+    return;
+    }
+  this->NumberOfPoints = input->GetNumberOfPoints();
+
+  // The octree's root is the bounding cube of the points. Its cells are halved until the offsets are
+  // fine enough, a decoded coordinate being off by half a step at most.
+  double bounds[6];
+  points->GetBounds(bounds);
+  double rootSize = std::max(bounds[1] - bounds[0], std::max(bounds[3] - bounds[2], bounds[5] - bounds[4]));
+  this->CellSize = rootSize > 0 ? rootSize : 1;
+  unsigned int level = 0;
+  while(this->CellSize > 2 * precision * MaximumOffset && level < 30)
+    {
+    this->CellSize /= 2;
+    level++;
+    }
+  this->Step = this->CellSize / MaximumOffset;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    this->Origin[d] = bounds[2 * d];
+    }
+
+  vtkPointData* pointData = input->GetPointData();
+  vtkDataArray* normals = pointData->GetNormals();
+  if(normals && normals->GetNumberOfComponents() == 3)
+    {
+    this->NormalsName = normals->GetName() ? normals->GetName() : "Normals";
+    this->Normals.resize(2 * this->NumberOfPoints);
+    }
+  else
+    {
+    normals = NULL;
+    }
+  vtkDataArray* intensity = pointData->GetArray("Intensity");
+  if(intensity && intensity->GetNumberOfComponents() == 1)
+    {
+    double range[2];
+    intensity->GetRange(range, 0);
+    this->IntensityMinimum = range[0];
+    this->IntensityStep = range[1] > range[0] ? (range[1] - range[0]) / MaximumOffset : 1;
+    this->Intensity.resize(this->NumberOfPoints);
+    }
+  else
+    {
+    intensity = NULL;
+    }
+  for(int a = 0; a < pointData->GetNumberOfArrays(); ++a)
+    {
+    vtkDataArray* array = pointData->GetArray(a);
+    if(array && array != normals && array != intensity)
+      {
+      this->OtherArrays.push_back(array);
+      }
+    }
+
+  this->Offsets.resize(3 * this->NumberOfPoints);
+  std::vector<std::vector<vtkIdType> > threadRunStarts(Parallel::GetNumberOfThreads());
+  std::vector<std::vector<unsigned int> > threadRunCells(Parallel::GetNumberOfThreads());
+  EncodeFunctor encode;
+  encode.Points = points;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    encode.Origin[d] = this->Origin[d];
+    }
+  encode.CellSize = this->CellSize;
+  encode.Step = this->Step;
+  encode.MaximumCell = (1u << level) - 1;
+  encode.Offsets = &this->Offsets[0];
+  encode.Normals = normals;
+  encode.EncodedNormals = normals ? &this->Normals[0] : 0;
+  encode.Intensity = intensity;
+  encode.IntensityMinimum = this->IntensityMinimum;
+  encode.IntensityStep = this->IntensityStep;
+  encode.EncodedIntensity = intensity ? &this->Intensity[0] : 0;
+  encode.RunStarts = &threadRunStarts;
+  encode.RunCells = &threadRunCells;
+  Parallel::For(0, this->NumberOfPoints, encode);
+
+  // The blocks are in order; a run that goes on into the next block is joined up
+  for(unsigned int thread = 0; thread < threadRunStarts.size(); ++thread)
+    {
+    for(unsigned int r = 0; r < threadRunStarts[thread].size(); ++r)
+      {
+      const unsigned int* cell = &threadRunCells[thread][3 * r];
+      size_t numberOfRuns = this->RunStarts.size();
+      if(numberOfRuns > 0 && std::equal(cell, cell + 3, &this->RunCells[3 * (numberOfRuns - 1)]))
+        {
+        continue;
+        }
+      this->RunStarts.push_back(threadRunStarts[thread][r]);
+      this->RunCells.insert(this->RunCells.end(), cell, cell + 3);
+      }
+    }
+}
+
+void QuantizedPointCloud::Decode(vtkPolyData* output) const
+{
+  output->Initialize();
+
+  vtkSmartPointer<vtkFloatArray> coordinates = vtkSmartPointer<vtkFloatArray>::New();
+  coordinates->SetNumberOfComponents(3);
+  coordinates->SetNumberOfTuples(this->NumberOfPoints);
+  vtkSmartPointer<vtkFloatArray> normals;
+  if(!this->Normals.empty())
+    {
+    normals = vtkSmartPointer<vtkFloatArray>::New();
+    normals->SetName(this->NormalsName.c_str());
+    normals->SetNumberOfComponents(3);
+    normals->SetNumberOfTuples(this->NumberOfPoints);
+    }
+  vtkSmartPointer<vtkFloatArray> intensity;
+  if(!this->Intensity.empty())
+    {
+    intensity = vtkSmartPointer<vtkFloatArray>::New();
+    intensity->SetName("Intensity");
+    intensity->SetNumberOfTuples(this->NumberOfPoints);
+    }
+
+  if(this->NumberOfPoints > 0)
+    {
+    DecodeFunctor decode;
+    decode.RunStarts = &this->RunStarts[0];
+    decode.NumberOfRuns = this->RunStarts.size();
+    decode.RunCells = &this->RunCells[0];
+    decode.Offsets = &this->Offsets[0];
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      decode.Origin[d] = this->Origin[d];
+      }
+    decode.CellSize = this->CellSize;
+    decode.Step = static_cast<float>(this->Step);
+    decode.Coordinates = coordinates->GetPointer(0);
+    decode.Normals = normals ? &this->Normals[0] : 0;
+    decode.DecodedNormals = normals ? normals->GetPointer(0) : 0;
+    decode.Intensity = intensity ? &this->Intensity[0] : 0;
+    decode.IntensityMinimum = static_cast<float>(this->IntensityMinimum);
+    decode.IntensityStep = static_cast<float>(this->IntensityStep);
+    decode.DecodedIntensity = intensity ? intensity->GetPointer(0) : 0;
+    Parallel::For(0, this->NumberOfPoints, decode);
+    }
+
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetData(coordinates);
+  output->SetPoints(points);
+  Helpers::AddVertices(output);
+  if(normals)
+    {
+    output->GetPointData()->SetNormals(normals);
+    }
+  if(intensity)
+    {
+    output->GetPointData()->AddArray(intensity);
+    }
+  for(unsigned int a = 0; a < this->OtherArrays.size(); ++a)
+    {
+    output->GetPointData()->AddArray(this->OtherArrays[a]);
+    }
+}
+
+void QuantizedPointCloud::GetPointDataLayout(vtkPointData* layout) const
+{
+  layout->Initialize();
+  if(!this->Normals.empty())
+    {
+    vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+    normals->SetName(this->NormalsName.c_str());
+    normals->SetNumberOfComponents(3);
+    layout->SetNormals(normals);
+    }
+  if(!this->Intensity.empty())
+    {
+    vtkSmartPointer<vtkFloatArray> intensity = vtkSmartPointer<vtkFloatArray>::New();
+    intensity->SetName("Intensity");
+    layout->AddArray(intensity);
+    }
+  for(unsigned int a = 0; a < this->OtherArrays.size(); ++a)
+    {
+    vtkSmartPointer<vtkDataArray> array;
+    array.TakeReference(this->OtherArrays[a]->NewInstance());
+    array->SetName(this->OtherArrays[a]->GetName());
+    array->SetNumberOfComponents(this->OtherArrays[a]->GetNumberOfComponents());
+    layout->AddArray(array);
+    }
+}
+
+size_t QuantizedPointCloud::FindRun(const vtkIdType pointId) const
+{
+  return std::upper_bound(this->RunStarts.begin(), this->RunStarts.end(), pointId) - this->RunStarts.begin() - 1;
+}
+
+void QuantizedPointCloud::GetPoint(const vtkIdType pointId, double point[3]) const
+{
+  size_t run = FindRun(pointId);
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    point[d] = this->Origin[d] + this->RunCells[3 * run + d] * this->CellSize + this->Offsets[3 * pointId + d] * this->Step;
+    }
+}
+
+vtkIdType QuantizedPointCloud::GetNumberOfPoints() const
+{
+  return this->NumberOfPoints;
+}
+
+size_t QuantizedPointCloud::GetSize() const
+{
+  size_t size = this->RunStarts.size() * sizeof(vtkIdType) + this->RunCells.size() * sizeof(unsigned int) +
+                this->Offsets.size() * sizeof(unsigned short) + this->Normals.size() +
+                this->Intensity.size() * sizeof(unsigned short);
+  for(unsigned int a = 0; a < this->OtherArrays.size(); ++a)
+    {
+    size += static_cast<size_t>(this->OtherArrays[a]->GetActualMemorySize()) * 1024;
+    }
+  return size;
+}
+
+double QuantizedPointCloud::GetPrecision() const
+{
+  return 0.5 * this->Step;
+}
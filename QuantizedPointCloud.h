@@ -0,0 +1,105 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef QUANTIZEDPOINTCLOUD_H
+#define QUANTIZEDPOINTCLOUD_H
+
+// VTK
+#include <vtkSmartPointer.h>
+#include <vtkType.h>
+
+// STL
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class vtkDataArray;
+class vtkPointData;
+class vtkPolyData;
+
+// A point cloud held in a fraction of the memory of a vtkPolyData, for points that are kept but not drawn
+// as they are (resident tiles, the full resolution points behind a reduced copy). The points keep their
+// order and are decoded, in parallel, when they are assembled for display or picked.
+//   Positions: 16 bit offsets within the cells of one level of an octree over the points. Each run of
+//              consecutive points in the same cell stores the cell once; scans are stored in sweeps, so
+//              runs are long.
+//   Normals (the normals of the point data): octahedral coordinates, 8 bits each.
+//   "Intensity": 16 bits over its range.
+// Other point data arrays are kept as they are, and faces are dropped. That is 10 bytes per point, plus 20
+// per run, against 28 for float coordinates, normals and intensity, plus the 16 of the vertex cell of each
+// point. Scattered points make short runs, so compare GetSize with the float size before keeping them.
+// Points that are drawn are decoded into a float copy, so the saving is only on the copy kept behind it.
+// Decoded values are off by at most:
+//   positions: the precision they were encoded with, in each coordinate (and float rounding)
+//   normals: 1 degree (MaximumNormalError)
+//   intensity: its range / 131070
+class QuantizedPointCloud
+{
+public:
+  QuantizedPointCloud();
+
+  // Degrees
+  static const double MaximumNormalError;
+
+  // Drop the points
+  void Clear();
+
+  // 'precision' is the largest error of a decoded coordinate; the octree level is the coarsest whose
+  // cells it can be kept within
+  void Encode(vtkPolyData* input, const double precision);
+
+  // The points, with a vertex each, float coordinates, normals and intensity, and the other arrays
+  // (shared, not copied). In parallel.
+  void Decode(vtkPolyData* output) const;
+
+  // Empty arrays of the names and types of the point data arrays Decode makes
+  void GetPointDataLayout(vtkPointData* layout) const;
+
+  // One point, as picked
+  void GetPoint(const vtkIdType pointId, double point[3]) const;
+
+  vtkIdType GetNumberOfPoints() const;
+  // Bytes
+  size_t GetSize() const;
+  // The largest error of a decoded coordinate
+  double GetPrecision() const;
+
+private:
+  // The run a point is in
+  size_t FindRun(const vtkIdType pointId) const;
+
+  vtkIdType NumberOfPoints;
+  double Origin[3]; // the lowest corner of the octree
+  double CellSize;
+  double Step; // of the offsets
+
+  std::vector<vtkIdType> RunStarts; // the first point of each run
+  std::vector<unsigned int> RunCells; // 3 per run
+  std::vector<unsigned short> Offsets; // 3 per point
+
+  std::string NormalsName;
+  std::vector<unsigned char> Normals; // 2 per point, if there are normals
+
+  std::vector<unsigned short> Intensity; // if there is an intensity
+  double IntensityMinimum;
+  double IntensityStep;
+
+  std::vector<vtkSmartPointer<vtkDataArray> > OtherArrays;
+};
+
+#endif
@@ -0,0 +1,269 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Compact points decode to within the documented errors, and their size counts every run
+
+// VTK
+#include <vtkFloatArray.h>
+#include <vtkMath.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Custom
+#include "QuantizedPointCloud.h"
+
+namespace
+{
+
+unsigned int NumberOfFailures = 0;
+
+void Check(const bool condition, const std::string& description)
+{
+  if(!condition)
+    {
+    std::cerr << "Failed: " << description << std::endl;
+    NumberOfFailures++;
+    }
+}
+
+// Decoded values are floats, so they are off by their rounding too
+double FloatRounding(const double value)
+{
+  return 1e-6 * (fabs(value) + 1);
+}
+
+double Random(const double minimum, const double maximum)
+{
+  return minimum + (maximum - minimum) * rand() / RAND_MAX;
+}
+
+// Points scattered in a cube of the given size, so consecutive points are mostly in different octree cells.
+// The first normals are along the axes, where the octahedral encoding folds.
+vtkSmartPointer<vtkPolyData> CreatePoints(const vtkIdType numberOfPoints, const double size, const bool attributes)
+{
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetDataTypeToFloat();
+  points->SetNumberOfPoints(numberOfPoints);
+  vtkSmartPointer<vtkFloatArray> normals = vtkSmartPointer<vtkFloatArray>::New();
+  normals->SetName("Normals");
+  normals->SetNumberOfComponents(3);
+  normals->SetNumberOfTuples(numberOfPoints);
+  vtkSmartPointer<vtkFloatArray> intensity = vtkSmartPointer<vtkFloatArray>::New();
+  intensity->SetName("Intensity");
+  intensity->SetNumberOfTuples(numberOfPoints);
+  vtkSmartPointer<vtkFloatArray> other = vtkSmartPointer<vtkFloatArray>::New();
+  other->SetName("Other");
+  other->SetNumberOfTuples(numberOfPoints);
+
+  const double axes[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+  for(vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+    points->SetPoint(i, Random(-size / 2, size / 2), Random(-size / 2, size / 2), Random(-size / 2, size / 2));
+
+    double normal[3];
+    if(i < 6)
+      {
+      std::copy(axes[i], axes[i] + 3, normal);
+      }
+    else
+      {
+      do
+        {
+        for(unsigned int d = 0; d < 3; ++d)
+          {
+          normal[d] = Random(-1, 1);
+          }
+        } while(vtkMath::Norm(normal) < 1e-3);
+      vtkMath::Normalize(normal);
+      }
+    normals->SetTuple(i, normal);
+
+    intensity->SetValue(i, static_cast<float>(Random(-20, 4075)));
+    other->SetValue(i, static_cast<float>(i));
+    }
+
+  vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+  polyData->SetPoints(points);
+  if(attributes)
+    {
+    polyData->GetPointData()->SetNormals(normals);
+    polyData->GetPointData()->AddArray(intensity);
+    polyData->GetPointData()->AddArray(other);
+    }
+  return polyData;
+}
+
+void TestErrors()
+{
+  const vtkIdType numberOfPoints = 100000;
+  const double precision = 0.001;
+  vtkSmartPointer<vtkPolyData> input = CreatePoints(numberOfPoints, 1000, true);
+
+  QuantizedPointCloud compact;
+  compact.Encode(input, precision);
+  Check(compact.GetNumberOfPoints() == numberOfPoints, "Every point is encoded");
+  Check(compact.GetPrecision() > 0 && compact.GetPrecision() <= precision, "The precision is the one asked for or better");
+
+  vtkSmartPointer<vtkPolyData> output = vtkSmartPointer<vtkPolyData>::New();
+  compact.Decode(output);
+  Check(output->GetNumberOfPoints() == numberOfPoints, "Every point is decoded");
+  Check(output->GetNumberOfVerts() == numberOfPoints, "Every decoded point has a vertex");
+  vtkDataArray* inputNormals = input->GetPointData()->GetNormals();
+  vtkDataArray* inputIntensity = input->GetPointData()->GetArray("Intensity");
+  vtkDataArray* normals = output->GetPointData()->GetNormals();
+  vtkDataArray* intensity = output->GetPointData()->GetArray("Intensity");
+  vtkDataArray* other = output->GetPointData()->GetArray("Other");
+  Check(normals && normals->GetNumberOfTuples() == numberOfPoints, "The normals are decoded");
+  Check(intensity && intensity->GetNumberOfTuples() == numberOfPoints, "The intensity is decoded");
+  Check(other == input->GetPointData()->GetArray("Other"), "Other arrays are shared as they are");
+  if(!normals || !intensity)
+    {
+    return;
+    }
+
+  double intensityRange[2];
+  inputIntensity->GetRange(intensityRange, 0);
+  const double maximumIntensityError = (intensityRange[1] - intensityRange[0]) / 131070;
+
+  double positionError = 0;
+  double pickError = 0;
+  double normalError = 0;
+  double intensityError = 0;
+  vtkIdType wrongPositions = 0;
+  vtkIdType wrongPicks = 0;
+  vtkIdType wrongNormals = 0;
+  vtkIdType wrongIntensities = 0;
+  for(vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+    double point[3];
+    input->GetPoint(i, point);
+    double decoded[3];
+    output->GetPoint(i, decoded);
+    double picked[3];
+    compact.GetPoint(i, picked);
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      double error = fabs(decoded[d] - point[d]);
+      positionError = std::max(positionError, error);
+      if(error > compact.GetPrecision() + FloatRounding(point[d]))
+        {
+        wrongPositions++;
+        }
+      error = fabs(picked[d] - point[d]);
+      pickError = std::max(pickError, error);
+      if(error > compact.GetPrecision() + FloatRounding(point[d]))
+        {
+        wrongPicks++;
+        }
+      }
+
+    double normal[3];
+    inputNormals->GetTuple(i, normal);
+    double decodedNormal[3];
+    normals->GetTuple(i, decodedNormal);
+    double cosine = vtkMath::Dot(normal, decodedNormal) / vtkMath::Norm(decodedNormal);
+    double angle = vtkMath::DegreesFromRadians(acos(std::min(1.0, std::max(-1.0, cosine))));
+    normalError = std::max(normalError, angle);
+    if(!(angle <= QuantizedPointCloud::MaximumNormalError))
+      {
+      wrongNormals++;
+      }
+
+    const double value = inputIntensity->GetTuple1(i);
+    const double error = fabs(intensity->GetTuple1(i) - value);
+    intensityError = std::max(intensityError, error);
+    if(error > maximumIntensityError + FloatRounding(value))
+      {
+      wrongIntensities++;
+      }
+    }
+
+  std::stringstream positions;
+  positions << "Decoded coordinates are within the precision (" << wrongPositions << " are not; the largest error is "
+            << positionError << " against " << compact.GetPrecision() << ")";
+  Check(wrongPositions == 0, positions.str());
+  std::stringstream picks;
+  picks << "Picked coordinates are within the precision (" << wrongPicks << " are not; the largest error is "
+        << pickError << ")";
+  Check(wrongPicks == 0, picks.str());
+  std::stringstream normalDescription;
+  normalDescription << "Decoded normals are within " << QuantizedPointCloud::MaximumNormalError << " degrees ("
+                    << wrongNormals << " are not; the largest error is " << normalError << ")";
+  Check(wrongNormals == 0, normalDescription.str());
+  std::stringstream intensityDescription;
+  intensityDescription << "Decoded intensities are within range / 131070 (" << wrongIntensities
+                       << " are not; the largest error is " << intensityError << " against "
+                       << maximumIntensityError << ")";
+  Check(wrongIntensities == 0, intensityDescription.str());
+}
+
+void TestPositionsOnly()
+{
+  vtkSmartPointer<vtkPolyData> input = CreatePoints(1000, 10, false);
+  QuantizedPointCloud compact;
+  compact.Encode(input, 0.001);
+
+  vtkSmartPointer<vtkPolyData> output = vtkSmartPointer<vtkPolyData>::New();
+  compact.Decode(output);
+  Check(output->GetNumberOfPoints() == 1000 && !output->GetPointData()->GetNormals() &&
+        output->GetPointData()->GetNumberOfArrays() == 0, "Points without point data decode without it");
+
+  // The cube fits one octree cell, so there is a single run: 6 bytes of offsets per point and one cell
+  const size_t expected = 6 * 1000 + sizeof(vtkIdType) + 3 * sizeof(unsigned int);
+  Check(compact.GetSize() == expected, "The size counts the offsets and the runs");
+}
+
+void TestEmpty()
+{
+  vtkSmartPointer<vtkPolyData> input = vtkSmartPointer<vtkPolyData>::New();
+  QuantizedPointCloud compact;
+  compact.Encode(input, 0.001);
+  Check(compact.GetNumberOfPoints() == 0 && compact.GetSize() == 0, "A cloud without points is empty");
+
+  compact.Encode(CreatePoints(10, 1, true), 0.001);
+  compact.Clear();
+  Check(compact.GetNumberOfPoints() == 0 && compact.GetSize() == 0, "Clear drops the points");
+}
+
+} // end anonymous namespace
+
+int main(int, char*[])
+{
+  srand(1);
+  TestErrors();
+  TestPositionsOnly();
+  TestEmpty();
+
+  if(NumberOfFailures > 0)
+    {
+    std::cerr << NumberOfFailures << " checks failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "All checks passed." << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,465 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Point cloud load time benchmark. A synthetic georeferenced scan of each size is written
+// as VTP (the previous only format), LAS, binary PLY and binary / compressed PCD, and each
+// file is then loaded through PointCloudReader the way Form opens it and compared with what was
+// written. The PCD files start with an invalid (NaN) point, as organized clouds do. Files given on
+// the command line after the sizes are timed as well.
+//
+// Usage: ReaderBenchmark [NumberOfPoints ...] [-- file ...]
+
+// VTK
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkMath.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkXMLPolyDataWriter.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Custom
+#include "Parallel.h"
+#include "PointCloudReader.h"
+
+namespace
+{
+
+const unsigned int NumberOfRuns = 3;
+
+// A gently curved sheet 200 m across at UTM-like coordinates, with the attributes a scan has.
+// Coordinates are kept at millimeter resolution so every format stores them exactly.
+struct SyntheticScan
+{
+  std::vector<double> Points;
+  std::vector<unsigned short> Intensity;
+  std::vector<unsigned char> RGB;
+  std::vector<unsigned char> Classification;
+};
+
+void CreateSyntheticScan(const vtkIdType numberOfPoints, SyntheticScan& scan)
+{
+  vtkMath::RandomSeed(0);
+  scan.Points.resize(3 * numberOfPoints);
+  scan.Intensity.resize(numberOfPoints);
+  scan.RGB.resize(3 * numberOfPoints);
+  scan.Classification.resize(numberOfPoints);
+  for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    double x = vtkMath::Random(-100.0, 100.0);
+    double y = vtkMath::Random(-100.0, 100.0);
+    double z = 5.0 * sin(0.05 * x) * cos(0.05 * y);
+    scan.Points[3 * pointId] = floor(1000.0 * (500000.0 + x) + 0.5) / 1000.0;
+    scan.Points[3 * pointId + 1] = floor(1000.0 * (4000000.0 + y) + 0.5) / 1000.0;
+    scan.Points[3 * pointId + 2] = floor(1000.0 * (100.0 + z) + 0.5) / 1000.0;
+    scan.Intensity[pointId] = static_cast<unsigned short>(vtkMath::Random(0, 65535));
+    for(unsigned int c = 0; c < 3; ++c)
+      {
+      scan.RGB[3 * pointId + c] = static_cast<unsigned char>(vtkMath::Random(0, 255));
+      }
+    scan.Classification[pointId] = static_cast<unsigned char>(z > 0 ? 6 : 2);
+    }
+}
+
+template <typename T>
+void Write(std::ostream& stream, const T value)
+{
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// The benchmark writes in the byte order of the machine, which these formats expect to be little endian
+void WriteVTP(const SyntheticScan& scan, const std::string& fileName)
+{
+  vtkIdType numberOfPoints = scan.Intensity.size();
+
+  vtkSmartPointer<vtkDoubleArray> coordinates = vtkSmartPointer<vtkDoubleArray>::New();
+  coordinates->SetNumberOfComponents(3);
+  coordinates->SetNumberOfTuples(numberOfPoints);
+  std::copy(scan.Points.begin(), scan.Points.end(), coordinates->GetPointer(0));
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetData(coordinates);
+
+  vtkSmartPointer<vtkFloatArray> intensity = vtkSmartPointer<vtkFloatArray>::New();
+  intensity->SetName("Intensity");
+  intensity->SetNumberOfTuples(numberOfPoints);
+  std::copy(scan.Intensity.begin(), scan.Intensity.end(), intensity->GetPointer(0));
+
+  vtkSmartPointer<vtkUnsignedCharArray> rgb = vtkSmartPointer<vtkUnsignedCharArray>::New();
+  rgb->SetName("RGB");
+  rgb->SetNumberOfComponents(3);
+  rgb->SetNumberOfTuples(numberOfPoints);
+  std::copy(scan.RGB.begin(), scan.RGB.end(), rgb->GetPointer(0));
+
+  vtkSmartPointer<vtkUnsignedCharArray> classification = vtkSmartPointer<vtkUnsignedCharArray>::New();
+  classification->SetName("Classification");
+  classification->SetNumberOfTuples(numberOfPoints);
+  std::copy(scan.Classification.begin(), scan.Classification.end(), classification->GetPointer(0));
+
+  vtkSmartPointer<vtkCellArray> vertices = vtkSmartPointer<vtkCellArray>::New();
+  vertices->Allocate(2 * numberOfPoints);
+  for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    vertices->InsertNextCell(1, &pointId);
+    }
+
+  vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+  polyData->SetPoints(points);
+  polyData->SetVerts(vertices);
+  polyData->GetPointData()->AddArray(intensity);
+  polyData->GetPointData()->AddArray(rgb);
+  polyData->GetPointData()->AddArray(classification);
+
+  vtkSmartPointer<vtkXMLPolyDataWriter> writer = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+  writer->SetFileName(fileName.c_str());
+  writer->SetInput(polyData);
+  writer->Write();
+}
+
+// LAS 1.2, point format 2 (colors), millimeter scale
+void WriteLAS(const SyntheticScan& scan, const std::string& fileName)
+{
+  vtkIdType numberOfPoints = scan.Intensity.size();
+  double bounds[6] = {1e300, -1e300, 1e300, -1e300, 1e300, -1e300};
+  for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      bounds[2 * d] = std::min(bounds[2 * d], scan.Points[3 * pointId + d]);
+      bounds[2 * d + 1] = std::max(bounds[2 * d + 1], scan.Points[3 * pointId + d]);
+      }
+    }
+  const double offset[3] = {floor(bounds[0]), floor(bounds[2]), floor(bounds[4])};
+
+  char header[227];
+  memset(header, 0, sizeof(header));
+  memcpy(header, "LASF", 4);
+  header[24] = 1;
+  header[25] = 2;
+  unsigned short headerSize = sizeof(header);
+  unsigned int pointDataOffset = sizeof(header);
+  unsigned short recordSize = 26;
+  unsigned int count = static_cast<unsigned int>(numberOfPoints);
+  double scale[3] = {0.001, 0.001, 0.001};
+  double extremes[6] = {bounds[1], bounds[0], bounds[3], bounds[2], bounds[5], bounds[4]};
+  memcpy(header + 94, &headerSize, 2);
+  memcpy(header + 96, &pointDataOffset, 4);
+  header[104] = 2;
+  memcpy(header + 105, &recordSize, 2);
+  memcpy(header + 107, &count, 4);
+  memcpy(header + 131, scale, sizeof(scale));
+  memcpy(header + 155, offset, sizeof(offset));
+  memcpy(header + 179, extremes, sizeof(extremes));
+
+  std::ofstream file(fileName.c_str(), std::ios::binary);
+  file.write(header, sizeof(header));
+  for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      Write<int>(file, static_cast<int>(floor((scan.Points[3 * pointId + d] - offset[d]) / scale[d] + 0.5)));
+      }
+    Write<unsigned short>(file, scan.Intensity[pointId]);
+    Write<unsigned char>(file, 0x09); // return 1 of 1
+    Write<unsigned char>(file, scan.Classification[pointId]);
+    Write<char>(file, 0); // scan angle
+    Write<unsigned char>(file, 0); // user data
+    Write<unsigned short>(file, 0); // point source
+    for(unsigned int c = 0; c < 3; ++c)
+      {
+      Write<unsigned short>(file, static_cast<unsigned short>(scan.RGB[3 * pointId + c] * 257));
+      }
+    }
+}
+
+void WritePLY(const SyntheticScan& scan, const std::string& fileName)
+{
+  vtkIdType numberOfPoints = scan.Intensity.size();
+  std::ofstream file(fileName.c_str(), std::ios::binary);
+  file << "ply\nformat binary_little_endian 1.0\nelement vertex " << numberOfPoints << "\n"
+       << "property double x\nproperty double y\nproperty double z\nproperty ushort intensity\n"
+       << "property uchar red\nproperty uchar green\nproperty uchar blue\nproperty uchar classification\nend_header\n";
+  for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      Write<double>(file, scan.Points[3 * pointId + d]);
+      }
+    Write<unsigned short>(file, scan.Intensity[pointId]);
+    for(unsigned int c = 0; c < 3; ++c)
+      {
+      Write<unsigned char>(file, scan.RGB[3 * pointId + c]);
+      }
+    Write<unsigned char>(file, scan.Classification[pointId]);
+    }
+}
+
+// Store a block as LZF literal runs. Decoding costs the same as for real LZF data of that size.
+void CompressLZFLiterals(const std::vector<char>& data, std::vector<char>& compressed)
+{
+  compressed.clear();
+  for(size_t position = 0; position < data.size(); position += 32)
+    {
+    size_t length = std::min(static_cast<size_t>(32), data.size() - position);
+    compressed.push_back(static_cast<char>(length - 1));
+    compressed.insert(compressed.end(), data.begin() + position, data.begin() + position + length);
+    }
+}
+
+// Preceded by an invalid point, which the reader drops, so the origin must come from the first finite one
+void WritePCD(const SyntheticScan& scan, const std::string& fileName, const bool compressed)
+{
+  vtkIdType numberOfPoints = scan.Intensity.size() + 1;
+  std::ofstream file(fileName.c_str(), std::ios::binary);
+  file << "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\nFIELDS x y z intensity rgb label\n"
+       << "SIZE 8 8 8 2 4 4\nTYPE F F F U F U\nCOUNT 1 1 1 1 1 1\nWIDTH " << numberOfPoints << "\nHEIGHT 1\n"
+       << "VIEWPOINT 0 0 0 1 0 0 0\nPOINTS " << numberOfPoints << "\nDATA " << (compressed ? "binary_compressed" : "binary") << "\n";
+
+  std::vector<double> points(3, std::numeric_limits<double>::quiet_NaN());
+  points.insert(points.end(), scan.Points.begin(), scan.Points.end());
+  std::vector<unsigned short> intensities(1, 0);
+  intensities.insert(intensities.end(), scan.Intensity.begin(), scan.Intensity.end());
+  std::vector<float> packedColors(numberOfPoints, 0);
+  std::vector<unsigned int> labels(numberOfPoints, 0);
+  for(vtkIdType pointId = 1; pointId < numberOfPoints; ++pointId)
+    {
+    const unsigned char* rgb = &scan.RGB[3 * (pointId - 1)];
+    unsigned int color = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+    memcpy(&packedColors[pointId], &color, 4);
+    labels[pointId] = scan.Classification[pointId - 1];
+    }
+
+  if(!compressed)
+    {
+    for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+      {
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        Write<double>(file, points[3 * pointId + d]);
+        }
+      Write<unsigned short>(file, intensities[pointId]);
+      Write<float>(file, packedColors[pointId]);
+      Write<unsigned int>(file, labels[pointId]);
+      }
+    return;
+    }
+
+  // Compressed data holds each field as its own array
+  std::vector<char> fields;
+  fields.reserve(34 * numberOfPoints);
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+      {
+      const char* bytes = reinterpret_cast<const char*>(&points[3 * pointId + d]);
+      fields.insert(fields.end(), bytes, bytes + 8);
+      }
+    }
+  const char* intensity = reinterpret_cast<const char*>(&intensities[0]);
+  fields.insert(fields.end(), intensity, intensity + 2 * numberOfPoints);
+  const char* colors = reinterpret_cast<const char*>(&packedColors[0]);
+  fields.insert(fields.end(), colors, colors + 4 * numberOfPoints);
+  const char* label = reinterpret_cast<const char*>(&labels[0]);
+  fields.insert(fields.end(), label, label + 4 * numberOfPoints);
+
+  std::vector<char> lzf;
+  CompressLZFLiterals(fields, lzf);
+  Write<unsigned int>(file, static_cast<unsigned int>(lzf.size()));
+  Write<unsigned int>(file, static_cast<unsigned int>(fields.size()));
+  file.write(&lzf[0], lzf.size());
+}
+
+double FileSizeInMB(const std::string& fileName)
+{
+  std::ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+  return static_cast<double>(file.tellg()) / (1024.0 * 1024.0);
+}
+
+// Compare the points read with the scan that was written. Float coordinates relative to the local origin
+// are good to well under 0.1 mm over the 200 m of the scan; the attributes must match exactly.
+// Returns false, after printing how they differ, if they do not.
+bool CheckRoundTrip(const SyntheticScan& scan, vtkPolyData* polyData, const double origin[3])
+{
+  const vtkIdType numberOfPoints = scan.Intensity.size();
+  if(polyData->GetNumberOfPoints() != numberOfPoints)
+    {
+    std::cerr << "  Read " << polyData->GetNumberOfPoints() << " of the " << numberOfPoints << " points written!"
+              << std::endl;
+    return false;
+    }
+  vtkDataArray* intensity = polyData->GetPointData()->GetArray("Intensity");
+  vtkDataArray* rgb = polyData->GetPointData()->GetArray("RGB");
+  vtkDataArray* classification = polyData->GetPointData()->GetArray("Classification");
+  if(!intensity || !rgb || !classification)
+    {
+    std::cerr << "  The intensity, colors or classification were not read!" << std::endl;
+    return false;
+    }
+
+  double largestError = 0;
+  vtkIdType numberOfMismatches = 0;
+  for(vtkIdType pointId = 0; pointId < numberOfPoints; ++pointId)
+    {
+    double point[3];
+    polyData->GetPoint(pointId, point);
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      largestError = std::max(largestError, fabs(point[d] + origin[d] - scan.Points[3 * pointId + d]));
+      }
+    bool match = intensity->GetComponent(pointId, 0) == scan.Intensity[pointId] &&
+                 classification->GetComponent(pointId, 0) == scan.Classification[pointId];
+    for(unsigned int c = 0; c < 3; ++c)
+      {
+      match = match && rgb->GetComponent(pointId, c) == scan.RGB[3 * pointId + c];
+      }
+    if(!match)
+      {
+      numberOfMismatches++;
+      }
+    }
+  if(!(largestError < 1e-4) || numberOfMismatches > 0)
+    {
+    std::cerr << "  Round trip: coordinates off by up to " << largestError << ", " << numberOfMismatches
+              << " points with other attributes!" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+// Best of NumberOfRuns loads, so the numbers are not dominated by the first (cold cache) read.
+// The first load is compared with 'scan', if given. Returns false if it cannot be read or does not match.
+bool TimeRead(const std::string& label, const std::string& fileName, const SyntheticScan* scan = NULL)
+{
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double best = 0;
+  vtkIdType numberOfPoints = 0;
+  for(unsigned int run = 0; run < NumberOfRuns; ++run)
+    {
+    vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+    double origin[3];
+    timer->StartTimer();
+    bool success = PointCloudReader::Read(fileName, polyData, origin);
+    timer->StopTimer();
+    if(!success)
+      {
+      std::cerr << "Could not read " << fileName << std::endl;
+      return false;
+      }
+    if(run == 0 && scan && !CheckRoundTrip(*scan, polyData, origin))
+      {
+      std::cerr << label << " does not read back what was written!" << std::endl;
+      return false;
+      }
+    numberOfPoints = polyData->GetNumberOfPoints();
+    if(run == 0 || timer->GetElapsedTime() < best)
+      {
+      best = timer->GetElapsedTime();
+      }
+    }
+
+  double megabytes = FileSizeInMB(fileName);
+  std::cout << std::left << std::setw(22) << label
+            << std::right << std::setw(11) << numberOfPoints << " points"
+            << std::fixed << std::setprecision(1) << std::setw(9) << megabytes << " MB"
+            << std::setprecision(3) << std::setw(9) << best << " s"
+            << std::setprecision(1) << std::setw(8) << numberOfPoints / best / 1e6 << " Mpoints/s"
+            << std::setw(8) << megabytes / best << " MB/s" << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+  return true;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char* argv[])
+{
+  std::vector<vtkIdType> cloudSizes;
+  std::vector<std::string> files;
+  bool readingFiles = false;
+  for(int arg = 1; arg < argc; ++arg)
+    {
+    if(std::string(argv[arg]) == "--")
+      {
+      readingFiles = true;
+      }
+    else if(readingFiles)
+      {
+      files.push_back(argv[arg]);
+      }
+    else
+      {
+      cloudSizes.push_back(atol(argv[arg]));
+      }
+    }
+  if(cloudSizes.empty() && files.empty())
+    {
+    cloudSizes.push_back(1000000);
+    cloudSizes.push_back(10000000);
+    }
+
+  std::cout << "Reading with " << Parallel::GetNumberOfThreads() << " threads, best of "
+            << NumberOfRuns << " runs." << std::endl;
+
+  bool success = true;
+  for(unsigned int size = 0; size < cloudSizes.size(); ++size)
+    {
+    SyntheticScan scan;
+    CreateSyntheticScan(cloudSizes[size], scan);
+
+    const char* labels[] = {"VTP", "LAS", "PLY binary", "PCD binary", "PCD binary_compressed"};
+    const char* fileNames[] = {"ReaderBenchmark.vtp", "ReaderBenchmark.las", "ReaderBenchmark.ply",
+                               "ReaderBenchmark.pcd", "ReaderBenchmarkCompressed.pcd"};
+    WriteVTP(scan, fileNames[0]);
+    WriteLAS(scan, fileNames[1]);
+    WritePLY(scan, fileNames[2]);
+    WritePCD(scan, fileNames[3], false);
+    WritePCD(scan, fileNames[4], true);
+
+    for(unsigned int format = 0; format < 5; ++format)
+      {
+      if(!TimeRead(labels[format], fileNames[format], &scan))
+        {
+        success = false;
+        }
+      remove(fileNames[format]);
+      }
+    }
+
+  for(unsigned int file = 0; file < files.size(); ++file)
+    {
+    TimeRead(files[file], files[file]);
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -19,10 +19,35 @@
 #include <QApplication>
 #include <QCleanlooksStyle>
 
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "CameraCalibration.h"
+#include "CorrespondenceDiagnostics.h"
 #include "Form.h"
+#include "Session.h"
 
 int main( int argc, char** argv )
 {
+  // Batch mode: leave-one-out diagnostics of every frame of a session, without the window
+  if(argc > 1 && std::string(argv[1]) == "--diagnose")
+    {
+    if(argc != 4)
+      {
+      std::cerr << "Usage: " << argv[0] << " --diagnose <session> <output.txt>" << std::endl;
+      return EXIT_FAILURE;
+      }
+    QApplication app( argc, argv, false );
+    Session session;
+    CalibrationStore calibrations;
+    if(!session.Read(argv[2]) || !calibrations.Read(Form::GetCalibrationFileName()))
+      {
+      return EXIT_FAILURE;
+      }
+    return CorrespondenceDiagnostics::WriteSession(session, calibrations, argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
   QApplication app( argc, argv );
 
   QApplication::setStyle(new QCleanlooksStyle);
@@ -0,0 +1,180 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "Session.h"
+
+// STL
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+
+// The rest of the line after the keyword, for file names with spaces
+std::string GetRemainder(std::istringstream& stream)
+{
+  std::string remainder;
+  std::getline(stream >> std::ws, remainder);
+  return remainder;
+}
+
+} // end anonymous namespace
+
+SessionFrame::SessionFrame() : HasPose(false)
+{
+}
+
+void Session::Clear()
+{
+  this->PointCloudFileName.clear();
+  this->Frames.clear();
+}
+
+bool Session::Write(const std::string& fileName) const
+{
+  std::ofstream fout(fileName.c_str());
+  if(!fout)
+    {
+    std::cerr << "Cannot write " << fileName << std::endl;
+    return false;
+    }
+  fout.precision(15); // World coordinates may be georeferenced
+
+  if(!this->PointCloudFileName.empty())
+    {
+    fout << "PointCloud " << this->PointCloudFileName << std::endl;
+    }
+
+  for(unsigned int i = 0; i < this->Frames.size(); ++i)
+    {
+    const SessionFrame& frame = this->Frames[i];
+    fout << "Frame " << frame.ImageFileName << std::endl;
+    if(!frame.CameraId.empty())
+      {
+      fout << "Camera " << frame.CameraId << std::endl;
+      }
+    if(frame.HasPose)
+      {
+      const Camera& pose = frame.Pose;
+      fout << "Pose " << pose.FocalLength << " " << pose.PrincipalPoint[0] << " " << pose.PrincipalPoint[1] << " "
+           << pose.Rotation[0] << " " << pose.Rotation[1] << " " << pose.Rotation[2] << " "
+           << pose.Translation[0] << " " << pose.Translation[1] << " " << pose.Translation[2];
+      if(pose.HasDistortion())
+        {
+        fout << " " << pose.Distortion[0] << " " << pose.Distortion[1] << " "
+             << pose.Distortion[2] << " " << pose.Distortion[3];
+        }
+      fout << std::endl;
+      }
+    for(unsigned int p = 0; p < frame.ImagePoints.size(); ++p)
+      {
+      fout << "ImagePoint " << frame.ImagePoints[p].x << " " << frame.ImagePoints[p].y << std::endl;
+      }
+    for(unsigned int p = 0; p < frame.WorldPoints.size(); ++p)
+      {
+      fout << "WorldPoint " << frame.WorldPoints[p].x << " " << frame.WorldPoints[p].y << " "
+           << frame.WorldPoints[p].z << std::endl;
+      }
+    }
+
+  return fout.good();
+}
+
+bool Session::Read(const std::string& fileName)
+{
+  std::ifstream fin(fileName.c_str());
+  if(!fin)
+    {
+    std::cerr << "Cannot open " << fileName << std::endl;
+    return false;
+    }
+
+  Session session;
+  std::string line;
+  unsigned int lineNumber = 0;
+  while(std::getline(fin, line))
+    {
+    lineNumber++;
+    std::istringstream ss(line);
+    std::string keyword;
+    if(!(ss >> keyword) || keyword[0] == '#')
+      {
+      continue;
+      }
+
+    if(keyword == "PointCloud")
+      {
+      session.PointCloudFileName = GetRemainder(ss);
+      continue;
+      }
+    if(keyword == "Frame")
+      {
+      session.Frames.push_back(SessionFrame());
+      session.Frames.back().ImageFileName = GetRemainder(ss);
+      continue;
+      }
+
+    if(session.Frames.empty())
+      {
+      std::cerr << fileName << " line " << lineNumber << ": " << keyword << " before the first Frame." << std::endl;
+      return false;
+      }
+    SessionFrame& frame = session.Frames.back();
+    bool valid = false;
+    if(keyword == "Camera")
+      {
+      frame.CameraId = GetRemainder(ss);
+      valid = !frame.CameraId.empty();
+      }
+    else if(keyword == "Pose")
+      {
+      Camera& pose = frame.Pose;
+      valid = static_cast<bool>(ss >> pose.FocalLength >> pose.PrincipalPoint[0] >> pose.PrincipalPoint[1]
+                                   >> pose.Rotation[0] >> pose.Rotation[1] >> pose.Rotation[2]
+                                   >> pose.Translation[0] >> pose.Translation[1] >> pose.Translation[2]);
+      // The distortion is optional, but then all four coefficients are required
+      if(valid && ss >> pose.Distortion[0])
+        {
+        valid = static_cast<bool>(ss >> pose.Distortion[1] >> pose.Distortion[2] >> pose.Distortion[3]);
+        }
+      frame.HasPose = valid;
+      }
+    else if(keyword == "ImagePoint")
+      {
+      Coord2D coord;
+      valid = static_cast<bool>(ss >> coord.x >> coord.y);
+      frame.ImagePoints.push_back(coord);
+      }
+    else if(keyword == "WorldPoint")
+      {
+      Coord3D coord;
+      valid = static_cast<bool>(ss >> coord.x >> coord.y >> coord.z);
+      frame.WorldPoints.push_back(coord);
+      }
+
+    if(!valid)
+      {
+      std::cerr << fileName << " line " << lineNumber << " is not valid: " << line << std::endl;
+      return false;
+      }
+    }
+
+  *this = session;
+  return true;
+}
@@ -0,0 +1,66 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef SESSION_H
+#define SESSION_H
+
+// STL
+#include <string>
+#include <vector>
+
+// Custom
+#include "Camera.h"
+#include "Coord.h"
+
+// One camera image registered against the session's point cloud
+struct SessionFrame
+{
+  SessionFrame();
+
+  std::string ImageFileName;
+  std::string CameraId; // frames taken with the same camera share a calibration; empty if unknown
+  std::vector<Coord2D> ImagePoints; // pixel coordinates
+  std::vector<Coord3D> WorldPoints; // world coordinates
+
+  Camera Pose;
+  bool HasPose;
+};
+
+// Many frames registered against one point cloud. Only the file names, keypoints and poses are kept here;
+// the cloud is loaded once and the images are decoded when shown (see FrameImageCache).
+// Sessions are saved as text, one keyword per line:
+//   PointCloud <file name>
+//   Frame <file name>
+//   Camera <camera id>
+//   Pose <focal length> <principal point (2)> <rotation (3)> <translation (3)> [<distortion (4)>]
+//   ImagePoint <u> <v>
+//   WorldPoint <x> <y> <z>
+// Camera, Pose, ImagePoint and WorldPoint lines belong to the Frame line before them.
+class Session
+{
+public:
+  std::string PointCloudFileName;
+  std::vector<SessionFrame> Frames;
+
+  void Clear();
+
+  bool Write(const std::string& fileName) const;
+  bool Read(const std::string& fileName);
+};
+
+#endif
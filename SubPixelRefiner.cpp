@@ -0,0 +1,195 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "SubPixelRefiner.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+SubPixelRefiner::SubPixelRefiner()
+{
+  this->Width = 0;
+  this->Height = 0;
+  this->Radius = 5;
+  this->NumberOfTilesX = 0;
+  this->NumberOfTilesY = 0;
+}
+
+void SubPixelRefiner::SetImage(const FloatScalarImageType* image)
+{
+  this->Image = image;
+  this->Width = image->GetLargestPossibleRegion().GetSize()[0];
+  this->Height = image->GetLargestPossibleRegion().GetSize()[1];
+
+  // Forget the tensors of the previous image
+  this->NumberOfTilesX = (this->Width + TileSize - 1) / TileSize;
+  this->NumberOfTilesY = (this->Height + TileSize - 1) / TileSize;
+  this->Tiles.clear();
+  this->Tiles.resize(this->NumberOfTilesX * this->NumberOfTilesY);
+}
+
+void SubPixelRefiner::SetRadius(const unsigned int radius)
+{
+  this->Radius = radius;
+}
+
+const float* SubPixelRefiner::GetTensor(const unsigned int tileX, const unsigned int tileY)
+{
+  std::vector<float>& tile = this->Tiles[tileY * this->NumberOfTilesX + tileX];
+  if(!tile.empty())
+    {
+    return &tile[0];
+    }
+
+  tile.resize(3 * TileSize * TileSize);
+  const float* pixels = this->Image->GetBufferPointer();
+  for(unsigned int j = 0; j < TileSize; ++j)
+    {
+    unsigned int y = std::min(tileY * TileSize + j, this->Height - 1);
+    unsigned int up = y > 0 ? y - 1 : y;
+    unsigned int down = y + 1 < this->Height ? y + 1 : y;
+    for(unsigned int i = 0; i < TileSize; ++i)
+      {
+      unsigned int x = std::min(tileX * TileSize + i, this->Width - 1);
+      unsigned int left = x > 0 ? x - 1 : x;
+      unsigned int right = x + 1 < this->Width ? x + 1 : x;
+
+      // Central differences (one-sided at the border)
+      float gx = (pixels[y * this->Width + right] - pixels[y * this->Width + left]) / static_cast<float>(right - left);
+      float gy = (pixels[down * this->Width + x] - pixels[up * this->Width + x]) / static_cast<float>(down - up);
+
+      float* tensor = &tile[3 * (j * TileSize + i)];
+      tensor[0] = gx * gx;
+      tensor[1] = gx * gy;
+      tensor[2] = gy * gy;
+      }
+    }
+  return &tile[0];
+}
+
+void SubPixelRefiner::GetTensorAt(const int x, const int y, float tensor[3])
+{
+  const float* tile = this->GetTensor(x / TileSize, y / TileSize);
+  const float* value = tile + 3 * ((y % TileSize) * TileSize + (x % TileSize));
+  tensor[0] = value[0];
+  tensor[1] = value[1];
+  tensor[2] = value[2];
+}
+
+bool SubPixelRefiner::Estimate(const double center[2], const bool blob, double estimate[2], double& residual)
+{
+  const int radius = static_cast<int>(this->Radius);
+  const int centerX = static_cast<int>(floor(center[0] + 0.5));
+  const int centerY = static_cast<int>(floor(center[1] + 0.5));
+
+  // Normal equations of the weighted line intersection: N p = b
+  double N[3] = {0, 0, 0};
+  double b[2] = {0, 0};
+  double constant = 0; // sum of q^T T q, for the residual
+  double energy = 0;
+  for(int y = std::max(0, centerY - radius); y <= std::min(static_cast<int>(this->Height) - 1, centerY + radius); ++y)
+    {
+    for(int x = std::max(0, centerX - radius); x <= std::min(static_cast<int>(this->Width) - 1, centerX + radius); ++x)
+      {
+      if((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY) > radius * radius)
+        {
+        continue;
+        }
+
+      float tensor[3];
+      this->GetTensorAt(x, y, tensor);
+      if(blob)
+        {
+        // Lines along the gradient instead of across it
+        std::swap(tensor[0], tensor[2]);
+        tensor[1] = -tensor[1];
+        }
+
+      N[0] += tensor[0];
+      N[1] += tensor[1];
+      N[2] += tensor[2];
+      b[0] += tensor[0] * x + tensor[1] * y;
+      b[1] += tensor[1] * x + tensor[2] * y;
+      constant += tensor[0] * x * x + 2.0 * tensor[1] * x * y + tensor[2] * y * y;
+      energy += tensor[0] + tensor[2];
+      }
+    }
+
+  // The lines have to actually intersect: both eigenvalues of N must be significant
+  double trace = N[0] + N[2];
+  double determinant = N[0] * N[2] - N[1] * N[1];
+  if(energy <= 0 || determinant <= 0.05 * trace * trace / 4.0)
+    {
+    return false;
+    }
+
+  estimate[0] = (N[2] * b[0] - N[1] * b[1]) / determinant;
+  estimate[1] = (N[0] * b[1] - N[1] * b[0]) / determinant;
+
+  // sum (p - q)^T T (p - q) = p^T N p - 2 p^T b + sum q^T T q
+  double pNp = N[0] * estimate[0] * estimate[0] + 2.0 * N[1] * estimate[0] * estimate[1] + N[2] * estimate[1] * estimate[1];
+  residual = (pNp - 2.0 * (estimate[0] * b[0] + estimate[1] * b[1]) + constant) / energy;
+  return true;
+}
+
+bool SubPixelRefiner::Refine(const double click[2], double refined[2])
+{
+  refined[0] = click[0];
+  refined[1] = click[1];
+  if(!this->Image || click[0] < 0 || click[1] < 0 || click[0] > this->Width - 1 || click[1] > this->Height - 1)
+    {
+    return false;
+    }
+
+  bool found = false;
+  double bestResidual = 0;
+  for(unsigned int model = 0; model < 2; ++model)
+    {
+    // Re-center the window on the estimate a few times; the first window may only partly cover the feature
+    double estimate[2] = {click[0], click[1]};
+    double residual = 0;
+    bool valid = false;
+    for(unsigned int iteration = 0; iteration < 3; ++iteration)
+      {
+      double previous[2] = {estimate[0], estimate[1]};
+      valid = this->Estimate(previous, model == 1, estimate, residual);
+      double dx = estimate[0] - click[0];
+      double dy = estimate[1] - click[1];
+      if(!valid || dx * dx + dy * dy > this->Radius * this->Radius)
+        {
+        valid = false;
+        break;
+        }
+      if(fabs(estimate[0] - previous[0]) < 0.05 && fabs(estimate[1] - previous[1]) < 0.05)
+        {
+        break;
+        }
+      }
+
+    if(valid && (!found || residual < bestResidual))
+      {
+      found = true;
+      bestResidual = residual;
+      refined[0] = estimate[0];
+      refined[1] = estimate[1];
+      }
+    }
+
+  return found;
+}
@@ -0,0 +1,67 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef SUBPIXELREFINER_H
+#define SUBPIXELREFINER_H
+
+// STL
+#include <vector>
+
+// Custom
+#include "Types.h"
+
+// Snap a click to the nearest corner or blob center with sub-pixel accuracy (Forstner operator).
+// A corner is the point closest to all the edge lines (through each pixel, perpendicular to its gradient)
+// in a window; a blob center is the point closest to all the gradient lines. Both are a 2x2 solve
+// from sums of the gradient structure tensor, which is computed lazily per tile so that only the
+// parts of the image that are clicked on are ever processed.
+class SubPixelRefiner
+{
+public:
+  SubPixelRefiner();
+
+  void SetImage(const FloatScalarImageType* image);
+
+  // Window radius in pixels (default 5). Clicks are not moved further than this.
+  void SetRadius(const unsigned int radius);
+
+  // Returns false (and leaves 'refined' as the click) if there is no well defined feature near the click.
+  bool Refine(const double click[2], double refined[2]);
+
+private:
+  static const unsigned int TileSize = 64;
+
+  // Structure tensor (gx*gx, gx*gy, gy*gy) of every pixel of a tile, computed on first use
+  const float* GetTensor(const unsigned int tileX, const unsigned int tileY);
+  void GetTensorAt(const int x, const int y, float tensor[3]);
+
+  // One Forstner estimate in the window around 'center'. 'residual' is the mean squared distance
+  // of the estimate to the lines, used to choose between the corner and the blob model.
+  bool Estimate(const double center[2], const bool blob, double estimate[2], double& residual);
+
+  FloatScalarImageType::ConstPointer Image;
+  unsigned int Width;
+  unsigned int Height;
+  unsigned int Radius;
+
+  unsigned int NumberOfTilesX;
+  unsigned int NumberOfTilesY;
+  std::vector<std::vector<float> > Tiles;
+};
+
+#endif
@@ -0,0 +1,526 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "TiledPointCloud.h"
+
+// Qt
+#include <QDir>
+#include <QFileInfo>
+
+// VTK
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+// Custom
+#include "Helpers.h"
+#include "Parallel.h"
+#include "PointCloudReader.h"
+
+namespace
+{
+
+// Move the points of a tile from its own origin to the common one
+struct ShiftFunctor
+{
+  vtkPoints* Points;
+  double Offset[3];
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      double p[3];
+      this->Points->GetPoint(i, p);
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        p[d] += this->Offset[d];
+        }
+      this->Points->SetPoint(i, p);
+      }
+  }
+};
+
+// Copy the points of one tile, and their point data, into the assembled cloud from Offset on
+struct AssembleFunctor
+{
+  vtkPoints* Points;
+  const std::vector<vtkDataArray*>* Inputs;
+  float* Coordinates;
+  const std::vector<vtkSmartPointer<vtkDataArray> >* Outputs;
+  vtkIdType Offset;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      double p[3];
+      this->Points->GetPoint(i, p);
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        this->Coordinates[3 * (this->Offset + i) + d] = static_cast<float>(p[d]);
+        }
+      for(unsigned int a = 0; a < this->Inputs->size(); ++a)
+        {
+        (*this->Outputs)[a]->SetTuple(this->Offset + i, i, (*this->Inputs)[a]);
+        }
+      }
+  }
+};
+
+// The rest of the line, for file names with spaces
+std::string GetRemainder(std::istringstream& stream)
+{
+  std::string remainder;
+  std::getline(stream >> std::ws, remainder);
+  return remainder;
+}
+
+} // end anonymous namespace
+
+TiledPointCloud::TiledPointCloud() : MemoryBudget(size_t(1) << 30), Compact(false), Precision(0),
+                                     BytesPerPoint(16), AssembledBytesPerPoint(16)
+{
+  this->Origin[0] = this->Origin[1] = this->Origin[2] = 0;
+}
+
+bool TiledPointCloud::IsIndexFile(const std::string& fileName)
+{
+  return QFileInfo(QString::fromStdString(fileName)).suffix().toLower() == "tiles";
+}
+
+bool TiledPointCloud::WriteIndex(const std::vector<std::string>& tileFileNames, const std::string& indexFileName)
+{
+  std::ofstream fout(indexFileName.c_str());
+  if(!fout)
+    {
+    std::cerr << "Cannot write " << indexFileName << std::endl;
+    return false;
+    }
+  fout.precision(15); // World coordinates may be georeferenced
+
+  QDir indexDirectory = QFileInfo(QString::fromStdString(indexFileName)).absoluteDir();
+  for(unsigned int i = 0; i < tileFileNames.size(); ++i)
+    {
+    vtkSmartPointer<vtkPolyData> tile = vtkSmartPointer<vtkPolyData>::New();
+    double origin[3];
+    if(!PointCloudReader::Read(tileFileNames[i], tile, origin))
+      {
+      return false;
+      }
+    double bounds[6];
+    tile->GetPoints()->GetBounds(bounds);
+    fout << "Tile " << tile->GetNumberOfPoints();
+    for(unsigned int j = 0; j < 6; ++j)
+      {
+      fout << " " << bounds[j] + origin[j / 2];
+      }
+    fout << " " << indexDirectory.relativeFilePath(QString::fromStdString(tileFileNames[i])).toStdString() << std::endl;
+    }
+
+  std::cout << "Wrote the index of " << tileFileNames.size() << " tiles to " << indexFileName << std::endl;
+  return fout.good();
+}
+
+void TiledPointCloud::Clear()
+{
+  this->Tiles.clear();
+  this->Origin[0] = this->Origin[1] = this->Origin[2] = 0;
+}
+
+bool TiledPointCloud::ReadIndex(const std::string& fileName)
+{
+  std::ifstream fin(fileName.c_str());
+  if(!fin)
+    {
+    std::cerr << "Cannot open " << fileName << std::endl;
+    return false;
+    }
+
+  QDir indexDirectory = QFileInfo(QString::fromStdString(fileName)).absoluteDir();
+  std::vector<Tile> tiles;
+  double bounds[6] = {HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL};
+  std::string line;
+  unsigned int lineNumber = 0;
+  while(std::getline(fin, line))
+    {
+    lineNumber++;
+    std::istringstream ss(line);
+    std::string keyword;
+    if(!(ss >> keyword) || keyword[0] == '#')
+      {
+      continue;
+      }
+
+    Tile tile;
+    tile.Resident = false;
+    tile.Size = 0;
+    tile.Failed = false;
+    bool valid = keyword == "Tile" && ss >> tile.NumberOfPoints >> tile.Bounds[0] >> tile.Bounds[1]
+                                          >> tile.Bounds[2] >> tile.Bounds[3] >> tile.Bounds[4] >> tile.Bounds[5];
+    if(valid)
+      {
+      tile.FileName = GetRemainder(ss);
+      valid = !tile.FileName.empty();
+      }
+    if(!valid)
+      {
+      std::cerr << fileName << " line " << lineNumber << " is not valid: " << line << std::endl;
+      return false;
+      }
+    tile.FileName = indexDirectory.absoluteFilePath(QString::fromStdString(tile.FileName)).toStdString();
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      bounds[2 * d] = std::min(bounds[2 * d], tile.Bounds[2 * d]);
+      bounds[2 * d + 1] = std::max(bounds[2 * d + 1], tile.Bounds[2 * d + 1]);
+      }
+    tiles.push_back(tile);
+    }
+  if(tiles.empty())
+    {
+    std::cerr << fileName << " lists no tiles." << std::endl;
+    return false;
+    }
+
+  this->Tiles = tiles;
+  Helpers::ChooseLocalOrigin(bounds, this->Origin);
+  for(unsigned int i = 0; i < this->Tiles.size(); ++i)
+    {
+    for(unsigned int j = 0; j < 6; ++j)
+      {
+      this->Tiles[i].Bounds[j] -= this->Origin[j / 2];
+      }
+    }
+  return true;
+}
+
+void TiledPointCloud::SetMemoryBudget(const size_t bytes)
+{
+  this->MemoryBudget = bytes;
+}
+
+void TiledPointCloud::SetCompact(const bool compact, const double precision)
+{
+  this->Compact = compact;
+  this->Precision = precision;
+}
+
+unsigned int TiledPointCloud::GetNumberOfTiles() const
+{
+  return this->Tiles.size();
+}
+
+void TiledPointCloud::GetOrigin(double origin[3]) const
+{
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    origin[d] = this->Origin[d];
+    }
+}
+
+void TiledPointCloud::GetBounds(double bounds[6]) const
+{
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    bounds[2 * d] = HUGE_VAL;
+    bounds[2 * d + 1] = -HUGE_VAL;
+    }
+  for(unsigned int i = 0; i < this->Tiles.size(); ++i)
+    {
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      bounds[2 * d] = std::min(bounds[2 * d], this->Tiles[i].Bounds[2 * d]);
+      bounds[2 * d + 1] = std::max(bounds[2 * d + 1], this->Tiles[i].Bounds[2 * d + 1]);
+      }
+    }
+}
+
+size_t TiledPointCloud::EstimateSize(const Tile& tile) const
+{
+  return tile.Resident ? tile.Size : static_cast<size_t>(tile.NumberOfPoints * this->BytesPerPoint);
+}
+
+void TiledPointCloud::ChooseTiles(const double viewpoint[3], const PointCloudReduction::CropRegion& view,
+                                  const size_t reserved, std::vector<unsigned int>& tiles) const
+{
+  // Tiles in view, by their distance from the viewpoint
+  std::vector<std::pair<double, unsigned int> > candidates;
+  for(unsigned int i = 0; i < this->Tiles.size(); ++i)
+    {
+    const double* bounds = this->Tiles[i].Bounds;
+    double lower[3] = {bounds[0], bounds[2], bounds[4]};
+    double upper[3] = {bounds[1], bounds[3], bounds[5]};
+    if(view.Classify(lower, upper) < 0)
+      {
+      continue;
+      }
+    double squaredDistance = 0;
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      double outside = std::max(0.0, std::max(lower[d] - viewpoint[d], viewpoint[d] - upper[d]));
+      squaredDistance += outside * outside;
+      }
+    candidates.push_back(std::make_pair(squaredDistance, i));
+    }
+  std::sort(candidates.begin(), candidates.end());
+
+  // The assembled cloud is a second, full precision copy of the tiles. It takes the place of the reserved
+  // cloud, which is in memory next to the tiles until then.
+  tiles.clear();
+  size_t tilesSize = 0;
+  size_t assembledSize = 0;
+  for(unsigned int i = 0; i < candidates.size(); ++i)
+    {
+    const Tile& tile = this->Tiles[candidates[i].second];
+    tilesSize += EstimateSize(tile);
+    assembledSize += static_cast<size_t>(tile.NumberOfPoints * this->AssembledBytesPerPoint);
+    if(tilesSize + std::max(assembledSize, reserved) > this->MemoryBudget && !tiles.empty())
+      {
+      break;
+      }
+    tiles.push_back(candidates[i].second);
+    }
+}
+
+bool TiledPointCloud::IsResident(const std::vector<unsigned int>& tiles) const
+{
+  unsigned int numberOfResident = 0;
+  for(unsigned int i = 0; i < tiles.size(); ++i)
+    {
+    const Tile& tile = this->Tiles[tiles[i]];
+    if(!tile.Resident && !tile.Failed)
+      {
+      return false;
+      }
+    if(tile.Resident)
+      {
+      numberOfResident++;
+      }
+    }
+  return numberOfResident == GetNumberOfResidentTiles();
+}
+
+void TiledPointCloud::Page(const std::vector<unsigned int>& tiles)
+{
+  // Make room first
+  std::vector<bool> wanted(this->Tiles.size(), false);
+  for(unsigned int i = 0; i < tiles.size(); ++i)
+    {
+    wanted[tiles[i]] = true;
+    }
+  for(unsigned int i = 0; i < this->Tiles.size(); ++i)
+    {
+    if(!wanted[i])
+      {
+      this->Tiles[i].Resident = false;
+      this->Tiles[i].Data = NULL;
+      this->Tiles[i].CompactData.Clear();
+      }
+    }
+
+  for(unsigned int i = 0; i < tiles.size(); ++i)
+    {
+    Tile& tile = this->Tiles[tiles[i]];
+    if(tile.Resident || tile.Failed)
+      {
+      continue;
+      }
+
+    vtkSmartPointer<vtkPolyData> data = vtkSmartPointer<vtkPolyData>::New();
+    double origin[3];
+    if(!PointCloudReader::Read(tile.FileName, data, origin) || !data->GetPoints())
+      {
+      tile.Failed = true;
+      continue;
+      }
+
+    ShiftFunctor shift;
+    shift.Points = data->GetPoints();
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      shift.Offset[d] = origin[d] - this->Origin[d];
+      }
+    if(shift.Offset[0] != 0 || shift.Offset[1] != 0 || shift.Offset[2] != 0)
+      {
+      Parallel::For(0, data->GetNumberOfPoints(), shift);
+      }
+
+    tile.Resident = true;
+    tile.NumberOfPoints = data->GetNumberOfPoints();
+    size_t size = static_cast<size_t>(data->GetActualMemorySize()) * 1024;
+    bool compact = false;
+    if(this->Compact)
+      {
+      // Each run of points in one octree cell costs 20 bytes, so scattered points can take more compact
+      tile.CompactData.Encode(data, this->Precision);
+      compact = tile.CompactData.GetSize() < size;
+      if(!compact)
+        {
+        tile.CompactData.Clear();
+        }
+      }
+    if(compact)
+      {
+      tile.Size = tile.CompactData.GetSize();
+      }
+    else
+      {
+      tile.Data = data;
+      tile.Size = size;
+      }
+    if(tile.NumberOfPoints > 0)
+      {
+      this->BytesPerPoint = static_cast<double>(tile.Size) / tile.NumberOfPoints;
+      this->AssembledBytesPerPoint = static_cast<double>(size) / tile.NumberOfPoints;
+      }
+    }
+}
+
+void TiledPointCloud::Assemble(vtkPolyData* output) const
+{
+  // The point data arrays of each resident tile; compact tiles are only decoded as they are copied
+  std::vector<const Tile*> resident;
+  std::vector<vtkSmartPointer<vtkPointData> > layouts;
+  vtkIdType numberOfPoints = 0;
+  for(unsigned int i = 0; i < this->Tiles.size(); ++i)
+    {
+    const Tile& tile = this->Tiles[i];
+    if(!tile.Resident)
+      {
+      continue;
+      }
+    resident.push_back(&tile);
+    numberOfPoints += tile.NumberOfPoints;
+    vtkSmartPointer<vtkPointData> layout;
+    if(tile.Data)
+      {
+      layout = tile.Data->GetPointData();
+      }
+    else
+      {
+      layout = vtkSmartPointer<vtkPointData>::New();
+      tile.CompactData.GetPointDataLayout(layout);
+      }
+    layouts.push_back(layout);
+    }
+
+  // The arrays every resident tile has, of the same type
+  std::vector<vtkSmartPointer<vtkDataArray> > outputs;
+  if(!resident.empty())
+    {
+    vtkPointData* pointData = layouts[0];
+    for(int a = 0; a < pointData->GetNumberOfArrays(); ++a)
+      {
+      vtkDataArray* array = pointData->GetArray(a);
+      if(!array || !array->GetName())
+        {
+        continue;
+        }
+      bool shared = true;
+      for(unsigned int t = 1; t < resident.size() && shared; ++t)
+        {
+        vtkDataArray* other = layouts[t]->GetArray(array->GetName());
+        shared = other && other->GetDataType() == array->GetDataType() &&
+                 other->GetNumberOfComponents() == array->GetNumberOfComponents();
+        }
+      if(!shared)
+        {
+        continue;
+        }
+      vtkSmartPointer<vtkDataArray> assembled;
+      assembled.TakeReference(array->NewInstance());
+      assembled->SetName(array->GetName());
+      assembled->SetNumberOfComponents(array->GetNumberOfComponents());
+      assembled->SetNumberOfTuples(numberOfPoints);
+      outputs.push_back(assembled);
+      }
+    }
+
+  vtkSmartPointer<vtkFloatArray> coordinates = vtkSmartPointer<vtkFloatArray>::New();
+  coordinates->SetNumberOfComponents(3);
+  coordinates->SetNumberOfTuples(numberOfPoints);
+  vtkIdType offset = 0;
+  for(unsigned int t = 0; t < resident.size(); ++t)
+    {
+    vtkSmartPointer<vtkPolyData> data = resident[t]->Data;
+    if(!data)
+      {
+      data = vtkSmartPointer<vtkPolyData>::New();
+      resident[t]->CompactData.Decode(data);
+      }
+    std::vector<vtkDataArray*> inputs(outputs.size());
+    for(unsigned int a = 0; a < outputs.size(); ++a)
+      {
+      inputs[a] = data->GetPointData()->GetArray(outputs[a]->GetName());
+      }
+    AssembleFunctor assemble;
+    assemble.Points = data->GetPoints();
+    assemble.Inputs = &inputs;
+    assemble.Coordinates = numberOfPoints > 0 ? coordinates->GetPointer(0) : 0;
+    assemble.Outputs = &outputs;
+    assemble.Offset = offset;
+    Parallel::For(0, data->GetNumberOfPoints(), assemble);
+    offset += data->GetNumberOfPoints();
+    }
+
+  output->Initialize();
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetData(coordinates);
+  output->SetPoints(points);
+  Helpers::AddVertices(output);
+  for(unsigned int a = 0; a < outputs.size(); ++a)
+    {
+    output->GetPointData()->AddArray(outputs[a]);
+    }
+}
+
+unsigned int TiledPointCloud::GetNumberOfResidentTiles() const
+{
+  unsigned int numberOfResident = 0;
+  for(unsigned int i = 0; i < this->Tiles.size(); ++i)
+    {
+    if(this->Tiles[i].Resident)
+      {
+      numberOfResident++;
+      }
+    }
+  return numberOfResident;
+}
+
+size_t TiledPointCloud::GetResidentSize() const
+{
+  size_t size = 0;
+  for(unsigned int i = 0; i < this->Tiles.size(); ++i)
+    {
+    if(this->Tiles[i].Resident)
+      {
+      size += this->Tiles[i].Size;
+      }
+    }
+  return size;
+}
@@ -0,0 +1,122 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef TILEDPOINTCLOUD_H
+#define TILEDPOINTCLOUD_H
+
+// VTK
+#include <vtkSmartPointer.h>
+#include <vtkType.h>
+
+// STL
+#include <string>
+#include <vector>
+
+// Custom
+#include "PointCloudReduction.h"
+#include "QuantizedPointCloud.h"
+
+class vtkPolyData;
+
+// A scan split into many tile files, of which only the tiles in view and nearest the camera are kept in
+// memory. An index file (.tiles) lists each tile's number of points, bounds (world coordinates) and file
+// (relative to the index), one per line:
+//   Tile <points> <xmin> <xmax> <ymin> <ymax> <zmin> <zmax> <file>
+// so the tiles to show are chosen without reading them. All tiles are shifted to one local origin as they
+// are read, so they fit together and keypoints keep their world coordinates whichever tiles are resident.
+// Tiles are used as points; the faces of mesh tiles are dropped when they are assembled.
+// Tiles can be kept compact (see QuantizedPointCloud). Only the resident copies are compact: the cloud assembled
+// from them to be drawn is float and counts against the budget too, so with normals and intensity about 54
+// bytes per point fit it instead of 88, about 1.6 times as many points.
+// Page reads and drops tiles and is meant to run in a worker thread; nothing else may be called meanwhile.
+class TiledPointCloud
+{
+public:
+  // 1 GB budget
+  TiledPointCloud();
+
+  // Whether fileName is an index (ends in .tiles)
+  static bool IsIndexFile(const std::string& fileName);
+
+  // Read each tile once for its bounds and write an index of them. Returns false, after printing why,
+  // if a tile cannot be read or the index cannot be written.
+  static bool WriteIndex(const std::vector<std::string>& tileFileNames, const std::string& indexFileName);
+
+  // Drop the tiles and forget the index
+  void Clear();
+
+  // Returns false, after printing why, if the index cannot be read
+  bool ReadIndex(const std::string& fileName);
+
+  // The resident tiles and the cloud assembled from them together stay within this
+  void SetMemoryBudget(const size_t bytes);
+
+  // Keep the tiles read from now on compact, their coordinates off by at most 'precision'. Default off.
+  void SetCompact(const bool compact, const double precision);
+
+  unsigned int GetNumberOfTiles() const;
+  // World coordinates of the local origin the tiles are shifted to
+  void GetOrigin(double origin[3]) const;
+  // Of all the tiles, in local coordinates
+  void GetBounds(double bounds[6]) const;
+
+  // The tiles that overlap 'view', nearest to 'viewpoint' first, as many as fit the budget (but at least
+  // one). Both are in local coordinates. 'reserved' bytes of the cloud shown now stay in memory next to
+  // the tiles while they are paged, and are to be released before they are assembled.
+  void ChooseTiles(const double viewpoint[3], const PointCloudReduction::CropRegion& view, const size_t reserved,
+                   std::vector<unsigned int>& tiles) const;
+
+  // Whether exactly these tiles are resident (tiles that cannot be read count as resident)
+  bool IsResident(const std::vector<unsigned int>& tiles) const;
+
+  // Drop the resident tiles that are not in 'tiles', then read the ones that are not resident
+  void Page(const std::vector<unsigned int>& tiles);
+
+  // The resident tiles as one cloud, with the point data arrays all of them have
+  void Assemble(vtkPolyData* output) const;
+
+  unsigned int GetNumberOfResidentTiles() const;
+  // Bytes
+  size_t GetResidentSize() const;
+
+private:
+  struct Tile
+  {
+    std::string FileName;
+    vtkIdType NumberOfPoints;
+    double Bounds[6]; // local coordinates
+    bool Resident;
+    vtkSmartPointer<vtkPolyData> Data; // if resident and not compact
+    QuantizedPointCloud CompactData; // if resident and compact
+    size_t Size; // bytes, once read
+    bool Failed; // could not be read, so not retried
+  };
+
+  // The size of a tile, or an estimate from the tiles read so far if it has not been read
+  size_t EstimateSize(const Tile& tile) const;
+
+  std::vector<Tile> Tiles;
+  double Origin[3];
+  size_t MemoryBudget;
+  bool Compact;
+  double Precision;
+  double BytesPerPoint; // of resident tiles
+  double AssembledBytesPerPoint;
+};
+
+#endif
@@ -0,0 +1,533 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "TriangleBVH.h"
+
+// VTK
+#include <vtkCellArray.h>
+#include <vtkPolyData.h>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Custom
+#include "Parallel.h"
+
+namespace
+{
+
+const unsigned int MaximumTrianglesPerLeaf = 4;
+
+// Marks a node whose subtree is built by a separate task
+const unsigned int TaskPlaceholder = std::numeric_limits<unsigned int>::max();
+
+struct CornerFunctor
+{
+  vtkPolyData* Mesh;
+  const vtkIdType* CornerIds; // 3 per triangle
+  float* Corners;             // 9 per triangle
+  float* Centroids;           // 3 per triangle
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType triangle = begin; triangle < end; ++triangle)
+      {
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        this->Centroids[3 * triangle + d] = 0;
+        }
+      for(unsigned int corner = 0; corner < 3; ++corner)
+        {
+        double p[3];
+        this->Mesh->GetPoint(this->CornerIds[3 * triangle + corner], p);
+        for(unsigned int d = 0; d < 3; ++d)
+          {
+          this->Corners[9 * triangle + 3 * corner + d] = static_cast<float>(p[d]);
+          this->Centroids[3 * triangle + d] += static_cast<float>(p[d] / 3.0);
+          }
+        }
+      }
+  }
+};
+
+struct CentroidLess
+{
+  const float* Centroids;
+  unsigned int Axis;
+
+  bool operator()(const unsigned int a, const unsigned int b) const
+  {
+    return this->Centroids[3 * a + this->Axis] < this->Centroids[3 * b + this->Axis];
+  }
+};
+
+void UnionBounds(const float a[6], const float b[6], float result[6])
+{
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    result[2 * d] = std::min(a[2 * d], b[2 * d]);
+    result[2 * d + 1] = std::max(a[2 * d + 1], b[2 * d + 1]);
+    }
+}
+
+// Bounds of the nodes above the task subtrees, once those are in place
+void ComputeBounds(std::vector<TriangleBVH::Node>& nodes, const unsigned int nodeIndex)
+{
+  TriangleBVH::Node& node = nodes[nodeIndex];
+  if(node.Count > 0)
+    {
+    return;
+    }
+  ComputeBounds(nodes, node.Left);
+  ComputeBounds(nodes, node.Right);
+  UnionBounds(nodes[node.Left].Bounds, nodes[node.Right].Bounds, node.Bounds);
+}
+
+struct Task
+{
+  unsigned int Begin;
+  unsigned int End;
+  unsigned int Placeholder;
+  std::vector<TriangleBVH::Node> Nodes;
+};
+
+// Builds the subtree of order[begin, end) depth first into 'nodes' and returns the index of its root.
+// If 'tasks' is given, ranges smaller than 'taskSize' are not built but recorded as tasks.
+// Leaf bounds come from the triangles and interior bounds from the children.
+class Builder
+{
+public:
+  const float* Corners;
+  const float* Centroids;
+  unsigned int* Order;
+
+  unsigned int Build(const unsigned int begin, const unsigned int end, std::vector<TriangleBVH::Node>& nodes,
+                     std::vector<Task>* tasks, const unsigned int taskSize)
+  {
+    unsigned int nodeIndex = nodes.size();
+    nodes.push_back(TriangleBVH::Node());
+
+    if(tasks && end - begin <= taskSize && end - begin > MaximumTrianglesPerLeaf)
+      {
+      Task task;
+      task.Begin = begin;
+      task.End = end;
+      task.Placeholder = nodeIndex;
+      tasks->push_back(task);
+      nodes[nodeIndex].Count = TaskPlaceholder;
+      return nodeIndex;
+      }
+
+    float centroidBounds[6];
+    for(unsigned int d = 0; d < 3; ++d)
+      {
+      centroidBounds[2 * d] = std::numeric_limits<float>::max();
+      centroidBounds[2 * d + 1] = -std::numeric_limits<float>::max();
+      }
+    for(unsigned int i = begin; i < end; ++i)
+      {
+      const float* centroid = this->Centroids + 3 * this->Order[i];
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        centroidBounds[2 * d] = std::min(centroidBounds[2 * d], centroid[d]);
+        centroidBounds[2 * d + 1] = std::max(centroidBounds[2 * d + 1], centroid[d]);
+        }
+      }
+
+    unsigned int axis = 0;
+    for(unsigned int d = 1; d < 3; ++d)
+      {
+      if(centroidBounds[2 * d + 1] - centroidBounds[2 * d] > centroidBounds[2 * axis + 1] - centroidBounds[2 * axis])
+        {
+        axis = d;
+        }
+      }
+
+    if(end - begin <= MaximumTrianglesPerLeaf || centroidBounds[2 * axis + 1] <= centroidBounds[2 * axis])
+      {
+      TriangleBVH::Node& leaf = nodes[nodeIndex];
+      leaf.Left = begin;
+      leaf.Right = 0;
+      leaf.Count = end - begin;
+      for(unsigned int d = 0; d < 3; ++d)
+        {
+        leaf.Bounds[2 * d] = std::numeric_limits<float>::max();
+        leaf.Bounds[2 * d + 1] = -std::numeric_limits<float>::max();
+        }
+      for(unsigned int i = begin; i < end; ++i)
+        {
+        const float* corners = this->Corners + 9 * this->Order[i];
+        for(unsigned int corner = 0; corner < 3; ++corner)
+          {
+          for(unsigned int d = 0; d < 3; ++d)
+            {
+            leaf.Bounds[2 * d] = std::min(leaf.Bounds[2 * d], corners[3 * corner + d]);
+            leaf.Bounds[2 * d + 1] = std::max(leaf.Bounds[2 * d + 1], corners[3 * corner + d]);
+            }
+          }
+        }
+      return nodeIndex;
+      }
+
+    unsigned int middle = begin + (end - begin) / 2;
+    CentroidLess less;
+    less.Centroids = this->Centroids;
+    less.Axis = axis;
+    std::nth_element(this->Order + begin, this->Order + middle, this->Order + end, less);
+
+    // 'nodes' may be reallocated by the recursion, so don't hold references across it
+    unsigned int left = this->Build(begin, middle, nodes, tasks, taskSize);
+    unsigned int right = this->Build(middle, end, nodes, tasks, taskSize);
+    nodes[nodeIndex].Left = left;
+    nodes[nodeIndex].Right = right;
+    nodes[nodeIndex].Count = 0;
+    if(nodes[left].Count != TaskPlaceholder && nodes[right].Count != TaskPlaceholder)
+      {
+      UnionBounds(nodes[left].Bounds, nodes[right].Bounds, nodes[nodeIndex].Bounds);
+      }
+    return nodeIndex;
+  }
+};
+
+struct TaskFunctor
+{
+  Builder* TreeBuilder;
+  std::vector<Task>* Tasks;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      Task& task = (*this->Tasks)[i];
+      this->TreeBuilder->Build(task.Begin, task.End, task.Nodes, NULL, 0);
+      }
+  }
+};
+
+struct ReorderFunctor
+{
+  const unsigned int* Order;
+  const float* Corners;
+  const vtkIdType* CellIds;
+  float* OrderedCorners;
+  vtkIdType* OrderedCellIds;
+
+  void operator()(const vtkIdType begin, const vtkIdType end, const int)
+  {
+    for(vtkIdType i = begin; i < end; ++i)
+      {
+      std::copy(this->Corners + 9 * this->Order[i], this->Corners + 9 * this->Order[i] + 9, this->OrderedCorners + 9 * i);
+      this->OrderedCellIds[i] = this->CellIds[this->Order[i]];
+      }
+  }
+};
+
+// Slab test. Returns the entry distance, or false if the box is missed or further than 'maximumDistance'.
+bool IntersectBox(const float bounds[6], const double origin[3], const double inverseDirection[3],
+                  const double maximumDistance, double& entry)
+{
+  double tEnter = 0;
+  double tExit = maximumDistance;
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    double t0 = (bounds[2 * d] - origin[d]) * inverseDirection[d];
+    double t1 = (bounds[2 * d + 1] - origin[d]) * inverseDirection[d];
+    if(t0 > t1)
+      {
+      std::swap(t0, t1);
+      }
+    tEnter = std::max(tEnter, t0);
+    tExit = std::min(tExit, t1);
+    if(tEnter > tExit)
+      {
+      return false;
+      }
+    }
+  entry = tEnter;
+  return true;
+}
+
+// Moller-Trumbore. Returns the distance along the ray, or false if the triangle is missed.
+bool IntersectTriangle(const float* corners, const double origin[3], const double direction[3], double& t)
+{
+  double edge1[3];
+  double edge2[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    edge1[d] = corners[3 + d] - corners[d];
+    edge2[d] = corners[6 + d] - corners[d];
+    }
+  double p[3] = {direction[1] * edge2[2] - direction[2] * edge2[1],
+                 direction[2] * edge2[0] - direction[0] * edge2[2],
+                 direction[0] * edge2[1] - direction[1] * edge2[0]};
+  double determinant = edge1[0] * p[0] + edge1[1] * p[1] + edge1[2] * p[2];
+  if(fabs(determinant) < 1e-20)
+    {
+    return false;
+    }
+  double inverseDeterminant = 1.0 / determinant;
+
+  double s[3] = {origin[0] - corners[0], origin[1] - corners[1], origin[2] - corners[2]};
+  double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverseDeterminant;
+  if(u < 0 || u > 1)
+    {
+    return false;
+    }
+  double q[3] = {s[1] * edge1[2] - s[2] * edge1[1],
+                 s[2] * edge1[0] - s[0] * edge1[2],
+                 s[0] * edge1[1] - s[1] * edge1[0]};
+  double v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverseDeterminant;
+  if(v < 0 || u + v > 1)
+    {
+    return false;
+    }
+  t = (edge2[0] * q[0] + edge2[1] * q[1] + edge2[2] * q[2]) * inverseDeterminant;
+  return t > 0;
+}
+
+} // end anonymous namespace
+
+TriangleBVH::TriangleBVH()
+{
+}
+
+void TriangleBVH::Initialize()
+{
+  this->Nodes.clear();
+  this->Triangles.clear();
+  this->CellIds.clear();
+}
+
+vtkIdType TriangleBVH::GetNumberOfTriangles() const
+{
+  return static_cast<vtkIdType>(this->CellIds.size());
+}
+
+const std::vector<TriangleBVH::Node>& TriangleBVH::GetNodes() const
+{
+  return this->Nodes;
+}
+
+const std::vector<float>& TriangleBVH::GetTriangles() const
+{
+  return this->Triangles;
+}
+
+const std::vector<vtkIdType>& TriangleBVH::GetCellIds() const
+{
+  return this->CellIds;
+}
+
+void TriangleBVH::Restore(const Node* nodes, const unsigned int numberOfNodes, const float* triangles,
+                          const vtkIdType* cellIds, const vtkIdType numberOfTriangles)
+{
+  this->Nodes.assign(nodes, nodes + numberOfNodes);
+  this->Triangles.assign(triangles, triangles + 9 * numberOfTriangles);
+  this->CellIds.assign(cellIds, cellIds + numberOfTriangles);
+}
+
+void TriangleBVH::Build(vtkPolyData* mesh)
+{
+  this->Initialize();
+
+  // Triangulate. Cell ids of a vtkPolyData count verts, then lines, then polys, then strips.
+  std::vector<vtkIdType> cornerIds;
+  std::vector<vtkIdType> cellIds;
+  vtkIdType cellId = mesh->GetNumberOfVerts() + mesh->GetNumberOfLines();
+  vtkIdType numberOfCellPoints;
+  vtkIdType* cellPoints;
+  vtkCellArray* polys = mesh->GetPolys();
+  for(polys->InitTraversal(); polys->GetNextCell(numberOfCellPoints, cellPoints); ++cellId)
+    {
+    for(vtkIdType i = 2; i < numberOfCellPoints; ++i)
+      {
+      cornerIds.push_back(cellPoints[0]);
+      cornerIds.push_back(cellPoints[i - 1]);
+      cornerIds.push_back(cellPoints[i]);
+      cellIds.push_back(cellId);
+      }
+    }
+  vtkCellArray* strips = mesh->GetStrips();
+  for(strips->InitTraversal(); strips->GetNextCell(numberOfCellPoints, cellPoints); ++cellId)
+    {
+    for(vtkIdType i = 2; i < numberOfCellPoints; ++i)
+      {
+      cornerIds.push_back(cellPoints[i - 2]);
+      cornerIds.push_back(cellPoints[i - 1]);
+      cornerIds.push_back(cellPoints[i]);
+      cellIds.push_back(cellId);
+      }
+    }
+
+  const unsigned int numberOfTriangles = cellIds.size();
+  if(numberOfTriangles == 0)
+    {
+    return;
+    }
+
+  std::vector<float> corners(9 * numberOfTriangles);
+  std::vector<float> centroids(3 * numberOfTriangles);
+  CornerFunctor cornerFunctor;
+  cornerFunctor.Mesh = mesh;
+  cornerFunctor.CornerIds = &cornerIds[0];
+  cornerFunctor.Corners = &corners[0];
+  cornerFunctor.Centroids = &centroids[0];
+  Parallel::For(0, numberOfTriangles, cornerFunctor);
+
+  std::vector<unsigned int> order(numberOfTriangles);
+  for(unsigned int i = 0; i < numberOfTriangles; ++i)
+    {
+    order[i] = i;
+    }
+
+  // The top of the tree is built here until the ranges are small enough that there are a few per thread
+  Builder builder;
+  builder.Corners = &corners[0];
+  builder.Centroids = &centroids[0];
+  builder.Order = &order[0];
+  std::vector<Task> tasks;
+  unsigned int taskSize = std::max(1024u, numberOfTriangles / (4 * Parallel::GetNumberOfThreads()));
+  builder.Build(0, numberOfTriangles, this->Nodes, &tasks, taskSize);
+
+  TaskFunctor taskFunctor;
+  taskFunctor.TreeBuilder = &builder;
+  taskFunctor.Tasks = &tasks;
+  Parallel::For(0, tasks.size(), taskFunctor);
+
+  // Splice the subtrees in, replacing each placeholder with the subtree root
+  for(unsigned int i = 0; i < tasks.size(); ++i)
+    {
+    unsigned int offset = this->Nodes.size();
+    for(unsigned int node = 0; node < tasks[i].Nodes.size(); ++node)
+      {
+      Node copy = tasks[i].Nodes[node];
+      if(copy.Count == 0)
+        {
+        copy.Left += offset;
+        copy.Right += offset;
+        }
+      this->Nodes.push_back(copy);
+      }
+    this->Nodes[tasks[i].Placeholder] = this->Nodes[offset];
+    }
+  ComputeBounds(this->Nodes, 0);
+
+  this->Triangles.resize(9 * numberOfTriangles);
+  this->CellIds.resize(numberOfTriangles);
+  ReorderFunctor reorderFunctor;
+  reorderFunctor.Order = &order[0];
+  reorderFunctor.Corners = &corners[0];
+  reorderFunctor.CellIds = &cellIds[0];
+  reorderFunctor.OrderedCorners = &this->Triangles[0];
+  reorderFunctor.OrderedCellIds = &this->CellIds[0];
+  Parallel::For(0, numberOfTriangles, reorderFunctor);
+}
+
+bool TriangleBVH::IntersectRay(const double origin[3], const double direction[3], double point[3], vtkIdType& cellId) const
+{
+  if(this->Nodes.empty())
+    {
+    return false;
+    }
+
+  double inverseDirection[3];
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    inverseDirection[d] = direction[d] != 0 ? 1.0 / direction[d] : std::numeric_limits<double>::max();
+    }
+
+  double nearest = std::numeric_limits<double>::max();
+  vtkIdType nearestTriangle = -1;
+
+  double entry;
+  if(!IntersectBox(this->Nodes[0].Bounds, origin, inverseDirection, nearest, entry))
+    {
+    return false;
+    }
+
+  // Depth first, nearer child first, skipping boxes beyond the nearest hit so far
+  std::vector<unsigned int> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+  while(!stack.empty())
+    {
+    const Node& node = this->Nodes[stack.back()];
+    stack.pop_back();
+    if(!IntersectBox(node.Bounds, origin, inverseDirection, nearest, entry))
+      {
+      continue;
+      }
+
+    if(node.Count > 0)
+      {
+      for(unsigned int triangle = node.Left; triangle < node.Left + node.Count; ++triangle)
+        {
+        double t;
+        if(IntersectTriangle(&this->Triangles[9 * triangle], origin, direction, t) && t < nearest)
+          {
+          nearest = t;
+          nearestTriangle = triangle;
+          }
+        }
+      continue;
+      }
+
+    double leftEntry = std::numeric_limits<double>::max();
+    double rightEntry = std::numeric_limits<double>::max();
+    bool hitLeft = IntersectBox(this->Nodes[node.Left].Bounds, origin, inverseDirection, nearest, leftEntry);
+    bool hitRight = IntersectBox(this->Nodes[node.Right].Bounds, origin, inverseDirection, nearest, rightEntry);
+    unsigned int left = node.Left;
+    unsigned int right = node.Right;
+    if(hitLeft && hitRight)
+      {
+      // Push the far one first so the near one is visited first
+      if(leftEntry < rightEntry)
+        {
+        stack.push_back(right);
+        stack.push_back(left);
+        }
+      else
+        {
+        stack.push_back(left);
+        stack.push_back(right);
+        }
+      }
+    else if(hitLeft)
+      {
+      stack.push_back(left);
+      }
+    else if(hitRight)
+      {
+      stack.push_back(right);
+      }
+    }
+
+  if(nearestTriangle < 0)
+    {
+    return false;
+    }
+
+  for(unsigned int d = 0; d < 3; ++d)
+    {
+    point[d] = origin[d] + nearest * direction[d];
+    }
+  cellId = this->CellIds[nearestTriangle];
+  return true;
+}
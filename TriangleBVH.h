@@ -0,0 +1,74 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2011 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef TRIANGLEBVH_H
+#define TRIANGLEBVH_H
+
+// VTK
+#include <vtkType.h>
+
+// STL
+#include <vector>
+
+class vtkPolyData;
+
+// Bounding volume hierarchy over the triangles of a mesh, for exact ray picking on the surface.
+// Polygons are triangulated as fans and triangle strips are split. Nodes are split at the median
+// of the longest axis of their triangle centroids; once there are enough subtrees for all threads
+// they are built concurrently. The triangle corners are copied in leaf order, so the mesh
+// may change after Build without affecting the hierarchy.
+class TriangleBVH
+{
+public:
+  TriangleBVH();
+
+  // Forget the triangles
+  void Initialize();
+
+  void Build(vtkPolyData* mesh);
+
+  vtkIdType GetNumberOfTriangles() const;
+
+  // Nearest intersection of origin + t * direction (t > 0) with the surface.
+  // Returns false if the ray misses. cellId is the polygon (or strip) of the mesh that was hit.
+  bool IntersectRay(const double origin[3], const double direction[3], double point[3], vtkIdType& cellId) const;
+
+  struct Node
+  {
+    float Bounds[6];
+    unsigned int Left;  // Interior: children. Leaf: first triangle (Left) and number of triangles (Count).
+    unsigned int Right;
+    unsigned int Count; // 0 for interior nodes
+  };
+
+  // The hierarchy as built, so it can be saved (see DerivedDataCache)
+  const std::vector<Node>& GetNodes() const;
+  const std::vector<float>& GetTriangles() const;
+  const std::vector<vtkIdType>& GetCellIds() const;
+
+  // Use a hierarchy that was built earlier instead of calling Build. The arrays are copied.
+  void Restore(const Node* nodes, const unsigned int numberOfNodes, const float* triangles,
+               const vtkIdType* cellIds, const vtkIdType numberOfTriangles);
+
+private:
+  std::vector<Node> Nodes; // Nodes[0] is the root
+  std::vector<float> Triangles; // 9 floats per triangle, in leaf order
+  std::vector<vtkIdType> CellIds;
+};
+
+#endif